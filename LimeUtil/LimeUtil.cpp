@@ -29,6 +29,11 @@ int deviceCalSweep(
     const double bw,
     const std::string &dir,
     const std::string &chans);
+int deviceStreamTelemetry(const std::string &argStr, const double rate, const double duration);
+int deviceRecord(const std::string &argStr, const std::string &path, const double rate,
+    const double freq, const double duration, const bool packed, const std::string &chans);
+int devicePlay(const std::string &argStr, const std::string &path, const std::string &format, const double rate,
+    const double freq, const double duration, const double delay, const bool loop, const bool pace, const std::string &chans);
 
 /***********************************************************************
  * print help
@@ -50,6 +55,22 @@ static int printHelp(void)
     std::cout << "    --fw=\"filename\"   \t\t\t Program FX3  firmware to flash" << std::endl;
     std::cout << "    --timing          \t\t\t Time interfaces and operations" << std::endl;
     std::cout << "    --FX3reset[=\"module=foo,serial=bar\"] \t\t\t FX3 USB controller reset" << std::endl;
+    std::cout << "    --telemetry[=seconds, default=5] \t Stream and print timing histograms" << std::endl;
+    std::cout << "    --rate[=sampleRate, default=10MHz] \t Sample rate for stream options(Hz)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "  Recording:" << std::endl;
+    std::cout << "    --record=\"path\"                  \t Record Rx samples to path.sigmf-data/.sigmf-meta" << std::endl;
+    std::cout << "    --duration[=seconds, default=0]    \t Recording or playback length, 0 for no limit" << std::endl;
+    std::cout << "    --freq[=frequency]                 \t Rx center frequency(Hz)" << std::endl;
+    std::cout << "    --packed                           \t Use 12 bit link and store packed samples" << std::endl;
+    std::cout << "    --chans[=channels, default=ALL]    \t Recorded channels, 0, 1, ALL" << std::endl;
+    std::cout << std::endl;
+    std::cout << "  Playback:" << std::endl;
+    std::cout << "    --play=\"filename\"                \t Transmit samples of file, --freq, --chans, --duration apply" << std::endl;
+    std::cout << "    --format[=cs16|cf32|packed]        \t File format, default from name or SigMF metadata" << std::endl;
+    std::cout << "    --loop                             \t Repeat file until Ctrl+C or --duration" << std::endl;
+    std::cout << "    --delay[=seconds]                  \t Timestamped start, seconds after stream start" << std::endl;
+    std::cout << "    --pace                             \t Limit feeding to --rate in software" << std::endl;
     std::cout << std::endl;
     std::cout << "  Calibrations sweep:" << std::endl;
     std::cout << "    --cal[=\"module=foo,serial=bar\"]  \t Calibrate device, optional device args..." << std::endl;
@@ -337,12 +358,23 @@ int main(int argc, char *argv[])
         {"bw",      required_argument, 0, 'b'},
         {"dir",     required_argument, 0, 'd'},
         {"chans",   required_argument, 0, 'c'},
+        {"telemetry", optional_argument, 0, 'T'},
+        {"rate",    required_argument, 0, 'R'},
+        {"record",  required_argument, 0, 'o'},
+        {"duration", required_argument, 0, 'D'},
+        {"freq",    required_argument, 0, 'q'},
+        {"packed",     no_argument, 0, 'P'},
+        {"play",    required_argument, 0, 'y'},
+        {"format",  required_argument, 0, 'M'},
+        {"loop",       no_argument, 0, 'L'},
+        {"delay",   required_argument, 0, 'Y'},
+        {"pace",       no_argument, 0, 'A'},
         {0, 0, 0,  0}
     };
 
-    std::string argStr, dir("BOTH"), chans("ALL");
-    double start(0.0), stop(0.0), step(1e6), bw(30e6);
-    bool testTiming(false), calSweep(false), update(false), force(false);
+    std::string argStr, dir("BOTH"), chans("ALL"), recordPath, playPath, format;
+    double start(0.0), stop(0.0), step(1e6), bw(30e6), rate(10e6), duration(5.0), recordDuration(0.0), freq(0.0), delay(0.0);
+    bool testTiming(false), calSweep(false), update(false), force(false), telemetry(false), packed(false), loop(false), pace(false);
     int long_index = 0;
     int option = 0;
     while ((option = getopt_long_only(argc, argv, "", long_options, &long_index)) != -1)
@@ -372,12 +404,29 @@ int main(int argc, char *argv[])
         case 'd': if (optarg != NULL) dir = optarg; break;
         case 'c': if (optarg != NULL) chans = optarg; break;
         case 'F': force = true; break;
+        case 'T':
+            telemetry = true;
+            if (optarg != NULL) duration = std::stod(optarg);
+            break;
+        case 'R': if (optarg != NULL) rate = std::stod(optarg); break;
+        case 'o': if (optarg != NULL) recordPath = optarg; break;
+        case 'D': if (optarg != NULL) recordDuration = std::stod(optarg); break;
+        case 'q': if (optarg != NULL) freq = std::stod(optarg); break;
+        case 'P': packed = true; break;
+        case 'y': if (optarg != NULL) playPath = optarg; break;
+        case 'M': if (optarg != NULL) format = optarg; break;
+        case 'L': loop = true; break;
+        case 'Y': if (optarg != NULL) delay = std::stod(optarg); break;
+        case 'A': pace = true; break;
         }
     }
 
     if (testTiming) return deviceTestTiming(argStr);
     if (calSweep) return deviceCalSweep(argStr, start, stop, step, bw, dir, chans);
     if (update) return programUpdate(force, argStr);
+    if (telemetry) return deviceStreamTelemetry(argStr, rate, duration);
+    if (!recordPath.empty()) return deviceRecord(argStr, recordPath, rate, freq, recordDuration, packed, chans);
+    if (!playPath.empty()) return devicePlay(argStr, playPath, format, rate, freq, recordDuration, delay, loop, pace, chans);
 
     //unknown or unspecified options, do help...
     return printHelp();
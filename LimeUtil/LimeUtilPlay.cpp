@@ -0,0 +1,196 @@
+/**
+    @file LimeUtilPlay.cpp
+    @author Lime Microsystems
+    @brief Playback of sample files through Tx stream
+*/
+
+#include "lime/LimeSuite.h"
+#include <ConnectionRegistry.h>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+static std::atomic<bool> stopRequested(false);
+
+static void onInterrupt(int)
+{
+    stopRequested.store(true);
+}
+
+static bool endsWith(const std::string &str, const std::string &suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//format from name, packed SigMF recordings are recognized by their metadata
+static int playbackFormat(const std::string &path, const std::string &format)
+{
+    if (format == "cs16")
+        return lms_player_config_t::LMS_PLAY_FMT_CS16;
+    if (format == "cf32")
+        return lms_player_config_t::LMS_PLAY_FMT_CF32;
+    if (format == "packed")
+        return lms_player_config_t::LMS_PLAY_FMT_PACKED12;
+    if (!format.empty())
+        return -1;
+    if (endsWith(path, ".cf32") || endsWith(path, ".fc32"))
+        return lms_player_config_t::LMS_PLAY_FMT_CF32;
+    if (endsWith(path, ".sigmf-data"))
+    {
+        std::ifstream meta(path.substr(0, path.size() - 4) + "meta");
+        const std::string text((std::istreambuf_iterator<char>(meta)), std::istreambuf_iterator<char>());
+        if (text.find("\"limesuite:sample_packing\": \"int12\"") != std::string::npos)
+            return lms_player_config_t::LMS_PLAY_FMT_PACKED12;
+        if (text.find("\"core:datatype\": \"cf32_le\"") != std::string::npos)
+            return lms_player_config_t::LMS_PLAY_FMT_CF32;
+    }
+    return lms_player_config_t::LMS_PLAY_FMT_CS16;
+}
+
+int devicePlay(const std::string &argStr, const std::string &path, const std::string &format, const double rate,
+    const double freq, const double duration, const double delay, const bool loop, const bool pace, const std::string &chans)
+{
+    const int fileFormat = playbackFormat(path, format);
+    if (fileFormat < 0)
+    {
+        std::cerr << "Unknown file format " << format << ", use cs16, cf32 or packed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    lms_device_t *device(nullptr);
+    lime::ConnectionHandle hint(argStr);
+    auto handles = lime::ConnectionRegistry::findConnections(hint);
+    if(handles.size() == 0)
+    {
+        std::cerr << "No available device!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Connected to [" << handles[0].ToString() << "]" << std::endl;
+    if (LMS_Open(&device, handles[0].serialize().c_str(), nullptr) != 0)
+    {
+        std::cerr << "Failed to open" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<int> channels;
+    const int chCount = LMS_GetNumChannels(device, LMS_CH_TX);
+    if (chans == "ALL")
+        for (int ch = 0; ch < chCount; ++ch)
+            channels.push_back(ch);
+    else
+        channels.push_back(std::stoi(chans));
+
+    bool configured = LMS_Init(device) == 0 && LMS_SetSampleRate(device, rate, 0) == 0;
+    for (const int ch : channels)
+    {
+        configured = configured && LMS_EnableChannel(device, LMS_CH_TX, ch, true) == 0;
+        if (freq > 0)
+            configured = configured && LMS_SetLOFrequency(device, LMS_CH_TX, ch, freq) == 0;
+    }
+    if (!configured)
+    {
+        std::cerr << "Failed to configure device: " << LMS_GetLastErrorMessage() << std::endl;
+        LMS_Close(device);
+        return EXIT_FAILURE;
+    }
+
+    //link format matching the file lets samples be copied into packets unchanged
+    std::vector<lms_stream_t> streams(channels.size());
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        lms_stream_t &stream = streams[i];
+        stream = lms_stream_t();
+        stream.channel = channels[i];
+        stream.fifoSize = 1024*1024;
+        stream.throughputVsLatency = 1.0;
+        stream.isTx = true;
+        stream.dataFmt = lms_stream_t::LMS_FMT_I16;
+        stream.linkFmt = fileFormat == lms_player_config_t::LMS_PLAY_FMT_PACKED12 ? lms_stream_t::LMS_LINK_FMT_I12 : lms_stream_t::LMS_LINK_FMT_I16;
+        if (LMS_SetupStream(device, &stream) != 0)
+        {
+            std::cerr << "Failed to setup stream: " << LMS_GetLastErrorMessage() << std::endl;
+            LMS_Close(device);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<lms_player_t*> players(channels.size(), nullptr);
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        lms_player_config_t config = {};
+        config.path = path.c_str();
+        config.format = decltype(config.format)(fileFormat);
+        config.loop = loop;
+        config.useTimestamp = delay > 0;
+        config.startTimestamp = delay > 0 ? uint64_t(delay*rate) : 0;
+        config.sampleRate = pace ? rate : 0;
+        if (LMS_StartPlayback(&streams[i], &config, &players[i]) != 0)
+        {
+            std::cerr << "Failed to start playback: " << LMS_GetLastErrorMessage() << std::endl;
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+
+    if (status == EXIT_SUCCESS)
+    {
+        for (size_t i = 0; i < channels.size(); ++i)
+            LMS_StartStream(&streams[i]);
+        std::cout << "Playing " << path << " at " << rate/1e6 << " MS/s" << (loop ? " in loop" : "");
+        std::cout << (duration > 0 || !loop ? "" : ", press Ctrl+C to stop") << std::endl;
+        signal(SIGINT, onInterrupt);
+        const auto t0 = std::chrono::steady_clock::now();
+        bool active = true;
+        while (active && !stopRequested.load())
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            active = false;
+            for (size_t i = 0; i < players.size(); ++i)
+            {
+                lms_player_status_t ps;
+                lms_stream_status_t ss;
+                LMS_GetPlaybackStatus(players[i], &ps);
+                LMS_GetStreamStatus(&streams[i], &ss);
+                active = active || ps.active;
+                printf("  ch%i: %12llu samples, %u loops, %8.3f MS/s, link %8.2f MB/s, underrun %u\n",
+                    channels[i], (unsigned long long)ps.samples, ps.loops, ps.sampleRate/1e6, ss.linkRate/1e6, ss.underrun);
+            }
+            if (duration > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() >= duration)
+                break;
+        }
+        signal(SIGINT, SIG_DFL);
+    }
+
+    std::vector<lms_player_status_t> results(players.size());
+    for (size_t i = 0; i < players.size(); ++i)
+    {
+        if (players[i] == nullptr)
+            continue;
+        if (LMS_StopPlayback(players[i], &results[i]) != 0)
+            status = EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        LMS_StopStream(&streams[i]);
+        LMS_DestroyStream(device, &streams[i]);
+    }
+    LMS_Close(device);
+
+    for (size_t i = 0; i < players.size(); ++i)
+    {
+        if (players[i] == nullptr)
+            continue;
+        const lms_player_status_t &ps = results[i];
+        std::cout << "ch" << channels[i] << ": " << ps.samples << " samples (" << ps.loops << " loops of "
+            << ps.fileSamples << "), " << ps.sampleRate/1e6 << " MS/s" << std::endl;
+    }
+    return status;
+}
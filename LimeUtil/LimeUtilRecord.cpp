@@ -0,0 +1,174 @@
+/**
+    @file LimeUtilRecord.cpp
+    @author Lime Microsystems
+    @brief Recording of received samples to SigMF files
+*/
+
+#include "lime/LimeSuite.h"
+#include <ConnectionRegistry.h>
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+static std::atomic<bool> stopRequested(false);
+
+static void onInterrupt(int)
+{
+    stopRequested.store(true);
+}
+
+static std::string recordingPath(std::string path, const int channel, const bool multipleChannels)
+{
+    for (const std::string ext : {".sigmf-data", ".sigmf-meta", ".sigmf"})
+        if (path.size() > ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0)
+            path.resize(path.size() - ext.size());
+    if (multipleChannels)
+        path += "_ch" + std::to_string(channel);
+    return path;
+}
+
+int deviceRecord(const std::string &argStr, const std::string &path, const double rate,
+    const double freq, const double duration, const bool packed, const std::string &chans)
+{
+    lms_device_t *device(nullptr);
+    lime::ConnectionHandle hint(argStr);
+    auto handles = lime::ConnectionRegistry::findConnections(hint);
+    if(handles.size() == 0)
+    {
+        std::cerr << "No available device!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Connected to [" << handles[0].ToString() << "]" << std::endl;
+    if (LMS_Open(&device, handles[0].serialize().c_str(), nullptr) != 0)
+    {
+        std::cerr << "Failed to open" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<int> channels;
+    const int chCount = LMS_GetNumChannels(device, LMS_CH_RX);
+    if (chans == "ALL")
+        for (int ch = 0; ch < chCount; ++ch)
+            channels.push_back(ch);
+    else
+        channels.push_back(std::stoi(chans));
+
+    bool configured = LMS_Init(device) == 0 && LMS_SetSampleRate(device, rate, 0) == 0;
+    for (const int ch : channels)
+    {
+        configured = configured && LMS_EnableChannel(device, LMS_CH_RX, ch, true) == 0;
+        if (freq > 0)
+            configured = configured && LMS_SetLOFrequency(device, LMS_CH_RX, ch, freq) == 0;
+    }
+    if (!configured)
+    {
+        std::cerr << "Failed to configure device: " << LMS_GetLastErrorMessage() << std::endl;
+        LMS_Close(device);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<lms_stream_t> streams(channels.size());
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        lms_stream_t &stream = streams[i];
+        stream = lms_stream_t();
+        stream.channel = channels[i];
+        //large FIFO rides out short disk stalls
+        stream.fifoSize = 4*1024*1024;
+        stream.throughputVsLatency = 1.0;
+        stream.isTx = false;
+        stream.dataFmt = lms_stream_t::LMS_FMT_I16;
+        stream.linkFmt = packed ? lms_stream_t::LMS_LINK_FMT_I12 : lms_stream_t::LMS_LINK_FMT_I16;
+        if (LMS_SetupStream(device, &stream) != 0)
+        {
+            std::cerr << "Failed to setup stream: " << LMS_GetLastErrorMessage() << std::endl;
+            LMS_Close(device);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const lms_dev_info_t* info = LMS_GetDeviceInfo(device);
+    std::vector<lms_recorder_t*> recorders(channels.size(), nullptr);
+    std::vector<std::string> paths;
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        paths.push_back(recordingPath(path, channels[i], channels.size() > 1));
+        const std::string description = "Rx channel " + std::to_string(channels[i]);
+        lms_recorder_config_t config = {};
+        config.path = paths[i].c_str();
+        config.packed = packed;
+        config.maxSamples = duration > 0 ? uint64_t(duration*rate) : 0;
+        config.sampleRate = rate;
+        config.frequency = freq;
+        config.hardware = info ? info->deviceName : nullptr;
+        config.description = description.c_str();
+        if (LMS_StartRecording(&streams[i], &config, &recorders[i]) != 0)
+        {
+            std::cerr << "Failed to start recording: " << LMS_GetLastErrorMessage() << std::endl;
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+
+    if (status == EXIT_SUCCESS)
+    {
+        for (size_t i = 0; i < channels.size(); ++i)
+            LMS_StartStream(&streams[i]);
+        std::cout << "Recording " << rate/1e6 << " MS/s to " << paths[0] << ".sigmf-data";
+        if (paths.size() > 1)
+            std::cout << " and " << paths.size() - 1 << " more";
+        std::cout << (duration > 0 ? "" : ", press Ctrl+C to stop") << std::endl;
+        signal(SIGINT, onInterrupt);
+        bool active = true;
+        while (active && !stopRequested.load())
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            active = false;
+            for (size_t i = 0; i < recorders.size(); ++i)
+            {
+                lms_recorder_status_t rs;
+                LMS_GetRecordingStatus(recorders[i], &rs);
+                active = active || rs.active;
+                printf("  ch%i: %10.1f MB %8.2f MB/s, disk %8.2f MB/s, buffers %u/%u, dropped %llu\n",
+                    channels[i], rs.bytesWritten/1e6, rs.writeRate/1e6, rs.diskRate/1e6,
+                    rs.buffersHighWater, rs.bufferCount, (unsigned long long)rs.droppedSamples);
+            }
+        }
+        signal(SIGINT, SIG_DFL);
+    }
+
+    std::vector<lms_recorder_status_t> results(recorders.size());
+    for (size_t i = 0; i < recorders.size(); ++i)
+    {
+        if (recorders[i] == nullptr)
+            continue;
+        if (LMS_StopRecording(recorders[i], &results[i]) != 0)
+            status = EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        LMS_StopStream(&streams[i]);
+        LMS_DestroyStream(device, &streams[i]);
+    }
+    LMS_Close(device);
+
+    for (size_t i = 0; i < recorders.size(); ++i)
+    {
+        if (recorders[i] == nullptr)
+            continue;
+        const lms_recorder_status_t &rs = results[i];
+        std::cout << paths[i] << ".sigmf-data: " << rs.samples << " samples, " << rs.bytesWritten/1e6 << " MB"
+            << (rs.directIO ? " (O_DIRECT)" : "") << std::endl;
+        std::cout << "  sustained " << rs.writeRate/1e6 << " MB/s, disk " << rs.diskRate/1e6 << " MB/s, "
+            << "buffers high water " << rs.buffersHighWater << "/" << rs.bufferCount << std::endl;
+        std::cout << "  dropped " << rs.droppedSamples << " samples in " << rs.gaps << " gap(s)" << std::endl;
+    }
+    return status;
+}
@@ -0,0 +1,134 @@
+/**
+    @file LimeUtilStream.cpp
+    @author Lime Microsystems
+    @brief Stream test with timing telemetry report
+*/
+
+#include "lime/LimeSuite.h"
+#include <ConnectionRegistry.h>
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+//upper bound of bucket holding given fraction of values
+static double histogramPercentile(const lms_histogram_t &h, const double fraction)
+{
+    if (h.count == 0)
+        return 0;
+    uint64_t sum = 0;
+    for (int i = 0; i < LMS_HISTOGRAM_BUCKETS; ++i)
+    {
+        sum += h.buckets[i];
+        if (sum >= fraction*h.count)
+            return i == 0 ? 0 : std::min(double(uint64_t(1) << i), double(h.max));
+    }
+    return double(h.max);
+}
+
+static void printHistogram(const char* name, const lms_histogram_t &h, const double scale)
+{
+    const double mean = h.count ? double(h.sum)/h.count : 0;
+    printf("    %-20s %10llu %10.1f %10.1f %10.1f %10.1f\n", name, (unsigned long long)h.count,
+        mean*scale, histogramPercentile(h, 0.5)*scale, histogramPercentile(h, 0.99)*scale, h.max*scale);
+}
+
+static void printTelemetry(const char* title, const lms_stream_telemetry_t &t, const double sampleRate)
+{
+    printf("  %s, FIFO high water %u/%u packets\n", title, t.fifoHighWater, t.fifoPackets);
+    printf("    %-20s %10s %10s %10s %10s %10s\n", "[us]", "count", "mean", "p50<=", "p99<=", "max");
+    printHistogram("transfer interval", t.transferInterval, 1e-3);
+    printHistogram("processing", t.processingTime, 1e-3);
+    printHistogram("producer wait", t.producerWait, 1e-3);
+    printHistogram("consumer wait", t.consumerWait, 1e-3);
+    if (t.txLeadTime.count)
+        printHistogram("Tx lead time", t.txLeadTime, 1e6/sampleRate);
+}
+
+int deviceStreamTelemetry(const std::string &argStr, const double rate, const double duration)
+{
+    lms_device_t *device(nullptr);
+    lime::ConnectionHandle hint(argStr);
+    auto handles = lime::ConnectionRegistry::findConnections(hint);
+    if(handles.size() == 0)
+    {
+        std::cerr << "No available device!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Connected to [" << handles[0].ToString() << "]" << std::endl;
+    if (LMS_Open(&device, handles[0].serialize().c_str(), nullptr) != 0)
+    {
+        std::cerr << "Failed to open" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (LMS_Init(device) != 0
+        || LMS_EnableChannel(device, LMS_CH_RX, 0, true) != 0
+        || LMS_EnableChannel(device, LMS_CH_TX, 0, true) != 0
+        || LMS_SetSampleRate(device, rate, 0) != 0)
+    {
+        std::cerr << "Failed to configure device: " << LMS_GetLastErrorMessage() << std::endl;
+        LMS_Close(device);
+        return EXIT_FAILURE;
+    }
+
+    lms_stream_t rxStream = {};
+    rxStream.channel = 0;
+    rxStream.fifoSize = 1024*1024;
+    rxStream.throughputVsLatency = 0.5;
+    rxStream.isTx = false;
+    rxStream.dataFmt = lms_stream_t::LMS_FMT_I16;
+    lms_stream_t txStream = rxStream;
+    txStream.isTx = true;
+    if (LMS_SetupStream(device, &rxStream) != 0 || LMS_SetupStream(device, &txStream) != 0)
+    {
+        std::cerr << "Failed to setup streams: " << LMS_GetLastErrorMessage() << std::endl;
+        LMS_Close(device);
+        return EXIT_FAILURE;
+    }
+
+    //transmit zeros timestamped ahead of received samples
+    const int bufferSize = 4096;
+    const uint64_t txLead = rate*10e-3;
+    std::vector<int16_t> rxBuffer(2*bufferSize);
+    std::vector<int16_t> txBuffer(2*bufferSize, 0);
+    lms_stream_meta_t rxMeta = {};
+    lms_stream_meta_t txMeta = {};
+    txMeta.waitForTimestamp = true;
+
+    std::cout << "Streaming " << rate/1e6 << " MS/s for " << duration << " s" << std::endl;
+    LMS_StartStream(&rxStream);
+    LMS_StartStream(&txStream);
+    uint64_t samplesReceived = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    while (std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() < duration)
+    {
+        const int count = LMS_RecvStream(&rxStream, rxBuffer.data(), bufferSize, &rxMeta, 1000);
+        if (count <= 0)
+            continue;
+        samplesReceived += count;
+        txMeta.timestamp = rxMeta.timestamp + txLead;
+        LMS_SendStream(&txStream, txBuffer.data(), count, &txMeta, 1000);
+    }
+
+    lms_stream_status_t rxStatus, txStatus;
+    lms_stream_telemetry_t rxTelemetry, txTelemetry;
+    LMS_GetStreamStatus(&rxStream, &rxStatus);
+    LMS_GetStreamStatus(&txStream, &txStatus);
+    LMS_GetStreamTelemetry(&rxStream, &rxTelemetry, false);
+    LMS_GetStreamTelemetry(&txStream, &txTelemetry, false);
+    LMS_StopStream(&txStream);
+    LMS_StopStream(&rxStream);
+    LMS_DestroyStream(device, &txStream);
+    LMS_DestroyStream(device, &rxStream);
+    LMS_Close(device);
+
+    std::cout << "Received " << samplesReceived << " samples, Rx dropped " << rxStatus.droppedPackets
+        << ", Tx dropped " << txStatus.droppedPackets << std::endl;
+    printTelemetry("Rx", rxTelemetry, rate);
+    printTelemetry("Tx", txTelemetry, rate);
+    return EXIT_SUCCESS;
+}
@@ -166,7 +166,7 @@ int deviceTestTiming(const std::string &argStr)
         auto t0 = std::chrono::high_resolution_clock::now();
         for (size_t i = 0; i < numIters; i++)
         {
-            lms7->CalibrateTx(10e6 + i*(3e6/numIters));
+            lms7->CalibrateTx(10e6 + i*(3e6/numIters), false, false);
         }
         auto t1 = std::chrono::high_resolution_clock::now();
         const auto secsPerOp = std::chrono::duration<double>(t1-t0).count()/numIters;
@@ -179,7 +179,7 @@ int deviceTestTiming(const std::string &argStr)
         auto t0 = std::chrono::high_resolution_clock::now();
         for (size_t i = 0; i < numIters; i++)
         {
-            lms7->CalibrateRx(10e6 + i*(3e6/numIters));
+            lms7->CalibrateRx(10e6 + i*(3e6/numIters), false, false);
         }
         auto t1 = std::chrono::high_resolution_clock::now();
         const auto secsPerOp = std::chrono::duration<double>(t1-t0).count()/numIters;
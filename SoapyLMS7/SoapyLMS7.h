@@ -104,6 +104,36 @@ public:
         long long &timeNs,
         const long timeoutUs = 100000);
 
+    /*******************************************************************
+     * Direct buffer access API
+     ******************************************************************/
+    size_t getNumDirectAccessBuffers(SoapySDR::Stream *stream);
+
+    int acquireReadBuffer(
+        SoapySDR::Stream *stream,
+        size_t &handle,
+        const void **buffs,
+        int &flags,
+        long long &timeNs,
+        const long timeoutUs = 100000);
+
+    void releaseReadBuffer(
+        SoapySDR::Stream *stream,
+        const size_t handle);
+
+    int acquireWriteBuffer(
+        SoapySDR::Stream *stream,
+        size_t &handle,
+        void **buffs,
+        const long timeoutUs = 100000);
+
+    void releaseWriteBuffer(
+        SoapySDR::Stream *stream,
+        const size_t handle,
+        const size_t numElems,
+        int &flags,
+        const long long timeNs = 0);
+
     /*******************************************************************
      * Antenna API
      ******************************************************************/
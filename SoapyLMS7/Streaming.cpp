@@ -14,6 +14,7 @@
 #include <algorithm> //min/max
 #include "Logger.h"
 #include "Streamer.h"
+#include "threadHelper.h"
 
 using namespace lime;
 
@@ -33,6 +34,30 @@ struct IConnectionStream
     int flags;
     long long timeNs;
     size_t numElems;
+
+    //direct buffer access, FIFO handles of each channel per buffer index
+    bool directAccess;
+    std::vector<std::vector<size_t>> directHandles;
+
+    //packets acquired by acquireReadBuffer() before another channel timed out,
+    //the next call continues from them so that channels stay aligned
+    struct PendingRead
+    {
+        PendingRead() : held(false), handle(0), samples(nullptr), timestamp(0), count(0) {}
+        bool held;
+        size_t handle;
+        const complex16_t* samples;
+        uint64_t timestamp;
+        int count;
+    };
+    std::vector<PendingRead> pendingReads;
+    void releasePendingReads(void)
+    {
+        for (size_t i = 0; i < pendingReads.size(); ++i)
+            if (pendingReads[i].held)
+                streamID[i]->ReleaseRead(pendingReads[i].handle);
+        pendingReads.assign(pendingReads.size(), PendingRead());
+    }
 };
 
 /*******************************************************************
@@ -106,6 +131,28 @@ SoapySDR::ArgInfoList SoapyLMS7::getStreamArgsInfo(const int direction, const si
         argInfos.push_back(info);
     }
 
+    //streaming thread CPUs
+    {
+        SoapySDR::ArgInfo info;
+        info.value = "";
+        info.key = "cpus";
+        info.name = "Thread CPUs";
+        info.description = "CPU list the streaming thread runs on, e.g. 0-3,8. Buffers are allocated on their NUMA node.";
+        info.type = SoapySDR::ArgInfo::STRING;
+        argInfos.push_back(info);
+    }
+
+    //streaming thread NUMA node
+    {
+        SoapySDR::ArgInfo info;
+        info.value = "-1";
+        info.key = "numaNode";
+        info.name = "NUMA Node";
+        info.description = "Run streaming thread on CPUs of this NUMA node, ignored when cpus is set.";
+        info.type = SoapySDR::ArgInfo::INT;
+        argInfos.push_back(info);
+    }
+
     return argInfos;
 }
 
@@ -125,6 +172,7 @@ SoapySDR::Stream *SoapyLMS7::setupStream(
     stream->elemSize = SoapySDR::formatToSize(format);
     stream->hasCmd = false;
     stream->skipCal = args.count("skipCal") != 0 and args.at("skipCal") == "true";
+    stream->directAccess = true;
 
     StreamConfig config;
     config.align = args.count("alignPhase") != 0 and args.at("alignPhase") == "true";
@@ -177,6 +225,24 @@ SoapySDR::Stream *SoapyLMS7::setupStream(
                 config.performanceLatency = 1;
         }
 
+        //FIFO packets can be handed out directly only when no conversion is needed
+        if (config.format != StreamConfig::FMT_INT16 or config.linkFormat != StreamConfig::FMT_INT16)
+            stream->directAccess = false;
+
+        //optional streaming thread placement
+        if (args.count("cpus") != 0)
+        {
+            config.threadCPUs = ParseCPUList(args.at("cpus"));
+            if (config.threadCPUs.empty())
+                throw std::runtime_error("SoapyLMS7::setupStream(cpus="+args.at("cpus")+") invalid CPU list");
+        }
+        else if (args.count("numaNode") != 0 and std::stoi(args.at("numaNode")) >= 0)
+        {
+            config.threadCPUs = GetNumaNodeCPUs(std::stoi(args.at("numaNode")));
+            if (config.threadCPUs.empty())
+                SoapySDR::logf(SOAPY_SDR_WARNING, "NUMA node %s CPUs not found", args.at("numaNode").c_str());
+        }
+
         //create the stream
         StreamChannel* streamID = lms7Device->SetupStream(config);
         if (streamID == 0)
@@ -264,6 +330,7 @@ int SoapyLMS7::deactivateStream(
     auto icstream = (IConnectionStream *)stream;
     const auto &streamID = icstream->streamID;
     icstream->hasCmd = false;
+    icstream->releasePendingReads();
 
     for(auto i : streamID)
     {
@@ -521,3 +588,217 @@ int SoapyLMS7::readStreamStatus(
     flags |= SOAPY_SDR_HAS_TIME;
     return ret;
 }
+
+/*******************************************************************
+ * Direct buffer access API
+ ******************************************************************/
+size_t SoapyLMS7::getNumDirectAccessBuffers(SoapySDR::Stream *stream)
+{
+    auto icstream = (IConnectionStream *)stream;
+    if (not icstream->directAccess)
+        return 0;
+    return icstream->streamID[0]->GetBufferCount();
+}
+
+int SoapyLMS7::acquireReadBuffer(
+    SoapySDR::Stream *stream,
+    size_t &handle,
+    const void **buffs,
+    int &flags,
+    long long &timeNs,
+    const long timeoutUs)
+{
+    auto icstream = (IConnectionStream *)stream;
+    const auto &streamID = icstream->streamID;
+    if (not icstream->directAccess)
+        return SOAPY_SDR_NOT_SUPPORTED;
+
+    //wait for a command from activate stream up to the timeout specified
+    if (not icstream->hasCmd)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(timeoutUs));
+        return SOAPY_SDR_TIMEOUT;
+    }
+
+    const size_t chCount = streamID.size();
+    auto &pending = icstream->pendingReads;
+    pending.resize(chCount);
+
+    //packets are consumed only when skipped, timeouts leave them pending for next call
+    auto acquire = [&](size_t i) -> bool
+    {
+        if (pending[i].held)
+            return true;
+        StreamChannel::Metadata md;
+        const int n = streamID[i]->AcquireRead(pending[i].handle, &pending[i].samples, &md, timeoutUs/1000);
+        pending[i].held = n > 0;
+        pending[i].timestamp = md.timestamp;
+        pending[i].count = n;
+        return pending[i].held;
+    };
+    auto skip = [&](size_t i)
+    {
+        streamID[i]->ReleaseRead(pending[i].handle);
+        pending[i].held = false;
+    };
+
+    const uint64_t cmdTicks = ((icstream->flags & SOAPY_SDR_HAS_TIME) != 0)?SoapySDR::timeNsToTicks(icstream->timeNs, sampleRate[SOAPY_SDR_RX]):0;
+    size_t offset = 0;
+    int count = 0;
+    while (true)
+    {
+        for (size_t i = 0; i < chCount; ++i)
+            if (not acquire(i))
+                return SOAPY_SDR_TIMEOUT;
+
+        //channels can lose different packets on overflow, skip older ones until aligned
+        bool aligned = false;
+        while (not aligned)
+        {
+            uint64_t newest = 0;
+            for (size_t i = 0; i < chCount; ++i)
+                newest = std::max(newest, pending[i].timestamp);
+            aligned = true;
+            for (size_t i = 0; i < chCount; ++i)
+            {
+                if (pending[i].timestamp >= newest)
+                    continue;
+                aligned = false;
+                skip(i);
+                if (not acquire(i))
+                    return SOAPY_SDR_TIMEOUT;
+            }
+        }
+        count = pending[0].count;
+        for (size_t i = 1; i < chCount; ++i)
+            count = std::min(count, pending[i].count);
+
+        if ((icstream->flags & SOAPY_SDR_HAS_TIME) == 0)
+            break;
+
+        //our request time is now late, clear command and return error code
+        if (cmdTicks < pending[0].timestamp)
+        {
+            icstream->releasePendingReads();
+            icstream->hasCmd = false;
+            return SOAPY_SDR_TIME_ERROR;
+        }
+        //requested time is in this packet, skip samples before it
+        if (cmdTicks < pending[0].timestamp + count)
+        {
+            offset = cmdTicks - pending[0].timestamp;
+            icstream->flags &= ~SOAPY_SDR_HAS_TIME; //clear for next read
+            break;
+        }
+        for (size_t i = 0; i < chCount; ++i)
+            skip(i);
+    }
+
+    StreamChannel::Metadata metadata;
+    metadata.flags = RingFIFO::SYNC_TIMESTAMP;
+    size_t numElems = count - offset;
+
+    //handle finite burst request commands
+    if (icstream->numElems != 0)
+    {
+        numElems = std::min<size_t>(numElems, icstream->numElems);
+        icstream->numElems -= numElems;
+        if (icstream->numElems == 0)
+        {
+            icstream->hasCmd = false;
+            metadata.flags |= RingFIFO::END_BURST;
+        }
+    }
+
+    //remember handles of every channel under channel 0 buffer index
+    const size_t bufferCount = streamID[0]->GetBufferCount();
+    if (icstream->directHandles.size() < bufferCount)
+        icstream->directHandles.resize(bufferCount);
+    std::vector<size_t> handles(chCount);
+    for (size_t i = 0; i < chCount; ++i)
+    {
+        handles[i] = pending[i].handle;
+        buffs[i] = pending[i].samples + offset;
+    }
+    handle = handles[0] % bufferCount;
+    icstream->directHandles[handle] = handles;
+    const uint64_t timestamp = pending[0].timestamp;
+    //packets now belong to returned handle
+    pending.assign(chCount, IConnectionStream::PendingRead());
+
+    //output metadata
+    flags = 0;
+    if ((metadata.flags & RingFIFO::END_BURST) != 0) flags |= SOAPY_SDR_END_BURST;
+    if ((metadata.flags & RingFIFO::SYNC_TIMESTAMP) != 0) flags |= SOAPY_SDR_HAS_TIME;
+    timeNs = SoapySDR::ticksToTimeNs(timestamp + offset, sampleRate[SOAPY_SDR_RX]);
+    return int(numElems);
+}
+
+void SoapyLMS7::releaseReadBuffer(
+    SoapySDR::Stream *stream,
+    const size_t handle)
+{
+    auto icstream = (IConnectionStream *)stream;
+    const auto &streamID = icstream->streamID;
+    if (handle >= icstream->directHandles.size())
+        return;
+    const auto &handles = icstream->directHandles[handle];
+    for (size_t i = 0; i < streamID.size() && i < handles.size(); ++i)
+        streamID[i]->ReleaseRead(handles[i]);
+}
+
+int SoapyLMS7::acquireWriteBuffer(
+    SoapySDR::Stream *stream,
+    size_t &handle,
+    void **buffs,
+    const long timeoutUs)
+{
+    auto icstream = (IConnectionStream *)stream;
+    const auto &streamID = icstream->streamID;
+    if (not icstream->directAccess)
+        return SOAPY_SDR_NOT_SUPPORTED;
+
+    //packets are not visible to Tx thread until released, so timed out channels need no cleanup
+    std::vector<size_t> handles(streamID.size());
+    int count = 0;
+    for (size_t i = 0; i < streamID.size(); ++i)
+    {
+        complex16_t* samples = nullptr;
+        count = streamID[i]->AcquireWrite(handles[i], &samples, timeoutUs/1000);
+        if (count < 0)
+            return SOAPY_SDR_STREAM_ERROR;
+        if (count == 0)
+            return SOAPY_SDR_TIMEOUT;
+        buffs[i] = samples;
+    }
+
+    const size_t bufferCount = streamID[0]->GetBufferCount();
+    if (icstream->directHandles.size() < bufferCount)
+        icstream->directHandles.resize(bufferCount);
+    handle = handles[0] % bufferCount;
+    icstream->directHandles[handle] = handles;
+    return count;
+}
+
+void SoapyLMS7::releaseWriteBuffer(
+    SoapySDR::Stream *stream,
+    const size_t handle,
+    const size_t numElems,
+    int &flags,
+    const long long timeNs)
+{
+    auto icstream = (IConnectionStream *)stream;
+    const auto &streamID = icstream->streamID;
+    if (handle >= icstream->directHandles.size())
+        return;
+
+    //input metadata
+    StreamChannel::Metadata metadata;
+    metadata.timestamp = SoapySDR::timeNsToTicks(timeNs, sampleRate[SOAPY_SDR_RX]);
+    metadata.flags = (flags & SOAPY_SDR_HAS_TIME) ? lime::RingFIFO::SYNC_TIMESTAMP : 0;
+    metadata.flags |= (flags & SOAPY_SDR_END_BURST) ? lime::RingFIFO::END_BURST : 0;
+
+    const auto &handles = icstream->directHandles[handle];
+    for (size_t i = 0; i < streamID.size() && i < handles.size(); ++i)
+        streamID[i]->CommitWrite(handles[i], numElems, &metadata);
+}
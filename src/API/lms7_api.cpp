@@ -2,6 +2,7 @@
 #include "ConnectionRegistry.h"
 #include "lime/LimeSuite.h"
 #include "lms7_device.h"
+#include "LMS7002M_CalibrationCache.h"
 #include "errno.h"
 #include <cmath>
 #include "VersionInfo.h"
@@ -9,6 +10,8 @@
 #include "Logger.h"
 #include "LMS64CProtocol.h"
 #include "Streamer.h"
+#include "StreamRecorder.h"
+#include "StreamPlayer.h"
 #include "../limeRFE/RFE_Device.h"
 
 using namespace std;
@@ -344,6 +347,45 @@ API_EXPORT int CALL_CONV LMS_GetLOFrequencyRange(lms_device_t *device, bool dir_
     return LMS_SUCCESS;
 }
 
+API_EXPORT int CALL_CONV LMS_CreateHopProfiles(lms_device_t *device, bool dir_tx, size_t chan, const float_type *frequencies, size_t count)
+{
+    lime::LMS7_Device* lms = CheckDevice(device, chan);
+    if (!lms)
+        return -1;
+    if (frequencies == nullptr)
+    {
+        lime::error("Frequency list cannot be NULL.");
+        return -1;
+    }
+    return lms->CreateHopProfiles(dir_tx, chan, std::vector<double>(frequencies, frequencies + count));
+}
+
+API_EXPORT int CALL_CONV LMS_Hop(lms_device_t *device, bool dir_tx, size_t chan, size_t index)
+{
+    lime::LMS7_Device* lms = CheckDevice(device, chan);
+    return lms ? lms->Hop(dir_tx, chan, index) : -1;
+}
+
+API_EXPORT int CALL_CONV LMS_HopAt(lms_device_t *device, bool dir_tx, size_t chan, size_t index, uint64_t timestamp)
+{
+    lime::LMS7_Device* lms = CheckDevice(device, chan);
+    return lms ? lms->HopAt(dir_tx, chan, index, timestamp) : -1;
+}
+
+API_EXPORT int CALL_CONV LMS_GetHopLatency(lms_device_t *device, bool dir_tx, size_t chan, float_type *latency)
+{
+    if (latency == nullptr)
+    {
+        lime::error("Latency pointer cannot be NULL");
+        return -1;
+    }
+    lime::LMS7_Device* lms = CheckDevice(device, chan);
+    if (!lms)
+        return -1;
+    *latency = lms->GetHopLatency(dir_tx, chan);
+    return LMS_SUCCESS;
+}
+
 API_EXPORT int CALL_CONV LMS_GetAntennaList(lms_device_t *device, bool dir_tx, size_t chan, lms_name_t *list)
 {
     lime::LMS7_Device* lms = CheckDevice(device, chan);
@@ -504,6 +546,59 @@ API_EXPORT int CALL_CONV LMS_Calibrate(lms_device_t *device, bool dir_tx, size_t
     return ret;
 }
 
+API_EXPORT int CALL_CONV LMS_CalibrateChannels(lms_device_t *device, bool dir_tx, const size_t *chans, size_t count, double bw, unsigned flags)
+{
+    lime::LMS7_Device* lms = CheckDevice(device);
+    if (!lms)
+        return -1;
+    if (chans == nullptr && count != 0)
+    {
+        lime::error("Channel list cannot be NULL.");
+        return -1;
+    }
+    std::vector<unsigned> channels;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (chans[i] >= lms->GetNumChannels())
+        {
+            lime::error("Invalid channel number.");
+            return -1;
+        }
+        channels.push_back(chans[i]);
+    }
+
+#ifdef LIMERFE
+    auto rfe = lms->GetLimeRFE();
+    if (rfe)
+        for (auto chan : channels)
+            rfe->OnCalibrate(chan, false);
+#endif
+    int ret = lms->CalibrateChannels(dir_tx, channels, bw, flags);
+
+#ifdef LIMERFE
+    if (rfe)
+        for (auto chan : channels)
+            rfe->OnCalibrate(chan, true);
+#endif
+    return ret;
+}
+
+API_EXPORT int CALL_CONV LMS_GetCalibrationCacheStats(lms_device_t *device, unsigned *hits, unsigned *misses, bool reset)
+{
+    lime::LMS7_Device* lms = CheckDevice(device);
+    if (!lms)
+        return -1;
+    unsigned h, m;
+    lime::LMS7002M_CalibrationCache::Instance().GetStats(h, m);
+    if (hits)
+        *hits = h;
+    if (misses)
+        *misses = m;
+    if (reset)
+        lime::LMS7002M_CalibrationCache::Instance().ResetStats();
+    return LMS_SUCCESS;
+}
+
 API_EXPORT int CALL_CONV LMS_LoadConfig(lms_device_t *device, const char *filename)
 {
     lime::LMS7_Device* lms = CheckDevice(device);
@@ -707,6 +802,21 @@ API_EXPORT int CALL_CONV LMS_WriteParam(lms_device_t *device, struct LMS7Paramet
     return lms->WriteParam(param, val);
 }
 
+API_EXPORT int CALL_CONV LMS_BeginTransaction(lms_device_t *device)
+{
+    lime::LMS7_Device* lms = CheckDevice(device);
+    if (!lms)
+        return -1;
+    lms->BeginTransaction();
+    return 0;
+}
+
+API_EXPORT int CALL_CONV LMS_CommitTransaction(lms_device_t *device)
+{
+    lime::LMS7_Device* lms = CheckDevice(device);
+    return lms ? lms->CommitTransaction() : -1;
+}
+
 API_EXPORT int CALL_CONV LMS_SetGFIRCoeff(lms_device_t * device, bool dir_tx, size_t chan, lms_gfir_t filt, const float_type* coef,size_t count)
 {
     lime::LMS7_Device* lms = CheckDevice(device, chan);
@@ -774,6 +884,12 @@ API_EXPORT int CALL_CONV LMS_SetupStream(lms_device_t *device, lms_stream_t *str
     return stream->handle == 0 ? -1 : 0;
 }
 
+API_EXPORT int CALL_CONV LMS_SetStreamCPUs(lms_device_t *device, bool dir_tx, size_t chan, uint64_t cpuMask)
+{
+    lime::LMS7_Device* lms = CheckDevice(device, chan);
+    return lms ? lms->SetStreamCPUs(dir_tx, chan, cpuMask) : -1;
+}
+
 API_EXPORT int CALL_CONV LMS_DestroyStream(lms_device_t *device, lms_stream_t *stream)
 {
     if(stream == nullptr)
@@ -827,6 +943,30 @@ API_EXPORT int CALL_CONV LMS_RecvStream(lms_stream_t *stream, void *samples, siz
     return status;
 }
 
+API_EXPORT int CALL_CONV LMS_AcquireRecvBuffer(lms_stream_t *stream, const int16_t **samples, size_t *handle, lms_stream_meta_t *meta, unsigned timeout_ms)
+{
+    if (stream==nullptr || stream->handle==0 || samples==nullptr || handle==nullptr)
+        return -1;
+    lime::StreamChannel* channel = (lime::StreamChannel*)stream->handle;
+    lime::StreamChannel::Metadata metadata;
+    metadata.flags = 0;
+    metadata.timestamp = 0;
+    const lime::complex16_t* ptr = nullptr;
+    int status = channel->AcquireRead(*handle, &ptr, &metadata, timeout_ms);
+    *samples = (const int16_t*)ptr;
+    if (meta)
+        meta->timestamp = metadata.timestamp;
+    return status;
+}
+
+API_EXPORT int CALL_CONV LMS_ReleaseRecvBuffer(lms_stream_t *stream, size_t handle)
+{
+    if (stream==nullptr || stream->handle==0)
+        return -1;
+    reinterpret_cast<lime::StreamChannel*>(stream->handle)->ReleaseRead(handle);
+    return 0;
+}
+
 API_EXPORT int CALL_CONV LMS_SendStream(lms_stream_t *stream, const void *samples, size_t sample_count, const lms_stream_meta_t *meta, unsigned timeout_ms)
 {
     if (stream==nullptr || stream->handle==0)
@@ -905,6 +1045,155 @@ API_EXPORT int CALL_CONV LMS_GetStreamStatus(lms_stream_t *stream, lms_stream_st
     return LMS_SUCCESS;
 }
 
+static void CopyHistogram(const lime::StreamHistogram::Snapshot &src, lms_histogram_t &dest)
+{
+    static_assert(LMS_HISTOGRAM_BUCKETS == lime::StreamHistogram::cBucketsCount, "histogram size mismatch");
+    dest.count = src.count;
+    dest.sum = src.sum;
+    dest.max = src.max;
+    for (int i = 0; i < LMS_HISTOGRAM_BUCKETS; ++i)
+        dest.buckets[i] = src.buckets[i];
+}
+
+API_EXPORT int CALL_CONV LMS_GetStreamTelemetry(lms_stream_t *stream, lms_stream_telemetry_t* telemetry, bool reset)
+{
+    if (stream==nullptr || stream->handle==0 || telemetry==nullptr)
+        return -1;
+    lime::StreamChannel* channel = (lime::StreamChannel*)stream->handle;
+    const lime::StreamTelemetry::Snapshot snapshot = channel->GetTelemetry(reset);
+
+    CopyHistogram(snapshot.transferInterval, telemetry->transferInterval);
+    CopyHistogram(snapshot.processingTime, telemetry->processingTime);
+    CopyHistogram(snapshot.producerWait, telemetry->producerWait);
+    CopyHistogram(snapshot.consumerWait, telemetry->consumerWait);
+    CopyHistogram(snapshot.txLeadTime, telemetry->txLeadTime);
+    telemetry->fifoHighWater = snapshot.fifoHighWater;
+    telemetry->fifoPackets = channel->fifo ? channel->GetBufferCount() : 0;
+    return LMS_SUCCESS;
+}
+
+static void CopyRecordingStatus(const lime::StreamRecorder::Status &src, lms_recorder_status_t *dest)
+{
+    dest->active = src.active;
+    dest->directIO = src.directIO;
+    dest->samples = src.samples;
+    dest->bytesWritten = src.bytesWritten;
+    dest->droppedSamples = src.droppedSamples;
+    dest->gaps = src.gaps;
+    dest->buffersHighWater = src.buffersHighWater;
+    dest->bufferCount = src.bufferCount;
+    dest->writeRate = src.seconds > 0 ? src.bytesWritten / src.seconds : 0;
+    dest->diskRate = src.writeSeconds > 0 ? src.bytesWritten / src.writeSeconds : 0;
+}
+
+API_EXPORT int CALL_CONV LMS_StartRecording(lms_stream_t *stream, const lms_recorder_config_t *config, lms_recorder_t **recorder)
+{
+    if (stream==nullptr || stream->handle==0 || config==nullptr || config->path==nullptr || recorder==nullptr)
+        return -1;
+    lime::StreamRecorder::Config conf;
+    conf.path = config->path;
+    conf.packed = config->packed;
+    conf.maxSamples = config->maxSamples;
+    if (config->bufferSize)
+        conf.bufferSize = config->bufferSize;
+    if (config->bufferCount)
+        conf.bufferCount = config->bufferCount;
+    conf.sampleRate = config->sampleRate;
+    conf.frequency = config->frequency;
+    if (config->hardware)
+        conf.hardware = config->hardware;
+    if (config->description)
+        conf.description = config->description;
+
+    lime::StreamRecorder* rec = new lime::StreamRecorder((lime::StreamChannel*)stream->handle);
+    if (rec->Start(conf) != 0)
+    {
+        delete rec;
+        return -1;
+    }
+    *recorder = rec;
+    return LMS_SUCCESS;
+}
+
+API_EXPORT int CALL_CONV LMS_GetRecordingStatus(lms_recorder_t *recorder, lms_recorder_status_t *status)
+{
+    if (recorder==nullptr || status==nullptr)
+        return -1;
+    CopyRecordingStatus(((lime::StreamRecorder*)recorder)->GetStatus(), status);
+    return LMS_SUCCESS;
+}
+
+API_EXPORT int CALL_CONV LMS_StopRecording(lms_recorder_t *recorder, lms_recorder_status_t *status)
+{
+    if (recorder==nullptr)
+        return -1;
+    lime::StreamRecorder* rec = (lime::StreamRecorder*)recorder;
+    const int ret = rec->Stop();
+    if (status)
+        CopyRecordingStatus(rec->GetStatus(), status);
+    delete rec;
+    return ret;
+}
+
+static void CopyPlaybackStatus(const lime::StreamPlayer::Status &src, lms_player_status_t *dest)
+{
+    dest->active = src.active;
+    dest->samples = src.samples;
+    dest->fileSamples = src.fileSamples;
+    dest->loops = src.loops;
+    dest->sampleRate = src.seconds > 0 ? src.samples / src.seconds : 0;
+}
+
+API_EXPORT int CALL_CONV LMS_StartPlayback(lms_stream_t *stream, const lms_player_config_t *config, lms_player_t **player)
+{
+    if (stream==nullptr || stream->handle==0 || config==nullptr || config->path==nullptr || player==nullptr)
+        return -1;
+    lime::StreamPlayer::Config conf;
+    conf.path = config->path;
+    switch (config->format)
+    {
+    case lms_player_config_t::LMS_PLAY_FMT_CS16: conf.format = lime::StreamPlayer::FMT_CS16; break;
+    case lms_player_config_t::LMS_PLAY_FMT_CF32: conf.format = lime::StreamPlayer::FMT_CF32; break;
+    case lms_player_config_t::LMS_PLAY_FMT_PACKED12: conf.format = lime::StreamPlayer::FMT_PACKED12; break;
+    default:
+        lime::error("Invalid playback file format");
+        return -1;
+    }
+    conf.loop = config->loop;
+    conf.useTimestamp = config->useTimestamp;
+    conf.startTimestamp = config->startTimestamp;
+    conf.sampleRate = config->sampleRate;
+
+    lime::StreamPlayer* play = new lime::StreamPlayer((lime::StreamChannel*)stream->handle);
+    if (play->Start(conf) != 0)
+    {
+        delete play;
+        return -1;
+    }
+    *player = play;
+    return LMS_SUCCESS;
+}
+
+API_EXPORT int CALL_CONV LMS_GetPlaybackStatus(lms_player_t *player, lms_player_status_t *status)
+{
+    if (player==nullptr || status==nullptr)
+        return -1;
+    CopyPlaybackStatus(((lime::StreamPlayer*)player)->GetStatus(), status);
+    return LMS_SUCCESS;
+}
+
+API_EXPORT int CALL_CONV LMS_StopPlayback(lms_player_t *player, lms_player_status_t *status)
+{
+    if (player==nullptr)
+        return -1;
+    lime::StreamPlayer* play = (lime::StreamPlayer*)player;
+    const int ret = play->Stop();
+    if (status)
+        CopyPlaybackStatus(play->GetStatus(), status);
+    delete play;
+    return ret;
+}
+
 API_EXPORT const lms_dev_info_t* CALL_CONV LMS_GetDeviceInfo(lms_device_t *device)
 {
     lime::LMS7_Device* lms = CheckDevice(device);
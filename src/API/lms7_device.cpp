@@ -5,6 +5,7 @@
  * Created on March 9, 2016, 12:54 PM
  */
 #include <cmath>
+#include <chrono>
 
 #include "lms7_device.h"
 #include "qLimeSDR.h"
@@ -70,7 +71,7 @@ LMS7_Device* LMS7_Device::CreateDevice(const lime::ConnectionHandle& handle, LMS
     return device;
 }
 
-LMS7_Device::LMS7_Device(LMS7_Device *obj) : connection(nullptr), lms_chip_id(0),fpga(nullptr), limeRFE(nullptr)
+LMS7_Device::LMS7_Device(LMS7_Device *obj) : connection(nullptr), lms_chip_id(0),fpga(nullptr), limeRFE(nullptr), hopStop(false)
 {
     if (obj != nullptr)
     {
@@ -93,6 +94,14 @@ LMS7_Device::LMS7_Device(LMS7_Device *obj) : connection(nullptr), lms_chip_id(0)
 
 LMS7_Device::~LMS7_Device()
 {
+    {
+        std::lock_guard<std::mutex> lock(hopLock);
+        hopStop = true;
+        hopCond.notify_one();
+    }
+    if (hopThread.joinable())
+        hopThread.join();
+
     for (unsigned i = 0; i < lms_list.size();i++)
         delete lms_list[i];
 
@@ -120,6 +129,40 @@ lime::LMS7002M* LMS7_Device::SelectChannel(unsigned ch) const
     return lms;
 }
 
+/** @brief Runs function for every chip, chips of multi-chip boards are
+    controlled through separate SPI peripherals, so they are run in parallel
+    @param func function of chip index returning 0 on success
+    @return 0 if function succeeded for all chips
+*/
+int LMS7_Device::ForEachChip(const std::function<int(unsigned)> &func)
+{
+    if (lms_list.size() == 1)
+        return func(0);
+
+    //errors are reported to thread local storage, pass them to caller thread
+    std::vector<int> status(lms_list.size(), 0);
+    std::vector<std::string> messages(lms_list.size());
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < lms_list.size(); i++)
+        threads.push_back(std::thread([&, i]()
+        {
+            status[i] = func(i);
+            if (status[i] != 0)
+                messages[i] = lime::GetLastErrorMessage();
+        }));
+    for (auto &thread : threads)
+        thread.join();
+    for (unsigned i = 0; i < lms_list.size(); i++)
+    {
+        if (status[i] != 0)
+        {
+            lime::ReportError(EIO, "Chip %u: %s", i, messages[i].c_str());
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int LMS7_Device::ConfigureGFIR(bool tx, unsigned ch, bool enabled, double bandwidth)
 {
     double w,w2;
@@ -1289,13 +1332,34 @@ int LMS7_Device::Calibrate(bool dir_tx, unsigned chan, double bw, unsigned flags
     auto reg20 = lms->SPI_read(0x20);
     lms->SPI_write(0x20,reg20 | (20 << (chan%2)));
     if (dir_tx)
-        ret = lms->CalibrateTx(bw, flags & 1);
+        ret = lms->CalibrateTx(bw, flags & 1, !(flags & LMS_CALIBRATE_FORCE));
     else
-        ret = lms->CalibrateRx(bw, flags & 1);
+        ret = lms->CalibrateRx(bw, flags & 1, !(flags & LMS_CALIBRATE_FORCE));
     lms->SPI_write(0x20,reg20);
     return ret;
 }
 
+/** @brief Calibrates given channels, channels of different chips are calibrated concurrently
+*/
+int LMS7_Device::CalibrateChannels(bool dir_tx, const std::vector<unsigned> &chans, double bw, unsigned flags)
+{
+    for (auto chan : chans)
+    {
+        if (chan / 2 >= lms_list.size())
+        {
+            lime::ReportError(EINVAL, "Invalid channel number.");
+            return -1;
+        }
+    }
+    return ForEachChip([&](unsigned i)->int
+    {
+        for (auto chan : chans)
+            if (chan / 2 == i && Calibrate(dir_tx, chan, bw, flags) != 0)
+                return -1;
+        return 0;
+    });
+}
+
 int LMS7_Device::SetFrequency(bool isTx, unsigned chan, double f_Hz)
 {
     lime::LMS7002M* lms = lms_list[chan / 2];
@@ -1384,6 +1448,183 @@ LMS7_Device::Range LMS7_Device::GetFrequencyRange(bool tx) const
     return Range(100e3, 3.8e9);
 }
 
+int LMS7_Device::CreateHopProfiles(bool tx, unsigned chan, const std::vector<double> &frequencies)
+{
+    if (frequencies.empty())
+        return lime::ReportError(EINVAL, "Hop frequency list is empty");
+    lime::LMS7002M* lms = lms_list[chan / 2];
+    std::vector<ChannelInfo>& channels = tx ? tx_channels : rx_channels;
+    const unsigned chA = chan&(~1);
+
+    std::lock_guard<std::mutex> lock(hopApplyLock);
+    channels[chan].hops.clear();
+    channels[chan].hopTime = 0;
+    channels[chan].hopCount = 0;
+
+    //tune to every frequency and record registers changed by tuning
+    std::vector<HopProfile> hops(frequencies.size());
+    std::vector<lime::LMS7002M::RegisterProfile> profiles;
+    const double cgenFreq = lms->GetFrequencyCGEN();
+    lms->BeginProfileCapture();
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        if (SetFrequency(tx, chan, frequencies[i]) != 0)
+        {
+            lms->EndProfileCapture(profiles);
+            return -1;
+        }
+        //sample rate changes also need FPGA configuration
+        if (fabs(lms->GetFrequencyCGEN() - cgenFreq) > 1)
+        {
+            lms->EndProfileCapture(profiles);
+            return lime::ReportError(EINVAL, "%g Hz requires sample rate change, cannot be used for hopping", frequencies[i]);
+        }
+        lms->CaptureProfile();
+        for (unsigned ch = 0; ch < 2; ++ch)
+        {
+            const bool exists = chA + ch < channels.size();
+            hops[i].freq[ch] = exists ? channels[chA + ch].freq : 0;
+            hops[i].cF_offset_nco[ch] = exists ? channels[chA + ch].cF_offset_nco : 0;
+        }
+    }
+    if (lms->EndProfileCapture(profiles) != 0)
+        return -1;
+    for (size_t i = 0; i < hops.size(); ++i)
+        hops[i].registers = profiles[i];
+    channels[chan].hops = hops;
+
+    //verify that every profile locks PLL, tuning ends on first frequency
+    for (size_t i = hops.size(); i-- > 0;)
+    {
+        if (ApplyHop(tx, chan, i) != 0)
+            return -1;
+        bool sxt = tx;
+        if (!tx)
+        {
+            lms->Modify_SPI_Reg_bits(LMS7_MAC, 1);
+            sxt = lms->Get_SPI_Reg_bits(LMS7_PD_VCO) == 1; //Tx PLL used for TX and RX
+        }
+        if (!lms->GetSXLocked(sxt))
+        {
+            channels[chan].hops.clear();
+            return lime::ReportError(EIO, "PLL does not lock with hop profile of %g Hz", frequencies[i]);
+        }
+    }
+    return 0;
+}
+
+int LMS7_Device::ApplyHop(bool tx, unsigned chan, unsigned index)
+{
+    std::vector<ChannelInfo>& channels = tx ? tx_channels : rx_channels;
+    if (index >= channels[chan].hops.size())
+        return lime::ReportError(EINVAL, "Hop profile %u does not exist", index);
+    const HopProfile &hop = channels[chan].hops[index];
+
+    auto t1 = std::chrono::steady_clock::now();
+    if (lms_list[chan / 2]->ApplyProfile(hop.registers) != 0)
+        return -1;
+    channels[chan].hopTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+    channels[chan].hopCount++;
+
+    const unsigned chA = chan&(~1);
+    for (unsigned ch = 0; ch < 2 && chA + ch < channels.size(); ++ch)
+    {
+        channels[chA + ch].freq = hop.freq[ch];
+        channels[chA + ch].cF_offset_nco = hop.cF_offset_nco[ch];
+    }
+    return 0;
+}
+
+int LMS7_Device::Hop(bool tx, unsigned chan, unsigned index)
+{
+    std::lock_guard<std::mutex> lock(hopApplyLock);
+    return ApplyHop(tx, chan, index);
+}
+
+int LMS7_Device::HopAt(bool tx, unsigned chan, unsigned index, uint64_t timestamp)
+{
+    {
+        std::lock_guard<std::mutex> lock(hopApplyLock);
+        const std::vector<ChannelInfo>& channels = tx ? tx_channels : rx_channels;
+        if (index >= channels[chan].hops.size())
+            return lime::ReportError(EINVAL, "Hop profile %u does not exist", index);
+    }
+    if (!mStreamers[chan / 2]->rxThread.joinable())
+        return lime::ReportError(EINVAL, "Timed hop requires running Rx stream");
+
+    PendingHop hop;
+    hop.tx = tx;
+    hop.chan = chan;
+    hop.index = index;
+    hop.rate = GetRate(false, chan);
+    std::lock_guard<std::mutex> lock(hopLock);
+    if (!hopThread.joinable())
+        hopThread = std::thread(&LMS7_Device::HopLoop, this);
+    pendingHops.insert(std::make_pair(timestamp, hop));
+    hopCond.notify_one();
+    return 0;
+}
+
+double LMS7_Device::GetHopLatency(bool tx, unsigned chan) const
+{
+    std::lock_guard<std::mutex> lock(hopApplyLock);
+    const ChannelInfo& channel = tx ? tx_channels[chan] : rx_channels[chan];
+    return channel.hopCount ? channel.hopTime / channel.hopCount : 0;
+}
+
+/** @brief Applies pending hops when Rx stream timestamp reaches hop time
+    minus measured hop latency.
+*/
+void LMS7_Device::HopLoop()
+{
+    //hops are dropped if stream timestamp stops advancing
+    const auto stallTimeout = std::chrono::seconds(1);
+    uint64_t lastNow = 0;
+    auto lastProgress = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(hopLock);
+    while (!hopStop)
+    {
+        if (pendingHops.empty())
+        {
+            hopCond.wait(lock);
+            lastProgress = std::chrono::steady_clock::now();
+            continue;
+        }
+        const uint64_t timestamp = pendingHops.begin()->first;
+        const PendingHop hop = pendingHops.begin()->second;
+        const lime::Streamer* streamer = mStreamers[hop.chan / 2];
+        const uint64_t now = streamer->rxLastTimestamp.load(std::memory_order_relaxed) + streamer->mTimestampOffset;
+        const double lead = GetHopLatency(hop.tx, hop.chan) * hop.rate;
+        if (now + lead >= timestamp)
+        {
+            pendingHops.erase(pendingHops.begin());
+            lock.unlock();
+            if (Hop(hop.tx, hop.chan, hop.index) != 0)
+                lime::warning("Timed hop to profile %u failed", hop.index);
+            lock.lock();
+            continue;
+        }
+
+        auto time = std::chrono::steady_clock::now();
+        if (now != lastNow)
+        {
+            lastNow = now;
+            lastProgress = time;
+        }
+        else if (time - lastProgress > stallTimeout)
+        {
+            lime::warning("Stream timestamp is not advancing, %u timed hops dropped", unsigned(pendingHops.size()));
+            pendingHops.clear();
+            continue;
+        }
+        //timestamp advances in packet steps, wake up halfway to hop time
+        const double wait = (timestamp - now - lead) / hop.rate / 2;
+        const double waitLimited = wait < 20e-6 ? 20e-6 : (wait > 10e-3 ? 10e-3 : wait);
+        hopCond.wait_for(lock, std::chrono::microseconds(int64_t(waitLimited * 1e6)));
+    }
+}
+
 int LMS7_Device::Init()
 {
     struct regVal
@@ -1407,7 +1648,8 @@ int LMS7_Device::Init()
         {0x040B, 0x1020}, {0x040C, 0x00FB}
     };
 
-    for (unsigned i = 0; i < lms_list.size(); i++)
+    //chip registers and channels of each chip are independent until sample rate is set
+    auto initChip = [&](unsigned i)->int
     {
         lime::LMS7002M* lms = lms_list[i];
         if (lms->ResetChip() != 0)
@@ -1438,7 +1680,10 @@ int LMS7_Device::Init()
             return -1;
         if(SetFrequency(false,2*i,GetFrequency(false,2*i))!=0)
             return -1;
-    }
+        return 0;
+    };
+    if (ForEachChip(initChip) != 0)
+        return -1;
 
     if (SetRate(10e6,2)!=0)
         return -1;
@@ -1663,23 +1908,20 @@ lms_dev_info_t* LMS7_Device::GetInfo()
 
 int LMS7_Device::Synchronize(bool toChip)
 {
-    int ret=0;
+    int ret = ForEachChip([this, toChip](unsigned i)->int
+    {
+        return toChip ? lms_list[i]->UploadAll() : lms_list[i]->DownloadAll();
+    });
+    if (ret != 0 || !toChip)
+        return ret;
     for (unsigned i = 0; i < lms_list.size(); i++)
     {
         lime::LMS7002M* lms = lms_list[i];
-        if (toChip)
-        {
-            if (lms->UploadAll()==0)
-            {
-                int tmp = lms_chip_id;
-                lms_chip_id = i;
-                lms->Modify_SPI_Reg_bits(LMS7param(MAC),1,true);
-                ret = SetFPGAInterfaceFreq(-1, -1, -1000, -1000);
-                lms_chip_id = tmp;
-            }
-        }
-        else
-            ret = lms->DownloadAll();
+        int tmp = lms_chip_id;
+        lms_chip_id = i;
+        lms->Modify_SPI_Reg_bits(LMS7param(MAC),1,true);
+        ret = SetFPGAInterfaceFreq(-1, -1, -1000, -1000);
+        lms_chip_id = tmp;
         if (ret != 0)
             break;
     }
@@ -1745,6 +1987,21 @@ int LMS7_Device::WriteLMSReg(uint16_t address, uint16_t val, int ind) const
     return lms_list.at(ind == -1 ? lms_chip_id : ind)->SPI_write(address & 0xFFFF, val);
 }
 
+void LMS7_Device::BeginTransaction()
+{
+    for (unsigned i = 0; i < lms_list.size(); i++)
+        lms_list[i]->BeginTransaction();
+}
+
+int LMS7_Device::CommitTransaction()
+{
+    int status = 0;
+    for (unsigned i = 0; i < lms_list.size(); i++)
+        if (lms_list[i]->CommitTransaction() != 0)
+            status = -1;
+    return status;
+}
+
 int LMS7_Device:: ReadFPGAReg(uint16_t address) const
 {
     return fpga ? fpga->ReadRegister(address): 0;
@@ -1848,7 +2105,22 @@ lime::StreamChannel* LMS7_Device::SetupStream(const lime::StreamConfig &config)
         return nullptr;
     if (!connection)
         return nullptr;
-    return mStreamers[config.channelID/2]->SetupStream(config);
+    const uint64_t cpuMask = (config.isTx ? tx_channels : rx_channels)[config.channelID].streamCPUs;
+    if (cpuMask == 0 || !config.threadCPUs.empty())
+        return mStreamers[config.channelID/2]->SetupStream(config);
+    lime::StreamConfig pinned = config;
+    for (int i = 0; i < 64; ++i)
+        if (cpuMask & (uint64_t(1) << i))
+            pinned.threadCPUs.push_back(i);
+    return mStreamers[config.channelID/2]->SetupStream(pinned);
+}
+
+int LMS7_Device::SetStreamCPUs(bool tx, unsigned chan, uint64_t cpuMask)
+{
+    if (chan >= GetNumChannels())
+        return lime::ReportError(EINVAL, "Invalid channel number");
+    (tx ? tx_channels : rx_channels)[chan].streamCPUs = cpuMask;
+    return 0;
 }
 
 int LMS7_Device::DestroyStream(lime::StreamChannel* streamID)
@@ -11,6 +11,11 @@
 #include "lime/LimeSuite.h"
 #include <vector>
 #include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
 #include "Streamer.h"
 #include "IConnection.h"
 
@@ -46,6 +51,10 @@ public:
     virtual int SetFrequency(bool tx, unsigned chan, double f_Hz);
     double GetFrequency(bool tx, unsigned chan) const;
     virtual Range GetFrequencyRange(bool tx) const;
+    int CreateHopProfiles(bool tx, unsigned chan, const std::vector<double> &frequencies);
+    int Hop(bool tx, unsigned chan, unsigned index);
+    int HopAt(bool tx, unsigned chan, unsigned index, uint64_t timestamp);
+    double GetHopLatency(bool tx, unsigned chan) const;
     virtual Range GetRxPathBand(unsigned path, unsigned chan) const;
     virtual Range GetTxPathBand(unsigned path, unsigned chan) const;
     int SetLPF(bool tx, unsigned chan, bool en, double bandwidth=-1);
@@ -64,6 +73,7 @@ public:
     int SetNCOPhase(bool tx, unsigned ch, int ind, double phase);
     double GetNCOPhase(bool tx, unsigned ch, int ind) const;
     virtual int Calibrate(bool dir_tx, unsigned chan, double bw, unsigned flags);
+    int CalibrateChannels(bool dir_tx, const std::vector<unsigned> &chans, double bw, unsigned flags);
     virtual std::vector<std::string> GetProgramModes() const;
     virtual int Program(const std::string& mode, const char* data, size_t len, lime::IConnection::ProgrammingCallback callback) const;
     double GetClockFreq(unsigned clk_id, int channel = -1) const;
@@ -77,6 +87,8 @@ public:
     int SaveConfig(const char *filename, int ind = -1) const;
     int ReadLMSReg(uint16_t address, int ind = -1) const;
     int WriteLMSReg(uint16_t address, uint16_t val, int ind = -1) const;
+    void BeginTransaction();
+    int CommitTransaction();
     int ReadFPGAReg(uint16_t address) const;
     int WriteFPGAReg(uint16_t address, uint16_t val) const;
     uint16_t ReadParam(const struct LMS7Parameter& param, int channel = -1, bool forceReadFromChip = false) const;
@@ -91,6 +103,7 @@ public:
     int ConfigureGFIR(bool tx, unsigned ch, bool enabled, double bandwidth);
 
     lime::StreamChannel* SetupStream(const lime::StreamConfig &config);
+    int SetStreamCPUs(bool tx, unsigned chan, uint64_t cpuMask);
     int DestroyStream(lime::StreamChannel* streamID);
     uint64_t GetHardwareTimestamp(void) const;
     void SetHardwareTimestamp(const uint64_t now);
@@ -103,15 +116,34 @@ public:
 
 protected:
 
+    ///chip registers and channel frequencies of one hopping frequency
+    struct HopProfile
+    {
+        lime::LMS7002M::RegisterProfile registers;
+        double freq[2];
+        double cF_offset_nco[2];
+    };
     struct ChannelInfo
     {
     public:
-        ChannelInfo(): lpf_bw(0), gfir_bw(-1.0), cF_offset_nco(0), sample_rate(30e6), freq(-1.0){}
+        ChannelInfo(): lpf_bw(0), gfir_bw(-1.0), cF_offset_nco(0), sample_rate(30e6), freq(-1.0), hopTime(0), hopCount(0), streamCPUs(0){}
         double lpf_bw;
         double gfir_bw;
         double cF_offset_nco;
         double sample_rate;
         double freq;
+        std::vector<HopProfile> hops;
+        double hopTime;
+        unsigned hopCount;
+        uint64_t streamCPUs; ///<mask of CPUs for stream threads, 0 for any
+    };
+    ///hop waiting for stream timestamp
+    struct PendingHop
+    {
+        bool tx;
+        unsigned chan;
+        unsigned index;
+        double rate;
     };
     lms_dev_info_t devInfo;
     std::vector<ChannelInfo> tx_channels;
@@ -119,10 +151,19 @@ protected:
     lime::IConnection* connection;
     std::vector<lime::LMS7002M*> lms_list;
     lime::LMS7002M* SelectChannel(unsigned chan) const;
+    int ForEachChip(const std::function<int(unsigned)> &func);
     unsigned lms_chip_id;
     std::vector<lime::Streamer*> mStreamers;
     lime::FPGA* fpga;
     RFE_Device* limeRFE;
+    int ApplyHop(bool tx, unsigned chan, unsigned index);
+    void HopLoop();
+    mutable std::mutex hopApplyLock;
+    std::mutex hopLock;
+    std::condition_variable hopCond;
+    std::multimap<uint64_t, PendingHop> pendingHops;
+    std::thread hopThread;
+    bool hopStop;
 };
 
 }
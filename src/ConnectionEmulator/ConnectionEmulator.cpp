@@ -0,0 +1,875 @@
+/**
+    @file ConnectionEmulator.cpp
+    @author Lime Microsystems
+    @brief Software emulated board, speaks LMS64C and streams synthetic samples
+*/
+
+#include "ConnectionEmulator.h"
+#include "FPGA_common.h"
+#include "LMS64CCommands.h"
+#include "LMSBoards.h"
+#include "Logger.h"
+#include "LinkTrace.h"
+#include "mcu_programs.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+
+using namespace lime;
+
+extern std::vector<const LMS7Parameter*> LMS7parameterList;
+
+static const double cRefClk = 30.72e6;      //LMS7002M reference clock
+static const double cFX3RefClk = 100.6e6;   //clock used by FPGA to measure reference clock
+static const int cTransfersCount = 256;     //in flight transfer slots for each direction
+static const uint64_t cDeviceBufferPackets = 64; //packets held by board before overflow
+static const size_t cMaxTxBlocks = 4096;    //transmitted packets kept for loopback
+static const int cToneTableBits = 12;
+static const int cNoiseTableSize = 1 << 16;
+static const int cUnitsRaw = 0; //eADC_UNITS codes reported with analog values
+static const int cUnitsTemperature = 5;
+
+static const double cSXVCORanges[3][2] = { {3700e6, 5300e6}, {4900e6, 6850e6}, {6250e6, 7800e6} };
+static const double cCGENVCORange[2] = {1900e6, 2980e6};
+
+ConnectionEmulator::ConnectionEmulator(const std::string &options) :
+    signal(SIGNAL_TONE),
+    toneFreq(1e6),
+    amplitude(0.7),
+    noiseLevel(0.001),
+    fixedRate(0),
+    serial(1),
+    controlLatency(0),
+    calibrationTime(0.5),
+    replayPace(true),
+    replyHead(0),
+    replyCount(0),
+    dacValue(125),
+    streaming(false),
+    sampleRate(1e6),
+    mimo(false),
+    packed(true),
+    stopTimestamp(0),
+    rxNextTimestamp(0),
+    txPlayhead(0),
+    txPacketLost(false),
+    rxTransfers(cTransfersCount),
+    txTransfers(cTransfersCount),
+    rxNextHandle(0),
+    txNextHandle(0),
+    replayFlags(0),
+    replayNext(0),
+    replayConsumed(0)
+{
+    std::string args = options;
+    if (args.empty())
+    {
+        const char* env = getenv("LIME_EMULATOR");
+        if (env)
+            args = env;
+    }
+
+    std::stringstream ss(args);
+    std::string item;
+    while (std::getline(ss, item, ';'))
+    {
+        const size_t pos = item.find('=');
+        if (pos == std::string::npos)
+            continue;
+        const std::string key = item.substr(0, pos);
+        const std::string value = item.substr(pos + 1);
+        if (key == "signal")
+        {
+            if (value == "tone") signal = SIGNAL_TONE;
+            else if (value == "noise") signal = SIGNAL_NOISE;
+            else if (value == "loopback") signal = SIGNAL_LOOPBACK;
+            else lime::warning("Emulator: unknown signal type '%s'", value.c_str());
+        }
+        else if (key == "freq") toneFreq = strtod(value.c_str(), nullptr);
+        else if (key == "amplitude") amplitude = strtod(value.c_str(), nullptr);
+        else if (key == "noise") noiseLevel = strtod(value.c_str(), nullptr);
+        else if (key == "rate") fixedRate = strtod(value.c_str(), nullptr);
+        else if (key == "serial") serial = strtoull(value.c_str(), nullptr, 0);
+        else if (key == "latency") controlLatency = strtod(value.c_str(), nullptr) * 1e-6;
+        else if (key == "calibration") calibrationTime = strtod(value.c_str(), nullptr) * 1e-3;
+        else if (key == "chips") chips.resize(std::max(1, std::min(8, atoi(value.c_str()))));
+        else if (key == "replay") replayPath = value;
+        else if (key == "pace") replayPace = atoi(value.c_str()) != 0;
+        else lime::warning("Emulator: unknown option '%s'", key.c_str());
+    }
+
+    if (!replayPath.empty())
+        LoadReplay(replayPath);
+    if (chips.empty())
+        chips.resize(1);
+    for (auto &chip : chips)
+        ResetChip(chip);
+    fpgaRegisters.assign(0x10000, 0);
+    for (auto &t : rxTransfers)
+        t.used = false;
+    for (auto &t : txTransfers)
+        t.used = false;
+    SetControlWindow(cMaxPendingReplies);
+    lime::info("Emulator: %s signal, serial %llu, %d chip(s)",
+        signal == SIGNAL_TONE ? "tone" : signal == SIGNAL_NOISE ? "noise" : "loopback",
+        (unsigned long long)serial, int(chips.size()));
+}
+
+ConnectionEmulator::~ConnectionEmulator(void)
+{
+}
+
+bool ConnectionEmulator::IsOpen(void)
+{
+    return true;
+}
+
+int ConnectionEmulator::Write(const unsigned char *buffer, int length, int)
+{
+    std::lock_guard<std::mutex> lock(mControlLock);
+    if (length != ProtocolLMS64C::pktLength || replyCount == cMaxPendingReplies)
+        return -1;
+    const int slot = (replyHead + replyCount) % cMaxPendingReplies;
+    ProcessPacket(buffer, replyPackets[slot]);
+    replyReady[slot] = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(controlLatency));
+    ++replyCount;
+    return length;
+}
+
+int ConnectionEmulator::Read(unsigned char *buffer, int length, int)
+{
+    std::unique_lock<std::mutex> lock(mControlLock);
+    if (length != ProtocolLMS64C::pktLength || replyCount == 0)
+        return -1;
+    //only one reader, oldest reply stays in place while waiting
+    const Clock::time_point ready = replyReady[replyHead];
+    lock.unlock();
+    std::this_thread::sleep_until(ready);
+    lock.lock();
+    memcpy(buffer, replyPackets[replyHead], length);
+    replyHead = (replyHead + 1) % cMaxPendingReplies;
+    --replyCount;
+    return length;
+}
+
+/** @brief Executes one LMS64C control packet, the same way board firmware does
+    @param request 64 byte packet from host
+    @param reply 64 byte packet to be returned to host
+*/
+void ConnectionEmulator::ProcessPacket(const unsigned char* request, unsigned char* reply)
+{
+    const int cmd = request[0];
+    const int blockCount = request[2];
+    const unsigned periphID = request[3];
+    const unsigned char* data = &request[8];
+    unsigned char* out = &reply[8];
+
+    memset(reply, 0, ProtocolLMS64C::pktLength);
+    memcpy(reply, request, 8);
+    reply[1] = STATUS_COMPLETED_CMD;
+
+    const bool chipCommand = cmd == CMD_LMS7002_RST || cmd == CMD_LMS7002_WR || cmd == CMD_LMS7002_RD;
+    if (chipCommand && periphID >= chips.size())
+    {
+        reply[1] = STATUS_ERROR_CMD;
+        return;
+    }
+    Chip &chip = chips[chipCommand ? periphID : 0];
+
+    switch (cmd)
+    {
+    case CMD_GET_INFO:
+        out[0] = 4; //firmware
+        out[1] = chips.size() > 1 ? LMS_DEV_LIMESDR_QPCIE : LMS_DEV_LIMESDR;
+        out[2] = 1; //protocol
+        out[3] = 4; //hardware
+        out[4] = EXP_BOARD_NO;
+        for (int i = 0; i < 8; ++i)
+            out[10 + i] = (serial >> (56 - 8 * i)) & 0xFF;
+        break;
+    case CMD_LMS7002_RST:
+        if (data[0] == 1 || data[0] == 2)
+            ResetChip(chip);
+        break;
+    case CMD_LMS7002_WR:
+    case CMD_BRDSPI_WR:
+        for (int i = 0; i < blockCount && i < ProtocolLMS64C::maxDataLength / 4; ++i)
+        {
+            const uint16_t addr = (data[4 * i] << 8) | data[4 * i + 1];
+            const uint16_t value = (data[4 * i + 2] << 8) | data[4 * i + 3];
+            if (cmd == CMD_LMS7002_WR)
+                WriteChipRegister(chip, addr, value);
+            else
+                WriteFPGARegister(addr, value);
+        }
+        break;
+    case CMD_LMS7002_RD:
+    case CMD_BRDSPI_RD:
+        for (int i = 0; i < blockCount && i < ProtocolLMS64C::maxDataLength / 4; ++i)
+        {
+            const uint16_t addr = (data[2 * i] << 8) | data[2 * i + 1];
+            const uint16_t value = cmd == CMD_LMS7002_RD ? ReadChipRegister(chip, addr) : ReadFPGARegister(addr);
+            out[4 * i] = addr >> 8;
+            out[4 * i + 1] = addr & 0xFF;
+            out[4 * i + 2] = value >> 8;
+            out[4 * i + 3] = value & 0xFF;
+        }
+        break;
+    case CMD_ANALOG_VAL_RD:
+        for (int i = 0; i < blockCount && i < ProtocolLMS64C::maxDataLength / 4; ++i)
+        {
+            int16_t value = 0;
+            int units = cUnitsRaw;
+            if (data[i] == 0)
+                value = dacValue;
+            else if (data[i] == 1)
+            {
+                value = 250; //25.0 C
+                units = cUnitsTemperature;
+            }
+            out[4 * i] = data[i];
+            out[4 * i + 1] = units << 4;
+            out[4 * i + 2] = (value >> 8) & 0xFF;
+            out[4 * i + 3] = value & 0xFF;
+        }
+        break;
+    case CMD_ANALOG_VAL_WR:
+        for (int i = 0; i < blockCount && i < ProtocolLMS64C::maxDataLength / 4; ++i)
+            if (data[4 * i] == 0)
+                dacValue = (data[4 * i + 2] << 8) | data[4 * i + 3];
+        break;
+    case CMD_PROG_MCU:
+        if (periphID < chips.size())
+            chips[periphID].mcuProgramID = MCU_ID_CALIBRATIONS_SINGLE_IMAGE;
+        break;
+    case CMD_GPIO_DIR_WR:
+    case CMD_GPIO_DIR_RD:
+    case CMD_GPIO_WR:
+    case CMD_GPIO_RD:
+    case CMD_SI5351_WR:
+    case CMD_ADF4002_WR:
+    case CMD_USB_FIFO_RST:
+    case CMD_MEMORY_WR:
+    case CMD_ALTERA_FPGA_GW_WR:
+        break; //accepted, nothing to emulate
+    default:
+        reply[1] = STATUS_UNKNOWN_CMD;
+        break;
+    }
+}
+
+void ConnectionEmulator::ResetChip(Chip &chip)
+{
+    chip.registers[0].assign(0x8000, 0);
+    for (const LMS7Parameter* param : LMS7parameterList)
+        chip.registers[0][param->address] |= param->defaultValue << param->lsb;
+    chip.registers[1] = chip.registers[0];
+    chip.registers[0][0x002F] = chip.registers[1][0x002F] = 0x3841; //VER 7, REV 1, MASK 1
+    memset(chip.analogDC, 0, sizeof(chip.analogDC));
+    chip.mcuProgramID = 0;
+    chip.mcuStatus = 0;
+    chip.mcuDone = Clock::now();
+}
+
+void ConnectionEmulator::WriteChipRegister(Chip &chip, uint16_t addr, uint16_t value)
+{
+    addr &= 0x7FFF;
+    if (addr == 0x002F)
+        return; //read only chip id
+    if (addr == 0x0002)
+    {
+        const uint16_t previous = chip.registers[0][addr];
+        chip.registers[0][addr] = value;
+        if ((value & 0x3) && !(previous & 0x3))
+            chip.mcuProgramID = MCU_ID_CALIBRATIONS_SINGLE_IMAGE; //program upload through SPI
+        if ((value & 0x08) && !(previous & 0x08))
+            RunMCUProcedure(chip, chip.registers[0][0x0000] & 0xFF);
+        return;
+    }
+    if (addr >= 0x05C3 && addr <= 0x05CA && (value & 0x8000))
+        chip.analogDC[addr - 0x05C3] = value & 0x07FF;
+    const int mac = chip.registers[0][0x0020] & 0x3;
+    if (addr < 0x0100 || (mac & 0x1))
+        chip.registers[0][addr] = value;
+    if (addr >= 0x0100 && (mac & 0x2))
+        chip.registers[1][addr] = value;
+}
+
+uint16_t ConnectionEmulator::ReadChipRegister(Chip &chip, uint16_t addr)
+{
+    addr &= 0x7FFF;
+    const int bank = (addr >= 0x0100 && (chip.registers[0][0x0020] & 0x3) == 0x2) ? 1 : 0;
+    uint16_t value = chip.registers[bank][addr];
+
+    switch (addr)
+    {
+    case 0x0001: //MCU procedure status, 0xFF while running
+        value = Clock::now() < chip.mcuDone ? 0xFF : chip.mcuStatus;
+        break;
+    case 0x0003: //MCU write buffer empty, programmed
+        value = 0x0041;
+        break;
+    case 0x05C3: case 0x05C4: case 0x05C5: case 0x05C6:
+    case 0x05C7: case 0x05C8: case 0x05C9: case 0x05CA:
+        value = (value & 0xF800) | chip.analogDC[addr - 0x05C3];
+        break;
+    case 0x0601: //internal ADC reference comparator, trips at mid bias
+        value = (value & ~0x0020) | (GetChipBits(chip, 0, LMS7param(RSSI_BIAS)) >= 16 ? 0x0020 : 0);
+        break;
+    case 0x0606: //Vtemp, Vptat of 25 C
+        value = 0x8075;
+        break;
+    case 0x008C: //CGEN VCO comparators
+    {
+        const double frac = ((chip.registers[0][0x0088] & 0xF) << 16) | chip.registers[0][0x0087];
+        const double fvco = cRefClk * (GetChipBits(chip, 0, LMS7param(INT_SDM_CGEN)) + 1 + frac / (1 << 20));
+        const int cmp = VCOComparators(fvco, GetChipBits(chip, 0, LMS7param(CSW_VCO_CGEN)), cCGENVCORange[0], cCGENVCORange[1]);
+        value = (value & ~0x3000) | (cmp << 12);
+        break;
+    }
+    case 0x0123: //SX VCO comparators
+    {
+        const double frac = ((chip.registers[bank][0x011E] & 0xF) << 16) | chip.registers[bank][0x011D];
+        const double fvco = cRefClk * (1 + GetChipBits(chip, bank, LMS7param(EN_DIV2_DIVPROG)))
+            * (GetChipBits(chip, bank, LMS7param(INT_SDM)) + 4 + frac / (1 << 20));
+        const int sel = std::min<int>(GetChipBits(chip, bank, LMS7param(SEL_VCO)), 2);
+        const int cmp = VCOComparators(fvco, GetChipBits(chip, bank, LMS7param(CSW_VCO)), cSXVCORanges[sel][0], cSXVCORanges[sel][1]);
+        value = (value & ~0x3000) | (cmp << 12);
+        break;
+    }
+    case 0x040E: //RSSI, follows TBB frontend gain
+    case 0x040F:
+    {
+        const uint32_t rssi = std::min<uint32_t>(0x3FFFF, GetChipBits(chip, bank, LMS7param(CG_IAMP_TBB)) * 2048);
+        value = addr == 0x040F ? (rssi >> 2) & 0xFFFF : (value & ~0x3) | (rssi & 0x3);
+        break;
+    }
+    default:
+        break;
+    }
+    return value;
+}
+
+uint16_t ConnectionEmulator::GetChipBits(const Chip &chip, int bank, const LMS7Parameter &param) const
+{
+    if (param.address < 0x0100)
+        bank = 0;
+    const uint16_t mask = (1 << (param.msb - param.lsb + 1)) - 1;
+    return (chip.registers[bank][param.address] >> param.lsb) & mask;
+}
+
+/** @brief Models VCO comparators, CSW value setting VCO to target frequency is linear in VCO range
+    @return comparators value: 0 - CSW too low, 2 - locked, 3 - CSW too high
+*/
+int ConnectionEmulator::VCOComparators(double vcoFreq, int csw, double minFreq, double maxFreq) const
+{
+    const double target = 255 * (vcoFreq - minFreq) / (maxFreq - minFreq);
+    if (csw < target - 3)
+        return csw == 255 ? 2 : 0;
+    if (csw > target + 3)
+        return csw == 0 ? 2 : 3;
+    return 2;
+}
+
+/** @brief Starts MCU procedure, calibrations write corrections of channel
+    selected by MAC, values depend on SX integer divider
+*/
+void ConnectionEmulator::RunMCUProcedure(Chip &chip, uint8_t id)
+{
+    const int mac = chip.registers[0][0x0020] & 0x3;
+    const int bank = mac == 2 ? 1 : 0;
+    chip.mcuStatus = 0;
+    chip.mcuDone = Clock::now();
+    switch (id)
+    {
+    case MCU_FUNCTION_GET_PROGRAM_ID:
+        chip.mcuStatus = chip.mcuProgramID;
+        break;
+    case MCU_FUNCTION_CALIBRATE_TX:
+    case MCU_FUNCTION_CALIBRATE_TX_EXTLOOPB:
+    case MCU_FUNCTION_CALIBRATE_RX:
+    case MCU_FUNCTION_CALIBRATE_RX_EXTLOOPB:
+    {
+        if (chip.mcuProgramID != MCU_ID_CALIBRATIONS_SINGLE_IMAGE || (mac != 1 && mac != 2))
+        {
+            chip.mcuStatus = 1;
+            break;
+        }
+        const bool tx = id == MCU_FUNCTION_CALIBRATE_TX || id == MCU_FUNCTION_CALIBRATE_TX_EXTLOOPB;
+        const int sx = GetChipBits(chip, tx ? 1 : 0, LMS7param(INT_SDM)) & 0x3F;
+        const uint16_t tsp = tx ? 0x0200 : 0x0400;
+        chip.registers[bank][tsp + 0x01] = 2047 - sx; //GCORRQ
+        chip.registers[bank][tsp + 0x02] = 2047;      //GCORRI
+        chip.registers[bank][tsp + 0x03] = (sx * 3) & 0x0FFF; //IQCORR
+        if (tx)
+            chip.registers[bank][0x0204] = (sx << 8) | (0x100 - sx) % 0x100; //DCCORRI, DCCORRQ
+        const int dc = (tx ? 0 : 4) + bank * 2;
+        chip.analogDC[dc] = sx;
+        chip.analogDC[dc + 1] = (tx ? 0x400 : 0x40) | (sx / 2);
+        chip.mcuDone += std::chrono::microseconds(int64_t(calibrationTime * 1e6));
+        break;
+    }
+    default:
+        break; //parameters, filter tuning
+    }
+}
+
+//! Mirrors LMS7002M::GetSampleRate() for receiver of channel A of the first chip
+double ConnectionEmulator::GetChipSampleRate() const
+{
+    const Chip &chip = chips[0];
+    const double frac = ((chip.registers[0][0x0088] & 0xF) << 16) | chip.registers[0][0x0087];
+    const double fvco = cRefClk * (GetChipBits(chip, 0, LMS7param(INT_SDM_CGEN)) + 1 + frac / (1 << 20));
+    const double cgen = fvco / 2 / (GetChipBits(chip, 0, LMS7param(DIV_OUTCH_CGEN)) + 1);
+    double tsp = cgen / 4;
+    if (GetChipBits(chip, 0, LMS7param(EN_ADCCLKH_CLKGN)) != 0)
+        tsp = cgen / (1 << GetChipBits(chip, 0, LMS7param(CLKH_OV_CLKL_CGEN))) / 4;
+    const int ratio = GetChipBits(chip, 0, LMS7param(HBD_OVR_RXTSP));
+    if (ratio != 7)
+        tsp /= (1 << ratio);
+    return tsp / 2;
+}
+
+void ConnectionEmulator::WriteFPGARegister(uint16_t addr, uint16_t value)
+{
+    const uint16_t previous = fpgaRegisters[addr];
+    fpgaRegisters[addr] = value;
+
+    if (addr == 0x0009)
+    {
+        std::lock_guard<std::mutex> lock(mStreamLock);
+        if ((value & 0x1) && !(previous & 0x1))
+            stopTimestamp = 0; //SMPL_NR_CLR
+        if (value & 0x2)
+            txPacketLost = false; //TXPCT_LOSS_CLR
+    }
+    else if (addr == 0x000A && ((value ^ previous) & 0x1))
+    {
+        std::lock_guard<std::mutex> lock(mStreamLock);
+        if (value & 0x1)
+            StartStreaming();
+        else
+            StopStreaming();
+    }
+}
+
+uint16_t ConnectionEmulator::ReadFPGARegister(uint16_t addr)
+{
+    //reference clock measured against FX3 clock
+    const uint32_t refClkCount = cRefClk * 16777210 / cFX3RefClk;
+    switch (addr)
+    {
+    case 0x0000: return chips.size() > 1 ? LMS_DEV_LIMESDR_QPCIE : LMS_DEV_LIMESDR;
+    case 0x0001: return 2;  //gateware version
+    case 0x0002: return 8;  //gateware revision
+    case 0x0003: return 4;  //hardware version
+    case 0x0021: return 0x0005; //PLL configuration and phase search done
+    case 0x0065: return 0x0004; //reference clock test done
+    case 0x0072: return refClkCount & 0xFFFF;
+    case 0x0073: return refClkCount >> 16;
+    default: return fpgaRegisters[addr];
+    }
+}
+
+void ConnectionEmulator::StartStreaming()
+{
+    sampleRate = fixedRate > 0 ? fixedRate : GetChipSampleRate();
+    if (!(sampleRate >= 1e3 && sampleRate <= 200e6))
+    {
+        lime::warning("Emulator: chip sample rate is invalid, using 1 MS/s");
+        sampleRate = 1e6;
+    }
+    mimo = (fpgaRegisters[0x0007] & 0x3) == 0x3;
+    packed = (fpgaRegisters[0x0008] & 0x3) == 0x2;
+
+    //device counter continues from where it stopped, unless it was cleared
+    startTime = Clock::now() - std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(stopTimestamp / sampleRate));
+    rxNextTimestamp = stopTimestamp;
+    txPlayhead = stopTimestamp;
+    txBlocks.clear();
+
+    const int fullScale = packed ? 2047 : 32767;
+    toneTable.resize(1 << cToneTableBits);
+    for (size_t i = 0; i < toneTable.size(); ++i)
+    {
+        const double phase = 2 * M_PI * i / toneTable.size();
+        toneTable[i].i = lround(amplitude * fullScale * cos(phase));
+        toneTable[i].q = lround(amplitude * fullScale * sin(phase));
+    }
+    const double noiseRms = (signal == SIGNAL_NOISE ? amplitude / 3 : noiseLevel) * fullScale;
+    std::normal_distribution<double> gauss(0, noiseRms);
+    noiseTable.resize(cNoiseTableSize);
+    for (auto &s : noiseTable)
+    {
+        s.i = std::max(-fullScale, std::min(fullScale, (int)lround(gauss(rng))));
+        s.q = std::max(-fullScale, std::min(fullScale, (int)lround(gauss(rng))));
+    }
+    if (!replayRecords.empty())
+    {
+        replayNext = 0;
+        replayConsumed = 0;
+        replayStart = Clock::now();
+        if (packed != bool(replayFlags & LinkTraceHeader::PACKED) || mimo != bool(replayFlags & LinkTraceHeader::MIMO))
+            lime::warning("Emulator: trace was recorded with %s %s link, stream is configured for %s %s",
+                replayFlags & LinkTraceHeader::MIMO ? "MIMO" : "SISO", replayFlags & LinkTraceHeader::PACKED ? "12 bit" : "16 bit",
+                mimo ? "MIMO" : "SISO", packed ? "12 bit" : "16 bit");
+    }
+    streaming = true;
+    lime::debug("Emulator: streaming %g MS/s, %s, %s", sampleRate / 1e6,
+        mimo ? "MIMO" : "SISO", packed ? "12 bit" : "16 bit");
+}
+
+void ConnectionEmulator::StopStreaming()
+{
+    stopTimestamp = DeviceTime(Clock::now());
+    streaming = false;
+}
+
+uint64_t ConnectionEmulator::DeviceTime(Clock::time_point t) const
+{
+    if (t <= startTime)
+        return 0;
+    return std::chrono::duration<double>(t - startTime).count() * sampleRate;
+}
+
+ConnectionEmulator::Clock::time_point ConnectionEmulator::TimeOfSample(uint64_t sample) const
+{
+    return startTime + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(sample / sampleRate));
+}
+
+/** @brief Produces received samples for given device time
+    @param timestamp first sample counter value
+    @param count number of samples for each channel
+    @param dest destination buffers for each channel
+*/
+void ConnectionEmulator::GenerateSamples(uint64_t timestamp, int count, complex16_t* const* dest)
+{
+    const int chCount = mimo ? 2 : 1;
+    const int fullScale = packed ? 2047 : 32767;
+
+    if (signal == SIGNAL_LOOPBACK)
+    {
+        //transmitted packets are already in time order, drop the ones in the past
+        while (!txBlocks.empty() && txBlocks.front().timestamp + txBlocks.front().samples[0].size() <= timestamp)
+            txBlocks.pop_front();
+        for (int ch = 0; ch < chCount; ++ch)
+            memset(dest[ch], 0, count * sizeof(complex16_t));
+        for (const auto &block : txBlocks)
+        {
+            if (block.timestamp >= timestamp + count)
+                break;
+            const uint64_t begin = std::max(block.timestamp, timestamp);
+            const uint64_t end = std::min<uint64_t>(block.timestamp + block.samples[0].size(), timestamp + count);
+            for (int ch = 0; ch < chCount; ++ch)
+            {
+                if (block.samples[ch].empty())
+                    continue;
+                memcpy(&dest[ch][begin - timestamp], &block.samples[ch][begin - block.timestamp],
+                    (end - begin) * sizeof(complex16_t));
+            }
+        }
+    }
+    else if (signal == SIGNAL_TONE)
+    {
+        //phase is derived from timestamp, so tone is continuous across dropped packets
+        const uint32_t step = (int64_t)llround(toneFreq / sampleRate * 4294967296.0);
+        for (int ch = 0; ch < chCount; ++ch)
+        {
+            uint32_t phase = (uint32_t)(timestamp * step);
+            for (int i = 0; i < count; ++i, phase += step)
+                dest[ch][i] = toneTable[phase >> (32 - cToneTableBits)];
+        }
+    }
+    else
+    {
+        for (int ch = 0; ch < chCount; ++ch)
+            memset(dest[ch], 0, count * sizeof(complex16_t));
+    }
+
+    if (signal == SIGNAL_LOOPBACK)
+        return;
+    for (int ch = 0; ch < chCount; ++ch)
+    {
+        const unsigned offset = rng();
+        for (int i = 0; i < count; ++i)
+        {
+            const complex16_t &n = noiseTable[(offset + i) & (cNoiseTableSize - 1)];
+            dest[ch][i].i = std::max(-fullScale - 1, std::min(fullScale, dest[ch][i].i + n.i));
+            dest[ch][i].q = std::max(-fullScale - 1, std::min(fullScale, dest[ch][i].q + n.q));
+        }
+    }
+}
+
+bool ConnectionEmulator::LoadReplay(const std::string &path)
+{
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file.good())
+    {
+        lime::error("Emulator: failed to open link trace %s", path.c_str());
+        return false;
+    }
+    //whole trace is kept in memory, so replay does not wait for disk
+    const size_t size = file.tellg();
+    file.seekg(0);
+    replayData.resize(size);
+    file.read(replayData.data(), size);
+    LinkTraceHeader header;
+    if (!file.good() || size < sizeof(header))
+    {
+        lime::error("Emulator: failed to read link trace %s", path.c_str());
+        return false;
+    }
+    memcpy(&header, replayData.data(), sizeof(header));
+    if (memcmp(header.magic, cLinkTraceMagic, sizeof(header.magic)) != 0 || header.version != cLinkTraceVersion)
+    {
+        lime::error("Emulator: %s is not a supported link trace", path.c_str());
+        return false;
+    }
+    replayFlags = header.flags;
+
+    uint64_t dropped = 0;
+    size_t offset = sizeof(header);
+    while (offset + sizeof(LinkTraceRecord) <= size)
+    {
+        LinkTraceRecord record;
+        memcpy(&record, &replayData[offset], sizeof(record));
+        offset += sizeof(record);
+        if (offset + record.length > size)
+        {
+            lime::warning("Emulator: link trace %s is truncated", path.c_str());
+            break;
+        }
+        ReplayRecord r;
+        r.offset = offset;
+        r.length = record.length;
+        r.time = record.time;
+        replayRecords.push_back(r);
+        dropped += record.dropped;
+        offset += record.length;
+    }
+    lime::info("Emulator: replaying %lu transfers (%.1f MB, %.3f s) from %s, %s",
+        (unsigned long)replayRecords.size(), size / 1e6,
+        replayRecords.empty() ? 0.0 : replayRecords.back().time * 1e-9, path.c_str(), replayPace ? "at recorded pace" : "as fast as possible");
+    if (dropped)
+        lime::warning("Emulator: %llu transfers are missing from trace", (unsigned long long)dropped);
+    return !replayRecords.empty();
+}
+
+//hands out next part of recorded transfer, records larger than requested transfer are split
+void ConnectionEmulator::BeginReplayReading(Transfer &t)
+{
+    const uint32_t requested = t.length / sizeof(FPGA_DataPacket) * sizeof(FPGA_DataPacket);
+    if (replayNext >= replayRecords.size() || requested == 0)
+    {
+        t.length = 0;
+        t.ready = Clock::time_point::max(); //trace has ended
+        return;
+    }
+    const ReplayRecord &record = replayRecords[replayNext];
+    t.replayOffset = record.offset + replayConsumed;
+    t.length = std::min(record.length - replayConsumed, requested);
+    t.ready = replayPace ? replayStart + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(record.time)) : Clock::now();
+    replayConsumed += t.length;
+    if (replayConsumed < record.length)
+        return;
+    replayConsumed = 0;
+    if (++replayNext == replayRecords.size())
+        lime::info("Emulator: end of link trace");
+}
+
+int ConnectionEmulator::ResetStreamBuffers()
+{
+    std::lock_guard<std::mutex> lock(mStreamLock);
+    txBlocks.clear();
+    for (auto &t : rxTransfers)
+        t.used = false;
+    for (auto &t : txTransfers)
+        t.used = false;
+    return 0;
+}
+
+int ConnectionEmulator::GetBuffersCount() const
+{
+    return 16;
+}
+
+int ConnectionEmulator::CheckStreamSize(int size) const
+{
+    return size;
+}
+
+int ConnectionEmulator::BeginDataReading(char*, uint32_t length, int)
+{
+    std::lock_guard<std::mutex> lock(mStreamLock);
+    const int handle = rxNextHandle++ % cTransfersCount;
+    Transfer &t = rxTransfers[handle];
+    t.used = true;
+    t.length = length;
+    t.timestamp = 0;
+    if (!streaming)
+    {
+        t.ready = Clock::time_point::max();
+        return handle;
+    }
+    if (!replayRecords.empty())
+    {
+        BeginReplayReading(t);
+        return handle;
+    }
+
+    const uint32_t samplesInPkt = (packed ? samples12InPkt : samples16InPkt) / (mimo ? 2 : 1);
+    const uint64_t packets = length / sizeof(FPGA_DataPacket);
+    //samples not collected in time are lost, board buffer is limited
+    const uint64_t produced = DeviceTime(Clock::now());
+    const uint64_t capacity = cDeviceBufferPackets * samplesInPkt;
+    if (produced > rxNextTimestamp + capacity)
+        rxNextTimestamp += (produced - rxNextTimestamp - capacity) / samplesInPkt * samplesInPkt;
+    t.timestamp = rxNextTimestamp;
+    rxNextTimestamp += packets * samplesInPkt;
+    t.ready = TimeOfSample(rxNextTimestamp);
+    return handle;
+}
+
+bool ConnectionEmulator::WaitForReading(int contextHandle, unsigned int timeout_ms)
+{
+    Clock::time_point ready;
+    {
+        std::lock_guard<std::mutex> lock(mStreamLock);
+        ready = rxTransfers[contextHandle].ready;
+    }
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    std::this_thread::sleep_until(std::min(ready, deadline));
+    return Clock::now() >= ready;
+}
+
+int ConnectionEmulator::FinishDataReading(char* buffer, uint32_t, int contextHandle)
+{
+    std::lock_guard<std::mutex> lock(mStreamLock);
+    Transfer &t = rxTransfers[contextHandle];
+    if (!t.used)
+        return 0;
+    t.used = false;
+    if (!streaming || Clock::now() < t.ready)
+        return 0;
+    if (!replayRecords.empty())
+    {
+        memcpy(buffer, &replayData[t.replayOffset], t.length);
+        return t.length;
+    }
+
+    const uint32_t samplesInPkt = (packed ? samples12InPkt : samples16InPkt) / (mimo ? 2 : 1);
+    const uint32_t packets = t.length / sizeof(FPGA_DataPacket);
+    for (auto &ch : rxSamples)
+        ch.resize(samplesInPkt);
+    complex16_t* const dest[2] = {rxSamples[0].data(), rxSamples[1].data()};
+
+    FPGA_DataPacket* pkt = reinterpret_cast<FPGA_DataPacket*>(buffer);
+    for (uint32_t i = 0; i < packets; ++i)
+    {
+        const uint64_t timestamp = t.timestamp + i * samplesInPkt;
+        GenerateSamples(timestamp, samplesInPkt, dest);
+        memset(pkt[i].reserved, 0, sizeof(pkt[i].reserved));
+        if (txPacketLost)
+        {
+            pkt[i].reserved[0] |= 1 << 3;
+            txPacketLost = false;
+        }
+        pkt[i].counter = timestamp;
+        FPGA::Samples2FPGAPacketPayload(dest, samplesInPkt, mimo, packed, pkt[i].data);
+    }
+    return packets * sizeof(FPGA_DataPacket);
+}
+
+void ConnectionEmulator::AbortReading(int)
+{
+    std::lock_guard<std::mutex> lock(mStreamLock);
+    for (auto &t : rxTransfers)
+        t.used = false;
+}
+
+int ConnectionEmulator::BeginDataSending(const char* buffer, uint32_t length, int)
+{
+    std::lock_guard<std::mutex> lock(mStreamLock);
+    const int handle = txNextHandle++ % cTransfersCount;
+    Transfer &t = txTransfers[handle];
+    t.used = true;
+    t.length = length;
+    t.timestamp = 0;
+    t.ready = Clock::now();
+    if (!streaming)
+        return handle; //data is discarded, as by board without stream enabled
+
+    const int chCount = mimo ? 2 : 1;
+    const uint64_t now = DeviceTime(Clock::now());
+    //packets are back to back, burst end packet can be shorter than full size
+    const uint32_t headerSize = sizeof(FPGA_DataPacket) - sizeof(FPGA_DataPacket::data);
+    for (uint32_t offset = 0; offset + headerSize < length; )
+    {
+        const FPGA_DataPacket* pkt = reinterpret_cast<const FPGA_DataPacket*>(buffer + offset);
+        const int payloadSize = std::min<int>(pkt->reserved[1] | (pkt->reserved[2] << 8), sizeof(FPGA_DataPacket::data));
+        offset += headerSize + payloadSize;
+        const bool ignoreTimestamp = pkt->reserved[0] & (1 << 4);
+        const int count = payloadSize / (packed ? 3 : 4) / chCount;
+        const uint64_t timestamp = ignoreTimestamp ? std::max(txPlayhead, now) : pkt->counter;
+        if (!ignoreTimestamp && timestamp + count <= now)
+        {
+            txPacketLost = true; //arrived too late to be transmitted
+            continue;
+        }
+        txPlayhead = std::max(txPlayhead, timestamp + count);
+        if (signal != SIGNAL_LOOPBACK)
+            continue;
+
+        TxBlock block;
+        block.timestamp = timestamp;
+        for (int ch = 0; ch < chCount; ++ch)
+            block.samples[ch].resize(count);
+        complex16_t* dest[2] = {block.samples[0].data(), block.samples[1].data()};
+        FPGA::FPGAPacketPayload2Samples(pkt->data, payloadSize, mimo, packed, dest);
+        txBlocks.push_back(std::move(block));
+        if (txBlocks.size() > cMaxTxBlocks)
+            txBlocks.pop_front();
+    }
+    //board accepts data while it fits into its buffer
+    const uint32_t samplesInPkt = (packed ? samples12InPkt : samples16InPkt) / chCount;
+    const uint64_t capacity = cDeviceBufferPackets * samplesInPkt;
+    if (txPlayhead > capacity)
+        t.ready = std::max(t.ready, TimeOfSample(txPlayhead - capacity));
+    return handle;
+}
+
+bool ConnectionEmulator::WaitForSending(int contextHandle, uint32_t timeout_ms)
+{
+    Clock::time_point ready;
+    {
+        std::lock_guard<std::mutex> lock(mStreamLock);
+        ready = txTransfers[contextHandle].ready;
+    }
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    std::this_thread::sleep_until(std::min(ready, deadline));
+    return Clock::now() >= ready;
+}
+
+int ConnectionEmulator::FinishDataSending(const char*, uint32_t, int contextHandle)
+{
+    std::lock_guard<std::mutex> lock(mStreamLock);
+    Transfer &t = txTransfers[contextHandle];
+    if (!t.used)
+        return 0;
+    t.used = false;
+    return t.length;
+}
+
+void ConnectionEmulator::AbortSending(int)
+{
+    std::lock_guard<std::mutex> lock(mStreamLock);
+    for (auto &t : txTransfers)
+        t.used = false;
+}
@@ -0,0 +1,198 @@
+/**
+    @file ConnectionEmulator.h
+    @author Lime Microsystems
+    @brief Software emulated board, speaks LMS64C and streams synthetic samples
+*/
+
+#pragma once
+#include <ConnectionRegistry.h>
+#include <LMS64CProtocol.h>
+#include "dataTypes.h"
+#include "LMS7002M_parameters.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <random>
+
+namespace lime{
+
+/*!
+ * Emulates LimeSDR-USB board without hardware.
+ * Control packets are processed in-process by models of LMS7002M
+ * and FPGA register files, VCO comparators and RSSI react to register
+ * configuration, so tuning and gain setup run as on real boards.
+ * MCU runs DC/IQ calibration procedures, which take configured time and
+ * write correction values derived from SX configuration.
+ * Stream data is generated at the sample rate configured in the chip.
+ *
+ * Options are given in handle address or LIME_EMULATOR environment
+ * variable as a semicolon separated list, e.g. "signal=tone;freq=1e6":
+ *  - signal: tone, noise or loopback (received samples repeat transmitted ones)
+ *  - freq: tone frequency offset in Hz (default 1e6)
+ *  - amplitude: tone amplitude, relative to full scale (default 0.7)
+ *  - noise: noise level added to signal, relative to full scale (default 0.001)
+ *  - rate: stream sample rate in Hz, 0 to follow chip configuration (default 0)
+ *  - serial: board serial number (default 1)
+ *  - latency: control packet round trip time in microseconds (default 0)
+ *  - calibration: duration of MCU Rx/Tx calibration in milliseconds (default 500)
+ *  - chips: number of LMS7002M chips, more than one emulates LimeSDR-QPCIe (default 1)
+ *  - replay: link trace recorded with LIME_LINK_TRACE, Rx transfers return its
+ *    packets unchanged instead of generated signal
+ *  - pace: 1 to complete replayed transfers at recorded times, 0 as fast as
+ *    they are requested (default 1)
+ */
+class ConnectionEmulator : public LMS64CProtocol
+{
+public:
+    ConnectionEmulator(const std::string &options);
+    ~ConnectionEmulator(void);
+
+    bool IsOpen(void) override;
+    eConnectionType GetType(void) override {return CONNECTION_UNDEFINED;}
+
+    int ResetStreamBuffers() override;
+    int GetBuffersCount() const override;
+    int CheckStreamSize(int size) const override;
+
+    int BeginDataReading(char* buffer, uint32_t length, int ep) override;
+    bool WaitForReading(int contextHandle, unsigned int timeout_ms) override;
+    int FinishDataReading(char* buffer, uint32_t length, int contextHandle) override;
+    void AbortReading(int ep) override;
+
+    int BeginDataSending(const char* buffer, uint32_t length, int ep) override;
+    bool WaitForSending(int contextHandle, uint32_t timeout_ms) override;
+    int FinishDataSending(const char* buffer, uint32_t length, int contextHandle) override;
+    void AbortSending(int ep) override;
+
+protected:
+    int Write(const unsigned char *buffer, int length, int timeout_ms = 100) override;
+    int Read(unsigned char *buffer, int length, int timeout_ms = 100) override;
+    bool CanPipeline(const int) const override {return true;}
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum SignalType
+    {
+        SIGNAL_TONE,
+        SIGNAL_NOISE,
+        SIGNAL_LOOPBACK,
+    };
+
+    struct Transfer
+    {
+        uint64_t timestamp; //first sample of transfer
+        size_t replayOffset; //trace data returned by replayed transfer
+        uint32_t length;
+        Clock::time_point ready;
+        bool used;
+    };
+
+    struct TxBlock
+    {
+        uint64_t timestamp;
+        std::vector<complex16_t> samples[2];
+    };
+
+    struct ReplayRecord
+    {
+        size_t offset; //data position in trace
+        uint32_t length;
+        uint64_t time; //nanoseconds since first record
+    };
+
+    struct Chip
+    {
+        std::vector<uint16_t> registers[2];
+        uint16_t analogDC[8]; //values latched by DCWR bits of 0x05C3-0x05CA
+        uint8_t mcuProgramID;
+        uint8_t mcuStatus;
+        Clock::time_point mcuDone;
+    };
+
+    void ProcessPacket(const unsigned char* request, unsigned char* reply);
+
+    //LMS7002M model
+    void ResetChip(Chip &chip);
+    void WriteChipRegister(Chip &chip, uint16_t addr, uint16_t value);
+    uint16_t ReadChipRegister(Chip &chip, uint16_t addr);
+    uint16_t GetChipBits(const Chip &chip, int bank, const LMS7Parameter &param) const;
+    int VCOComparators(double vcoFreq, int csw, double minFreq, double maxFreq) const;
+    void RunMCUProcedure(Chip &chip, uint8_t id);
+    double GetChipSampleRate() const;
+
+    //FPGA model
+    void WriteFPGARegister(uint16_t addr, uint16_t value);
+    uint16_t ReadFPGARegister(uint16_t addr);
+
+    //stream model, called with mStreamLock held
+    void StartStreaming();
+    void StopStreaming();
+    uint64_t DeviceTime(Clock::time_point t) const;
+    Clock::time_point TimeOfSample(uint64_t sample) const;
+    void GenerateSamples(uint64_t timestamp, int count, complex16_t* const* dest);
+    bool LoadReplay(const std::string &path);
+    void BeginReplayReading(Transfer &t);
+
+    //options
+    SignalType signal;
+    double toneFreq;
+    double amplitude;
+    double noiseLevel;
+    double fixedRate;
+    uint64_t serial;
+    double controlLatency;
+    double calibrationTime;
+    std::string replayPath;
+    bool replayPace;
+
+    std::mutex mControlLock; //guards board model and replies, Write and Read may be called by different threads
+    std::vector<Chip> chips;
+    std::vector<uint16_t> fpgaRegisters;
+    static const int cMaxPendingReplies = 64;
+    unsigned char replyPackets[cMaxPendingReplies][ProtocolLMS64C::pktLength];
+    Clock::time_point replyReady[cMaxPendingReplies];
+    int replyHead; //oldest reply not read yet
+    int replyCount;
+    int16_t dacValue;
+
+    std::mutex mStreamLock;
+    bool streaming;
+    double sampleRate;
+    bool mimo;
+    bool packed;
+    Clock::time_point startTime;
+    uint64_t stopTimestamp;
+    uint64_t rxNextTimestamp;
+    uint64_t txPlayhead;
+    bool txPacketLost;
+    std::vector<Transfer> rxTransfers;
+    std::vector<Transfer> txTransfers;
+    unsigned rxNextHandle;
+    unsigned txNextHandle;
+    std::deque<TxBlock> txBlocks;
+    std::vector<complex16_t> toneTable;
+    std::vector<complex16_t> noiseTable;
+    std::vector<complex16_t> rxSamples[2];
+    std::minstd_rand rng;
+
+    //link trace replay
+    std::vector<char> replayData;
+    std::vector<ReplayRecord> replayRecords;
+    uint32_t replayFlags;
+    size_t replayNext; //record to be returned next
+    uint32_t replayConsumed; //bytes of next record already returned
+    Clock::time_point replayStart;
+};
+
+class ConnectionEmulatorEntry : public ConnectionRegistryEntry
+{
+public:
+    ConnectionEmulatorEntry(void);
+    std::vector<ConnectionHandle> enumerate(const ConnectionHandle &hint);
+    IConnection *make(const ConnectionHandle &handle);
+};
+
+}
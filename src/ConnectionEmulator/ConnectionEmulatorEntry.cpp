@@ -0,0 +1,41 @@
+/**
+    @file ConnectionEmulatorEntry.cpp
+    @author Lime Microsystems
+    @brief Registry entry of software emulated board
+*/
+
+#include "ConnectionEmulator.h"
+
+using namespace lime;
+
+//! make a static-initialized entry in the registry
+void __loadConnectionEmulatorEntry(void) //TODO fixme replace with LoadLibrary/dlopen
+{
+    static ConnectionEmulatorEntry emulatorEntry;
+}
+
+ConnectionEmulatorEntry::ConnectionEmulatorEntry(void):
+    ConnectionRegistryEntry("Z_Emulator") //Z to appear after real boards
+{
+    return;
+}
+
+std::vector<ConnectionHandle> ConnectionEmulatorEntry::enumerate(const ConnectionHandle &hint)
+{
+    std::vector<ConnectionHandle> result;
+    if (!hint.media.empty() && hint.media != "emulator")
+        return result;
+
+    ConnectionHandle handle;
+    handle.media = "emulator";
+    handle.name = "Emulator";
+    handle.addr = hint.addr;
+    result.push_back(handle);
+
+    return result;
+}
+
+IConnection *ConnectionEmulatorEntry::make(const ConnectionHandle &handle)
+{
+    return new ConnectionEmulator(handle.addr);
+}
@@ -11,6 +11,7 @@
 
 #include <thread>
 #include <chrono>
+#include <cstdlib>
 #include <FPGA_common.h>
 #include <ciso646>
 #include "Logger.h"
@@ -22,16 +23,31 @@ const int ConnectionFT601::streamWrEp = 0x03;
 const int ConnectionFT601::streamRdEp = 0x83;
 const int ConnectionFT601::ctrlWrEp = 0x02;
 const int ConnectionFT601::ctrlRdEp = 0x82;
+//stream transfers in flight for each direction, unless set by LIME_USB_TRANSFERS
+static const int cDefaultTransferCount = 16;
+
+//power of two number of stream transfers kept in flight
+static int GetTransferCount(int maxCount)
+{
+    const char* value = std::getenv("LIME_USB_TRANSFERS");
+    const int requested = value ? std::atoi(value) : cDefaultTransferCount;
+    int count = 2;
+    while (count * 2 <= requested && count * 2 <= maxCount)
+        count *= 2;
+    return count;
+}
 
 ConnectionFT601::ConnectionFT601(void *arg)
 {
     isConnected = false;
+    mTransferCount = GetTransferCount(USB_MAX_CONTEXTS);
 #ifndef __unix__
     mFTHandle = NULL;
 #else
     dev_handle = 0;
     mUsbCounter = 0;
     ctx = (libusb_context *)arg;
+    InitTransferContexts();
 #endif
 }
 
@@ -43,6 +59,7 @@ ConnectionFT601::ConnectionFT601(void *arg, const ConnectionHandle &handle)
     int pid = -1;
     int vid = -1;
     mSerial = std::strtoll(handle.serial.c_str(),nullptr,16);
+    mTransferCount = GetTransferCount(USB_MAX_CONTEXTS);
 #ifndef __unix__
     mFTHandle = NULL;
 #else
@@ -53,6 +70,7 @@ ConnectionFT601::ConnectionFT601(void *arg, const ConnectionHandle &handle)
     dev_handle = 0;
     mUsbCounter = 0;
     ctx = (libusb_context *)arg;
+    InitTransferContexts();
 #endif
     if (this->Open(handle.serial, vid, pid) != 0)
         lime::error("Failed to open device");
@@ -367,25 +385,13 @@ int ConnectionFT601::Read(unsigned char *buffer, const int length, int timeout_m
 static void callback_libusbtransfer(libusb_transfer *trans)
 {
     ConnectionFT601::USBTransferContext *context = reinterpret_cast<ConnectionFT601::USBTransferContext*>(trans->user_data);
-    std::unique_lock<std::mutex> lck(context->transferLock);
     switch(trans->status)
     {
-        case LIBUSB_TRANSFER_CANCELLED:
-            context->bytesXfered = trans->actual_length;
-            context->done.store(true);
-            break;
-        case LIBUSB_TRANSFER_COMPLETED:
-            context->bytesXfered = trans->actual_length;
-            context->done.store(true);
-            break;
         case LIBUSB_TRANSFER_ERROR:
             lime::error("TRANSFER ERROR");
-            context->bytesXfered = trans->actual_length;
-            context->done.store(true);
             break;
         case LIBUSB_TRANSFER_TIMED_OUT:
             lime::error("USB transfer timed out");
-            context->done.store(true);
             break;
         case LIBUSB_TRANSFER_OVERFLOW:
             lime::error("transfer overflow\n");
@@ -396,15 +402,31 @@ static void callback_libusbtransfer(libusb_transfer *trans)
         case LIBUSB_TRANSFER_NO_DEVICE:
             lime::error("transfer no device");
             break;
+        default:
+            break;
+    }
+    context->bytesXfered = trans->actual_length;
+    //stream thread is woken only if it sleeps waiting for completion
+    context->completions->Push(context->index);
+}
+
+void ConnectionFT601::InitTransferContexts()
+{
+    mReadCompletions.Resize(mTransferCount);
+    mSendCompletions.Resize(mTransferCount);
+    for (int i = 0; i < USB_MAX_CONTEXTS; ++i)
+    {
+        contexts[i].completions = &mReadCompletions;
+        contexts[i].index = i;
+        contextsToSend[i].completions = &mSendCompletions;
+        contextsToSend[i].index = i;
     }
-    lck.unlock();
-    context->cv.notify_one();
 }
 #endif
 
 int ConnectionFT601::GetBuffersCount() const
 {
-    return USB_MAX_CONTEXTS;
+    return mTransferCount;
 }
 
 int ConnectionFT601::CheckStreamSize(int size)const
@@ -423,7 +445,7 @@ int ConnectionFT601::BeginDataReading(char *buffer, uint32_t length, int ep)
     int i = 0;
     bool contextFound = false;
     //find not used context
-    for(i = 0; i<USB_MAX_CONTEXTS; i++)
+    for(i = 0; i<mTransferCount; i++)
     {
         if(!contexts[i].used)
         {
@@ -452,8 +474,8 @@ int ConnectionFT601::BeginDataReading(char *buffer, uint32_t length, int ep)
 #else
     libusb_transfer *tr = contexts[i].transfer;
     libusb_fill_bulk_transfer(tr, dev_handle, streamRdEp, (unsigned char*)buffer, length, callback_libusbtransfer, &contexts[i], 0);
-    contexts[i].done = false;
     contexts[i].bytesXfered = 0;
+    mReadCompletions.Clear(i);
     int status = libusb_submit_transfer(tr);
     if(status != 0)
     {
@@ -481,8 +503,7 @@ bool ConnectionFT601::WaitForReading(int contextHandle, unsigned int timeout_ms)
                 return 1;
 #else
         //blocking not to waste CPU
-        std::unique_lock<std::mutex> lck(contexts[contextHandle].transferLock);
-        return contexts[contextHandle].cv.wait_for(lck, chrono::milliseconds(timeout_ms), [&](){return contexts[contextHandle].done.load();});
+        return mReadCompletions.Wait(contextHandle, timeout_ms);
 #endif
     }
     return true;  //there is nothing to wait for (signal wait finished)
@@ -527,7 +548,7 @@ void ConnectionFT601::AbortReading(int ep)
 {
 #ifndef __unix__
     FT_AbortPipe(mFTHandle, streamRdEp);
-    for (int i = 0; i < USB_MAX_CONTEXTS; ++i)
+    for (int i = 0; i < mTransferCount; ++i)
     {
         if (contexts[i].used == true)
         {
@@ -539,7 +560,7 @@ void ConnectionFT601::AbortReading(int ep)
     FT_SetStreamPipe(mFTHandle, FALSE, FALSE, streamRdEp, sizeof(FPGA_DataPacket));
 #else
 
-    for(int i = 0; i<USB_MAX_CONTEXTS; ++i)
+    for(int i = 0; i<mTransferCount; ++i)
     {
         if(contexts[i].used)
 	{
@@ -549,7 +570,7 @@ void ConnectionFT601::AbortReading(int ep)
             	libusb_cancel_transfer(contexts[i].transfer);
 	}
     }
-    for(int i=0; i<USB_MAX_CONTEXTS; ++i)
+    for(int i=0; i<mTransferCount; ++i)
     {
         if(contexts[i].used)
         {
@@ -571,7 +592,7 @@ int ConnectionFT601::BeginDataSending(const char *buffer, uint32_t length, int e
     int i = 0;
     //find not used context
     bool contextFound = false;
-    for(i = 0; i<USB_MAX_CONTEXTS; i++)
+    for(i = 0; i<mTransferCount; i++)
     {
         if(!contextsToSend[i].used)
         {
@@ -596,8 +617,8 @@ int ConnectionFT601::BeginDataSending(const char *buffer, uint32_t length, int e
     }
 #else
     libusb_transfer *tr = contextsToSend[i].transfer;
-    contextsToSend[i].done = false;
     contextsToSend[i].bytesXfered = 0;
+    mSendCompletions.Clear(i);
     libusb_fill_bulk_transfer(tr, dev_handle, streamWrEp, (unsigned char*)buffer, length, callback_libusbtransfer, &contextsToSend[i], 0);
     int status = libusb_submit_transfer(tr);
     if(status != 0)
@@ -626,8 +647,7 @@ bool ConnectionFT601::WaitForSending(int contextHandle, unsigned int timeout_ms)
                 return 1;
 #else
         //blocking not to waste CPU
-        std::unique_lock<std::mutex> lck(contextsToSend[contextHandle].transferLock);
-        return contextsToSend[contextHandle].cv.wait_for(lck, chrono::milliseconds(timeout_ms), [&](){return contextsToSend[contextHandle].done.load();});
+        return mSendCompletions.Wait(contextHandle, timeout_ms);
 #endif
     }
     return true; //there is nothing to wait for (signal wait finished)
@@ -672,7 +692,7 @@ void ConnectionFT601::AbortSending(int ep)
 {
 #ifndef __unix__
     FT_AbortPipe(mFTHandle, streamWrEp);
-    for (int i = 0; i < USB_MAX_CONTEXTS; ++i)
+    for (int i = 0; i < mTransferCount; ++i)
     {
         if (contextsToSend[i].used == true)
         {
@@ -682,7 +702,7 @@ void ConnectionFT601::AbortSending(int ep)
     }
     FT_SetStreamPipe(mFTHandle, FALSE, FALSE, streamWrEp, sizeof(FPGA_DataPacket));
 #else
-    for(int i = 0; i<USB_MAX_CONTEXTS; ++i)
+    for(int i = 0; i<mTransferCount; ++i)
     {
         if(contextsToSend[i].used)
         {
@@ -692,7 +712,7 @@ void ConnectionFT601::AbortSending(int ep)
                 libusb_cancel_transfer(contextsToSend[i].transfer);
         }
     }
-    for (int i = 0; i<USB_MAX_CONTEXTS; ++i)
+    for (int i = 0; i<mTransferCount; ++i)
     {
         if(contextsToSend[i].used)
         {
@@ -703,6 +723,27 @@ void ConnectionFT601::AbortSending(int ep)
 #endif
 }
 
+/** @brief Allocates transfer buffers in memory mapped from usbfs
+    Kernel hands such buffers to USB controller directly instead of copying
+    transfer data, needs Linux 4.6 and libusb 1.0.21 or newer.
+*/
+void* ConnectionFT601::AllocateStreamBuffers(size_t size)
+{
+#if defined(__unix__) && defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+    if (dev_handle)
+        return libusb_dev_mem_alloc(dev_handle, size);
+#endif
+    return nullptr;
+}
+
+void ConnectionFT601::FreeStreamBuffers(void* buffer, size_t size)
+{
+#if defined(__unix__) && defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+    if (dev_handle)
+        libusb_dev_mem_free(dev_handle, static_cast<unsigned char*>(buffer), size);
+#endif
+}
+
 int ConnectionFT601::ResetStreamBuffers()
 {
 #ifndef __unix__
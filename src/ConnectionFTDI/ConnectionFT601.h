@@ -22,6 +22,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include "CompletionQueue.h"
 #endif
 
 namespace lime{
@@ -41,7 +42,8 @@ public:
 #else
             transfer = libusb_alloc_transfer(0);
             bytesXfered = 0;
-            done = 0;
+            completions = nullptr;
+            index = 0;
 #endif
         }
         ~USBTransferContext()
@@ -57,9 +59,8 @@ public:
 #else
         libusb_transfer* transfer;
         long bytesXfered;
-        std::atomic<bool> done;
-        std::mutex transferLock;
-        std::condition_variable cv;
+        CompletionQueue* completions; //receives index when transfer completes
+        unsigned index;
 #endif
     };
 
@@ -99,13 +100,16 @@ protected:
     void AbortSending(int ep) override;
     
     int ResetStreamBuffers() override;
+    void* AllocateStreamBuffers(size_t size) override;
+    void FreeStreamBuffers(void* buffer, size_t size) override;
 
     eConnectionType GetType(void) {return USB_PORT;}
     
-    static const int USB_MAX_CONTEXTS = 16; //maximum number of contexts for asynchronous transfers
+    static const int USB_MAX_CONTEXTS = 64; //maximum number of contexts for asynchronous transfers
 
     USBTransferContext contexts[USB_MAX_CONTEXTS];
     USBTransferContext contextsToSend[USB_MAX_CONTEXTS];
+    int mTransferCount; //contexts used for each direction
 
     bool isConnected;
 
@@ -119,9 +123,12 @@ protected:
 #else
     int FT_SetStreamPipe(unsigned char ep, size_t size);
     int FT_FlushPipe(unsigned char ep);
+    void InitTransferContexts();
     uint32_t mUsbCounter;
     libusb_device_handle *dev_handle; //a device handle
     libusb_context *ctx; //a libusb session
+    CompletionQueue mReadCompletions;
+    CompletionQueue mSendCompletions;
 #endif
     std::mutex mExtraUsbMutex;
     uint64_t mSerial;
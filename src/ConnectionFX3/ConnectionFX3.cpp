@@ -14,6 +14,7 @@
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <cstdlib>
 
 using namespace std;
 
@@ -29,6 +30,21 @@ using namespace lime;
 
 const uint8_t ConnectionFX3::ctrlBulkOutAddr = 0x0F;
 const uint8_t ConnectionFX3::ctrlBulkInAddr = 0x8F;
+//control packets sent ahead of replies on bulk endpoints, small to fit device buffering
+static const int cBulkCtrlWindow = 4;
+//stream transfers in flight for each direction, unless set by LIME_USB_TRANSFERS
+static const int cDefaultTransferCount = 16;
+
+//power of two number of stream transfers kept in flight
+static int GetTransferCount(int maxCount)
+{
+    const char* value = std::getenv("LIME_USB_TRANSFERS");
+    const int requested = value ? std::atoi(value) : cDefaultTransferCount;
+    int count = 2;
+    while (count * 2 <= requested && count * 2 <= maxCount)
+        count *= 2;
+    return count;
+}
 
 //control commands to be send via bulk port for boards v1.1 and earlier
 const std::set<uint8_t> ConnectionFX3::commandsToBulkCtrlHw1 =
@@ -54,8 +70,9 @@ const std::set<uint8_t> ConnectionFX3::commandsToBulkCtrlHw2 =
 ConnectionFX3::ConnectionFX3(void *arg, const std::string &vidpid, const std::string &serial, const unsigned index)
 {
     bulkCtrlAvailable = false;
-    bulkCtrlInProgress = false;
+    bulkCtrlPending = 0;
     isConnected = false;
+    mTransferCount = GetTransferCount(USB_MAX_CONTEXTS);
 #ifndef __unix__
     if(arg == nullptr)
         USBDevicePrimary = new CCyFX3Device();
@@ -71,6 +88,15 @@ ConnectionFX3::ConnectionFX3(void *arg, const std::string &vidpid, const std::st
 #else
     dev_handle = nullptr;
     ctx = (libusb_context *)arg;
+    mReadCompletions.Resize(mTransferCount);
+    mSendCompletions.Resize(mTransferCount);
+    for (int i = 0; i < USB_MAX_CONTEXTS; ++i)
+    {
+        contexts[i].completions = &mReadCompletions;
+        contexts[i].index = i;
+        contextsToSend[i].completions = &mSendCompletions;
+        contextsToSend[i].index = i;
+    }
 #endif
     if (this->Open(vidpid, serial, index) != 0)
         lime::error("Failed to open device");
@@ -81,6 +107,8 @@ ConnectionFX3::ConnectionFX3(void *arg, const std::string &vidpid, const std::st
 
     if (info.device == LMS_DEV_LIMESDR && info.hardware <= 1)
         commandsToBulkCtrl = commandsToBulkCtrlHw1;
+    if (bulkCtrlAvailable)
+        SetControlWindow(cBulkCtrlWindow);
 
     this->VersionCheck();
 
@@ -331,14 +359,13 @@ int ConnectionFX3::Write(const unsigned char *buffer, const int length, int time
     if(IsOpen() == false)
         return 0;
 
-    unsigned char* wbuffer = new unsigned char[length];
-    memcpy(wbuffer, buffer, length);
-    bulkCtrlInProgress = false;
+    //out transfers do not modify data
+    unsigned char* wbuffer = const_cast<unsigned char*>(buffer);
     #ifndef __unix__
     if(bulkCtrlAvailable
         && commandsToBulkCtrl.find(buffer[0]) != commandsToBulkCtrl.end())
     {
-        bulkCtrlInProgress = true;
+        ++bulkCtrlPending;
         OutCtrlBulkEndPt->XferData(wbuffer, len);
     }
     else if(OutCtrlEndPt3)
@@ -349,15 +376,15 @@ int ConnectionFX3::Write(const unsigned char *buffer, const int length, int time
     if(bulkCtrlAvailable
         && commandsToBulkCtrl.find(buffer[0]) != commandsToBulkCtrl.end())
     {
-        bulkCtrlInProgress = true;
         int actual = 0;
         libusb_bulk_transfer(dev_handle, ctrlBulkOutAddr, wbuffer, length, &actual, timeout_ms);
         len = actual;
+        if (actual == length)
+            ++bulkCtrlPending;
     }
     else
         len = libusb_control_transfer(dev_handle, LIBUSB_REQUEST_TYPE_VENDOR,CTR_W_REQCODE ,CTR_W_VALUE, CTR_W_INDEX, wbuffer, length, timeout_ms);
     #endif
-    delete[] wbuffer;
     return len;
 }
 
@@ -376,17 +403,17 @@ int ConnectionFX3::Read(unsigned char *buffer, const int length, int timeout_ms)
         return 0;
 
 #ifndef __unix__
-    if(bulkCtrlAvailable && bulkCtrlInProgress)
+    if(bulkCtrlAvailable && bulkCtrlPending > 0)
     {
         InCtrlBulkEndPt->XferData(buffer, len);
-        bulkCtrlInProgress = false;
+        --bulkCtrlPending;
     }
     else if(InCtrlEndPt3)
         InCtrlEndPt3->Read(buffer, len);
     else
         len = 0;
 #else
-    if(bulkCtrlAvailable && bulkCtrlInProgress)
+    if(bulkCtrlAvailable && bulkCtrlPending > 0)
     {
         int actual = 0;
         int r = libusb_bulk_transfer(dev_handle, ctrlBulkInAddr, buffer, len, &actual, timeout_ms);
@@ -395,7 +422,7 @@ int ConnectionFX3::Read(unsigned char *buffer, const int length, int timeout_ms)
             libusb_bulk_transfer(dev_handle, ctrlBulkInAddr, buffer, len, &actual, timeout_ms);
         }
         len = actual;
-        bulkCtrlInProgress = false;
+        --bulkCtrlPending;
     }
     else
         len = libusb_control_transfer(dev_handle, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_IN ,CTR_R_REQCODE ,CTR_R_VALUE, CTR_R_INDEX, buffer, len, timeout_ms);
@@ -403,31 +430,21 @@ int ConnectionFX3::Read(unsigned char *buffer, const int length, int timeout_ms)
     return len;
 }
 
+bool ConnectionFX3::CanPipeline(const int cmd) const
+{
+    return bulkCtrlAvailable && commandsToBulkCtrl.find(cmd) != commandsToBulkCtrl.end();
+}
+
 #ifdef __unix__
 /**	@brief Function for handling libusb callbacks
 */
 void callback_libusbtransfer(libusb_transfer *trans)
 {
 	USBTransferContext *context = reinterpret_cast<USBTransferContext*>(trans->user_data);
-	std::unique_lock<std::mutex> lck(context->transferLock);
 	switch(trans->status)
 	{
-    case LIBUSB_TRANSFER_CANCELLED:
-        context->bytesXfered = trans->actual_length;
-        context->done.store(true);
-        break;
-    case LIBUSB_TRANSFER_COMPLETED:
-        context->bytesXfered = trans->actual_length;
-        context->done.store(true);
-        break;
     case LIBUSB_TRANSFER_ERROR:
         lime::error("USB TRANSFER ERROR");
-        context->bytesXfered = trans->actual_length;
-        context->done.store(true);
-        break;
-    case LIBUSB_TRANSFER_TIMED_OUT:
-        context->bytesXfered = trans->actual_length;
-        context->done.store(true);
         break;
     case LIBUSB_TRANSFER_OVERFLOW:
         lime::error("USB transfer overflow");
@@ -438,9 +455,12 @@ void callback_libusbtransfer(libusb_transfer *trans)
     case LIBUSB_TRANSFER_NO_DEVICE:
         lime::error("USB transfer no device");
         break;
+    default:
+        break;
 	}
-	lck.unlock();
-	context->cv.notify_one();
+	context->bytesXfered = trans->actual_length;
+	//stream thread is woken only if it sleeps waiting for completion
+	context->completions->Push(context->index);
 }
 #endif
 
@@ -457,7 +477,7 @@ int ConnectionFX3::BeginDataReading(char *buffer, uint32_t length, int ep)
     int i = 0;
 	bool contextFound = false;
 	//find not used context
-    for(i = 0; i<USB_MAX_CONTEXTS; i++)
+    for(i = 0; i<mTransferCount; i++)
     {
         if(!contexts[i].used)
         {
@@ -481,8 +501,8 @@ int ConnectionFX3::BeginDataReading(char *buffer, uint32_t length, int ep)
     #else
     libusb_transfer *tr = contexts[i].transfer;
     libusb_fill_bulk_transfer(tr, dev_handle, streamBulkInAddr, (unsigned char*)buffer, length, callback_libusbtransfer, &contexts[i], 0);
-    contexts[i].done = false;
     contexts[i].bytesXfered = 0;
+    mReadCompletions.Clear(i);
     int status = libusb_submit_transfer(tr);
     if(status != 0)
     {
@@ -510,8 +530,7 @@ bool ConnectionFX3::WaitForReading(int contextHandle, unsigned int timeout_ms)
 	return status;
     #else
     //blocking not to waste CPU
-    std::unique_lock<std::mutex> lck(contexts[contextHandle].transferLock);
-    return contexts[contextHandle].cv.wait_for(lck, chrono::milliseconds(timeout_ms), [&](){return contexts[contextHandle].done.load();});
+    return mReadCompletions.Wait(contextHandle, timeout_ms);
     #endif
     }
     return true;  //there is nothing to wait for (signal wait finished)
@@ -556,13 +575,13 @@ void ConnectionFX3::AbortReading(int ep)
         if (InEndPt[i] && InEndPt[i]->Address == 0x81)
 	        InEndPt[i]->Abort();
 #else
-    for(int i=0; i<USB_MAX_CONTEXTS; ++i)
+    for(int i=0; i<mTransferCount; ++i)
     {
         if(contexts[i].used && contexts[i].transfer->endpoint == 0x81)
             libusb_cancel_transfer( contexts[i].transfer );
     }
 #endif
-    for(int i=0; i<USB_MAX_CONTEXTS; ++i)
+    for(int i=0; i<mTransferCount; ++i)
     {
         if(contexts[i].used)
         {
@@ -585,7 +604,7 @@ int ConnectionFX3::BeginDataSending(const char *buffer, uint32_t length, int ep)
     int i = 0;
 	//find not used context
 	bool contextFound = false;
-    for(i = 0; i<USB_MAX_CONTEXTS; i++)
+    for(i = 0; i<mTransferCount; i++)
     {
         if(!contextsToSend[i].used)
         {
@@ -605,8 +624,8 @@ int ConnectionFX3::BeginDataSending(const char *buffer, uint32_t length, int ep)
 	return i;
     #else
     libusb_transfer *tr = contextsToSend[i].transfer;
-    contextsToSend[i].done = false;
     contextsToSend[i].bytesXfered = 0;
+    mSendCompletions.Clear(i);
     libusb_fill_bulk_transfer(tr, dev_handle, streamBulkOutAddr, (unsigned char*)buffer, length, callback_libusbtransfer, &contextsToSend[i], 0);
     int status = libusb_submit_transfer(tr);
     if(status != 0)
@@ -635,8 +654,7 @@ bool ConnectionFX3::WaitForSending(int contextHandle, unsigned int timeout_ms)
 	return status;
 #   else
     //blocking not to waste CPU
-    std::unique_lock<std::mutex> lck(contextsToSend[contextHandle].transferLock);
-    return contextsToSend[contextHandle].cv.wait_for(lck, chrono::milliseconds(timeout_ms), [&](){return contextsToSend[contextHandle].done.load();});
+    return mSendCompletions.Wait(contextHandle, timeout_ms);
 #   endif
     }
     return true;  //there is nothing to wait for (signal wait finished)
@@ -680,13 +698,13 @@ void ConnectionFX3::AbortSending(int ep)
         if (OutEndPt[i] && OutEndPt[i]->Address == 0x01)
             OutEndPt[i]->Abort();
 #else
-    for (int i = 0; i<USB_MAX_CONTEXTS; ++i)
+    for (int i = 0; i<mTransferCount; ++i)
     {
         if(contextsToSend[i].used && contextsToSend[i].transfer->endpoint == 0x01)
             libusb_cancel_transfer(contextsToSend[i].transfer);
     }
 #endif
-    for (int i = 0; i<USB_MAX_CONTEXTS; ++i)
+    for (int i = 0; i<mTransferCount; ++i)
     {
         if(contextsToSend[i].used)
         {
@@ -698,7 +716,7 @@ void ConnectionFX3::AbortSending(int ep)
 
 int ConnectionFX3::GetBuffersCount() const
 {
-    return USB_MAX_CONTEXTS;
+    return mTransferCount;
 }
 
 int ConnectionFX3::CheckStreamSize(int size)const
@@ -776,6 +794,27 @@ int ConnectionFX3::ProgramWrite(const char *buffer, const size_t length, const i
     return LMS64CProtocol::ProgramWrite(buffer,length,programmingMode,device,callback);
 }
 
+/** @brief Allocates transfer buffers in memory mapped from usbfs
+    Kernel hands such buffers to USB controller directly instead of copying
+    transfer data, needs Linux 4.6 and libusb 1.0.21 or newer.
+*/
+void* ConnectionFX3::AllocateStreamBuffers(size_t size)
+{
+#if defined(__unix__) && defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+    if (dev_handle)
+        return libusb_dev_mem_alloc(dev_handle, size);
+#endif
+    return nullptr;
+}
+
+void ConnectionFX3::FreeStreamBuffers(void* buffer, size_t size)
+{
+#if defined(__unix__) && defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+    if (dev_handle)
+        libusb_dev_mem_free(dev_handle, static_cast<unsigned char*>(buffer), size);
+#endif
+}
+
 int ConnectionFX3::ResetStreamBuffers()
 {
     //USB FIFO reset
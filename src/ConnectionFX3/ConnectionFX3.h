@@ -24,6 +24,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include "CompletionQueue.h"
 #endif
 
 namespace lime
@@ -45,7 +46,8 @@ public:
 #else
         transfer = libusb_alloc_transfer(0);
         bytesXfered = 0;
-        done = 0;
+        completions = nullptr;
+        index = 0;
 #endif
     }
     ~USBTransferContext()
@@ -76,9 +78,8 @@ public:
 #else
     libusb_transfer* transfer;
     long bytesXfered;
-    std::atomic<bool> done;
-    std::mutex transferLock;
-    std::condition_variable cv;
+    CompletionQueue* completions; //receives index when transfer completes
+    unsigned index;
 #endif
 };
 
@@ -95,6 +96,7 @@ public:
 
     int Write(const unsigned char* buffer, int length, int timeout_ms = 100) override;
     int Read(unsigned char* buffer, int length, int timeout_ms = 100) override;
+    bool CanPipeline(const int cmd) const override;
 
     //hooks to update FPGA plls when baseband interface data rate is changed
     int ProgramWrite(const char *buffer, const size_t length, const int programmingMode, const int device, ProgrammingCallback callback) override;
@@ -115,12 +117,15 @@ protected:
     void AbortSending(int ep) override;
 
     int ResetStreamBuffers() override;
+    void* AllocateStreamBuffers(size_t size) override;
+    void FreeStreamBuffers(void* buffer, size_t size) override;
     eConnectionType GetType(void) {return USB_PORT;}
     
-    static const int USB_MAX_CONTEXTS = 16; //maximum number of contexts for asynchronous transfers
+    static const int USB_MAX_CONTEXTS = 64; //maximum number of contexts for asynchronous transfers
     
     USBTransferContext contexts[USB_MAX_CONTEXTS];
     USBTransferContext contextsToSend[USB_MAX_CONTEXTS];
+    int mTransferCount; //contexts used for each direction
 
     bool isConnected;
 
@@ -140,6 +145,8 @@ protected:
 #else
     libusb_device_handle* dev_handle; //a device handle
     libusb_context* ctx; //a libusb session
+    CompletionQueue mReadCompletions;
+    CompletionQueue mSendCompletions;
     int read_firmware_image(unsigned char *buf, int len);
     int fx3_usbboot_download(unsigned char *buf, int len);
     int ram_write(unsigned char *buf, unsigned int ramAddress, int len);
@@ -149,7 +156,7 @@ protected:
     static const std::set<uint8_t> commandsToBulkCtrlHw1;
     static const std::set<uint8_t> commandsToBulkCtrlHw2;
     std::set<uint8_t> commandsToBulkCtrl;
-    bool bulkCtrlInProgress;
+    int bulkCtrlPending; //replies to be read from bulk control endpoint
     bool bulkCtrlAvailable;
     std::mutex mExtraUsbMutex;
 };
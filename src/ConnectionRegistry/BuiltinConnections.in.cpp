@@ -10,6 +10,7 @@
 #cmakedefine ENABLE_PCIE_XILLYBUS
 #cmakedefine ENABLE_REMOTE
 #cmakedefine ENABLE_SPI
+#cmakedefine ENABLE_EMULATOR
 
 void __loadConnectionEVB7COMEntry(void);
 void __loadConnectionFX3Entry(void);
@@ -19,6 +20,7 @@ void __loadConnectionFT601Entry(void);
 void __loadConnectionXillybusEntry(void);
 void __loadConnectionRemoteEntry(void);
 void __loadConnectionSPIEntry(void);
+void __loadConnectionEmulatorEntry(void);
 
 void __loadAllConnections(void)
 {
@@ -49,4 +51,8 @@ void __loadAllConnections(void)
     #ifdef ENABLE_SPI
     __loadConnectionSPIEntry();
     #endif
+
+    #ifdef ENABLE_EMULATOR
+    __loadConnectionEmulatorEntry();
+    #endif
 }
@@ -107,6 +107,14 @@ int IConnection::FinishDataReading(char* buffer, uint32_t length, int contextHan
     return 0;
 }
 
+void* IConnection::AllocateStreamBuffers(size_t)
+{
+    return nullptr;
+}
+void IConnection::FreeStreamBuffers(void*, size_t)
+{
+}
+
 /** @brief Sets callback function which gets called each time data is sent or received
 */
 void IConnection::SetDataLogCallback(std::function<void(bool, const unsigned char*, const unsigned int)> callback)
@@ -173,6 +173,13 @@ public:
     virtual bool WaitForReading(int contextHandle, unsigned int timeout_ms);
     virtual int FinishDataReading(char* buffer, uint32_t length, int contextHandle);
     virtual void AbortReading(int ep){};
+
+    /** @brief Allocates stream transfer buffers which device can access without copying
+        @param size number of bytes
+        @return nullptr if connection has no such memory, ordinary memory is used then
+    */
+    virtual void* AllocateStreamBuffers(size_t size);
+    virtual void FreeStreamBuffers(void* buffer, size_t size);
     
     /***********************************************************************
      * Programming API
@@ -159,10 +159,14 @@ void LMS64CProtocol::ProcessConnections()
             if(not connected)
                 break;
 
-            mControlPortLock.lock();
-            Write((unsigned char*)data, msgSize);
-            Read((unsigned char*)data, msgSize);
-            mControlPortLock.unlock();
+            {
+                //wait until replies of local transfers are read
+                std::unique_lock<std::mutex> lock(mControlPortLock);
+                while (!mPendingReplies.empty() || mReplyReading)
+                    mReplyCond.wait(lock);
+                Write((unsigned char*)data, msgSize);
+                Read((unsigned char*)data, msgSize);
+            }
 
             int bsent = 0;
             while(bsent < msgSize)
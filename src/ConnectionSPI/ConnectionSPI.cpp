@@ -6,7 +6,9 @@
 
 #include <linux/spi/spidev.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <fstream>
 #include <wiringPi.h>
@@ -22,25 +24,25 @@ using namespace lime;
 #define SPI_STREAM_SPEED_HZ 50000000
 #define SPI_CTRL_SPEED_HZ   1000000
 
-ConnectionSPI* ConnectionSPI::pthis = nullptr;
-char ConnectionSPI::last_flags = 0x10;  //no sync
-uint64_t ConnectionSPI::rx_timestamp = 0;
-std::atomic<bool> ConnectionSPI::program_mode(false);
-std::atomic<bool> ConnectionSPI::program_ready(false);
 /** @brief Initializes port type and object necessary to communicate to usb device.
 */
 ConnectionSPI::ConnectionSPI(const unsigned index) :
+    last_flags(0x10), //no sync
+    rx_timestamp(0),
+    program_ready(false),
+    program_mode(false),
+    streamFilePoll(true),
     fd_stream(-1),
     fd_stream_clocks(-1),
+    fd_stream_stop(-1),
     fd_control_lms(-1),
     fd_control_fpga(-1),
-    int_pin(26)
+    int_pin(26),
+    rxQueue(cQueuePackets),
+    txQueue(cQueuePackets),
+    txPending(nullptr),
+    txPendingCount(0)
 {
-    pthis = this;
-    program_ready.store(false);
-    program_mode.store(false);
-    if (Open(index) < 0)
-        lime::error("Failed to open SPI device");
     if (index == SPIDEV)
     {
         std::ifstream file("/proc/device-tree/model");
@@ -56,8 +58,9 @@ ConnectionSPI::ConnectionSPI(const unsigned index) :
         wiringPiSetup();
         pinMode(int_pin, INPUT);
         pullUpDnControl(int_pin, PUD_OFF);
-        wiringPiISR(int_pin, INT_EDGE_RISING, &ConnectionSPI::StreamISR);
     }
+    if (Open(index) < 0)
+        lime::error("Failed to open SPI device");
 
     uint8_t id = 0;
     double val = 35487;
@@ -117,6 +120,7 @@ int ConnectionSPI::Open(const unsigned index)
     }
     else if((fd_stream = open("/dev/lime_spi", O_RDWR)) < 0)
         lime::error("Failed to open /dev/lime_spi");
+    streamFilePoll = true;
 
     if ((fd_control_fpga = open("/dev/spidev1.0", O_RDWR)) != -1)
     {
@@ -150,13 +154,18 @@ int ConnectionSPI::Open(const unsigned index)
             lime::error("Failed to set SPI read max speed");
     }
 
-    return IsOpen() ? 0 : -1;
+    if (!IsOpen())
+        return -1;
+    if (fd_stream_clocks != -1)
+        return StartStreamWorker();
+    return 0;
 }
 
 /** @brief Closes communication to device.
 */
 void ConnectionSPI::Close()
 {
+    StopStreamWorker();
     if (fd_stream != -1)
         close(fd_stream);
     if (fd_stream_clocks != -1)
@@ -211,10 +220,10 @@ int ConnectionSPI::TransferSPI(int fd, const void *tx, void *rx, uint32_t len)
                             0,
                             8 };
     int ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
-    if (pthis->callback_logData)
+    if (callback_logData)
     {
-        pthis->callback_logData(true, (const unsigned char*)tx, len);
-        pthis->callback_logData(false, (const unsigned char*)rx, len);
+        callback_logData(true, (const unsigned char*)tx, len);
+        callback_logData(false, (const unsigned char*)rx, len);
     }
     return ret;
 }
@@ -447,20 +456,17 @@ int ConnectionSPI::ResetStreamBuffers()
             lime::error("Failed to open /dev/lime_spi");
             return -1;
         }
+        streamFilePoll = true;
         return 0;
     }
 
-    {
-        std::lock_guard<std::mutex> lock(mTxStreamLock);
-        txQueue = std::queue<FPGA_DataPacket>();
-    }
-    {
-        std::lock_guard<std::mutex> lock(mRxStreamLock);
-        rxQueue = std::queue<FPGA_DataPacket>();
-    }
+    txPending = nullptr;
+    txPendingCount = 0;
+    txQueue.Clear();
+    rxQueue.Clear();
     program_mode.store(false);
-    last_flags = 0x10; //no sync
-    rx_timestamp = 0;
+    last_flags.store(0x10); //no sync
+    rx_timestamp.store(0);
     return 0;
 }
 
@@ -471,7 +477,12 @@ int ConnectionSPI::GetBuffersCount() const
 
 int ConnectionSPI::CheckStreamSize(int size) const
 {
-    return 1;
+    //packets are moved to and from queues in batches, half of the queue is
+    //left for the stream worker while stream thread handles the batch
+    const int maxPackets = cQueuePackets/2;
+    if (size < 1)
+        return 1;
+    return size < maxPackets ? size : maxPackets;
 }
 
 /**
@@ -483,16 +494,19 @@ int ConnectionSPI::CheckStreamSize(int size) const
 */
 int ConnectionSPI::ReceiveData(char *buffer, int length, int epIndex, int timeout_ms)
 {
-    const int count = length/sizeof(FPGA_DataPacket);
-    int offset = 0;
-    for (int i = 0; i <  count; i++)
+    const auto t1 = chrono::steady_clock::now();
+    int received = 0;
+    while (length - received >= int(sizeof(FPGA_DataPacket)))
     {
-        if (WaitForReading(0, timeout_ms)== false)
-            return i * sizeof(FPGA_DataPacket);
-        FinishDataReading(buffer+offset, sizeof(FPGA_DataPacket), 0);
-        offset += sizeof(FPGA_DataPacket);
+        const int elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - t1).count();
+        if (elapsed >= timeout_ms || WaitForReading(0, timeout_ms - elapsed) == false)
+            break;
+        const int cnt = FinishDataReading(buffer + received, length - received, 0);
+        if (cnt <= 0)
+            break;
+        received += cnt;
     }
-    return count * sizeof(FPGA_DataPacket);
+    return received;
 }
 
 void ConnectionSPI::AbortReading(int epIndex)
@@ -509,21 +523,20 @@ void ConnectionSPI::AbortReading(int epIndex)
 */
 int ConnectionSPI::SendData(const char *buffer, int length, int epIndex, int timeout_ms)
 {
-    const int count = length/sizeof(FPGA_DataPacket);
-    int offset = 0;
-    for (int i = 0; i <  count; i++)
+    const int handle = BeginDataSending(buffer, length, epIndex);
+    if (WaitForSending(handle, timeout_ms) == false)
     {
-        BeginDataSending(buffer+offset, length, 0);
-        if (WaitForSending(0, timeout_ms) == false)
-            return i * sizeof(FPGA_DataPacket);
-        offset += sizeof(FPGA_DataPacket);
+        const int sent = length - txPendingCount*sizeof(FPGA_DataPacket);
+        AbortSending(epIndex);
+        return sent > 0 ? sent : 0;
     }
-    return count * sizeof(FPGA_DataPacket);
+    return FinishDataSending(buffer, length, handle);
 }
 
 void ConnectionSPI::AbortSending(int epIndex)
 {
-    return;
+    txPending = nullptr;
+    txPendingCount = 0;
 }
 
 int ConnectionSPI::BeginDataReading(char* buffer, uint32_t length, int ep)
@@ -534,69 +547,51 @@ int ConnectionSPI::BeginDataReading(char* buffer, uint32_t length, int ep)
 bool ConnectionSPI::WaitForReading(int contextHandle, unsigned int timeout_ms)
 {
     if (fd_stream_clocks < 0) //lime spi
-        return true;
-    auto t1 = chrono::high_resolution_clock::now();
-    do
-    {
-        {
-            std::lock_guard<std::mutex> lock(mRxStreamLock);
-            if (!rxQueue.empty())
-                return true;
-        }
-        std::this_thread::sleep_for(std::chrono::microseconds(250));
-    }
-    while (std::chrono::duration_cast<std::chrono::milliseconds>(chrono::high_resolution_clock::now() - t1).count() < timeout_ms);
-        return false;
+        return WaitStreamFile(false, timeout_ms);
+    return rxQueue.event.Wait([this]{ return rxQueue.Size() != 0; }, timeout_ms);
 }
 
 int ConnectionSPI::FinishDataReading(char* buffer, uint32_t length, int contextHandle)
 {
+    const unsigned count = length / sizeof(FPGA_DataPacket);
     if (fd_stream_clocks < 0) //lime spi
     {
-        auto t1 = chrono::high_resolution_clock::now();
-        do
+        //first packet may still be on its way, the rest only if already available
+        int received = 0;
+        for (unsigned i = 0; i < count; ++i)
         {
-            int cnt = read(fd_stream, buffer, sizeof(FPGA_DataPacket));
-            if (cnt >= 0)
-                return cnt;
-            std::this_thread::sleep_for(std::chrono::microseconds(300));
-        }while (std::chrono::duration_cast<std::chrono::milliseconds>(chrono::high_resolution_clock::now() - t1).count() < 3000);
-        return 0;
-    }
-
-    FPGA_DataPacket* packet = reinterpret_cast<FPGA_DataPacket*>(buffer);
-    std::lock_guard<std::mutex> lock(mRxStreamLock);
-    if (!rxQueue.empty())
-    {
-        *packet = rxQueue.front();
-        rxQueue.pop();
-        return sizeof(FPGA_DataPacket);;
+            const int cnt = TransferStreamFile(buffer + received, sizeof(FPGA_DataPacket), false, i == 0 ? 3000 : 0);
+            if (cnt <= 0)
+                break;
+            received += cnt;
+        }
+        return received;
     }
-    return 0;
+    return rxQueue.Pop(reinterpret_cast<FPGA_DataPacket*>(buffer), count) * sizeof(FPGA_DataPacket);
 }
 
 int ConnectionSPI::BeginDataSending(const char* buffer, uint32_t length, int ep)
 {
+    const unsigned count = (length + sizeof(FPGA_DataPacket) - 1) / sizeof(FPGA_DataPacket);
     if (fd_stream_clocks < 0) //lime spi
     {
-        auto t1 = chrono::high_resolution_clock::now();
-        do
+        uint32_t sent = 0;
+        for (unsigned i = 0; i < count; ++i)
         {
-            int cnt = write(fd_stream, buffer, sizeof(FPGA_DataPacket));
-            if (cnt >= 0)
-                return cnt;
-            std::this_thread::sleep_for(std::chrono::microseconds(300));
-        }while (std::chrono::duration_cast<std::chrono::milliseconds>(chrono::high_resolution_clock::now() - t1).count() < 3000);
-        return 0;
-    }
-    const FPGA_DataPacket* packet = reinterpret_cast<const FPGA_DataPacket*>(buffer);
-    std::lock_guard<std::mutex> lock(mTxStreamLock);
-    if (txQueue.size() < 10)
-    {
-        txQueue.push(*packet);
-        return sizeof(FPGA_DataPacket);
+            const int cnt = TransferStreamFile((char*)buffer + i*sizeof(FPGA_DataPacket), sizeof(FPGA_DataPacket), true, 3000);
+            if (cnt <= 0)
+                break;
+            sent += cnt;
+        }
+        return sent < length ? sent : length;
     }
-    return 0;
+    //packets that do not fit into queue now are queued by WaitForSending
+    txPending = reinterpret_cast<const FPGA_DataPacket*>(buffer);
+    txPendingCount = count;
+    const unsigned queued = txQueue.Push(txPending, txPendingCount);
+    txPending += queued;
+    txPendingCount -= queued;
+    return length;
 }
 
 
@@ -604,83 +599,202 @@ bool ConnectionSPI::WaitForSending(int contextHandle, uint32_t timeout_ms)
 {
     if (fd_stream_clocks < 0) //lime spi
         return true;
-    auto t1 = chrono::high_resolution_clock::now();
-    do
+    return txQueue.event.Wait([this]{
+        const unsigned queued = txQueue.Push(txPending, txPendingCount);
+        txPending += queued;
+        txPendingCount -= queued;
+        return txPendingCount == 0;
+    }, timeout_ms);
+}
+
+int ConnectionSPI::FinishDataSending(const char* buffer, uint32_t length, int contextHandle)
+{
+    return contextHandle;
+}
+
+/** @brief Reads or writes lime_spi device file, waiting until it is ready
+    @return number of bytes transferred, 0 on timeout
+*/
+int ConnectionSPI::TransferStreamFile(char* buffer, uint32_t length, bool tx, unsigned timeout_ms)
+{
+    const auto t1 = chrono::steady_clock::now();
+    int spuriousWakeups = 0;
+    while (true)
     {
+        const int cnt = tx ? write(fd_stream, buffer, length) : read(fd_stream, buffer, length);
+        if (cnt >= 0)
+            return cnt;
+        //driver without poll support reports file as always ready
+        if (streamFilePoll && spuriousWakeups > 16)
         {
-            std::lock_guard<std::mutex> lock(mTxStreamLock);
-            if (txQueue.size() < 10)
-                return true;
+            lime::info("lime_spi does not support poll, stream transfers will be retried periodically");
+            streamFilePoll = false;
         }
-        std::this_thread::sleep_for(std::chrono::microseconds(250));
+        const unsigned elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - t1).count();
+        if (elapsed >= timeout_ms || WaitStreamFile(tx, timeout_ms - elapsed) == false)
+            return 0;
+        ++spuriousWakeups;
     }
-    while (std::chrono::duration_cast<std::chrono::milliseconds>(chrono::high_resolution_clock::now() - t1).count() < timeout_ms);
-    return false;
 }
 
-int ConnectionSPI::FinishDataSending(const char* buffer, uint32_t length, int contextHandle)
+bool ConnectionSPI::WaitStreamFile(bool tx, unsigned timeout_ms)
 {
-    return contextHandle;
+    if (!streamFilePoll)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(300));
+        return true;
+    }
+    pollfd pfd = {fd_stream, short(tx ? POLLOUT : POLLIN), 0};
+    return poll(&pfd, 1, timeout_ms) > 0;
 }
 
-void ConnectionSPI::StreamISR()
+static void WriteSysfs(const std::string &path, const std::string &value)
 {
-    if (program_mode.load())
+    std::ofstream file(path);
+    file << value;
+}
+
+/** @brief Starts thread exchanging stream packets when FPGA raises interrupt line
+*/
+int ConnectionSPI::StartStreamWorker()
+{
+    //interrupt line is watched through sysfs, same as wiringPi does it
+    const int gpio = wpiPinToGpio(int_pin);
+    const std::string path = "/sys/class/gpio/gpio" + std::to_string(gpio);
+    if (access(path.c_str(), F_OK) != 0)
+        WriteSysfs("/sys/class/gpio/export", std::to_string(gpio));
+    WriteSysfs(path + "/direction", "in");
+    WriteSysfs(path + "/edge", "rising");
+    const int pinFd = open((path + "/value").c_str(), O_RDONLY);
+    if (pinFd < 0)
+        return ReportError(errno, "Failed to open %s/value", path.c_str());
+    if ((fd_stream_stop = eventfd(0, EFD_CLOEXEC)) < 0)
+    {
+        close(pinFd);
+        return ReportError(errno, "Failed to create stream worker event");
+    }
+    streamThread = std::thread(&ConnectionSPI::StreamWorker, this, pinFd);
+    return 0;
+}
+
+void ConnectionSPI::StopStreamWorker()
+{
+    if (streamThread.joinable())
     {
-        program_ready.store(true);
-        return;
+        const uint64_t one = 1;
+        if (write(fd_stream_stop, &one, sizeof(one)) < 0)
+            lime::error("Failed to stop SPI stream worker");
+        streamThread.join();
     }
-    static const FPGA_DataPacket dummy_packet = {0};
-    FPGA_DataPacket rx_packet;
-    FPGA_DataPacket tx_packet;
-    while (1)
+    if (fd_stream_stop != -1)
+        close(fd_stream_stop);
+    fd_stream_stop = -1;
+}
+
+void ConnectionSPI::StreamWorker(int pinFd)
+{
+    pollfd fds[2] = {{pinFd, POLLPRI | POLLERR, 0}, {fd_stream_stop, POLLIN, 0}};
+    char value[4];
+    //reading value acknowledges edge that was already reported
+    if (read(pinFd, value, sizeof(value)) < 0)
+        lime::warning("Failed to read SPI stream interrupt pin");
+    while (true)
     {
-        pthis->mTxStreamLock.lock();
-        if (pthis->txQueue.empty() || (!(tx_packet.reserved[0]&0x10) && pthis->txQueue.front().counter > rx_timestamp+12000))
+        if (poll(fds, 2, -1) < 0)
         {
-            pthis->mTxStreamLock.unlock();
-            tx_packet = dummy_packet;
-            tx_packet.reserved[0] = last_flags;
+            if (errno == EINTR)
+                continue;
+            lime::error("SPI stream worker: poll failed");
+            break;
         }
-        else
+        if (fds[1].revents)
+            break;
+        if (fds[0].revents)
         {
-            tx_packet = pthis->txQueue.front();
-            last_flags = tx_packet.reserved[0];
-            pthis->txQueue.pop();
-            pthis->mTxStreamLock.unlock();
-            if (!(tx_packet.reserved[0]&0x10) && tx_packet.counter < rx_timestamp+6000)
+            lseek(pinFd, 0, SEEK_SET);
+            if (read(pinFd, value, sizeof(value)) < 0)
                 continue;
+            ServiceStreamInterrupt();
         }
-        break;
     }
+    close(pinFd);
+}
 
+/** @brief Exchanges one packet with FPGA, Tx and Rx packets are transferred
+    directly from and to queue memory
+*/
+void ConnectionSPI::ServiceStreamInterrupt()
+{
+    if (program_mode.load())
+    {
+        program_ready.store(true);
+        programEvent.Notify();
+        return;
+    }
+    const uint64_t rxTs = rx_timestamp.load(std::memory_order_relaxed);
+    const FPGA_DataPacket* tx_packet;
+    bool txPopped = false;
+    while ((tx_packet = txQueue.Front()) != nullptr)
     {
-        spi_ioc_transfer tr = { (unsigned long)&tx_packet,
-                                (unsigned long)&rx_packet,
-                                sizeof(tx_packet),
+        const bool timestamped = !(tx_packet->reserved[0]&0x10);
+        if (timestamped && tx_packet->counter > rxTs+12000) //too early, keep it queued
+        {
+            tx_packet = nullptr;
+            break;
+        }
+        last_flags.store(tx_packet->reserved[0], std::memory_order_relaxed);
+        if (!timestamped || tx_packet->counter >= rxTs+6000)
+            break;
+        txQueue.Pop(); //too late
+        txPopped = true;
+    }
+    FPGA_DataPacket idle_packet = {};
+    if (tx_packet == nullptr)
+    {
+        idle_packet.reserved[0] = last_flags.load(std::memory_order_relaxed);
+        tx_packet = &idle_packet;
+    }
+
+    //packet is dropped if stream thread does not keep up
+    FPGA_DataPacket overflow_packet;
+    FPGA_DataPacket* rx_packet = rxQueue.Reserve();
+    if (rx_packet == nullptr)
+        rx_packet = &overflow_packet;
+
+    {
+        spi_ioc_transfer tr = { (unsigned long)tx_packet,
+                                (unsigned long)rx_packet,
+                                sizeof(FPGA_DataPacket),
                                 SPI_STREAM_SPEED_HZ,
                                 0,
                                 8 };
-        ioctl(pthis->fd_stream, SPI_IOC_MESSAGE(1), &tr);
+        ioctl(fd_stream, SPI_IOC_MESSAGE(1), &tr);
     }
 
-    rx_timestamp = rx_packet.counter;
-
-    pthis->mRxStreamLock.lock();
+    if (tx_packet != &idle_packet)
+    {
+        txQueue.Pop();
+        txPopped = true;
+    }
+    if (txPopped)
+        txQueue.event.Notify();
 
-    if (pthis->rxQueue.size() >= 10)
-        pthis->rxQueue.pop();
-    pthis->rxQueue.push(rx_packet);
-    pthis->mRxStreamLock.unlock();
+    rx_timestamp.store(rx_packet->counter, std::memory_order_relaxed);
+    if (rx_packet != &overflow_packet)
+    {
+        rxQueue.Publish();
+        rxQueue.event.Notify();
+    }
 
     {
-        spi_ioc_transfer tr = { (unsigned long)&dummy_packet,
-                                (unsigned long)&rx_packet,
-                                2,
+        uint8_t ack[2] = {0, 0};
+        spi_ioc_transfer tr = { (unsigned long)ack,
+                                (unsigned long)ack,
+                                sizeof(ack),
                                 SPI_STREAM_SPEED_HZ,
                                 0,
                                 8 };
-        ioctl(pthis->fd_stream_clocks, SPI_IOC_MESSAGE(1), &tr);
+        ioctl(fd_stream_clocks, SPI_IOC_MESSAGE(1), &tr);
     }
 }
 
@@ -759,7 +873,7 @@ int ConnectionSPI::ProgramWrite(const char *data, size_t length, int prog_mode,
                 cnt = 0;
 
             }
-            else if (program_ready.load())
+            else if (programEvent.Wait([this]{ return program_ready.load(); }, 100))
             {
                 cnt = buffer.size() - data_sent;
                 if (cnt > 4096)
@@ -771,7 +885,7 @@ int ConnectionSPI::ProgramWrite(const char *data, size_t length, int prog_mode,
                                             SPI_STREAM_SPEED_HZ,
                                             0,
                                             8 };
-                    ioctl(pthis->fd_stream, SPI_IOC_MESSAGE(1), &tr);
+                    ioctl(fd_stream, SPI_IOC_MESSAGE(1), &tr);
                 }
                 program_ready.store(false);
                 {
@@ -781,7 +895,7 @@ int ConnectionSPI::ProgramWrite(const char *data, size_t length, int prog_mode,
                                             SPI_STREAM_SPEED_HZ,
                                             0,
                                             8 };
-                    ioctl(pthis->fd_stream_clocks, SPI_IOC_MESSAGE(1), &tr);
+                    ioctl(fd_stream_clocks, SPI_IOC_MESSAGE(1), &tr);
                 }
                 break;
             }
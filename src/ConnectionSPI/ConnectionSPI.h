@@ -6,12 +6,12 @@
 #pragma once
 
 #include <atomic>
-#include <mutex>
-#include <queue>
+#include <thread>
 
 #include "ConnectionRegistry.h"
 #include "LMS64CProtocol.h"
 #include "dataTypes.h"
+#include "PacketQueue.h"
 
 namespace lime{
 
@@ -63,23 +63,32 @@ protected:
 private:
     void SetChipSelect(int cs);
     int WriteADF4002SPI(const uint32_t *writeData, const size_t size);
-    static int TransferSPI(int fd, const void *tx, void *rx, uint32_t len);
-    static ConnectionSPI* pthis;
-    static char last_flags;
-    static uint64_t rx_timestamp;
-    static void StreamISR();
-    static std::atomic<bool> program_ready;
-    static std::atomic<bool> program_mode;
+    int TransferSPI(int fd, const void *tx, void *rx, uint32_t len);
+    int TransferStreamFile(char* buffer, uint32_t length, bool write, unsigned timeout_ms);
+    bool WaitStreamFile(bool write, unsigned timeout_ms);
+    int StartStreamWorker();
+    void StopStreamWorker();
+    void StreamWorker(int pinFd);
+    void ServiceStreamInterrupt();
+    static const unsigned cQueuePackets = 16;
+    std::atomic<char> last_flags;
+    std::atomic<uint64_t> rx_timestamp;
+    std::atomic<bool> program_ready;
+    std::atomic<bool> program_mode;
+    StreamEvent programEvent;
+    std::thread streamThread;
+    bool streamFilePoll; //false if lime_spi driver does not implement poll
     int fd_stream;
     int fd_stream_clocks;
+    int fd_stream_stop; //eventfd stopping stream worker
     int fd_control_lms;
     int fd_control_fpga;
     int dac_value;
     int int_pin;
-    std::mutex mTxStreamLock;
-    std::mutex mRxStreamLock;
-    std::queue<FPGA_DataPacket> rxQueue;
-    std::queue<FPGA_DataPacket> txQueue;  
+    PacketQueue rxQueue;
+    PacketQueue txQueue;
+    const FPGA_DataPacket* txPending; //packets of BeginDataSending not yet queued
+    unsigned txPendingCount;
 };
 
 class ConnectionSPIEntry : public ConnectionRegistryEntry
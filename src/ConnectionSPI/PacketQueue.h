@@ -0,0 +1,209 @@
+/**
+    @file PacketQueue.h
+    @author Lime Microsystems
+    @brief Lock-free packet queue between SPI stream worker and stream threads
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "dataTypes.h"
+
+namespace lime{
+
+/** @brief Wakes one thread sleeping in poll() on an eventfd.
+
+    Notify() makes a system call only while waiter is sleeping, so it is cheap
+    to call after every packet.
+*/
+class StreamEvent
+{
+public:
+    StreamEvent() : mWaiting(false)
+    {
+        mFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    ~StreamEvent()
+    {
+        if (mFd >= 0)
+            close(mFd);
+    }
+
+    /** @brief Waits until ready() returns true or timeout expires
+        @return true if predicate was satisfied
+    */
+    template<typename Predicate>
+    bool Wait(Predicate ready, unsigned timeout_ms)
+    {
+        if (ready())
+            return true;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true)
+        {
+            mWaiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready())
+            {
+                mWaiting.store(false, std::memory_order_relaxed);
+                return true;
+            }
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0 || mFd < 0)
+            {
+                mWaiting.store(false, std::memory_order_relaxed);
+                return false;
+            }
+            pollfd pfd = {mFd, POLLIN, 0};
+            poll(&pfd, 1, remaining);
+            mWaiting.store(false, std::memory_order_relaxed);
+            uint64_t count;
+            if (read(mFd, &count, sizeof(count)) < 0)
+                count = 0; //nothing to drain
+        }
+    }
+
+    //! @brief Wakes waiter, called after changing state checked by its predicate
+    void Notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mWaiting.load(std::memory_order_relaxed))
+        {
+            const uint64_t one = 1;
+            if (write(mFd, &one, sizeof(one)) < 0)
+                return; //counter is already signalled
+        }
+    }
+
+private:
+    int mFd;
+    std::atomic<bool> mWaiting;
+};
+
+/** @brief Bounded single producer, single consumer queue of FPGA packets.
+
+    Packets can be produced and consumed in place, so SPI transfers use queue
+    memory directly. Clear() may be called from any thread, consumer drops
+    cleared packets the next time it looks at the queue.
+*/
+class PacketQueue
+{
+public:
+    explicit PacketQueue(unsigned capacity) : mHead(0), mTail(0), mClearTo(0)
+    {
+        unsigned size = 1;
+        while (size < capacity)
+            size <<= 1;
+        mPackets.resize(size);
+        mMask = size - 1;
+    }
+
+    unsigned Capacity() const
+    {
+        return mMask + 1;
+    }
+
+    //! @brief Approximate number of queued packets
+    unsigned Size() const
+    {
+        const uint32_t head = mHead.load(std::memory_order_acquire);
+        const uint32_t tail = mTail.load(std::memory_order_acquire);
+        const uint32_t clearTo = mClearTo.load(std::memory_order_acquire);
+        return tail - (int32_t(clearTo - head) > 0 ? clearTo : head);
+    }
+
+    //! @brief Producer: slot for next packet, nullptr if queue is full
+    FPGA_DataPacket* Reserve()
+    {
+        const uint32_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) > mMask)
+            return nullptr;
+        return &mPackets[tail & mMask];
+    }
+
+    //! @brief Producer: makes reserved packet visible to consumer
+    void Publish()
+    {
+        mTail.store(mTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //! @brief Producer: copies packets into queue
+    //! @return number of packets queued
+    unsigned Push(const FPGA_DataPacket* packets, unsigned count)
+    {
+        const uint32_t tail = mTail.load(std::memory_order_relaxed);
+        const uint32_t space = Capacity() - (tail - mHead.load(std::memory_order_acquire));
+        if (count > space)
+            count = space;
+        for (unsigned i = 0; i < count; ++i)
+            mPackets[(tail + i) & mMask] = packets[i];
+        mTail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    //! @brief Consumer: oldest packet, nullptr if queue is empty
+    const FPGA_DataPacket* Front()
+    {
+        const uint32_t head = Discard();
+        if (head == mTail.load(std::memory_order_acquire))
+            return nullptr;
+        return &mPackets[head & mMask];
+    }
+
+    //! @brief Consumer: releases packet returned by Front()
+    void Pop()
+    {
+        mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //! @brief Consumer: copies packets out of queue
+    //! @return number of packets copied
+    unsigned Pop(FPGA_DataPacket* packets, unsigned count)
+    {
+        const uint32_t head = Discard();
+        const uint32_t available = mTail.load(std::memory_order_acquire) - head;
+        if (count > available)
+            count = available;
+        for (unsigned i = 0; i < count; ++i)
+            packets[i] = mPackets[(head + i) & mMask];
+        mHead.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    //! @brief Drops all packets queued so far
+    void Clear()
+    {
+        mClearTo.store(mTail.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    //! @brief Wakes stream thread waiting for this queue
+    StreamEvent event;
+
+private:
+    //moves consumer past cleared packets
+    uint32_t Discard()
+    {
+        uint32_t head = mHead.load(std::memory_order_relaxed);
+        const uint32_t clearTo = mClearTo.load(std::memory_order_acquire);
+        if (int32_t(clearTo - head) > 0)
+        {
+            head = clearTo;
+            mHead.store(head, std::memory_order_release);
+        }
+        return head;
+    }
+
+    std::vector<FPGA_DataPacket> mPackets;
+    uint32_t mMask;
+    std::atomic<uint32_t> mHead;
+    std::atomic<uint32_t> mTail;
+    std::atomic<uint32_t> mClearTo;
+};
+
+}
@@ -0,0 +1,417 @@
+/**
+    @file AsyncStreamIO.cpp
+    @author Lime Microsystems
+    @brief Multi-buffer asynchronous reading and writing of stream device files
+*/
+
+#include "AsyncStreamIO.h"
+#include "Logger.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace lime;
+
+//how long Abort waits for cancelled requests to complete
+static const int cCancelTimeout_ms = 1000;
+
+#ifdef HAVE_IO_URING
+//user data of cancel requests, data requests use context handle
+static const uint64_t cCancelRequest = UINT64_MAX;
+
+struct AsyncStreamIO::Ring
+{
+    Ring() : fd(-1), sq(MAP_FAILED), cq(MAP_FAILED), sqes(MAP_FAILED), sqSize(0), cqSize(0), sqesSize(0) {}
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqesSize);
+        if (cq != MAP_FAILED && cq != sq)
+            munmap(cq, cqSize);
+        if (sq != MAP_FAILED)
+            munmap(sq, sqSize);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    io_uring_sqe* NextRequest()
+    {
+        const unsigned index = sqTail & *sqMask;
+        io_uring_sqe* sqe = &static_cast<io_uring_sqe*>(sqes)[index];
+        memset(sqe, 0, sizeof(io_uring_sqe));
+        sqArray[index] = index;
+        ++sqTail;
+        ++toSubmit;
+        return sqe;
+    }
+
+    //makes prepared requests visible to kernel and submits them
+    int Submit()
+    {
+        __atomic_store_n(sqTailPtr, sqTail, __ATOMIC_RELEASE);
+        while (toSubmit > 0)
+        {
+            const int submitted = syscall(__NR_io_uring_enter, fd, toSubmit, 0, 0, nullptr, 0);
+            if (submitted < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return errno;
+            }
+            toSubmit -= submitted;
+        }
+        return 0;
+    }
+
+    int fd;
+    void* sq;
+    void* cq;
+    void* sqes;
+    size_t sqSize;
+    size_t cqSize;
+    size_t sqesSize;
+    unsigned sqTail;
+    unsigned toSubmit;
+    unsigned* sqTailPtr;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+};
+#else
+struct AsyncStreamIO::Ring {};
+#endif
+
+AsyncStreamIO::AsyncStreamIO(int fd, bool write, int contexts, Backend backend) :
+    mFd(fd),
+    mFileFlags(fcntl(fd, F_GETFL)),
+    mWrite(write),
+    mFailed(false),
+    mBackend(POLL),
+    mContexts(contexts < 1 ? 1 : contexts),
+    mInFlight(0)
+{
+    //ring holds whole chain of requests and their cancellations
+    if (backend != POLL && SetupRing(2 * mContexts.size()))
+        mBackend = IO_URING;
+    else if (backend == IO_URING)
+        lime::warning("io_uring is not available, using poll for stream transfers");
+    //io_uring fails non-blocking requests instead of waiting for data,
+    //poll backend must not block in read() or write()
+    if (mFileFlags != -1)
+        fcntl(fd, F_SETFL, mBackend == IO_URING ? mFileFlags & ~O_NONBLOCK : mFileFlags | O_NONBLOCK);
+}
+
+AsyncStreamIO::~AsyncStreamIO()
+{
+    Abort();
+    mRing.reset();
+    if (mFileFlags != -1)
+        fcntl(mFd, F_SETFL, mFileFlags);
+}
+
+AsyncStreamIO::Backend AsyncStreamIO::GetBackend() const
+{
+    return mBackend;
+}
+
+const char* AsyncStreamIO::GetBackendName(Backend backend)
+{
+    switch (backend)
+    {
+    case IO_URING: return "io_uring";
+    case POLL: return "poll";
+    default: return "auto";
+    }
+}
+
+bool AsyncStreamIO::Failed() const
+{
+    return mFailed;
+}
+
+bool AsyncStreamIO::SetupRing(unsigned entries)
+{
+#ifdef HAVE_IO_URING
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    std::unique_ptr<Ring> ring(new Ring());
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+        return false;
+    //reads of device files are driven by poll instead of blocking kernel worker thread
+    if (!(params.features & IORING_FEAT_FAST_POLL))
+        return false;
+
+    ring->sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap)
+        ring->sqSize = ring->cqSize = std::max(ring->sqSize, ring->cqSize);
+    ring->sq = mmap(nullptr, ring->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq == MAP_FAILED)
+        return false;
+    if (singleMap)
+        ring->cq = ring->sq;
+    else
+    {
+        ring->cq = mmap(nullptr, ring->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq == MAP_FAILED)
+            return false;
+    }
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        return false;
+
+    char* sq = static_cast<char*>(ring->sq);
+    char* cq = static_cast<char*>(ring->cq);
+    ring->sqTailPtr = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->sqTail = *ring->sqTailPtr;
+    ring->toSubmit = 0;
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    mRing = std::move(ring);
+    return true;
+#else
+    return false;
+#endif
+}
+
+int AsyncStreamIO::Begin(char* buffer, size_t length)
+{
+    if (mFailed)
+        return -1;
+    for (size_t i = 0; i < mContexts.size(); ++i)
+    {
+        Context &context = mContexts[i];
+        if (context.used)
+            continue;
+        context.buffer = buffer;
+        context.length = length;
+        context.done = 0;
+        context.used = true;
+        context.completed = length == 0;
+        context.submitted = false;
+        if (!context.completed)
+            mQueue.push_back(i);
+        if (mBackend == IO_URING)
+        {
+            ReapCompletions();
+            SubmitChain();
+        }
+        else
+            TransferReady();
+        return i;
+    }
+    return -1;
+}
+
+bool AsyncStreamIO::Wait(int handle, unsigned timeout_ms)
+{
+    if (handle < 0 || handle >= int(mContexts.size()) || !mContexts[handle].used)
+        return true;
+    return Progress(handle, timeout_ms);
+}
+
+int AsyncStreamIO::Finish(int handle)
+{
+    if (handle < 0 || handle >= int(mContexts.size()))
+        return -1;
+    Context &context = mContexts[handle];
+    if (!context.used || !context.completed)
+        return -1;
+    context.used = false;
+    return int(context.done);
+}
+
+void AsyncStreamIO::Abort()
+{
+#ifdef HAVE_IO_URING
+    if (mBackend == IO_URING && mInFlight > 0)
+    {
+        for (auto handle : mQueue)
+        {
+            if (!mContexts[handle].submitted)
+                continue;
+            io_uring_sqe* sqe = mRing->NextRequest();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = handle;
+            sqe->user_data = cCancelRequest;
+        }
+        mRing->Submit();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(cCancelTimeout_ms);
+        while (mInFlight > 0 && std::chrono::steady_clock::now() < deadline)
+        {
+            pollfd pfd = {mRing->fd, POLLIN, 0};
+            poll(&pfd, 1, 10);
+            ReapCompletions();
+        }
+    }
+#endif
+    mQueue.clear();
+    for (auto &context : mContexts)
+        context.used = false;
+    //requests which could not be cancelled may still write to buffers,
+    //so contexts are not reused
+    mFailed = mInFlight > 0;
+    if (mFailed)
+        lime::warning("Stream transfers could not be cancelled");
+}
+
+bool AsyncStreamIO::Progress(int handle, unsigned timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true)
+    {
+        if (mBackend == IO_URING)
+        {
+            ReapCompletions();
+            SubmitChain();
+        }
+        else
+            TransferReady();
+        if (mContexts[handle].completed)
+            return true;
+
+        auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+            return false;
+        //io_uring fd becomes readable when completions are available
+        pollfd pfd;
+        pfd.fd = mBackend == IO_URING ? mRing->fd : mFd;
+        pfd.events = mBackend == IO_URING || !mWrite ? POLLIN : POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, int((remaining + 999) / 1000)) < 0 && errno != EINTR)
+            Fail(errno);
+    }
+}
+
+void AsyncStreamIO::Complete(int handle)
+{
+    mContexts[handle].completed = true;
+    mQueue.erase(std::find(mQueue.begin(), mQueue.end(), handle));
+    //flush data to FPGA
+    if (mWrite)
+        while (write(mFd, nullptr, 0) < 0 && errno == EINTR);
+}
+
+/** @brief Completes all begun contexts with data transferred so far
+    @param error errno value, 0 for end of file
+*/
+void AsyncStreamIO::Fail(int error)
+{
+    if (!mFailed)
+    {
+        if (error)
+            lime::ReportError(error, "Stream transfer failed: %s", strerror(error));
+        else
+            lime::ReportError(EPIPE, "Stream device file was closed");
+    }
+    mFailed = true;
+    for (auto handle : mQueue)
+        mContexts[handle].completed = true;
+    mQueue.clear();
+}
+
+void AsyncStreamIO::TransferReady()
+{
+    while (!mQueue.empty())
+    {
+        const int handle = mQueue.front();
+        Context &context = mContexts[handle];
+        const ssize_t count = mWrite ?
+            write(mFd, context.buffer + context.done, context.length - context.done) :
+            read(mFd, context.buffer + context.done, context.length - context.done);
+        if (count > 0)
+        {
+            context.done += count;
+            if (context.done == context.length)
+                Complete(handle);
+            continue;
+        }
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        Fail(count < 0 ? errno : 0);
+        return;
+    }
+}
+
+void AsyncStreamIO::SubmitChain()
+{
+#ifdef HAVE_IO_URING
+    //linked chain can not be extended, contexts begun meanwhile form next one
+    if (mInFlight > 0 || mQueue.empty() || mFailed)
+        return;
+    for (size_t i = 0; i < mQueue.size(); ++i)
+    {
+        Context &context = mContexts[mQueue[i]];
+        io_uring_sqe* sqe = mRing->NextRequest();
+        sqe->opcode = mWrite ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = mFd;
+        sqe->off = uint64_t(-1); //current file position
+        sqe->addr = reinterpret_cast<uintptr_t>(context.buffer + context.done);
+        sqe->len = context.length - context.done;
+        sqe->user_data = mQueue[i];
+        //next request starts after this one transferred whole buffer,
+        //short transfer cancels the rest of chain, which is then submitted again
+        if (i + 1 < mQueue.size())
+            sqe->flags = IOSQE_IO_LINK;
+        context.submitted = true;
+        ++mInFlight;
+    }
+    const int status = mRing->Submit();
+    if (status != 0)
+        Fail(status);
+#endif
+}
+
+void AsyncStreamIO::ReapCompletions()
+{
+#ifdef HAVE_IO_URING
+    unsigned head = *mRing->cqHead;
+    const unsigned tail = __atomic_load_n(mRing->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe &cqe = mRing->cqes[head & *mRing->cqMask];
+        if (cqe.user_data >= mContexts.size())
+            continue;
+        --mInFlight;
+        const int handle = int(cqe.user_data);
+        Context &context = mContexts[handle];
+        context.submitted = false;
+        if (context.completed)
+            continue;
+        if (cqe.res > 0)
+        {
+            context.done += cqe.res;
+            if (context.done == context.length)
+                Complete(handle);
+        }
+        else if (cqe.res == 0)
+            Fail(0);
+        else if (cqe.res != -ECANCELED && cqe.res != -EINTR && cqe.res != -EAGAIN)
+            Fail(-cqe.res);
+    }
+    __atomic_store_n(mRing->cqHead, head, __ATOMIC_RELEASE);
+#endif
+}
@@ -0,0 +1,101 @@
+/**
+    @file AsyncStreamIO.h
+    @author Lime Microsystems
+    @brief Multi-buffer asynchronous reading and writing of stream device files
+*/
+
+#pragma once
+#include "LimeSuiteConfig.h"
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace lime{
+
+/** @brief Keeps several transfers of a byte stream file in flight.
+
+    Transfers are completed in the order they were begun, each one only after
+    its whole buffer was transferred. Written buffers are followed by zero
+    length write, which makes Xillybus flush data to FPGA.
+    IO_URING backend submits queued transfers as a linked chain, so kernel
+    executes them in order without further system calls from the caller.
+    POLL backend transfers data with non-blocking calls and sleeps in poll()
+    while device file is not ready. Both wait without spinning.
+    Object is not thread safe, it is meant to be used by one stream thread.
+*/
+class LIME_API AsyncStreamIO
+{
+public:
+    enum Backend
+    {
+        AUTO, ///<io_uring if supported by system, poll otherwise
+        IO_URING,
+        POLL,
+    };
+
+    /** @param fd opened device file, stays owned by caller
+        @param write true for writing to file
+        @param contexts maximum number of transfers in flight
+        @param backend requested backend, POLL is used if io_uring is not available
+    */
+    AsyncStreamIO(int fd, bool write, int contexts, Backend backend = AUTO);
+    ~AsyncStreamIO();
+
+    Backend GetBackend() const;
+    static const char* GetBackendName(Backend backend);
+
+    /** @brief Queues transfer of whole buffer
+        @return context handle, -1 if there is no free context or stream failed
+    */
+    int Begin(char* buffer, size_t length);
+
+    /** @return true if transfer of given context is completed
+    */
+    bool Wait(int handle, unsigned timeout_ms);
+
+    /** @brief Releases completed context
+        @return number of bytes transferred, -1 if transfer is not completed
+    */
+    int Finish(int handle);
+
+    /** @brief Cancels all transfers and releases their contexts
+    */
+    void Abort();
+
+    /** @return true if device file returned error or end of file
+    */
+    bool Failed() const;
+
+private:
+    struct Context
+    {
+        char* buffer;
+        size_t length;
+        size_t done;
+        bool used;
+        bool completed;
+        bool submitted;
+    };
+    struct Ring;
+
+    bool Progress(int handle, unsigned timeout_ms);
+    void Complete(int handle);
+    void Fail(int error);
+    void TransferReady();
+    bool SetupRing(unsigned entries);
+    void SubmitChain();
+    void ReapCompletions();
+
+    int mFd;
+    int mFileFlags;
+    bool mWrite;
+    bool mFailed;
+    Backend mBackend;
+    std::vector<Context> mContexts;
+    std::deque<int> mQueue; //begun contexts in order, not yet completed
+    unsigned mInFlight; //io_uring requests waiting for completion
+    std::unique_ptr<Ring> mRing;
+};
+
+}
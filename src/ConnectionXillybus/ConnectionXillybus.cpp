@@ -9,6 +9,7 @@
 #include "Windows.h"
 #else
 #include <unistd.h>
+#include <poll.h>
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -19,6 +20,7 @@
 #include <FPGA_common.h>
 #include <LMS7002M.h>
 #include <ciso646>
+#include <cstdlib>
 #include "Logger.h"
 
 #include <thread>
@@ -103,8 +105,16 @@ ConnectionXillybus::ConnectionXillybus(const unsigned index)
 #else
     hWrite = -1;
     hRead = -1;
+    mControlUsers = 0;
     for (int i = 0; i < MAX_EP_CNT; i++)
         hWriteStream[i] = hReadStream[i] = -1;
+    //stream transfer backend can be forced for comparison
+    const char* backend = std::getenv("LIME_XILLYBUS_IO");
+    mStreamBackend = AsyncStreamIO::AUTO;
+    if (backend && strcmp(backend, "poll") == 0)
+        mStreamBackend = AsyncStreamIO::POLL;
+    else if (backend && strcmp(backend, "io_uring") == 0)
+        mStreamBackend = AsyncStreamIO::IO_URING;
 #endif
     Open(index);
     isConnected = true;
@@ -191,6 +201,8 @@ void ConnectionXillybus::Close()
     CloseControl();
     for (int i = 0; i < MAX_EP_CNT; i++)
     {
+        mWriteStreamIO[i].reset();
+        mReadStreamIO[i].reset();
         if( hWriteStream[i] >= 0)
             close(hWriteStream[i]);
         hWriteStream[i] = -1;
@@ -210,6 +222,28 @@ bool ConnectionXillybus::IsOpen()
 }
 
 #ifdef __unix__
+/** @brief Sleeps until device file is ready for transfer or timeout passes
+*/
+static void WaitReady(int fd, short events, chrono::high_resolution_clock::time_point start, int timeout_ms)
+{
+    const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count();
+    if (elapsed >= timeout_ms)
+        return;
+    pollfd pfd = {fd, events, 0};
+    poll(&pfd, 1, timeout_ms - elapsed);
+}
+
+/** @brief Opens stream device file if it is not opened yet
+*/
+int ConnectionXillybus::OpenStream(int &handle, const std::string &port, int flags)
+{
+    if (handle != -1)
+        return 0;
+    if ((handle = open(port.c_str(), flags | O_NOCTTY | O_NONBLOCK)) == -1)
+        return ReportError(errno);
+    return 0;
+}
+
 int ConnectionXillybus::OpenControl()
 {
     int timeout_cnt = 100;
@@ -240,26 +274,43 @@ void ConnectionXillybus::CloseControl()
     hRead = -1;
 }
 
-int ConnectionXillybus::TransferPacket(GenericPacket &pkt)
+/** @brief Opens control port for the first of concurrent transfers
+*/
+int ConnectionXillybus::AcquireControl()
 {
-    int status;
     std::lock_guard<std::mutex> lock(mTransferLock);
-    if (OpenControl() == 0)
-        status = LMS64CProtocol::TransferPacket(pkt);
-    else
-        status = -1;
-    CloseControl();
+    if (mControlUsers == 0 && OpenControl() != 0)
+    {
+        CloseControl();
+        return -1;
+    }
+    ++mControlUsers;
+    return 0;
+}
+
+/** @brief Closes control port after the last of concurrent transfers
+*/
+void ConnectionXillybus::ReleaseControl()
+{
+    std::lock_guard<std::mutex> lock(mTransferLock);
+    if (--mControlUsers == 0)
+        CloseControl();
+}
+
+int ConnectionXillybus::TransferPacket(GenericPacket &pkt)
+{
+    if (AcquireControl() != 0)
+        return -1;
+    int status = LMS64CProtocol::TransferPacket(pkt);
+    ReleaseControl();
     return status;
 }
 int ConnectionXillybus::ProgramWrite(const char *data_src, const size_t length, const int prog_mode, const int device, ProgrammingCallback callback)
 {
-    int status;
-    std::lock_guard<std::mutex> lock(mTransferLock);
-    if (OpenControl() == 0)
-        status = LMS64CProtocol::ProgramWrite(data_src, length, prog_mode, device, callback);
-    else
-        status = -1;
-    CloseControl();
+    if (AcquireControl() != 0)
+        return -1;
+    int status = LMS64CProtocol::ProgramWrite(data_src, length, prog_mode, device, callback);
+    ReleaseControl();
     return status;
 }
 #endif
@@ -312,7 +363,11 @@ int ConnectionXillybus::Write(const unsigned char *buffer, const int length, int
         if ((bytesSent  = write(hWrite, buffer+ totalBytesWritten, bytesToWrite))<0)
         {
             if(errno == EINTR || errno == EAGAIN)
-                 continue;
+            {
+                if (errno == EAGAIN)
+                    WaitReady(hWrite, POLLOUT, t1, timeout_ms);
+                continue;
+            }
             ReportError(errno);
             return totalBytesWritten;
         }
@@ -398,7 +453,11 @@ int ConnectionXillybus::Read(unsigned char *buffer, const int length, int timeou
         if ((bytesReceived = read(hRead, buffer+ totalBytesReaded, bytesToRead))<0)
         {
            if(errno == EINTR || errno == EAGAIN)
+           {
+               if (errno == EAGAIN)
+                   WaitReady(hRead, POLLIN, t1, timeout_ms);
                continue;
+           }
            ReportError(errno);
            return totalBytesReaded;
         }
@@ -428,7 +487,11 @@ int ConnectionXillybus::Read(unsigned char *buffer, const int length, int timeou
 
 int ConnectionXillybus::GetBuffersCount() const
 {
+#ifdef __unix__
+    return STREAM_CONTEXTS;
+#else
     return 1;
+#endif
 }
 
 int ConnectionXillybus::CheckStreamSize(int size) const
@@ -456,14 +519,10 @@ int ConnectionXillybus::ReceiveData(char *buffer, int length, int epIndex, int t
         }
     }
 #else
-    if (hReadStream[epIndex] == -1)
-    {
-       if (( hReadStream[epIndex] = open(readStreamPort[epIndex].c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK))==-1)
-       {
-            ReportError(errno);
-            return 0;
-       }
-    }
+    //synchronous reads continue where asynchronous transfers stopped
+    mReadStreamIO[epIndex].reset();
+    if (OpenStream(hReadStream[epIndex], readStreamPort[epIndex], O_RDONLY) != 0)
+        return 0;
 #endif
 
     int totalBytesReaded = 0;
@@ -502,7 +561,11 @@ int ConnectionXillybus::ReceiveData(char *buffer, int length, int epIndex, int t
         if ((bytesReceived = read(hReadStream[epIndex], buffer+ totalBytesReaded, bytesToRead))<0)
         {
             if(errno == EINTR || errno == EAGAIN)
+            {
+                if (errno == EAGAIN)
+                    WaitReady(hReadStream[epIndex], POLLIN, t1, timeout_ms);
                 continue;
+            }
             ReportError(errno);
             return totalBytesReaded;
         }
@@ -530,6 +593,7 @@ void ConnectionXillybus::AbortReading(int epIndex)
 	hReadStream[epIndex] = INVALID_HANDLE_VALUE;
     }
 #else
+    mReadStreamIO[epIndex].reset();
     if (hReadStream[epIndex] >= 0)
     {
         close(hReadStream[epIndex]);
@@ -558,14 +622,9 @@ int ConnectionXillybus::SendData(const char *buffer, int length, int epIndex, in
         }
     }
 #else
-    if (hWriteStream[epIndex] == -1)
-    {
-       if ((hWriteStream[epIndex] = open(writeStreamPort[epIndex].c_str(), O_WRONLY | O_NOCTTY | O_NONBLOCK))==-1)
-       {
-            ReportError(errno);
-            return 0;
-       }
-    }
+    mWriteStreamIO[epIndex].reset();
+    if (OpenStream(hWriteStream[epIndex], writeStreamPort[epIndex], O_WRONLY) != 0)
+        return 0;
 #endif
     int totalBytesWritten = 0;
     int bytesToWrite = length;
@@ -603,7 +662,11 @@ int ConnectionXillybus::SendData(const char *buffer, int length, int epIndex, in
         if ((bytesSent  = write(hWriteStream[epIndex], buffer+ totalBytesWritten, bytesToWrite))<0)
         {
             if(errno == EINTR || errno == EAGAIN)
+            {
+                if (errno == EAGAIN)
+                    WaitReady(hWriteStream[epIndex], POLLOUT, t1, timeout_ms);
                 continue;
+            }
             ReportError(errno);
             return totalBytesWritten;
         }
@@ -640,6 +703,7 @@ void ConnectionXillybus::AbortSending(int epIndex)
         hWriteStream[epIndex] = INVALID_HANDLE_VALUE;
     }
 #else
+    mWriteStreamIO[epIndex].reset();
     if (hWriteStream[epIndex] >= 0)
     {
         close(hWriteStream[epIndex]);
@@ -648,6 +712,67 @@ void ConnectionXillybus::AbortSending(int epIndex)
 #endif
 }
 
+#ifdef __unix__
+/** @brief Queues reading of whole buffer, several reads are kept in flight
+    @return context handle, -1 on failure
+*/
+int ConnectionXillybus::BeginDataReading(char* buffer, uint32_t length, int ep)
+{
+    if (!mReadStreamIO[ep])
+    {
+        if (OpenStream(hReadStream[ep], readStreamPort[ep], O_RDONLY) != 0)
+            return -1;
+        mReadStreamIO[ep].reset(new AsyncStreamIO(hReadStream[ep], false, STREAM_CONTEXTS, mStreamBackend));
+    }
+    const int context = mReadStreamIO[ep]->Begin(buffer, length);
+    if (context < 0)
+        return -1;
+    return ep * STREAM_CONTEXTS + context;
+}
+bool ConnectionXillybus::WaitForReading(int contextHandle, unsigned int timeout_ms)
+{
+    if (contextHandle < 0 || !mReadStreamIO[contextHandle / STREAM_CONTEXTS])
+        return true;
+    return mReadStreamIO[contextHandle / STREAM_CONTEXTS]->Wait(contextHandle % STREAM_CONTEXTS, timeout_ms);
+}
+int ConnectionXillybus::FinishDataReading(char*, uint32_t, int contextHandle)
+{
+    if (contextHandle < 0 || !mReadStreamIO[contextHandle / STREAM_CONTEXTS])
+        return 0;
+    const int bytesReceived = mReadStreamIO[contextHandle / STREAM_CONTEXTS]->Finish(contextHandle % STREAM_CONTEXTS);
+    return bytesReceived < 0 ? 0 : bytesReceived;
+}
+
+/** @brief Queues writing of whole buffer, data is flushed to FPGA after each buffer
+    @return context handle, -1 on failure
+*/
+int ConnectionXillybus::BeginDataSending(const char* buffer, uint32_t length, int ep)
+{
+    if (!mWriteStreamIO[ep])
+    {
+        if (OpenStream(hWriteStream[ep], writeStreamPort[ep], O_WRONLY) != 0)
+            return -1;
+        mWriteStreamIO[ep].reset(new AsyncStreamIO(hWriteStream[ep], true, STREAM_CONTEXTS, mStreamBackend));
+    }
+    const int context = mWriteStreamIO[ep]->Begin(const_cast<char*>(buffer), length);
+    if (context < 0)
+        return -1;
+    return ep * STREAM_CONTEXTS + context;
+}
+bool ConnectionXillybus::WaitForSending(int contextHandle, uint32_t timeout_ms)
+{
+    if (contextHandle < 0 || !mWriteStreamIO[contextHandle / STREAM_CONTEXTS])
+        return true;
+    return mWriteStreamIO[contextHandle / STREAM_CONTEXTS]->Wait(contextHandle % STREAM_CONTEXTS, timeout_ms);
+}
+int ConnectionXillybus::FinishDataSending(const char*, uint32_t, int contextHandle)
+{
+    if (contextHandle < 0 || !mWriteStreamIO[contextHandle / STREAM_CONTEXTS])
+        return 0;
+    const int bytesSent = mWriteStreamIO[contextHandle / STREAM_CONTEXTS]->Finish(contextHandle % STREAM_CONTEXTS);
+    return bytesSent < 0 ? 0 : bytesSent;
+}
+#else
 int ConnectionXillybus::BeginDataReading(char* buffer, uint32_t length, int ep)
 {
     return ep;
@@ -673,3 +798,4 @@ int ConnectionXillybus::FinishDataSending(const char* buffer, uint32_t length, i
 {
     return contextHandle;
 }
+#endif
@@ -19,6 +19,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include "AsyncStreamIO.h"
 #endif
 
 namespace lime{
@@ -82,12 +83,20 @@ private:
     HANDLE hWriteStream[MAX_EP_CNT];
     HANDLE hReadStream[MAX_EP_CNT];
 #else
+    static const int STREAM_CONTEXTS = 8; //transfers in flight per stream
+    int OpenStream(int &handle, const std::string &port, int flags);
     int OpenControl();
     void CloseControl();
+    int AcquireControl();
+    void ReleaseControl();
+    int mControlUsers; //transfers sharing opened control port
     int hWrite;
     int hRead;
     int hWriteStream[MAX_EP_CNT];
     int hReadStream[MAX_EP_CNT];
+    AsyncStreamIO::Backend mStreamBackend;
+    std::unique_ptr<AsyncStreamIO> mWriteStreamIO[MAX_EP_CNT];
+    std::unique_ptr<AsyncStreamIO> mReadStreamIO[MAX_EP_CNT];
 #endif
     std::string writeCtrlPort;
     std::string readCtrlPort;
@@ -1,6 +1,7 @@
 #include "FPGA_common.h"
 #include "IConnection.h"
 #include "LMS64CProtocol.h"
+#include "SampleConversion.h"
 #include <ciso646>
 #include <vector>
 #include <map>
@@ -502,46 +503,21 @@ int FPGA::SetDirectClocking(int clockIndex)
 */
 int FPGA::FPGAPacketPayload2Samples(const uint8_t* buffer, int bufLen, bool mimo, bool compressed, complex16_t** samples)
 {
+    const SampleConverters& conv = GetSampleConverters();
     if(compressed) //compressed samples
     {
-        int16_t sample;
-        int collected = 0;
-        for(int b=0; b<bufLen;collected++)
-        {
-            //I sample
-            sample = buffer[b++];
-            sample |= (buffer[b] << 8);
-            sample <<= 4;
-            samples[0][collected].i = sample >> 4;
-            //Q sample
-            sample =  buffer[b++];
-            sample |= buffer[b++] << 8;
-            samples[0][collected].q = sample >> 4;
-            if (mimo)
-            {
-                //I sample
-                sample = buffer[b++];
-                sample |= (buffer[b] << 8);
-                sample <<= 4;
-                samples[1][collected].i = sample >> 4;
-                //Q sample
-                sample =  buffer[b++];
-                sample |= buffer[b++] << 8;
-                samples[1][collected].q = sample >> 4;
-            }
-        }
+        const int collected = bufLen/(mimo ? 6 : 3);
+        if (mimo)
+            conv.Unpack12MIMO(buffer, collected, samples[0], samples[1]);
+        else
+            conv.Unpack12(buffer, collected, samples[0]);
         return collected;
     }
 
     if (mimo) //uncompressed samples
     {
-        complex16_t* ptr = (complex16_t*)buffer;
         const int collected = bufLen/sizeof(complex16_t)/2;
-        for(int i=0; i<collected;i++)
-        {
-            samples[0][i] = *ptr++;
-            samples[1][i] = *ptr++;
-        }
+        conv.Deinterleave16((const complex16_t*)buffer, collected, samples[0], samples[1]);
         return collected;
     }
 
@@ -551,32 +527,21 @@ int FPGA::FPGAPacketPayload2Samples(const uint8_t* buffer, int bufLen, bool mimo
 
 int FPGA::Samples2FPGAPacketPayload(const complex16_t* const* samples, int samplesCount, bool mimo, bool compressed, uint8_t* buffer)
 {
+    const SampleConverters& conv = GetSampleConverters();
     if(compressed)
     {
-        int b=0;
-        for(int src=0; src<samplesCount; ++src)
+        if (mimo)
         {
-            buffer[b++] = samples[0][src].i;
-            buffer[b++] = ((samples[0][src].i >> 8) & 0x0F) | (samples[0][src].q << 4);
-            buffer[b++] = samples[0][src].q >> 4;
-            if (mimo)
-            {
-                buffer[b++] = samples[1][src].i;
-                buffer[b++] = ((samples[1][src].i >> 8) & 0x0F) | (samples[1][src].q << 4);
-                buffer[b++] = samples[1][src].q >> 4;
-            }
+            conv.Pack12MIMO(samples[0], samples[1], samplesCount, buffer);
+            return samplesCount*6;
         }
-        return b;
+        conv.Pack12(samples[0], samplesCount, buffer);
+        return samplesCount*3;
     }
 
     if (mimo)
     {
-        complex16_t* ptr = (complex16_t*)buffer;
-        for(int src=0; src<samplesCount; ++src)
-        {
-            *ptr++ = samples[0][src];
-            *ptr++ = samples[1][src];
-        }
+        conv.Interleave16(samples[0], samples[1], samplesCount, (complex16_t*)buffer);
         return samplesCount*2*sizeof(complex16_t);
     }
     memcpy(buffer,samples[0],samplesCount*sizeof(complex16_t));
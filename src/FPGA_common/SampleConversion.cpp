@@ -0,0 +1,642 @@
+/**
+@file SampleConversion.cpp
+@author Lime Microsystems
+@brief Packet payload packing/unpacking kernels with runtime CPU dispatch
+*/
+
+#include "SampleConversion.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define LIME_SIMD_X86 1
+    #define LIME_TARGET(isa) __attribute__((target(isa)))
+    #include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #define LIME_SIMD_X86 1
+    #define LIME_TARGET(isa)
+    #include <immintrin.h>
+    #include <intrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define LIME_SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+namespace lime
+{
+
+/***********************************************************************
+ * Scalar reference implementation
+ **********************************************************************/
+static inline void Unpack12One(const uint8_t* src, complex16_t &dst)
+{
+    dst.i = int16_t((src[0] | src[1] << 8) << 4) >> 4;
+    dst.q = int16_t(src[1] | src[2] << 8) >> 4;
+}
+
+static inline void Pack12One(const complex16_t &src, uint8_t* dst)
+{
+    dst[0] = src.i;
+    dst[1] = ((src.i >> 8) & 0x0F) | (src.q << 4);
+    dst[2] = src.q >> 4;
+}
+
+static void Unpack12_scalar(const uint8_t* src, int count, complex16_t* dst)
+{
+    for (int i = 0; i < count; ++i)
+        Unpack12One(src + 3*i, dst[i]);
+}
+
+static void Unpack12MIMO_scalar(const uint8_t* src, int count, complex16_t* dstA, complex16_t* dstB)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Unpack12One(src + 6*i, dstA[i]);
+        Unpack12One(src + 6*i + 3, dstB[i]);
+    }
+}
+
+static void Pack12_scalar(const complex16_t* src, int count, uint8_t* dst)
+{
+    for (int i = 0; i < count; ++i)
+        Pack12One(src[i], dst + 3*i);
+}
+
+static void Pack12MIMO_scalar(const complex16_t* srcA, const complex16_t* srcB, int count, uint8_t* dst)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        Pack12One(srcA[i], dst + 6*i);
+        Pack12One(srcB[i], dst + 6*i + 3);
+    }
+}
+
+static void Deinterleave16_scalar(const complex16_t* src, int count, complex16_t* dstA, complex16_t* dstB)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        dstA[i] = src[2*i];
+        dstB[i] = src[2*i+1];
+    }
+}
+
+static void Interleave16_scalar(const complex16_t* srcA, const complex16_t* srcB, int count, complex16_t* dst)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        dst[2*i] = srcA[i];
+        dst[2*i+1] = srcB[i];
+    }
+}
+
+static void FloatToInt16_scalar(const float* src, int count, float scale, complex16_t* dst)
+{
+    int16_t* out = (int16_t*)dst;
+    const float lo = -scale - 1;
+    for (int i = 0; i < 2*count; ++i)
+    {
+        float v = src[i]*scale;
+        v = v < lo ? lo : (v > scale ? scale : v);
+        out[i] = v;
+    }
+}
+
+static void Int16ToFloat_scalar(const complex16_t* src, int count, float scale, float* dst)
+{
+    const int16_t* in = (const int16_t*)src;
+    const float mult = 1.0f/scale;
+    for (int i = 0; i < 2*count; ++i)
+        dst[i] = in[i]*mult;
+}
+
+static const SampleConverters convScalar = {
+    "scalar",
+    Unpack12_scalar,
+    Unpack12MIMO_scalar,
+    Pack12_scalar,
+    Pack12MIMO_scalar,
+    Deinterleave16_scalar,
+    Interleave16_scalar,
+    FloatToInt16_scalar,
+    Int16ToFloat_scalar
+};
+
+#ifdef LIME_SIMD_X86
+/***********************************************************************
+ * x86 SSSE3 (12 bit kernels need PSHUFB) and SSE2 (16 bit kernels)
+ **********************************************************************/
+//I word from bytes 0,1; Q word from bytes 1,2 of every 3 byte group
+#define UNPACK12_SHUF 0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11
+//same as above, but channel A groups first, then channel B groups
+#define UNPACK12_MIMO_SHUF 0, 1, 1, 2, 6, 7, 7, 8, 3, 4, 4, 5, 9, 10, 10, 11
+//drop top byte of every 32 bit lane
+#define PACK12_SHUF 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+//I lanes are shifted up by 4 (multiply by 16), so that arithmetic shift right
+//by 4 sign extends the 12 bit value, Q lanes already have sign bit on top
+LIME_TARGET("ssse3") static inline __m128i Unpack12x4_ssse3(const uint8_t* src, const __m128i shuf)
+{
+    const __m128i scale = _mm_set1_epi32(0x00010010);
+    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)src), shuf);
+    return _mm_srai_epi16(_mm_mullo_epi16(v, scale), 4);
+}
+
+//returns 12 packed bytes in low part of register, top 4 bytes are zero
+LIME_TARGET("ssse3") static inline __m128i Pack12x4_ssse3(__m128i v)
+{
+    const __m128i shuf = _mm_setr_epi8(PACK12_SHUF);
+    const __m128i maskI = _mm_set1_epi32(0x00000FFF);
+    const __m128i maskQ = _mm_set1_epi32(0x00FFF000);
+    v = _mm_or_si128(_mm_and_si128(v, maskI), _mm_and_si128(_mm_srli_epi32(v, 4), maskQ));
+    return _mm_shuffle_epi8(v, shuf);
+}
+
+//merges four 12 byte blocks into three full 16 byte stores
+LIME_TARGET("ssse3") static inline void Store48_ssse3(__m128i p0, __m128i p1, __m128i p2, __m128i p3, uint8_t* dst)
+{
+    _mm_storeu_si128((__m128i*)dst, _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+    _mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+    _mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+LIME_TARGET("ssse3") static void Unpack12_ssse3(const uint8_t* src, int count, complex16_t* dst)
+{
+    const __m128i shuf = _mm_setr_epi8(UNPACK12_SHUF);
+    int i = 0;
+    for (; i + 6 <= count; i += 4) //16 byte load must stay inside buffer
+        _mm_storeu_si128((__m128i*)(dst + i), Unpack12x4_ssse3(src + 3*i, shuf));
+    Unpack12_scalar(src + 3*i, count - i, dst + i);
+}
+
+LIME_TARGET("ssse3") static void Unpack12MIMO_ssse3(const uint8_t* src, int count, complex16_t* dstA, complex16_t* dstB)
+{
+    const __m128i shuf = _mm_setr_epi8(UNPACK12_MIMO_SHUF);
+    int i = 0;
+    for (; i + 5 <= count; i += 4)
+    {
+        //A0A1 B0B1, A2A3 B2B3
+        const __m128i v0 = Unpack12x4_ssse3(src + 6*i, shuf);
+        const __m128i v1 = Unpack12x4_ssse3(src + 6*i + 12, shuf);
+        _mm_storeu_si128((__m128i*)(dstA + i), _mm_unpacklo_epi64(v0, v1));
+        _mm_storeu_si128((__m128i*)(dstB + i), _mm_unpackhi_epi64(v0, v1));
+    }
+    Unpack12MIMO_scalar(src + 6*i, count - i, dstA + i, dstB + i);
+}
+
+LIME_TARGET("ssse3") static void Pack12_ssse3(const complex16_t* src, int count, uint8_t* dst)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i* in = (const __m128i*)(src + i);
+        Store48_ssse3(Pack12x4_ssse3(_mm_loadu_si128(in)), Pack12x4_ssse3(_mm_loadu_si128(in + 1)),
+                      Pack12x4_ssse3(_mm_loadu_si128(in + 2)), Pack12x4_ssse3(_mm_loadu_si128(in + 3)), dst + 3*i);
+    }
+    Pack12_scalar(src + i, count - i, dst + 3*i);
+}
+
+LIME_TARGET("ssse3") static void Pack12MIMO_ssse3(const complex16_t* srcA, const complex16_t* srcB, int count, uint8_t* dst)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i a0 = _mm_loadu_si128((const __m128i*)(srcA + i));
+        const __m128i b0 = _mm_loadu_si128((const __m128i*)(srcB + i));
+        const __m128i a1 = _mm_loadu_si128((const __m128i*)(srcA + i + 4));
+        const __m128i b1 = _mm_loadu_si128((const __m128i*)(srcB + i + 4));
+        Store48_ssse3(Pack12x4_ssse3(_mm_unpacklo_epi32(a0, b0)), Pack12x4_ssse3(_mm_unpackhi_epi32(a0, b0)),
+                      Pack12x4_ssse3(_mm_unpacklo_epi32(a1, b1)), Pack12x4_ssse3(_mm_unpackhi_epi32(a1, b1)), dst + 6*i);
+    }
+    Pack12MIMO_scalar(srcA + i, srcB + i, count - i, dst + 6*i);
+}
+
+LIME_TARGET("sse2") static void Deinterleave16_sse2(const complex16_t* src, int count, complex16_t* dstA, complex16_t* dstB)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        //A0 B0 A1 B1 -> A0 A1 B0 B1
+        const __m128i v0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src + 2*i)), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m128i v1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src + 2*i + 4)), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(dstA + i), _mm_unpacklo_epi64(v0, v1));
+        _mm_storeu_si128((__m128i*)(dstB + i), _mm_unpackhi_epi64(v0, v1));
+    }
+    Deinterleave16_scalar(src + 2*i, count - i, dstA + i, dstB + i);
+}
+
+LIME_TARGET("sse2") static void Interleave16_sse2(const complex16_t* srcA, const complex16_t* srcB, int count, complex16_t* dst)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(srcA + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(srcB + i));
+        _mm_storeu_si128((__m128i*)(dst + 2*i), _mm_unpacklo_epi32(a, b));
+        _mm_storeu_si128((__m128i*)(dst + 2*i + 4), _mm_unpackhi_epi32(a, b));
+    }
+    Interleave16_scalar(srcA + i, srcB + i, count - i, dst + 2*i);
+}
+
+LIME_TARGET("sse2") static void FloatToInt16_sse2(const float* src, int count, float scale, complex16_t* dst)
+{
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 lo = _mm_set1_ps(-scale - 1);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + 2*i), s), lo), s);
+        const __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + 2*i + 4), s), lo), s);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+    }
+    FloatToInt16_scalar(src + 2*i, count - i, scale, dst + i);
+}
+
+LIME_TARGET("sse2") static void Int16ToFloat_sse2(const complex16_t* src, int count, float scale, float* dst)
+{
+    const __m128 mult = _mm_set1_ps(1.0f/scale);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        //sign extend by placing values in upper halves and shifting down
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + 2*i, _mm_mul_ps(_mm_cvtepi32_ps(lo), mult));
+        _mm_storeu_ps(dst + 2*i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), mult));
+    }
+    Int16ToFloat_scalar(src + i, count - i, scale, dst + 2*i);
+}
+
+static const SampleConverters convSSSE3 = {
+    "SSSE3",
+    Unpack12_ssse3,
+    Unpack12MIMO_ssse3,
+    Pack12_ssse3,
+    Pack12MIMO_ssse3,
+    Deinterleave16_sse2,
+    Interleave16_sse2,
+    FloatToInt16_sse2,
+    Int16ToFloat_sse2
+};
+
+/***********************************************************************
+ * x86 AVX2, byte shuffles work within 128 bit lanes
+ **********************************************************************/
+LIME_TARGET("avx2") static inline __m256i Unpack12x8_avx2(const uint8_t* src, const __m256i shuf)
+{
+    const __m256i scale = _mm256_set1_epi32(0x00010010);
+    const __m128i lo = _mm_loadu_si128((const __m128i*)src);
+    const __m128i hi = _mm_loadu_si128((const __m128i*)(src + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    v = _mm256_shuffle_epi8(v, shuf);
+    return _mm256_srai_epi16(_mm256_mullo_epi16(v, scale), 4);
+}
+
+//each 128 bit lane gets 12 packed bytes in its low part
+LIME_TARGET("avx2") static inline __m256i Pack12x8_avx2(__m256i v)
+{
+    const __m256i shuf = _mm256_setr_epi8(PACK12_SHUF, PACK12_SHUF);
+    const __m256i maskI = _mm256_set1_epi32(0x00000FFF);
+    const __m256i maskQ = _mm256_set1_epi32(0x00FFF000);
+    v = _mm256_or_si256(_mm256_and_si256(v, maskI), _mm256_and_si256(_mm256_srli_epi32(v, 4), maskQ));
+    return _mm256_shuffle_epi8(v, shuf);
+}
+
+LIME_TARGET("avx2") static inline void Store48_avx2(__m256i v0, __m256i v1, uint8_t* dst)
+{
+    Store48_ssse3(_mm256_castsi256_si128(v0), _mm256_extracti128_si256(v0, 1),
+                  _mm256_castsi256_si128(v1), _mm256_extracti128_si256(v1, 1), dst);
+}
+
+LIME_TARGET("avx2") static void Unpack12_avx2(const uint8_t* src, int count, complex16_t* dst)
+{
+    const __m256i shuf = _mm256_setr_epi8(UNPACK12_SHUF, UNPACK12_SHUF);
+    int i = 0;
+    for (; i + 10 <= count; i += 8) //last 16 byte load starts at +12
+        _mm256_storeu_si256((__m256i*)(dst + i), Unpack12x8_avx2(src + 3*i, shuf));
+    Unpack12_ssse3(src + 3*i, count - i, dst + i);
+}
+
+LIME_TARGET("avx2") static void Unpack12MIMO_avx2(const uint8_t* src, int count, complex16_t* dstA, complex16_t* dstB)
+{
+    const __m256i shuf = _mm256_setr_epi8(UNPACK12_MIMO_SHUF, UNPACK12_MIMO_SHUF);
+    int i = 0;
+    for (; i + 9 <= count; i += 8)
+    {
+        //A0A1 B0B1 A2A3 B2B3 -> A0A1 A2A3 B0B1 B2B3
+        const __m256i v0 = _mm256_permute4x64_epi64(Unpack12x8_avx2(src + 6*i, shuf), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i v1 = _mm256_permute4x64_epi64(Unpack12x8_avx2(src + 6*i + 24, shuf), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(dstA + i), _mm256_permute2x128_si256(v0, v1, 0x20));
+        _mm256_storeu_si256((__m256i*)(dstB + i), _mm256_permute2x128_si256(v0, v1, 0x31));
+    }
+    Unpack12MIMO_ssse3(src + 6*i, count - i, dstA + i, dstB + i);
+}
+
+LIME_TARGET("avx2") static void Pack12_avx2(const complex16_t* src, int count, uint8_t* dst)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m256i v0 = Pack12x8_avx2(_mm256_loadu_si256((const __m256i*)(src + i)));
+        const __m256i v1 = Pack12x8_avx2(_mm256_loadu_si256((const __m256i*)(src + i + 8)));
+        Store48_avx2(v0, v1, dst + 3*i);
+    }
+    Pack12_ssse3(src + i, count - i, dst + 3*i);
+}
+
+LIME_TARGET("avx2") static void Pack12MIMO_avx2(const complex16_t* srcA, const complex16_t* srcB, int count, uint8_t* dst)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(srcA + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(srcB + i));
+        const __m256i lo = _mm256_unpacklo_epi32(a, b);
+        const __m256i hi = _mm256_unpackhi_epi32(a, b);
+        //lanes in sample order: A0B0A1B1 A2B2A3B3, A4B4A5B5 A6B6A7B7
+        Store48_avx2(Pack12x8_avx2(_mm256_permute2x128_si256(lo, hi, 0x20)),
+                     Pack12x8_avx2(_mm256_permute2x128_si256(lo, hi, 0x31)), dst + 6*i);
+    }
+    Pack12MIMO_ssse3(srcA + i, srcB + i, count - i, dst + 6*i);
+}
+
+LIME_TARGET("avx2") static void Deinterleave16_avx2(const complex16_t* src, int count, complex16_t* dstA, complex16_t* dstB)
+{
+    const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i v0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(src + 2*i)), split);
+        const __m256i v1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(src + 2*i + 8)), split);
+        _mm256_storeu_si256((__m256i*)(dstA + i), _mm256_permute2x128_si256(v0, v1, 0x20));
+        _mm256_storeu_si256((__m256i*)(dstB + i), _mm256_permute2x128_si256(v0, v1, 0x31));
+    }
+    Deinterleave16_sse2(src + 2*i, count - i, dstA + i, dstB + i);
+}
+
+LIME_TARGET("avx2") static void Interleave16_avx2(const complex16_t* srcA, const complex16_t* srcB, int count, complex16_t* dst)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(srcA + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(srcB + i));
+        const __m256i lo = _mm256_unpacklo_epi32(a, b);
+        const __m256i hi = _mm256_unpackhi_epi32(a, b);
+        _mm256_storeu_si256((__m256i*)(dst + 2*i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + 2*i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    Interleave16_sse2(srcA + i, srcB + i, count - i, dst + 2*i);
+}
+
+LIME_TARGET("avx2") static void FloatToInt16_avx2(const float* src, int count, float scale, complex16_t* dst)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+    const __m256 lo = _mm256_set1_ps(-scale - 1);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + 2*i), s), lo), s);
+        const __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + 2*i + 8), s), lo), s);
+        //pack works within 128 bit lanes, restore sample order
+        const __m256i v = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    FloatToInt16_sse2(src + 2*i, count - i, scale, dst + i);
+}
+
+LIME_TARGET("avx2") static void Int16ToFloat_avx2(const complex16_t* src, int count, float scale, float* dst)
+{
+    const __m256 mult = _mm256_set1_ps(1.0f/scale);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        const __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 4)));
+        _mm256_storeu_ps(dst + 2*i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), mult));
+        _mm256_storeu_ps(dst + 2*i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), mult));
+    }
+    Int16ToFloat_sse2(src + i, count - i, scale, dst + 2*i);
+}
+
+static const SampleConverters convAVX2 = {
+    "AVX2",
+    Unpack12_avx2,
+    Unpack12MIMO_avx2,
+    Pack12_avx2,
+    Pack12MIMO_avx2,
+    Deinterleave16_avx2,
+    Interleave16_avx2,
+    FloatToInt16_avx2,
+    Int16ToFloat_avx2
+};
+
+static bool CpuHasSSSE3()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static bool CpuHasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // LIME_SIMD_X86
+
+#ifdef LIME_SIMD_NEON
+/***********************************************************************
+ * ARM NEON, structure loads/stores do the 3 byte de-interleaving
+ **********************************************************************/
+static inline int16x8_t UnpackI_neon(uint8x8_t b0, uint8x8_t b1)
+{
+    const int16x8_t v = vreinterpretq_s16_u16(vorrq_u16(vmovl_u8(b0), vshll_n_u8(b1, 8)));
+    return vshrq_n_s16(vshlq_n_s16(v, 4), 4);
+}
+
+static inline int16x8_t UnpackQ_neon(uint8x8_t b1, uint8x8_t b2)
+{
+    return vshrq_n_s16(vreinterpretq_s16_u16(vorrq_u16(vmovl_u8(b1), vshll_n_u8(b2, 8))), 4);
+}
+
+static inline uint8x8x3_t Pack12x8_neon(const int16x8x2_t &s)
+{
+    const uint16x8_t i = vreinterpretq_u16_s16(s.val[0]);
+    const uint16x8_t q = vreinterpretq_u16_s16(s.val[1]);
+    uint8x8x3_t b;
+    b.val[0] = vmovn_u16(i);
+    b.val[1] = vmovn_u16(vorrq_u16(vandq_u16(vshrq_n_u16(i, 8), vdupq_n_u16(0x0F)), vshlq_n_u16(q, 4)));
+    b.val[2] = vmovn_u16(vshrq_n_u16(q, 4));
+    return b;
+}
+
+static void Unpack12_neon(const uint8_t* src, int count, complex16_t* dst)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const uint8x16x3_t b = vld3q_u8(src + 3*i);
+        int16x8x2_t lo, hi;
+        lo.val[0] = UnpackI_neon(vget_low_u8(b.val[0]), vget_low_u8(b.val[1]));
+        lo.val[1] = UnpackQ_neon(vget_low_u8(b.val[1]), vget_low_u8(b.val[2]));
+        hi.val[0] = UnpackI_neon(vget_high_u8(b.val[0]), vget_high_u8(b.val[1]));
+        hi.val[1] = UnpackQ_neon(vget_high_u8(b.val[1]), vget_high_u8(b.val[2]));
+        vst2q_s16((int16_t*)(dst + i), lo);
+        vst2q_s16((int16_t*)(dst + i + 8), hi);
+    }
+    Unpack12_scalar(src + 3*i, count - i, dst + i);
+}
+
+static void Unpack12MIMO_neon(const uint8_t* src, int count, complex16_t* dstA, complex16_t* dstB)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        //even groups belong to channel A, odd groups to channel B
+        const uint8x16x3_t b = vld3q_u8(src + 6*i);
+        const int16x8x2_t vi = vuzpq_s16(UnpackI_neon(vget_low_u8(b.val[0]), vget_low_u8(b.val[1])),
+                                         UnpackI_neon(vget_high_u8(b.val[0]), vget_high_u8(b.val[1])));
+        const int16x8x2_t vq = vuzpq_s16(UnpackQ_neon(vget_low_u8(b.val[1]), vget_low_u8(b.val[2])),
+                                         UnpackQ_neon(vget_high_u8(b.val[1]), vget_high_u8(b.val[2])));
+        int16x8x2_t a, c;
+        a.val[0] = vi.val[0];
+        a.val[1] = vq.val[0];
+        c.val[0] = vi.val[1];
+        c.val[1] = vq.val[1];
+        vst2q_s16((int16_t*)(dstA + i), a);
+        vst2q_s16((int16_t*)(dstB + i), c);
+    }
+    Unpack12MIMO_scalar(src + 6*i, count - i, dstA + i, dstB + i);
+}
+
+static void Pack12_neon(const complex16_t* src, int count, uint8_t* dst)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        vst3_u8(dst + 3*i, Pack12x8_neon(vld2q_s16((const int16_t*)(src + i))));
+    Pack12_scalar(src + i, count - i, dst + 3*i);
+}
+
+static void Pack12MIMO_neon(const complex16_t* srcA, const complex16_t* srcB, int count, uint8_t* dst)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const uint8x8x3_t a = Pack12x8_neon(vld2q_s16((const int16_t*)(srcA + i)));
+        const uint8x8x3_t b = Pack12x8_neon(vld2q_s16((const int16_t*)(srcB + i)));
+        uint8x16x3_t out;
+        for (int k = 0; k < 3; ++k)
+        {
+            const uint8x8x2_t z = vzip_u8(a.val[k], b.val[k]);
+            out.val[k] = vcombine_u8(z.val[0], z.val[1]);
+        }
+        vst3q_u8(dst + 6*i, out);
+    }
+    Pack12MIMO_scalar(srcA + i, srcB + i, count - i, dst + 6*i);
+}
+
+static void Deinterleave16_neon(const complex16_t* src, int count, complex16_t* dstA, complex16_t* dstB)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const uint32x4x2_t v = vld2q_u32((const uint32_t*)(src + 2*i));
+        vst1q_u32((uint32_t*)(dstA + i), v.val[0]);
+        vst1q_u32((uint32_t*)(dstB + i), v.val[1]);
+    }
+    Deinterleave16_scalar(src + 2*i, count - i, dstA + i, dstB + i);
+}
+
+static void Interleave16_neon(const complex16_t* srcA, const complex16_t* srcB, int count, complex16_t* dst)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32x4x2_t v;
+        v.val[0] = vld1q_u32((const uint32_t*)(srcA + i));
+        v.val[1] = vld1q_u32((const uint32_t*)(srcB + i));
+        vst2q_u32((uint32_t*)(dst + 2*i), v);
+    }
+    Interleave16_scalar(srcA + i, srcB + i, count - i, dst + 2*i);
+}
+
+static void FloatToInt16_neon(const float* src, int count, float scale, complex16_t* dst)
+{
+    const float32x4_t s = vdupq_n_f32(scale);
+    const float32x4_t lo = vdupq_n_f32(-scale - 1);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const float32x4_t a = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(src + 2*i), s), lo), s);
+        const float32x4_t b = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(src + 2*i + 4), s), lo), s);
+        vst1q_s16((int16_t*)(dst + i), vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))));
+    }
+    FloatToInt16_scalar(src + 2*i, count - i, scale, dst + i);
+}
+
+static void Int16ToFloat_neon(const complex16_t* src, int count, float scale, float* dst)
+{
+    const float32x4_t mult = vdupq_n_f32(1.0f/scale);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const int16x8_t v = vld1q_s16((const int16_t*)(src + i));
+        vst1q_f32(dst + 2*i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), mult));
+        vst1q_f32(dst + 2*i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), mult));
+    }
+    Int16ToFloat_scalar(src + i, count - i, scale, dst + 2*i);
+}
+
+static const SampleConverters convNEON = {
+    "NEON",
+    Unpack12_neon,
+    Unpack12MIMO_neon,
+    Pack12_neon,
+    Pack12MIMO_neon,
+    Deinterleave16_neon,
+    Interleave16_neon,
+    FloatToInt16_neon,
+    Int16ToFloat_neon
+};
+#endif // LIME_SIMD_NEON
+
+std::vector<const SampleConverters*> GetAvailableSampleConverters()
+{
+    std::vector<const SampleConverters*> list;
+    list.push_back(&convScalar);
+#ifdef LIME_SIMD_X86
+    if (CpuHasSSSE3())
+        list.push_back(&convSSSE3);
+    if (CpuHasAVX2())
+        list.push_back(&convAVX2);
+#endif
+#ifdef LIME_SIMD_NEON
+    list.push_back(&convNEON);
+#endif
+    return list;
+}
+
+const SampleConverters& GetSampleConverters()
+{
+    static const SampleConverters* best = GetAvailableSampleConverters().back();
+    return *best;
+}
+
+}
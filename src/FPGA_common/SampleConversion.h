@@ -0,0 +1,53 @@
+/**
+@file SampleConversion.h
+@author Lime Microsystems
+@brief Packet payload packing/unpacking kernels with runtime CPU dispatch
+*/
+
+#ifndef LIME_SAMPLE_CONVERSION_H
+#define LIME_SAMPLE_CONVERSION_H
+
+#include "LimeSuiteConfig.h"
+#include "dataTypes.h"
+#include <stdint.h>
+#include <vector>
+
+namespace lime
+{
+
+/** @brief Set of sample format conversion kernels for one instruction set.
+
+    12 bit link format stores each I/Q pair in 3 bytes:
+    byte0 = I[7:0], byte1 = Q[3:0]<<4 | I[11:8], byte2 = Q[11:4].
+    In MIMO mode channel A and channel B pairs are interleaved.
+    All counts are in complex samples per channel.
+*/
+struct LIME_API SampleConverters
+{
+    //! Instruction set name, e.g. "AVX2"
+    const char* name;
+
+    void (*Unpack12)(const uint8_t* src, int count, complex16_t* dst);
+    void (*Unpack12MIMO)(const uint8_t* src, int count, complex16_t* dstA, complex16_t* dstB);
+    void (*Pack12)(const complex16_t* src, int count, uint8_t* dst);
+    void (*Pack12MIMO)(const complex16_t* srcA, const complex16_t* srcB, int count, uint8_t* dst);
+    void (*Deinterleave16)(const complex16_t* src, int count, complex16_t* dstA, complex16_t* dstB);
+    void (*Interleave16)(const complex16_t* srcA, const complex16_t* srcB, int count, complex16_t* dst);
+    //! Multiplies by scale, saturates to [-scale-1, scale] and truncates to integer
+    void (*FloatToInt16)(const float* src, int count, float scale, complex16_t* dst);
+    //! Divides by scale and converts to float
+    void (*Int16ToFloat)(const complex16_t* src, int count, float scale, float* dst);
+};
+
+/** @brief Returns the fastest converters supported by the running CPU.
+    Selection is done once on first call.
+*/
+LIME_API const SampleConverters& GetSampleConverters();
+
+/** @brief Returns all converters usable on the running CPU, scalar first.
+    Intended for benchmarking and verification.
+*/
+LIME_API std::vector<const SampleConverters*> GetAvailableSampleConverters();
+
+}
+#endif // LIME_SAMPLE_CONVERSION_H
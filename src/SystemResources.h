@@ -39,6 +39,12 @@ LIME_API std::string getAppDataDirectory(void);
  */
 LIME_API std::string getConfigDirectory(void);
 
+/*!
+ * Create directory and its missing parent directories.
+ * @param path directory path
+ */
+LIME_API void makeDirectories(const std::string &path);
+
 /*!
  * Get a list of directories to search for image resources.
  * Directories are returned in the order of search priority.
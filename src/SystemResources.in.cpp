@@ -16,6 +16,7 @@
 #include <windows.h>
 #include <shlobj.h>
 #include <io.h>
+#include <direct.h>
 
 //access mode constants
 #define F_OK 0
@@ -118,6 +119,21 @@ std::string lime::getConfigDirectory(void)
     return lime::getHomeDirectory() + "/.limesuite";
 }
 
+void lime::makeDirectories(const std::string &path)
+{
+    for (size_t pos = path.find_first_of("/\\", 1); ; pos = path.find_first_of("/\\", pos + 1))
+    {
+        const std::string dir = path.substr(0, pos);
+#ifdef _MSC_VER
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+        if (pos == std::string::npos)
+            break;
+    }
+}
+
 std::vector<std::string> lime::listImageSearchPaths(void)
 {
     std::vector<std::string> imageSearchPaths;
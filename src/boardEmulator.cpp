@@ -46,10 +46,11 @@ int main(int argc, char** argv)
 	printf("slave: %s\n", ptsname(masterFd));
 
 	//create soft link to emulator
-	char linkCommand[256];
-	printf("Creating symbolik link /dev/ttyACM_LMS7emulator\n");
-	sprintf(linkCommand, "sudo ln -s %s /dev/ttyACM_LMS7emulator", ptsname(masterFd));
-	system(linkCommand);
+	const char* linkPath = "/dev/ttyACM_LMS7emulator";
+	printf("Creating symbolic link %s\n", linkPath);
+	unlink(linkPath);
+	if(symlink(ptsname(masterFd), linkPath) != 0)
+		printf("failed to create %s (%s), use %s directly\n", linkPath, strerror(errno), ptsname(masterFd));
 
 	cout << "LMS7 board emulator started" << endl;
 
@@ -106,9 +107,8 @@ int main(int argc, char** argv)
 		}
 	}
 	close(masterFd);
-	printf("Removing symbolic link /dev/ttyACM_LMS7emulator\n");
-	sprintf(linkCommand, "sudo rm /dev/ttyACM_LMS7emulator");
-	system(linkCommand);
+	printf("Removing symbolic link %s\n", linkPath);
+	unlink(linkPath);
 	return 0;
 }
 
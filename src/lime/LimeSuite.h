@@ -276,6 +276,70 @@ API_EXPORT int CALL_CONV LMS_GetLOFrequency(lms_device_t *device, bool dir_tx,
 API_EXPORT int CALL_CONV LMS_GetLOFrequencyRange(lms_device_t *device, bool dir_tx,
                                                  lms_range_t *range);
 
+/**
+ * Tune to each frequency of the list and store LMS chip registers changed by
+ * tuning as hop profiles, so that LMS_Hop() can switch frequency with one
+ * batched register write. Each profile is applied once to verify PLL lock
+ * and measure hop latency, device is left tuned to the first frequency.
+ * Frequencies that need sample rate change are not supported. Profiles must
+ * be created again after changing sample rate, or frequency or RF path of
+ * other direction, board RF switches outside LMS chip are not changed by hops.
+ *
+ * @param   device      Device handle previously obtained by LMS_Open().
+ * @param   dir_tx      Select RX or TX
+ * @param   chan        Channel index
+ * @param   frequencies RF center frequencies in Hz
+ * @param   count       Number of frequencies
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_CreateHopProfiles(lms_device_t *device, bool dir_tx,
+                    size_t chan, const float_type *frequencies, size_t count);
+
+/**
+ * Tune to frequency of hop profile created by LMS_CreateHopProfiles()
+ *
+ * @param   device      Device handle previously obtained by LMS_Open().
+ * @param   dir_tx      Select RX or TX
+ * @param   chan        Channel index
+ * @param   index       Profile index, order of frequencies list
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_Hop(lms_device_t *device, bool dir_tx, size_t chan,
+                                 size_t index);
+
+/**
+ * Schedule hop to be applied when Rx stream timestamp reaches given value.
+ * Registers are written by library thread, hop is started earlier by
+ * measured hop latency. Stream timestamp is updated when packets are
+ * received, so timing accuracy is limited by packet duration. Other device
+ * configuration calls should not be made while hops are pending.
+ *
+ * @param   device      Device handle previously obtained by LMS_Open().
+ * @param   dir_tx      Select RX or TX
+ * @param   chan        Channel index
+ * @param   index       Profile index, order of frequencies list
+ * @param   timestamp   Rx stream timestamp of hop
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_HopAt(lms_device_t *device, bool dir_tx, size_t chan,
+                                   size_t index, uint64_t timestamp);
+
+/**
+ * Get average hop duration measured since hop profiles were created
+ *
+ * @param       device      Device handle previously obtained by LMS_Open().
+ * @param       dir_tx      Select RX or TX
+ * @param       chan        Channel index
+ * @param[out]  latency     Average hop duration in seconds
+ *
+ * @return      0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_GetHopLatency(lms_device_t *device, bool dir_tx,
+                                           size_t chan, float_type *latency);
+
 ///Enumeration of RF ports
 enum
 {
@@ -498,6 +562,9 @@ API_EXPORT int CALL_CONV LMS_SetGFIRLPF(lms_device_t *device, bool dir_tx,
  * Perform the automatic calibration of specified RX/TX channel. The automatic
  * calibration must be run after device configuration is finished because
  * calibration values are dependant on various configuration settings.
+ * Results are stored per board, channel, LO frequency band, bandwidth and
+ * gain configuration. When stored result matches and chip temperature has not
+ * drifted, it is written to chip instead of running calibration again.
  *
  * @pre Device should be configured
  *
@@ -505,13 +572,51 @@ API_EXPORT int CALL_CONV LMS_SetGFIRLPF(lms_device_t *device, bool dir_tx,
  * @param   dir_tx      Select RX or TX
  * @param   chan        channel index
  * @param   bw          bandwidth
- * @param   flags       additional calibration flags (normally should be 0)
+ * @param   flags       additional calibration flags (normally should be 0),
+ *                      ::LMS_CALIBRATE_FORCE to neither use nor store cached results
  *
  * @return  0 on success, (-1) on failure
  */
 API_EXPORT int CALL_CONV LMS_Calibrate(lms_device_t *device, bool dir_tx,
                                         size_t chan, double bw, unsigned flags);
 
+///LMS_Calibrate() flag to run calibration even if stored result matches
+#define LMS_CALIBRATE_FORCE (1<<1)
+
+/**
+ * Perform the automatic calibration of several RX/TX channels. Channels of
+ * different LMS7002M chips (e.g. LimeSDR-QPCIe) are calibrated concurrently,
+ * channels of the same chip are calibrated one after another.
+ *
+ * @pre Device should be configured
+ *
+ * @param   device      Device handle previously obtained by LMS_Open().
+ * @param   dir_tx      Select RX or TX
+ * @param   chans       channel indexes
+ * @param   count       number of channels
+ * @param   bw          bandwidth
+ * @param   flags       additional calibration flags, same as for LMS_Calibrate()
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_CalibrateChannels(lms_device_t *device, bool dir_tx,
+                    const size_t *chans, size_t count, double bw, unsigned flags);
+
+/**
+ * Get number of LMS_Calibrate() calls served from stored results (hits) and
+ * calls that had to run calibration (misses). Statistics are shared by all
+ * devices of the process.
+ *
+ * @param   device      Device handle previously obtained by LMS_Open().
+ * @param   hits        number of calibrations restored from stored results
+ * @param   misses      number of calibrations without matching stored result
+ * @param   reset       clear statistics after reading
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_GetCalibrationCacheStats(lms_device_t *device,
+                                unsigned *hits, unsigned *misses, bool reset);
+
 /**
  * Load LMS chip configuration from a file
  *
@@ -840,6 +945,29 @@ API_EXPORT int CALL_CONV LMS_ReadParam(lms_device_t *device,
 API_EXPORT int CALL_CONV LMS_WriteParam(lms_device_t *device,
                                       struct LMS7Parameter param, uint16_t val);
 
+/**
+ * Start collecting LMS chip register writes. LMS_WriteLMSReg() and
+ * LMS_WriteParam() calls update register cache only, all writes, including
+ * repeated writes to the same register, are sent in order in one batch by
+ * LMS_CommitTransaction(). Reading registers that are volatile sends collected
+ * writes first, other parameters read back values written in transaction.
+ * Transactions can be nested.
+ *
+ * @param device    Device handle previously obtained by LMS_Open().
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_BeginTransaction(lms_device_t *device);
+
+/**
+ * Send LMS chip register writes collected since LMS_BeginTransaction()
+ *
+ * @param device    Device handle previously obtained by LMS_Open().
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_CommitTransaction(lms_device_t *device);
+
 /**
  * Read device FPGA register
  *
@@ -1137,6 +1265,41 @@ typedef struct
 
 } lms_stream_status_t;
 
+///Number of buckets in ::lms_histogram_t
+#define LMS_HISTOGRAM_BUCKETS 32
+
+/**Histogram with power of two buckets*/
+typedef struct
+{
+    ///Number of recorded values
+    uint64_t count;
+    ///Sum of recorded values
+    uint64_t sum;
+    ///Largest recorded value
+    uint64_t max;
+    ///buckets[0] counts zero values, buckets[i] counts values in [2^(i-1), 2^i)
+    uint64_t buckets[LMS_HISTOGRAM_BUCKETS];
+} lms_histogram_t;
+
+/**Stream stage timings, times are in nanoseconds*/
+typedef struct
+{
+    ///Time between completions of consecutive link transfers
+    lms_histogram_t transferInterval;
+    ///Time spent decoding (Rx) or encoding (Tx) packets of one transfer
+    lms_histogram_t processingTime;
+    ///Time FIFO writer was blocked waiting for free space (LMS_SendStream() for Tx)
+    lms_histogram_t producerWait;
+    ///Time FIFO reader was blocked waiting for data (LMS_RecvStream() for Rx)
+    lms_histogram_t consumerWait;
+    ///Tx only: samples between packet timestamp and the latest Rx timestamp when packet was sent, 0 if late
+    lms_histogram_t txLeadTime;
+    ///Largest number of packets held in FIFO
+    uint32_t fifoHighWater;
+    ///FIFO capacity in packets
+    uint32_t fifoPackets;
+} lms_stream_telemetry_t;
+
 /**
  * Create new stream based on parameters passed in configuration structure.
  * The structure is initialized with stream handle.
@@ -1148,6 +1311,20 @@ typedef struct
  */
 API_EXPORT int CALL_CONV LMS_SetupStream(lms_device_t *device, lms_stream_t *stream);
 
+/**
+ * Select CPUs the streaming thread of channel is allowed to run on. Stream
+ * buffers are allocated on NUMA node of these CPUs. Applies to streams set up
+ * by LMS_SetupStream() afterwards.
+ *
+ * @param device    Device handle previously obtained by LMS_Open().
+ * @param dir_tx    Select RX or TX
+ * @param chan      Channel index
+ * @param cpuMask   Bit mask of CPUs (0-63), 0 to allow any CPU
+ *
+ * @return      0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_SetStreamCPUs(lms_device_t *device, bool dir_tx, size_t chan, uint64_t cpuMask);
+
 /**
  * Deallocate memory used by stream.
  *
@@ -1191,6 +1368,35 @@ API_EXPORT int CALL_CONV LMS_StopStream(lms_stream_t *stream);
  API_EXPORT int CALL_CONV LMS_RecvStream(lms_stream_t *stream, void *samples,
              size_t sample_count, lms_stream_meta_t *meta, unsigned timeout_ms);
 
+/**
+ * Get direct access to the next received packet inside stream FIFO, avoiding
+ * copy to user buffer. Samples are interleaved int16 I/Q values in link
+ * format scale (12 bit link: [-2048, 2047]) regardless of stream data format.
+ * Buffer must be returned with LMS_ReleaseRecvBuffer() before stopping the
+ * stream. Do not mix with LMS_RecvStream() on the same stream.
+ *
+ * @param stream        structure previously initialized with LMS_SetupStream().
+ * @param samples       returns pointer to packet samples.
+ * @param handle        returns handle for LMS_ReleaseRecvBuffer().
+ * @param meta          Metadata. See the ::lms_stream_meta_t description.
+ * @param timeout_ms    how long to wait for data before timing out.
+ *
+ * @return number of samples in buffer, 0 on timeout, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_AcquireRecvBuffer(lms_stream_t *stream,
+             const int16_t **samples, size_t *handle, lms_stream_meta_t *meta,
+             unsigned timeout_ms);
+
+/**
+ * Return buffer obtained with LMS_AcquireRecvBuffer() back to stream FIFO
+ *
+ * @param stream    structure previously initialized with LMS_SetupStream().
+ * @param handle    handle returned by LMS_AcquireRecvBuffer().
+ *
+ * @return 0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_ReleaseRecvBuffer(lms_stream_t *stream, size_t handle);
+
 /**
  * Get stream operation status
  *
@@ -1201,6 +1407,176 @@ API_EXPORT int CALL_CONV LMS_StopStream(lms_stream_t *stream);
  */
 API_EXPORT int CALL_CONV LMS_GetStreamStatus(lms_stream_t *stream, lms_stream_status_t* status);
 
+/**
+ * Get stream stage timing histograms, collected since stream setup or the
+ * last reset. Timing is recorded by streaming threads at low overhead and
+ * helps to find whether drops are caused by link latency, packet
+ * processing or slow application.
+ *
+ * @param stream    structure previously initialized with LMS_SetupStream().
+ * @param telemetry Stream telemetry. See the ::lms_stream_telemetry_t for description
+ * @param reset     clear histograms after reading
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_GetStreamTelemetry(lms_stream_t *stream, lms_stream_telemetry_t* telemetry, bool reset);
+
+/**Recording handle*/
+typedef void lms_recorder_t;
+
+/**Recording configuration for LMS_StartRecording()*/
+typedef struct
+{
+    ///Path without extension, samples are written to path.sigmf-data and metadata to path.sigmf-meta
+    const char* path;
+    ///Store samples packed to 12 bits (3 bytes per I/Q pair), requires ::LMS_LINK_FMT_I12
+    bool packed;
+    ///Stop after this many samples, 0 for no limit
+    uint64_t maxSamples;
+    ///Size of one write buffer in bytes, 0 for default (4 MiB)
+    uint32_t bufferSize;
+    ///Number of write buffers, 0 for default (16)
+    uint32_t bufferCount;
+    ///Stored in metadata: sample rate (Hz) and center frequency (Hz, 0 to omit)
+    float_type sampleRate;
+    float_type frequency;
+    ///Stored in metadata, may be NULL: hardware name and description
+    const char* hardware;
+    const char* description;
+} lms_recorder_config_t;
+
+/**Recording progress*/
+typedef struct
+{
+    ///Indicates whether samples are still being recorded
+    bool active;
+    ///Data file is written bypassing page cache (O_DIRECT)
+    bool directIO;
+    ///Number of samples stored
+    uint64_t samples;
+    ///Number of bytes written to data file
+    uint64_t bytesWritten;
+    ///Number of samples missing according to packet timestamps
+    uint64_t droppedSamples;
+    ///Number of timestamp discontinuities, each annotated in metadata
+    uint32_t gaps;
+    ///Largest number of full write buffers waiting to be written
+    uint32_t buffersHighWater;
+    ///Number of write buffers
+    uint32_t bufferCount;
+    ///Average write rate since recording start (B/s)
+    float_type writeRate;
+    ///Rate the writer thread achieved while writing (B/s), upper bound of sustainable rate
+    float_type diskRate;
+} lms_recorder_status_t;
+
+/**
+ * Start recording samples of Rx stream to disk in SigMF format. Samples are
+ * stored as int16 I/Q pairs in link format scale. Recording takes all
+ * samples of the stream, do not call LMS_RecvStream() while it is active.
+ * Stop recording with LMS_StopRecording() before stopping the stream.
+ *
+ * @param stream    Rx stream previously initialized with LMS_SetupStream().
+ * @param config    Recording configuration. See ::lms_recorder_config_t.
+ * @param recorder  Returns recording handle.
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_StartRecording(lms_stream_t *stream, const lms_recorder_config_t *config, lms_recorder_t **recorder);
+
+/**
+ * Get recording progress
+ *
+ * @param recorder  Handle obtained with LMS_StartRecording().
+ * @param status    Recording status. See ::lms_recorder_status_t.
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_GetRecordingStatus(lms_recorder_t *recorder, lms_recorder_status_t *status);
+
+/**
+ * Write remaining samples, complete metadata and release recorder
+ *
+ * @param recorder  Handle obtained with LMS_StartRecording().
+ * @param status    Optional, final recording status. See ::lms_recorder_status_t.
+ *
+ * @return  0 on success, (-1) if writing failed
+ */
+API_EXPORT int CALL_CONV LMS_StopRecording(lms_recorder_t *recorder, lms_recorder_status_t *status);
+
+/**Playback handle*/
+typedef void lms_player_t;
+
+/**Playback configuration for LMS_StartPlayback()*/
+typedef struct
+{
+    ///Path of raw sample file, including extension
+    const char* path;
+    ///Sample format of the file
+    enum
+    {
+        LMS_PLAY_FMT_CS16=0,    ///<interleaved 16-bit I/Q, full scale 32767
+        LMS_PLAY_FMT_CF32,      ///<interleaved 32-bit float I/Q, full scale 1.0
+        LMS_PLAY_FMT_PACKED12   ///<12-bit I/Q packed to 3 bytes, as stored by packed recording
+    }format;
+    ///Start over from beginning of file when end is reached
+    bool loop;
+    ///Transmit first sample at startTimestamp, otherwise as soon as possible
+    bool useTimestamp;
+    uint64_t startTimestamp;
+    ///Limit playback to this many samples per second, 0 to let link pace it
+    float_type sampleRate;
+} lms_player_config_t;
+
+/**Playback progress*/
+typedef struct
+{
+    ///Indicates whether samples are still being played
+    bool active;
+    ///Number of samples handed to Tx stream
+    uint64_t samples;
+    ///Number of samples in file
+    uint64_t fileSamples;
+    ///Number of completed passes over file
+    uint32_t loops;
+    ///Average sample rate since first sample (S/s)
+    float_type sampleRate;
+} lms_player_status_t;
+
+/**
+ * Play samples of memory mapped file through Tx stream. Samples are taken
+ * directly from file mapping by the stream thread, bypassing stream FIFO, so
+ * LMS_SendStream() has no effect while playback is attached. Start playback
+ * before starting the stream with LMS_StartStream().
+ *
+ * @param stream    Tx stream previously initialized with LMS_SetupStream().
+ * @param config    Playback configuration. See ::lms_player_config_t.
+ * @param player    Returns playback handle.
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_StartPlayback(lms_stream_t *stream, const lms_player_config_t *config, lms_player_t **player);
+
+/**
+ * Get playback progress
+ *
+ * @param player    Handle obtained with LMS_StartPlayback().
+ * @param status    Playback status. See ::lms_player_status_t.
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_GetPlaybackStatus(lms_player_t *player, lms_player_status_t *status);
+
+/**
+ * Stop playback and release player. Stream is stopped if it is still running.
+ *
+ * @param player    Handle obtained with LMS_StartPlayback().
+ * @param status    Optional, final playback status. See ::lms_player_status_t.
+ *
+ * @return  0 on success, (-1) on failure
+ */
+API_EXPORT int CALL_CONV LMS_StopPlayback(lms_player_t *player, lms_player_status_t *status);
+
 /**
  * Write samples to the FIFO of the specified stream.
  *
@@ -10,6 +10,7 @@
 
 #include "LMS7002M.h"
 #include <stdio.h>
+#include <string.h>
 #include <set>
 #include "IConnection.h"
 #include "INI.h"
@@ -18,6 +19,7 @@
 #include <fstream>
 #include <algorithm>
 #include "LMS7002M_RegistersMap.h"
+#include "LMS7002M_VCOCache.h"
 #include <math.h>
 #include <assert.h>
 #include <chrono>
@@ -100,6 +102,7 @@ void LMS7002M::SetConnection(IConnection* port, const size_t devIndex)
 {
     controlPort = port;
     mdevIndex = devIndex;
+    mBoardSerialValid = false;
 
     if (controlPort != nullptr)
     {
@@ -125,6 +128,11 @@ LMS7002M::LMS7002M() :
     controlPort(nullptr),
     mdevIndex(0),
     mSelfCalDepth(0),
+    mTransactionDepth(0),
+    mPendingMAC(false),
+    mCaptureBase(nullptr),
+    mBoardSerial(0),
+    mBoardSerialValid(false),
     _cachedRefClockRate(30.72e6)
 {
     mCalibrationByMCU = true;
@@ -199,10 +207,15 @@ LMS7002M::LMS7002M() :
     mRegistersMap->InitializeDefaultValues(LMS7parameterList);
     mcuControl = new MCU_BD();
     mcuControl->Initialize(nullptr);
+    //MCU writes chip directly, writes collected by transaction must reach chip first
+    mcuControl->SetPendingWritesFlush([this]{ return FlushTransaction(); });
 }
 
 LMS7002M::~LMS7002M()
 {
+    for (auto map : mCapturedMaps)
+        delete map;
+    delete mCaptureBase;
     delete mcuControl;
     delete mRegistersMap;
 }
@@ -1010,6 +1023,7 @@ int LMS7002M::SetPathRFE(PathRFE path)
         default: sel_path_rfe = 0; break;
     }
 
+    Transaction transaction(this);
     Modify_SPI_Reg_bits(LMS7param(SEL_PATH_RFE), sel_path_rfe);
 
     int pd_lna_rfe = (path == PATH_RFE_LB2 || path == PATH_RFE_LB1 || sel_path_rfe == 0) ? 1 : 0;
@@ -1026,7 +1040,7 @@ int LMS7002M::SetPathRFE(PathRFE path)
     const bool loopback = (path == PATH_RFE_LB1) or (path == PATH_RFE_LB2);
     Modify_SPI_Reg_bits(LMS7param(EN_LOOPB_TXPAD_TRF), loopback?1:0);
 
-    return 0;
+    return transaction.Commit();
 }
 
 LMS7002M::PathRFE LMS7002M::GetPathRFE(void)
@@ -1042,10 +1056,11 @@ LMS7002M::PathRFE LMS7002M::GetPathRFE(void)
 
 int LMS7002M::SetBandTRF(const int band)
 {
+    Transaction transaction(this);
     this->Modify_SPI_Reg_bits(LMS7param(SEL_BAND1_TRF), (band==1)?1:0);
     this->Modify_SPI_Reg_bits(LMS7param(SEL_BAND2_TRF), (band==2)?1:0);
 
-    return 0;
+    return transaction.Commit();
 }
 
 int LMS7002M::GetBandTRF(void)
@@ -1106,6 +1121,7 @@ int LMS7002M::SetFrequencyCGEN(const float_type freq_Hz, const bool retainNCOfre
     float_type dFvco;
     float_type dFrac;
 
+    Transaction transaction(this);
     //remember NCO frequencies
     Channel chBck = this->GetActiveChannel();
     vector<vector<float_type> > rxNCO(2);
@@ -1172,18 +1188,22 @@ int LMS7002M::SetFrequencyCGEN(const float_type freq_Hz, const bool retainNCOfre
 #ifndef NDEBUG
     printf("CGEN: Freq=%g MHz, VCO=%g GHz, INT=%i, FRAC=%i, DIV_OUTCH_CGEN=%i\n", freq_Hz/1e6, dFvco/1e9, gINT, gFRAC, iHdiv);
 #endif // NDEBUG
-    if(TuneVCO(VCO_CGEN) != 0)
+    if(TuneVCOFromCache(VCO_CGEN, dFvco) != 0)
     {
-        if (output)
+        if(TuneVCO(VCO_CGEN) != 0)
         {
-            output->success = false;
-            output->csw = Get_SPI_Reg_bits(LMS7param(CSW_VCO_CGEN));
+            if (output)
+            {
+                output->success = false;
+                output->csw = Get_SPI_Reg_bits(LMS7param(CSW_VCO_CGEN));
+            }
+            return ReportError("SetFrequencyCGEN(%g MHz) failed", freq_Hz/1e6);
         }
-        return ReportError("SetFrequencyCGEN(%g MHz) failed", freq_Hz/1e6);
+        StoreVCOTuning(VCO_CGEN, dFvco, 0, Get_SPI_Reg_bits(LMS7param(CSW_VCO_CGEN)));
     }
     if (output)
         output->csw = Get_SPI_Reg_bits(LMS7param(CSW_VCO_CGEN));
-    return 0;
+    return transaction.Commit();
 }
 
 bool LMS7002M::GetCGENLocked(void)
@@ -1211,7 +1231,7 @@ int LMS7002M::TuneCGENVCO()
 
     auto checkCSW = [this] (int cswVal){
             Modify_SPI_Reg_bits (LMS7_CSW_VCO_CGEN, cswVal);    //write CSW value
-            this_thread::sleep_for(chrono::microseconds(50)); //comparator settling time
+            SettlingDelay(chrono::microseconds(50)); //comparator settling time
             return Get_SPI_Reg_bits(LMS7_VCO_CMPHO_CGEN.address, 13, 12, true); //read comparators
         };
     //find lock
@@ -1297,7 +1317,7 @@ int LMS7002M::TuneVCO(VCO_Module module) // 0-cgen, 1-SXR, 2-SXT
     //check if lock is within VCO range
     {
         Modify_SPI_Reg_bits (addrCSW_VCO , msb, lsb , 0);
-        this_thread::sleep_for(settlingTime);
+        SettlingDelay(settlingTime);
         cmphl = (uint8_t)Get_SPI_Reg_bits(addrCMP, 13, 12, true);
         if(cmphl == 3) //VCO too high
         {
@@ -1306,7 +1326,7 @@ int LMS7002M::TuneVCO(VCO_Module module) // 0-cgen, 1-SXR, 2-SXT
             return -1;
         }
         Modify_SPI_Reg_bits (addrCSW_VCO , msb, lsb , 255);
-        this_thread::sleep_for(settlingTime);
+        SettlingDelay(settlingTime);
         cmphl = (uint8_t)Get_SPI_Reg_bits(addrCMP, 13, 12, true);
         if(cmphl == 0) //VCO too low
         {
@@ -1326,7 +1346,7 @@ int LMS7002M::TuneVCO(VCO_Module module) // 0-cgen, 1-SXR, 2-SXT
         {
             cswSearch[t].high |= 1 << i; //CSW_VCO<i>=1
             Modify_SPI_Reg_bits (addrCSW_VCO, msb, lsb, cswSearch[t].high);
-            this_thread::sleep_for(settlingTime);
+            SettlingDelay(settlingTime);
             cmphl = (uint8_t)Get_SPI_Reg_bits(addrCMP, 13, 12, true);
             lime::debug ("csw=%d\tcmphl=%d", cswSearch[t].high,(int16_t)cmphl);
             if(cmphl & 0x01) // reduce CSW
@@ -1338,7 +1358,7 @@ int LMS7002M::TuneVCO(VCO_Module module) // 0-cgen, 1-SXR, 2-SXT
         {
             --cswSearch[t].low;
             Modify_SPI_Reg_bits(addrCSW_VCO, msb, lsb, cswSearch[t].low);
-            this_thread::sleep_for(settlingTime);
+            SettlingDelay(settlingTime);
             if(Get_SPI_Reg_bits(addrCMP, 13, 12, true) != 2)
             {
                 ++cswSearch[t].low;
@@ -1375,14 +1395,14 @@ int LMS7002M::TuneVCO(VCO_Module module) // 0-cgen, 1-SXR, 2-SXT
     {
         //check which of two values really locks
         Modify_SPI_Reg_bits(addrCSW_VCO, msb, lsb, cswLow);
-        this_thread::sleep_for(settlingTime);
+        SettlingDelay(settlingTime);
         cmphl = (uint8_t)Get_SPI_Reg_bits(addrCMP, 13, 12, true);
         if(cmphl != 2)
             Modify_SPI_Reg_bits(addrCSW_VCO, msb, lsb, cswHigh);
     }
     else
         Modify_SPI_Reg_bits(addrCSW_VCO, msb, lsb, cswLow+(cswHigh-cswLow)/2);
-    this_thread::sleep_for(settlingTime);
+    SettlingDelay(settlingTime);
     cmphl = (uint8_t)Get_SPI_Reg_bits(addrCMP, 13, 12, true);
     lime::debug("cmphl=%d",(uint16_t)cmphl);
     this->SetActiveChannel(ch); //restore previously used channel
@@ -1392,6 +1412,129 @@ int LMS7002M::TuneVCO(VCO_Module module) // 0-cgen, 1-SXR, 2-SXT
     return -1;
 }
 
+/** @brief Searches VCO lock interval starting from given CSW value
+    @param module VCO to tune
+    @param sel VCO core to use, ignored for CGEN
+    @param seed CSW value to start from
+    @param acceptSeed return seed value without searching interval edges if it locks
+    @return CSW value in the middle of lock interval, -1 if lock was not found near seed
+*/
+int LMS7002M::TuneVCOFromSeed(VCO_Module module, int sel, int seed, bool acceptSeed)
+{
+    const int maxSteps = 16; //longer walks are left for full search
+    const LMS7Parameter &cswParam = module == VCO_CGEN ? LMS7param(CSW_VCO_CGEN) : LMS7param(CSW_VCO);
+    const uint16_t addrCMP = module == VCO_CGEN ? LMS7param(VCO_CMPHO_CGEN).address : LMS7param(VCO_CMPHO).address;
+    const uint16_t addrVCOpd = module == VCO_CGEN ? LMS7param(PD_VCO_CGEN).address : LMS7param(PD_VCO).address;
+    Channel ch = this->GetActiveChannel(); //remember used channel
+    if (module != VCO_CGEN)
+    {
+        this->SetActiveChannel(Channel(module));
+        Modify_SPI_Reg_bits(LMS7param(SEL_VCO), sel);
+    }
+    //activate VCO and comparator
+    Modify_SPI_Reg_bits(addrVCOpd, 2, 1, 0);
+    auto checkCSW = [&](int cswVal){
+        Modify_SPI_Reg_bits(cswParam, cswVal);
+        SettlingDelay(chrono::microseconds(50)); //comparator settling time
+        return Get_SPI_Reg_bits(addrCMP, 13, 12, true);
+    };
+
+    int csw = seed < 0 ? 0 : (seed > 255 ? 255 : seed);
+    int cmphl = checkCSW(csw);
+    if (cmphl == 2 && acceptSeed)
+    {
+        this->SetActiveChannel(ch);
+        return csw;
+    }
+    //walk towards lock interval, comparators tell the direction
+    const int dir = (cmphl == 0) ? 1 : -1;
+    int steps = 0;
+    while (cmphl != 2 && steps < maxSteps && csw + dir >= 0 && csw + dir <= 255)
+    {
+        const int prev = cmphl;
+        csw += dir;
+        ++steps;
+        cmphl = checkCSW(csw);
+        if (cmphl != 2 && cmphl != prev) //passed over lock interval
+            break;
+    }
+    int cswLow = csw, cswHigh = csw;
+    if (cmphl == 2)
+    {
+        //walk stopped at interval edge it came from, search the other edge
+        if (steps == 0 || dir < 0)
+            while (cswLow > 0 && cswHigh - cswLow < maxSteps && checkCSW(cswLow-1) == 2)
+                --cswLow;
+        if (steps == 0 || dir > 0)
+            while (cswHigh < 255 && cswHigh - cswLow < maxSteps && checkCSW(cswHigh+1) == 2)
+                ++cswHigh;
+        csw = (cswLow + cswHigh)/2;
+        cmphl = checkCSW(csw);
+    }
+    this->SetActiveChannel(ch); //restore previously used channel
+    return cmphl == 2 ? csw : -1;
+}
+
+/** @brief Tunes VCO from results stored for this board
+    Stored result for the same frequency is checked for lock first, CSW
+    estimated from neighbouring results is used as search starting point otherwise.
+    @param module VCO to tune
+    @param vcoFreq VCO frequency in Hz
+    @return 0-success, other-no usable results, full search is needed
+*/
+int LMS7002M::TuneVCOFromCache(VCO_Module module, float_type vcoFreq)
+{
+    LMS7002M_VCOCache &cache = LMS7002M_VCOCache::Instance();
+    const uint64_t serial = GetBoardSerial();
+    int sel, csw;
+    if (cache.Find(serial, mdevIndex, module, vcoFreq, sel, csw))
+    {
+        //temperature drift moves lock interval, search continues near stored value
+        const int tuned = TuneVCOFromSeed(module, sel, csw, true);
+        if (tuned >= 0)
+        {
+            if (tuned != csw)
+                StoreVCOTuning(module, vcoFreq, sel, tuned);
+            return 0;
+        }
+    }
+
+    //VCO core with estimate closest to the middle of CSW range is the best choice
+    std::vector<std::pair<int, int> > seeds;
+    for (sel = 0; sel < (module == VCO_CGEN ? 1 : 3); ++sel)
+        if (cache.Estimate(serial, mdevIndex, module, sel, vcoFreq, csw))
+            seeds.push_back(std::make_pair(abs(csw - 128), sel*256 + csw));
+    std::sort(seeds.begin(), seeds.end());
+    for (const auto &seed : seeds)
+    {
+        sel = seed.second / 256;
+        const int tuned = TuneVCOFromSeed(module, sel, seed.second % 256, false);
+        if (tuned >= 0)
+        {
+            StoreVCOTuning(module, vcoFreq, sel, tuned);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void LMS7002M::StoreVCOTuning(VCO_Module module, float_type vcoFreq, int sel, int csw)
+{
+    LMS7002M_VCOCache::Instance().Store(GetBoardSerial(), mdevIndex, module, vcoFreq, sel, csw);
+}
+
+/** @brief Returns serial number of connected board, 0 if unknown
+*/
+uint64_t LMS7002M::GetBoardSerial()
+{
+    if (!mBoardSerialValid && controlPort && controlPort->IsOpen())
+    {
+        mBoardSerial = controlPort->GetDeviceInfo().boardSerialNumber;
+        mBoardSerialValid = true;
+    }
+    return mBoardSerial;
+}
+
 /** @brief Returns given parameter value from chip register
     @param param LMS7002M control parameter
     @param fromChip read directly from chip
@@ -1465,15 +1608,60 @@ int LMS7002M::Modify_SPI_Reg_mask(const uint16_t *addr, const uint16_t *masks, c
     return status;
 }
 
+/** @brief Open addressing hash index of LMS7parameterList by parameter name
+*/
+class LMS7ParameterIndex
+{
+public:
+    LMS7ParameterIndex()
+    {
+        size_t size = 1;
+        while (size < 2*LMS7parameterList.size())
+            size <<= 1;
+        mSlots.resize(size, nullptr);
+        for (const LMS7Parameter* parameter : LMS7parameterList)
+        {
+            size_t i = Hash(parameter->name) & (size-1);
+            //keep first parameter of repeated names
+            while (mSlots[i] && strcmp(mSlots[i]->name, parameter->name) != 0)
+                i = (i+1) & (size-1);
+            if (!mSlots[i])
+                mSlots[i] = parameter;
+        }
+    }
+
+    const LMS7Parameter* Find(const char* name) const
+    {
+        const size_t mask = mSlots.size()-1;
+        for (size_t i = Hash(name) & mask; mSlots[i]; i = (i+1) & mask)
+            if (strcmp(mSlots[i]->name, name) == 0)
+                return mSlots[i];
+        return nullptr;
+    }
+
+private:
+    static uint32_t Hash(const char* str)
+    {
+        uint32_t hash = 2166136261u; //FNV-1a
+        while (*str)
+            hash = (hash ^ uint8_t(*str++)) * 16777619u;
+        return hash;
+    }
+    std::vector<const LMS7Parameter*> mSlots;
+};
+
 /** @brief Get parameter by name
     @param name parameter name
 */
+const LMS7Parameter* LMS7002M::GetParam(const char* name)
+{
+    static const LMS7ParameterIndex index;
+    return name ? index.Find(name) : nullptr;
+}
+
 const LMS7Parameter* LMS7002M::GetParam(const std::string &name)
 {
-    for(const LMS7Parameter* parameter : LMS7parameterList)
-        if (std::string(parameter->name) == name)
-            return parameter;
-    return nullptr;
+    return GetParam(name.c_str());
 }
 
 /** @brief Sets SX frequency
@@ -1484,9 +1672,6 @@ const LMS7Parameter* LMS7002M::GetParam(const std::string &name)
 */
 int LMS7002M::SetFrequencySX(bool tx, float_type freq_Hz, SX_details* output)
 {
-    static map<float_type, int8_t> tuning_cache_sel_vco;
-    static map<float_type, int16_t> tuning_cache_csw_value;
-
     const char* vcoNames[] = {"VCOL", "VCOM", "VCOH"};
     const uint8_t sxVCO_N = 2; //number of entries in VCO frequencies
     const float_type m_dThrF = 5500e6; //threshold to enable additional divider
@@ -1518,6 +1703,7 @@ int LMS7002M::SetFrequencySX(bool tx, float_type freq_Hz, SX_details* output)
     integerPart = (uint16_t)(VCOfreq / (refClk_Hz * (1 + (VCOfreq > m_dThrF))) - 4);
     fractionalPart = (uint32_t)((VCOfreq / (refClk_Hz * (1 + (VCOfreq > m_dThrF))) - (uint32_t)(VCOfreq / (refClk_Hz * (1 + (VCOfreq > m_dThrF))))) * 1048576);
 
+    Transaction transaction(this);
     Channel ch = this->GetActiveChannel();
     this->SetActiveChannel(tx?ChSXT:ChSXR);
     Modify_SPI_Reg_bits(LMS7param(EN_INTONLY_SDM), 0);
@@ -1549,26 +1735,21 @@ int LMS7002M::SetFrequencySX(bool tx, float_type freq_Hz, SX_details* output)
     Modify_SPI_Reg_bits(LMS7param(PD_VCO), 0); //
     Modify_SPI_Reg_bits(LMS7param(PD_VCO_COMP), 0);
 
-    // try setting tuning values from the cache, if it fails perform full tuning
-    if  (useCache && tuning_cache_sel_vco.count(freq_Hz) > 0)
-    {
-        sel_vco = tuning_cache_sel_vco[freq_Hz];
-        csw_value = tuning_cache_csw_value[freq_Hz];
-        Modify_SPI_Reg_bits(LMS7param(SEL_VCO), sel_vco);
-        Modify_SPI_Reg_bits(LMS7param(CSW_VCO).address, LMS7param(CSW_VCO).msb, LMS7param(CSW_VCO).lsb, csw_value);
-        this_thread::sleep_for(chrono::microseconds(50)); // probably no need for this as the interface is already very slow..
-        auto cmphl = (uint8_t)Get_SPI_Reg_bits(LMS7param(VCO_CMPHO).address, 13, 12, true);
-        if(cmphl == 2) {
-            lime::info("Fast Tune success; vco=%d value=%d", tuning_cache_sel_vco[freq_Hz], tuning_cache_csw_value[freq_Hz]);
-            this->SetActiveChannel(ch); //restore used channel
-            if (output)
-            {
-                output->success = true;
-                output->sel_vco = sel_vco;
-                output->csw = csw_value;
-            }
-            return 0;
+    // try tuning values from previous results, if it fails perform full tuning
+    if (TuneVCOFromCache(tx ? VCO_SXT : VCO_SXR, VCOfreq) == 0)
+    {
+        this->SetActiveChannel(tx?ChSXT:ChSXR);
+        sel_vco = Get_SPI_Reg_bits(LMS7param(SEL_VCO));
+        csw_value = Get_SPI_Reg_bits(LMS7param(CSW_VCO));
+        lime::debug("Fast Tune success; vco=%d value=%d", sel_vco, csw_value);
+        this->SetActiveChannel(ch); //restore used channel
+        if (output)
+        {
+            output->success = true;
+            output->sel_vco = sel_vco;
+            output->csw = csw_value;
         }
+        return transaction.Commit();
     }
 
     canDeliverFrequency = false;
@@ -1623,11 +1804,9 @@ int LMS7002M::SetFrequencySX(bool tx, float_type freq_Hz, SX_details* output)
     Modify_SPI_Reg_bits(LMS7param(SEL_VCO), sel_vco);
     Modify_SPI_Reg_bits(LMS7param(CSW_VCO), csw_value);
 
-    // save successful tuning results in cache
-    if (useCache && canDeliverFrequency) {
-        tuning_cache_sel_vco[freq_Hz] = sel_vco;
-        tuning_cache_csw_value[freq_Hz] = csw_value;
-    }
+    // save successful tuning results
+    if (canDeliverFrequency)
+        StoreVCOTuning(tx ? VCO_SXT : VCO_SXR, VCOfreq, sel_vco, csw_value);
 
     this->SetActiveChannel(ch); //restore used channel
 
@@ -1635,7 +1814,7 @@ int LMS7002M::SetFrequencySX(bool tx, float_type freq_Hz, SX_details* output)
         return ReportError("SetFrequencySX%s(%g MHz) - cannot deliver frequency",
                             tx?"T":"R",
                             freq_Hz / 1e6);
-    return 0;
+    return transaction.Commit();
 }
 
 /** @brief Sets SX frequency with Reference clock spur cancelation
@@ -1898,6 +2077,141 @@ int LMS7002M::GetGFIRCoefficients(bool tx, uint8_t GFIR_index, int16_t *coef, ui
     return status;
 
 }
+/** @brief Checks if register holds read only values, which can change
+    @param address SPI address
+*/
+static bool IsVolatileRegister(const uint16_t address)
+{
+    static const uint16_t readOnlyRegs[] = { 0, 1, 2, 3, 4, 5, 6, 0x002F, 0x008C, 0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x0123, 0x0209, 0x020A, 0x020B, 0x040E, 0x040F, 0x05C3, 0x05C4, 0x05C5, 0x05C6, 0x05C7, 0x05C8, 0x05C9, 0x05CA};
+    for (unsigned i = 0; i < sizeof(readOnlyRegs) / sizeof(uint16_t); ++i)
+        if (address == readOnlyRegs[i])
+            return true;
+    return false;
+}
+
+/** @brief Sends deferred register writes and waits for analog circuits to settle
+*/
+void LMS7002M::SettlingDelay(std::chrono::microseconds delay)
+{
+    FlushTransaction();
+    this_thread::sleep_for(delay);
+}
+
+void LMS7002M::BeginTransaction()
+{
+    ++mTransactionDepth;
+}
+
+int LMS7002M::CommitTransaction()
+{
+    if (mTransactionDepth == 0)
+        return ReportError(EINVAL, "CommitTransaction() without BeginTransaction()");
+    if (--mTransactionDepth > 0)
+        return 0;
+    return FlushTransaction();
+}
+
+int LMS7002M::FlushTransaction()
+{
+    mPendingAddresses.clear();
+    mPendingMAC = false;
+    if (mPendingWrites.empty())
+        return 0;
+    int status = 0;
+    if (controlPort)
+        status = controlPort->WriteLMS7002MSPI(mPendingWrites.data(), mPendingWrites.size(), mdevIndex);
+    else if (!useCache)
+        status = ReportError(ENODEV, "No device connected");
+    mPendingWrites.clear();
+    return status;
+}
+
+void LMS7002M::BeginProfileCapture()
+{
+    for (auto map : mCapturedMaps)
+        delete map;
+    mCapturedMaps.clear();
+    delete mCaptureBase;
+    //dirty bits of base are merged back at the end for pending register map backups
+    mCaptureBase = new LMS7002M_RegistersMap(*mRegistersMap);
+    mRegistersMap->ClearDirty();
+}
+
+void LMS7002M::CaptureProfile()
+{
+    if (mCaptureBase)
+        mCapturedMaps.push_back(new LMS7002M_RegistersMap(*mRegistersMap));
+}
+
+int LMS7002M::EndProfileCapture(std::vector<RegisterProfile> &profiles)
+{
+    if (!mCaptureBase)
+        return ReportError(EINVAL, "EndProfileCapture() without BeginProfileCapture()");
+    std::vector<uint16_t> addresses[2];
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        for (const uint16_t addr : mRegistersMap->GetDirtyAddresses(ch))
+        {
+            if (ch == 1 && addr < 0x0100)
+                continue;
+            if (addr == LMS7param(MAC).address || IsVolatileRegister(addr))
+                continue;
+            addresses[ch].push_back(addr);
+        }
+    }
+    profiles.clear();
+    for (auto map : mCapturedMaps)
+    {
+        RegisterProfile profile;
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            profile.addresses[ch] = addresses[ch];
+            for (const uint16_t addr : addresses[ch])
+                profile.values[ch].push_back(map->GetValue(ch, addr));
+        }
+        profiles.push_back(profile);
+        delete map;
+    }
+    mCapturedMaps.clear();
+    mRegistersMap->AddDirty(*mCaptureBase);
+    delete mCaptureBase;
+    mCaptureBase = nullptr;
+    return 0;
+}
+
+int LMS7002M::ApplyProfile(const RegisterProfile &profile)
+{
+    const uint16_t macAddr = LMS7param(MAC).address;
+    const uint16_t mac = mRegistersMap->GetValue(0, macAddr);
+    std::vector<uint16_t> addrs;
+    std::vector<uint16_t> values;
+    bool macChanged = false;
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        bool macSet = false;
+        for (size_t i = 0; i < profile.addresses[ch].size(); ++i)
+        {
+            const uint16_t addr = profile.addresses[ch][i];
+            if (useCache && mRegistersMap->GetValue(ch, addr) == profile.values[ch][i])
+                continue;
+            if (addr >= 0x0100 && !macSet)
+            {
+                addrs.push_back(macAddr);
+                values.push_back((mac & ~0x3) | (ch + 1));
+                macSet = macChanged = true;
+            }
+            addrs.push_back(addr);
+            values.push_back(profile.values[ch][i]);
+        }
+    }
+    if (macChanged)
+    {
+        addrs.push_back(macAddr);
+        values.push_back(mac);
+    }
+    return SPI_write_batch(addrs.data(), values.data(), addrs.size(), true);
+}
+
 /** @brief Write given data value to whole register
     @param address SPI address
     @param data new register value
@@ -1907,6 +2221,7 @@ int LMS7002M::SPI_write(uint16_t address, uint16_t data, bool toChip)
 {
     if(address == 0x0640 || address == 0x0641)
     {
+        FlushTransaction();
         MCU_BD* mcu = GetMCUControls();
         mcu->RunProcedure(MCU_FUNCTION_GET_PROGRAM_ID);
         if(mcu->WaitForMCU(100) != MCU_ID_CALIBRATIONS_SINGLE_IMAGE)
@@ -1930,14 +2245,11 @@ int LMS7002M::SPI_write(uint16_t address, uint16_t data, bool toChip)
 uint16_t LMS7002M::SPI_read(uint16_t address, bool fromChip, int *status)
 {
     fromChip |= !useCache;
-    //registers containing read only registers, which values can change
-    const uint16_t readOnlyRegs[] = { 0, 1, 2, 3, 4, 5, 6, 0x002F, 0x008C, 0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x0123, 0x0209, 0x020A, 0x020B, 0x040E, 0x040F, 0x05C3, 0x05C4, 0x05C5, 0x05C6, 0x05C7, 0x05C8, 0x05C9, 0x05CA};
-    for (unsigned i = 0; i < sizeof(readOnlyRegs) / sizeof(uint16_t); ++i)
-        if (address == readOnlyRegs[i])
-        {
-            fromChip = true;
-            break;
-        }
+    if (IsVolatileRegister(address))
+        fromChip = true;
+    //value written in transaction is not in chip yet, cache holds it
+    else if (mTransactionDepth > 0 && mPendingAddresses.count(address))
+        fromChip = false;
     if (!controlPort || fromChip == false)
     {
         if (status && !controlPort)
@@ -1953,6 +2265,7 @@ uint16_t LMS7002M::SPI_read(uint16_t address, bool fromChip, int *status)
         int st;
         if(address == 0x0640 || address == 0x0641)
         {
+            FlushTransaction();
             MCU_BD* mcu = GetMCUControls();
             mcu->RunProcedure(MCU_FUNCTION_GET_PROGRAM_ID);
             if(mcu->WaitForMCU(100) != MCU_ID_CALIBRATIONS_SINGLE_IMAGE)
@@ -2009,6 +2322,23 @@ int LMS7002M::SPI_write_batch(const uint16_t* spiAddr, const uint16_t* spiData,
 
     if (data.size() == 0)
         return 0;
+    if (mTransactionDepth > 0)
+    {
+        for (auto cmd : data)
+        {
+            const uint16_t addr = (cmd >> 16) & 0x7FFF;
+            //repeated writes are all kept in order, they can be load or reset strobes
+            mPendingAddresses.insert(addr);
+            mPendingWrites.push_back(cmd);
+            //writes before and after channel change go to different register banks
+            if (addr == LMS7param(MAC).address)
+            {
+                mPendingAddresses.clear();
+                mPendingMAC = true;
+            }
+        }
+        return 0;
+    }
     if (!controlPort)
     {
         if (useCache) return 0;
@@ -2032,6 +2362,17 @@ int LMS7002M::SPI_read_batch(const uint16_t* spiAddr, uint16_t* spiData, uint16_
         return -1;
     }
 
+    //chip state must include collected writes that can affect read values
+    bool flush = mPendingMAC;
+    for (size_t i = 0; i < cnt && mTransactionDepth > 0 && !flush; ++i)
+        flush = IsVolatileRegister(spiAddr[i]) || mPendingAddresses.count(spiAddr[i]);
+    if (flush)
+    {
+        int status = FlushTransaction();
+        if (status != 0)
+            return status;
+    }
+
     std::vector<uint32_t> dataWr(cnt);
     std::vector<uint32_t> dataRd(cnt);
     for (size_t i = 0; i < cnt; ++i)
@@ -2719,7 +3060,7 @@ float_type LMS7002M::GetTemperature()
     uint16_t biasMux = Get_SPI_Reg_bits(LMS7_MUX_BIAS_OUT);
     Modify_SPI_Reg_bits(LMS7_MUX_BIAS_OUT, 2);
 
-    this_thread::sleep_for(chrono::microseconds(250));
+    SettlingDelay(chrono::microseconds(250));
     const uint16_t reg606 = SPI_read(0x0606, true);
     float Vtemp = (reg606 >> 8) & 0xFF;
     Vtemp *= 1.84;
@@ -2788,7 +3129,7 @@ int LMS7002M::CalibrateAnalogRSSI_DC_Offset()
         if(value < 0)
             wrValue |= 0x40;
         Modify_SPI_Reg_bits(LMS7param(RSSIDC_DCO1), wrValue, true);
-        this_thread::sleep_for(chrono::microseconds(5));
+        SettlingDelay(chrono::microseconds(5));
         cmp = Get_SPI_Reg_bits(LMS7param(RSSIDC_CMPSTATUS), true);
         if(cmp != cmpPrev)
         {
@@ -14,6 +14,8 @@
 #include <stdarg.h>
 #include <functional>
 #include <vector>
+#include <set>
+#include <chrono>
 
 namespace lime{
 class IConnection;
@@ -155,12 +157,94 @@ public:
     int SPI_write(uint16_t address, uint16_t data, bool toChip = false);
     uint16_t SPI_read(uint16_t address, bool fromChip = false, int *status = 0);
     int RegistersTest(const char* fileName = "registersTest.txt");
+    static const LMS7Parameter* GetParam(const char* name);
     static const LMS7Parameter* GetParam(const std::string &name);
     ///@}
 
+    ///@name Deferred register writes
+    /*!
+     * Starts collecting register writes instead of sending each one to chip.
+     * Writes update register cache and are kept in order, including repeated
+     * writes to the same address, CommitTransaction() sends them all in one batch. Reading volatile
+     * registers from chip sends collected writes first, registers written in
+     * transaction are read back from cache.
+     * Transactions can be nested, only outermost commit sends the writes.
+     */
+    void BeginTransaction();
+    /*!
+     * Ends transaction started by BeginTransaction()
+     * @return 0-success, other-failure to write collected registers
+     */
+    int CommitTransaction();
+    /*!
+     * Sends writes collected so far without ending transaction
+     * @return 0-success, other-failure
+     */
+    int FlushTransaction();
+    bool InTransaction() const {return mTransactionDepth > 0;}
+
+    /*!
+     * Transaction for the lifetime of object, commits on destruction if
+     * Commit() was not called.
+     */
+    class LIME_API Transaction
+    {
+    public:
+        Transaction(LMS7002M* chip) : mChip(chip), mActive(true) {mChip->BeginTransaction();}
+        ~Transaction() {Commit();}
+        int Commit()
+        {
+            if (!mActive)
+                return 0;
+            mActive = false;
+            return mChip->CommitTransaction();
+        }
+    private:
+        Transaction(const Transaction&);
+        Transaction& operator=(const Transaction&);
+        LMS7002M* mChip;
+        bool mActive;
+    };
+    ///@}
+
+    ///@name Register profiles
+    /*!
+     * Register values recorded by profile capture, applied with one batched write
+     */
+    struct RegisterProfile
+    {
+        ///registers of channel A including registers below MAC mapped space, and of channel B
+        std::vector<uint16_t> addresses[2];
+        std::vector<uint16_t> values[2];
+    };
+    /*!
+     * Starts recording registers changed by following configuration calls,
+     * each CaptureProfile() call stores current state as one profile.
+     */
+    void BeginProfileCapture();
+    void CaptureProfile();
+    /*!
+     * Ends recording started by BeginProfileCapture(). Every profile holds
+     * values of all registers changed during recording, except volatile
+     * registers and MAC.
+     * @return 0-success, other-capture was not started
+     */
+    int EndProfileCapture(std::vector<RegisterProfile> &profiles);
+    /*!
+     * Writes profile registers that differ from cache in one batch
+     * @return 0-success, other-failure
+     */
+    int ApplyProfile(const RegisterProfile &profile);
+    ///@}
+
     ///@name Transmitter, Receiver calibrations
-    int CalibrateRx(float_type bandwidth, const bool useExtLoopback = false);
-    int CalibrateTx(float_type bandwidth, const bool useExtLoopback = false);
+    /*!
+     * Calibrations reuse stored results of earlier calibration done with the
+     * same board, channel, LO band, bandwidth, gains and close temperature.
+     * With useStoredResult false the cache is neither read nor updated.
+     */
+    int CalibrateRx(float_type bandwidth, const bool useExtLoopback = false, const bool useStoredResult = true);
+    int CalibrateTx(float_type bandwidth, const bool useExtLoopback = false, const bool useStoredResult = true);
     ///@}
 
     ///@name Filters tuning
@@ -470,6 +554,13 @@ protected:
     int TxFilterSearch(const LMS7Parameter &param, const uint32_t rssi_3dB, uint8_t rssiAvgCnt, const int stepLimit);
     int TxFilterSearch_S5(const LMS7Parameter &param, const uint32_t rssi_3dB, uint8_t rssiAvgCnt, const int stepLimit);
 
+    void SettlingDelay(std::chrono::microseconds delay);
+    int TuneVCOFromSeed(VCO_Module module, int sel, int seed, bool acceptSeed);
+    int TuneVCOFromCache(VCO_Module module, float_type vcoFreq);
+    void StoreVCOTuning(VCO_Module module, float_type vcoFreq, int sel, int csw);
+    uint64_t GetBoardSerial();
+    bool ApplyStoredCalibration(bool tx, float_type bandwidth_Hz, bool useExtLoopback, float_type temperature);
+    void StoreCalibration(bool tx, float_type bandwidth_Hz, bool useExtLoopback, float_type temperature);
     int TuneRxFilterSetup(const float_type rx_lpf_IF);
     int TuneTxFilterSetup(const float_type tx_lpf_IF);
 
@@ -496,6 +587,19 @@ protected:
     IConnection* controlPort;
     unsigned mdevIndex;
     size_t mSelfCalDepth;
+    int mTransactionDepth;
+    ///SPI write commands collected by transaction
+    std::vector<uint32_t> mPendingWrites;
+    ///addresses written since last MAC change
+    std::set<uint16_t> mPendingAddresses;
+    ///MAC was written in transaction, chip reads need flush
+    bool mPendingMAC;
+    ///register map state when profile capture started, nullptr when not capturing
+    LMS7002M_RegistersMap* mCaptureBase;
+    std::vector<LMS7002M_RegistersMap*> mCapturedMaps;
+    ///serial number of board for VCO tuning results, read on first use
+    uint64_t mBoardSerial;
+    bool mBoardSerialValid;
     int opt_gain_tbb[2];
     double _cachedRefClockRate;
     int LoadConfigLegacyFile(const char* filename);
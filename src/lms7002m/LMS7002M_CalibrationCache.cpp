@@ -0,0 +1,185 @@
+/**
+@file LMS7002M_CalibrationCache.cpp
+@author Lime Microsystems
+@brief Persistent storage of LMS7002M Rx/Tx calibration results
+*/
+
+#include "LMS7002M_CalibrationCache.h"
+#include "SystemResources.h"
+#include "Logger.h"
+#include <cstdlib>
+#include <cmath>
+#include <cinttypes>
+
+using namespace lime;
+
+//width of LO frequency band sharing calibration results
+static const double cBandWidth = 10e6;
+//largest temperature change for which results are reused
+static const float cTemperatureDrift = 5.0;
+//rewrite file when it holds more superseded lines than results
+static const int cCompactThreshold = 256;
+//registers stored in one result
+static const unsigned cMaxRegisters = 32;
+
+LMS7002M_CalibrationCache &LMS7002M_CalibrationCache::Instance()
+{
+    static LMS7002M_CalibrationCache cache;
+    return cache;
+}
+
+LMS7002M_CalibrationCache::LMS7002M_CalibrationCache() :
+    mLoaded(false),
+    mHits(0),
+    mMisses(0)
+{
+    const char* path = std::getenv("LIME_CALIBRATION_CACHE");
+    mPath = path ? path : getAppDataDirectory() + "/calibration_cache.txt";
+}
+
+int LMS7002M_CalibrationCache::GetBand(double loFreq)
+{
+    return int(std::lround(loFreq / cBandWidth));
+}
+
+void LMS7002M_CalibrationCache::Load()
+{
+    mLoaded = true;
+    if (mPath.empty())
+        return;
+    FILE* file = fopen(mPath.c_str(), "r");
+    if (!file)
+        return;
+    //later lines supersede earlier results
+    int lines = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        uint64_t serial;
+        unsigned chip, bandwidth, count;
+        int channel, tx, band, ext, pos;
+        uint32_t gain;
+        Result result;
+        if (sscanf(line, "%" SCNx64 " %u %d %d %d %u %" SCNx32 " %d %f %u%n", &serial, &chip, &channel, &tx,
+                &band, &bandwidth, &gain, &ext, &result.temperature, &count, &pos) != 10 || count > cMaxRegisters)
+            continue;
+        const char* regs = line + pos;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            unsigned addr, value;
+            int len;
+            if (sscanf(regs, " %x=%x%n", &addr, &value, &len) != 2)
+                break;
+            result.addresses.push_back(addr);
+            result.values.push_back(value);
+            regs += len;
+        }
+        if (result.addresses.size() != count)
+            continue;
+        Insert(Key(serial, chip, channel, tx != 0, band, bandwidth, gain, ext != 0), result);
+        ++lines;
+    }
+    fclose(file);
+
+    size_t count = 0;
+    for (const auto &results : mResults)
+        count += results.second.size();
+    if (lines - int(count) < cCompactThreshold)
+        return;
+    file = fopen(mPath.c_str(), "w");
+    if (!file)
+        return;
+    for (const auto &results : mResults)
+        for (const auto &result : results.second)
+            Write(file, results.first, result);
+    fclose(file);
+}
+
+void LMS7002M_CalibrationCache::Write(FILE* file, const Key &key, const Result &result) const
+{
+    fprintf(file, "%" PRIx64 " %u %d %d %d %u %" PRIx32 " %d %.1f %u", std::get<0>(key), std::get<1>(key),
+        std::get<2>(key), int(std::get<3>(key)), std::get<4>(key), std::get<5>(key), std::get<6>(key),
+        int(std::get<7>(key)), result.temperature, unsigned(result.addresses.size()));
+    for (size_t i = 0; i < result.addresses.size(); ++i)
+        fprintf(file, " %04X=%04X", result.addresses[i], result.values[i]);
+    fprintf(file, "\n");
+}
+
+void LMS7002M_CalibrationCache::Insert(const Key &key, const Result &result)
+{
+    //result replaces one calibrated at similar temperature
+    std::vector<Result> &results = mResults[key];
+    for (auto &stored : results)
+    {
+        if (std::fabs(stored.temperature - result.temperature) <= cTemperatureDrift)
+        {
+            stored = result;
+            return;
+        }
+    }
+    results.push_back(result);
+}
+
+bool LMS7002M_CalibrationCache::Find(const Key &key, float temperature, Result &result)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mLoaded)
+        Load();
+    const Result* best = nullptr;
+    auto iter = mResults.find(key);
+    if (iter != mResults.end())
+    {
+        for (const auto &stored : iter->second)
+        {
+            const float drift = std::fabs(stored.temperature - temperature);
+            if (drift <= cTemperatureDrift && (!best || drift < std::fabs(best->temperature - temperature)))
+                best = &stored;
+        }
+    }
+    if (!best)
+    {
+        ++mMisses;
+        return false;
+    }
+    ++mHits;
+    result = *best;
+    return true;
+}
+
+void LMS7002M_CalibrationCache::Store(const Key &key, const Result &result)
+{
+    if (result.addresses.size() > cMaxRegisters)
+        return;
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mLoaded)
+        Load();
+    Insert(key, result);
+    if (mPath.empty() || std::get<0>(key) == 0)
+        return;
+    FILE* file = fopen(mPath.c_str(), "a");
+    if (!file)
+    {
+        makeDirectories(mPath.substr(0, mPath.find_last_of("/\\")));
+        file = fopen(mPath.c_str(), "a");
+    }
+    if (!file)
+    {
+        lime::warning("Calibration cache: cannot write %s", mPath.c_str());
+        mPath.clear();
+        return;
+    }
+    Write(file, key, result);
+    fclose(file);
+}
+
+void LMS7002M_CalibrationCache::GetStats(unsigned &hits, unsigned &misses) const
+{
+    hits = mHits;
+    misses = mMisses;
+}
+
+void LMS7002M_CalibrationCache::ResetStats()
+{
+    mHits = 0;
+    mMisses = 0;
+}
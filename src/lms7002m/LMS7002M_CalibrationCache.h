@@ -0,0 +1,76 @@
+/**
+@file LMS7002M_CalibrationCache.h
+@author Lime Microsystems
+@brief Persistent storage of LMS7002M Rx/Tx calibration results
+*/
+
+#ifndef LMS7002M_CALIBRATION_CACHE_H
+#define LMS7002M_CALIBRATION_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace lime{
+
+/** @brief DC/IQ correction registers found by Rx/Tx calibration.
+
+    Results are kept per board serial number, chip index, channel, direction,
+    LO frequency band, calibration bandwidth, gain configuration and
+    loopback type. Result is reused only if chip temperature is close to
+    temperature measured at calibration.
+    Every stored result is appended to a file in application data directory,
+    which is loaded on first use. Path can be overridden by
+    LIME_CALIBRATION_CACHE environment variable, empty value keeps results in
+    memory only. Results of boards without serial number are not saved.
+*/
+class LMS7002M_CalibrationCache
+{
+public:
+    //serial, chip, channel, tx, LO band, bandwidth kHz, gain configuration, external loopback
+    typedef std::tuple<uint64_t, unsigned, int, bool, int, unsigned, uint32_t, bool> Key;
+
+    struct Result
+    {
+        float temperature;
+        std::vector<uint16_t> addresses;
+        std::vector<uint16_t> values;
+    };
+
+    static LMS7002M_CalibrationCache &Instance();
+
+    /** @brief Returns LO band index of frequency used in key
+    */
+    static int GetBand(double loFreq);
+
+    /** @brief Finds result calibrated at temperature closest to given one
+        @return true if result within allowed temperature drift was found
+    */
+    bool Find(const Key &key, float temperature, Result &result);
+
+    void Store(const Key &key, const Result &result);
+
+    void GetStats(unsigned &hits, unsigned &misses) const;
+    void ResetStats();
+
+private:
+    LMS7002M_CalibrationCache();
+    void Load();
+    void Insert(const Key &key, const Result &result);
+    void Write(FILE* file, const Key &key, const Result &result) const;
+
+    std::mutex mLock;
+    bool mLoaded;
+    std::string mPath;
+    std::map<Key, std::vector<Result> > mResults;
+    std::atomic<unsigned> mHits;
+    std::atomic<unsigned> mMisses;
+};
+
+}
+#endif
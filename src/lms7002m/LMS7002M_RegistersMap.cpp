@@ -1,10 +1,26 @@
 #include "LMS7002M_RegistersMap.h"
 #include "LMS7002M_parameters.h"
+#include <cstring>
 using namespace lime;
 
+//storage page index of each 32 register page, -1 for pages without registers
+const int8_t LMS7002M_RegistersMap::cPageSlots[0x0800/cPageSize] = {
+    0,  1, -1, -1,  2,  3, -1, -1, //0x0000
+    4,  5, -1, -1, -1, -1, -1, -1, //0x0100
+    6, -1,  7,  8,  9, 10, 11, 12, //0x0200
+   13, 14, 15, 16, 17, 18, -1, -1, //0x0300
+   19, -1, 20, 21, 22, 23, 24, 25, //0x0400
+   26, 27, 28, 29, 30, 31, 32, -1, //0x0500
+   33, -1, 34, -1, -1, -1, -1, -1, //0x0600
+   -1, -1, -1, -1, -1, -1, -1, -1, //0x0700
+};
+
 LMS7002M_RegistersMap::LMS7002M_RegistersMap()
 {
-
+    memset(mValues, 0, sizeof(mValues));
+    memset(mDefaults, 0, sizeof(mDefaults));
+    memset(mUsed, 0, sizeof(mUsed));
+    memset(mDirty, 0, sizeof(mDirty));
 }
 
 LMS7002M_RegistersMap::~LMS7002M_RegistersMap()
@@ -14,35 +30,31 @@ LMS7002M_RegistersMap::~LMS7002M_RegistersMap()
 
 uint16_t LMS7002M_RegistersMap::GetDefaultValue(uint16_t address) const
 {
-    auto iter = mChannelA.find(address);
-    if( iter != mChannelA.end())
-        return iter->second.defaultValue;
-    else
-        return 0;
+    const int slot = GetSlot(address);
+    return slot < 0 ? 0 : mDefaults[slot];
 }
 
 void LMS7002M_RegistersMap::InitializeDefaultValues(const std::vector<const LMS7Parameter*> parameterList)
 {
     for(auto parameter : parameterList)
     {
-        uint16_t regValue = mChannelA[parameter->address].defaultValue;
-        mChannelA[parameter->address].defaultValue = regValue | (parameter->defaultValue << parameter->lsb);
-        mChannelA[parameter->address].value = mChannelA[parameter->address].defaultValue;
+        const int slot = GetSlot(parameter->address);
+        if (slot < 0)
+            continue;
+        mDefaults[slot] |= parameter->defaultValue << parameter->lsb;
+        SetValue(0, parameter->address, mDefaults[slot]);
         if(parameter->address >= 0x0100)
-            mChannelB[parameter->address].value = mChannelA[parameter->address].value;
+            SetValue(1, parameter->address, mDefaults[slot]);
     }
     //add NCO/PHO registers
     const uint16_t addr = 0x0242;
     for (int i = 0; i < 32; ++i)
     {
-        mChannelA[addr + i].defaultValue = 0;
-        mChannelA[addr + i].value = 0;
-        mChannelB[addr + i].defaultValue = 0;
-        mChannelB[addr + i].value = 0;
-        mChannelA[addr + i + 0x0200].defaultValue = 0;
-        mChannelA[addr + i + 0x0200].value = 0;
-        mChannelB[addr + i + 0x0200].defaultValue = 0;
-        mChannelB[addr + i + 0x0200].value = 0;
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            SetValue(ch, addr + i, 0);
+            SetValue(ch, addr + i + 0x0200, 0);
+        }
     }
 
     //add GFIRS
@@ -57,52 +69,54 @@ void LMS7002M_RegistersMap::InitializeDefaultValues(const std::vector<const LMS7
     {
         for(int i=range.first; i<=range.second; ++i)
         {
-            mChannelA[i].defaultValue = 0;
-            mChannelA[i].value = 0;
-            mChannelB[i].defaultValue = 0;
-            mChannelB[i].value = 0;
+            for (int ch = 0; ch < 2; ++ch)
+            {
+                SetValue(ch, i, 0);
+                SetValue(ch, i + 0x0200, 0);
+            }
+        }
+    }
+}
 
-            mChannelA[i+0x0200].defaultValue = 0;
-            mChannelA[i+0x0200].value = 0;
-            mChannelB[i+0x0200].defaultValue = 0;
-            mChannelB[i+0x0200].value = 0;
+std::vector<uint16_t> LMS7002M_RegistersMap::GetAddresses(const uint64_t* bitmap) const
+{
+    std::vector<uint16_t> addresses;
+    for (int page = 0; page < 0x0800/cPageSize; ++page)
+    {
+        if (cPageSlots[page] < 0)
+            continue;
+        for (int i = 0; i < cPageSize; ++i)
+        {
+            const int slot = cPageSlots[page]*cPageSize + i;
+            if (bitmap[slot >> 6] & (uint64_t(1) << (slot & 63)))
+                addresses.push_back(page*cPageSize + i);
         }
     }
+    return addresses;
 }
 
-void LMS7002M_RegistersMap::SetValue(uint8_t channel, const uint16_t address, const uint16_t value)
+std::vector<uint16_t> LMS7002M_RegistersMap::GetUsedAddresses(const uint8_t channel) const
 {
-    if(channel == 0)
-        mChannelA[address].value = value;
-    else if(channel == 1)
-        mChannelB[address].value = value;
+    if (channel > 1)
+        return std::vector<uint16_t>();
+    return GetAddresses(mUsed[channel]);
 }
 
-uint16_t LMS7002M_RegistersMap::GetValue(uint8_t channel, uint16_t address) const
+std::vector<uint16_t> LMS7002M_RegistersMap::GetDirtyAddresses(const uint8_t channel) const
 {
-    const std::map<const uint16_t, Register> *regMap(nullptr);
-    if(channel == 0)
-        regMap = &mChannelA;
-    else if(channel == 1)
-        regMap = &mChannelB;
-    else
-        return 0;
-    std::map<const uint16_t, Register>::const_iterator iter;
-    iter = regMap->find(address);
-    if (iter != regMap->end())
-        return iter->second.value;
-    else
-        return 0;
+    if (channel > 1)
+        return std::vector<uint16_t>();
+    return GetAddresses(mDirty[channel]);
 }
 
-std::vector<uint16_t> LMS7002M_RegistersMap::GetUsedAddresses(const uint8_t channel) const
+void LMS7002M_RegistersMap::ClearDirty()
 {
-    std::vector<uint16_t> addresses;
-    if(channel == 0)
-        for(auto iter : mChannelA)
-            addresses.push_back(iter.first);
-    else if(channel == 1)
-        for(auto iter : mChannelB)
-            addresses.push_back(iter.first);
-    return addresses;
+    memset(mDirty, 0, sizeof(mDirty));
+}
+
+void LMS7002M_RegistersMap::AddDirty(const LMS7002M_RegistersMap &other)
+{
+    for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < cBitmapWords; ++i)
+            mDirty[ch][i] |= other.mDirty[ch][i];
 }
@@ -2,43 +2,78 @@
 #define LMS7002M_REGISTERS_MAP_H
 
 #include <vector>
-#include <map>
 #include <cstdint>
 struct LMS7Parameter;
 namespace lime{
 
 
+/** @brief Shadow copy of LMS7002M registers for both channels.
 
+    Registers are stored in flat arrays, address space 0x0000-0x07FF is split
+    into 32 register pages and only pages containing registers get storage
+    slots. Copying the map is a plain memory copy, changed registers are
+    marked in dirty bitmap.
+*/
 class LMS7002M_RegistersMap
 {
 public:
-    struct Register
-    {
-        uint16_t value;
-        uint16_t defaultValue;
-        uint16_t mask;
-    };
-
     LMS7002M_RegistersMap();
     ~LMS7002M_RegistersMap();
 
-    uint16_t GetValue(uint8_t channel, uint16_t address) const;
-    void SetValue(uint8_t channel, const uint16_t address, const uint16_t value);
+    uint16_t GetValue(uint8_t channel, uint16_t address) const
+    {
+        const int slot = GetSlot(address);
+        if (slot < 0 || channel > 1)
+            return 0;
+        return mValues[channel][slot];
+    }
+
+    void SetValue(uint8_t channel, const uint16_t address, const uint16_t value)
+    {
+        const int slot = GetSlot(address);
+        if (slot < 0 || channel > 1)
+            return;
+        const uint64_t bit = uint64_t(1) << (slot & 63);
+        mUsed[channel][slot >> 6] |= bit;
+        if (mValues[channel][slot] != value)
+            mDirty[channel][slot >> 6] |= bit;
+        mValues[channel][slot] = value;
+    }
 
     void InitializeDefaultValues(const std::vector<const LMS7Parameter*> parameterList);
     uint16_t GetDefaultValue(uint16_t address) const;
     std::vector<uint16_t> GetUsedAddresses(const uint8_t channel) const;
 
-    LMS7002M_RegistersMap &operator=(const LMS7002M_RegistersMap &other)
+    /** @brief Returns addresses which values changed since last ClearDirty()
+    */
+    std::vector<uint16_t> GetDirtyAddresses(const uint8_t channel) const;
+    void ClearDirty();
+    /** @brief Marks registers changed in other map as dirty in this one
+    */
+    void AddDirty(const LMS7002M_RegistersMap &other);
+
+protected:
+    static const int cPageSize = 32;
+    static const int cPagesCount = 35;
+    static const int cSlotsCount = cPagesCount*cPageSize;
+    static const int cBitmapWords = (cSlotsCount+63)/64;
+    static const int8_t cPageSlots[0x0800/cPageSize];
+
+    static int GetSlot(const uint16_t address)
     {
-        mChannelA.insert(other.mChannelA.begin(), other.mChannelA.end());
-        mChannelB.insert(other.mChannelB.begin(), other.mChannelB.end());
-        return *this;
+        if (address >= 0x0800)
+            return -1;
+        const int page = cPageSlots[address/cPageSize];
+        if (page < 0)
+            return -1;
+        return page*cPageSize + (address & (cPageSize-1));
     }
+    std::vector<uint16_t> GetAddresses(const uint64_t* bitmap) const;
 
-protected:
-    std::map<const uint16_t, Register> mChannelA;
-    std::map<const uint16_t, Register> mChannelB;
+    uint16_t mValues[2][cSlotsCount];
+    uint16_t mDefaults[cSlotsCount];
+    uint64_t mUsed[2][cBitmapWords];
+    uint64_t mDirty[2][cBitmapWords];
 };
 
 }
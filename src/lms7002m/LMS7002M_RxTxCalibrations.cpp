@@ -1,12 +1,16 @@
 #include "LMS7002M.h"
 #include <assert.h>
+#include <algorithm>
 #include "MCU_BD.h"
 #include "IConnection.h"
 #include "mcu_programs.h"
 #include <chrono>
 #include <thread>
+#include <cmath>
 #include "Logger.h"
 #include "LMSBoards.h"
+#include "LMS7002M_CalibrationCache.h"
+#include "LMS7002M_RegistersMap.h"
 
 #ifndef NDEBUG
 #define LMS_VERBOSE_OUTPUT
@@ -94,6 +98,140 @@ static int16_t ReadAnalogDC(lime::LMS7002M* lmsControl, const LMS7Parameter& par
     return result;
 }
 
+/** @brief Measures chip temperature without changing configuration
+*/
+static float_type MeasureTemperature(lime::LMS7002M* lmsControl)
+{
+    LMS7002M_RegistersMap* backup = lmsControl->BackupRegisterMap();
+    const float_type temperature = lmsControl->GetTemperature();
+    lmsControl->RestoreRegisterMap(backup);
+    return temperature;
+}
+
+/** @brief Returns fields holding calibration results of active channel
+*/
+static std::vector<LMS7Parameter> CalibrationFields(bool tx, uint8_t channel)
+{
+    if (tx)
+        return {LMS7_GCORRQ_TXTSP, LMS7_GCORRI_TXTSP, LMS7_IQCORR_TXTSP, LMS7_DCCORRI_TXTSP, LMS7_DCCORRQ_TXTSP,
+            LMS7_DC_BYP_TXTSP, LMS7_GC_BYP_TXTSP, LMS7_PH_BYP_TXTSP, LMS7_DCMODE,
+            channel ? LMS7_PD_DCDAC_TXB : LMS7_PD_DCDAC_TXA, channel ? LMS7_PD_DCCMP_TXB : LMS7_PD_DCCMP_TXA,
+            channel ? LMS7_DC_TXBI : LMS7_DC_TXAI, channel ? LMS7_DC_TXBQ : LMS7_DC_TXAQ};
+    return {LMS7_GCORRQ_RXTSP, LMS7_GCORRI_RXTSP, LMS7_IQCORR_RXTSP,
+        LMS7_DC_BYP_RXTSP, LMS7_GC_BYP_RXTSP, LMS7_PH_BYP_RXTSP, LMS7_DCMODE,
+        channel ? LMS7_PD_DCDAC_RXB : LMS7_PD_DCDAC_RXA, channel ? LMS7_PD_DCCMP_RXB : LMS7_PD_DCCMP_RXA,
+        channel ? LMS7_DC_RXBI : LMS7_DC_RXAI, channel ? LMS7_DC_RXBQ : LMS7_DC_RXAQ};
+}
+
+/** @brief Returns registers holding calibration results of active channel
+    @param masks returns bits of calibration fields in each register, other bits are left untouched
+*/
+static std::vector<uint16_t> CalibrationRegisters(bool tx, uint8_t channel, std::vector<uint16_t> &masks)
+{
+    std::vector<uint16_t> addrs;
+    masks.clear();
+    for (const LMS7Parameter &param : CalibrationFields(tx, channel))
+    {
+        const uint16_t mask = ((1 << (param.msb - param.lsb + 1)) - 1) << param.lsb;
+        const size_t i = std::find(addrs.begin(), addrs.end(), param.address) - addrs.begin();
+        if (i == addrs.size())
+        {
+            addrs.push_back(param.address);
+            masks.push_back(mask);
+        }
+        else
+            masks[i] |= mask;
+    }
+    return addrs;
+}
+
+/** @brief Describes conditions of calibration for active channel
+*/
+static LMS7002M_CalibrationCache::Key CalibrationKey(lime::LMS7002M* lmsControl, uint64_t serial, unsigned chip,
+    bool tx, float_type bandwidth_Hz, bool useExtLoopback)
+{
+    const uint8_t ch = (uint8_t)lmsControl->Get_SPI_Reg_bits(LMS7_MAC);
+    uint32_t gain;
+    bool useSXT = tx;
+    if (tx)
+        gain = lmsControl->Get_SPI_Reg_bits(LMS7_SEL_BAND2_TRF) << 17 | lmsControl->Get_SPI_Reg_bits(LMS7_SEL_BAND1_TRF) << 16
+            | lmsControl->Get_SPI_Reg_bits(LMS7_LOSS_MAIN_TXPAD_TRF) << 8 | lmsControl->Get_SPI_Reg_bits(LMS7_CG_IAMP_TBB);
+    else
+    {
+        gain = lmsControl->Get_SPI_Reg_bits(LMS7_SEL_PATH_RFE) << 16 | lmsControl->Get_SPI_Reg_bits(LMS7_G_LNA_RFE) << 8
+            | lmsControl->Get_SPI_Reg_bits(LMS7_G_TIA_RFE) << 6 | lmsControl->Get_SPI_Reg_bits(LMS7_G_PGA_RBB);
+        lmsControl->SetActiveChannel(LMS7002M::ChSXR);
+        useSXT = lmsControl->Get_SPI_Reg_bits(LMS7_PD_VCO) == 1; //Tx PLL used for TX and RX
+        lmsControl->SetActiveChannel(LMS7002M::Channel(ch));
+    }
+    const double loFreq = lmsControl->GetFrequencySX(useSXT);
+    return LMS7002M_CalibrationCache::Key(serial, chip, ch == 1 ? 0 : 1, tx, LMS7002M_CalibrationCache::GetBand(loFreq),
+        unsigned(std::lround(bandwidth_Hz / 1e3)), gain, useExtLoopback);
+}
+
+/** @brief Writes stored calibration results matching current conditions
+    @return true if results were found and written
+*/
+bool LMS7002M::ApplyStoredCalibration(bool tx, float_type bandwidth_Hz, bool useExtLoopback, float_type temperature)
+{
+    LMS7002M_CalibrationCache::Result result;
+    const auto key = CalibrationKey(this, GetBoardSerial(), mdevIndex, tx, bandwidth_Hz, useExtLoopback);
+    if (!LMS7002M_CalibrationCache::Instance().Find(key, temperature, result))
+        return false;
+    //only calibration fields are written, registers also hold unrelated settings
+    const uint8_t channel = Get_SPI_Reg_bits(LMS7_MAC) == 1 ? 0 : 1;
+    std::vector<uint16_t> masks;
+    const std::vector<uint16_t> calAddrs = CalibrationRegisters(tx, channel, masks);
+    std::vector<uint16_t> current(result.addresses.size());
+    if (SPI_read_batch(result.addresses.data(), current.data(), result.addresses.size()) != 0)
+        return false;
+    std::vector<uint16_t> addrs;
+    std::vector<uint16_t> values;
+    for (size_t i = 0; i < result.addresses.size(); ++i)
+    {
+        const uint16_t addr = result.addresses[i];
+        const size_t field = std::find(calAddrs.begin(), calAddrs.end(), addr) - calAddrs.begin();
+        if (field == calAddrs.size())
+            continue;
+        const uint16_t value = (current[i] & ~masks[field]) | (result.values[i] & masks[field]);
+        addrs.push_back(addr);
+        //analog DC values are loaded by DCWR strobe
+        if (addr >= 0x05C3 && addr <= 0x05CA)
+        {
+            values.push_back(value & ~0xC000);
+            addrs.push_back(addr);
+            values.push_back((value & ~0xC000) | 0x8000);
+            addrs.push_back(addr);
+            values.push_back(value & ~0xC000);
+        }
+        else
+            values.push_back(value);
+    }
+    return SPI_write_batch(addrs.data(), values.data(), addrs.size(), true) == 0;
+}
+
+void LMS7002M::StoreCalibration(bool tx, float_type bandwidth_Hz, bool useExtLoopback, float_type temperature)
+{
+    const uint8_t channel = Get_SPI_Reg_bits(LMS7_MAC) == 1 ? 0 : 1;
+    LMS7002M_CalibrationCache::Result result;
+    result.temperature = temperature;
+    std::vector<uint16_t> masks;
+    result.addresses = CalibrationRegisters(tx, channel, masks);
+    //MCU changed registers in chip, analog DC values were read to cache
+    result.values.resize(result.addresses.size());
+    if (SPI_read_batch(result.addresses.data(), result.values.data(), result.addresses.size()) != 0)
+        return;
+    for (size_t i = 0; i < result.addresses.size(); ++i)
+    {
+        const uint16_t addr = result.addresses[i];
+        if (addr >= 0x05C3 && addr <= 0x05CA)
+            result.values[i] = mRegistersMap->GetValue(channel, addr);
+        result.values[i] &= masks[i];
+    }
+    const auto key = CalibrationKey(this, GetBoardSerial(), mdevIndex, tx, bandwidth_Hz, useExtLoopback);
+    LMS7002M_CalibrationCache::Instance().Store(key, result);
+}
+
 static int SetExtLoopback(IConnection* port, uint8_t ch, bool enable, bool tx)
 {
     //enable external loopback switches
@@ -185,7 +323,7 @@ uint32_t LMS7002M::GetRSSI(RSSI_measurements *measurements)
 /** @brief Calibrates Transmitter. DC correction, IQ gains, IQ phase correction
 @return 0-success, other-failure
 */
-int LMS7002M::CalibrateTx(float_type bandwidth_Hz, bool useExtLoopback)
+int LMS7002M::CalibrateTx(float_type bandwidth_Hz, bool useExtLoopback, bool useStoredResult)
 {
     if (TrxCalib_RF_LimitLow > bandwidth_Hz)
     {
@@ -207,6 +345,14 @@ int LMS7002M::CalibrateTx(float_type bandwidth_Hz, bool useExtLoopback)
     if(ch == 0 || ch == 3)
         return ReportError(EINVAL, "Tx Calibration: Incorrect channel selection MAC %i", ch);
 
+    //results of calibration in the same conditions are reused
+    const float_type temperature = useStoredResult ? MeasureTemperature(this) : 0;
+    if (useStoredResult && ApplyStoredCalibration(true, bandwidth_Hz, useExtLoopback, temperature))
+    {
+        Log("Tx calibration restored from stored result", LOG_INFO);
+        return 0;
+    }
+
     //caching variables
     DeviceInfo info = controlPort->GetDeviceInfo();
     double txFreq = GetFrequencySX(LMS7002M::Tx);
@@ -269,6 +415,8 @@ int LMS7002M::CalibrateTx(float_type bandwidth_Hz, bool useExtLoopback)
     gcorrq = Get_SPI_Reg_bits(LMS7_GCORRQ_TXTSP, true);
     phaseOffset = signextIqCorr(Get_SPI_Reg_bits(LMS7_IQCORR_TXTSP, true));
 
+    if (useStoredResult)
+        StoreCalibration(true, bandwidth_Hz, useExtLoopback, temperature);
     Log("Tx calibration finished", LOG_INFO);
 #ifdef LMS_VERBOSE_OUTPUT
     verbose_printf("Tx | DC  | GAIN | PHASE\n");
@@ -285,7 +433,7 @@ int LMS7002M::CalibrateTx(float_type bandwidth_Hz, bool useExtLoopback)
 /** @brief Calibrates Receiver. DC offset, IQ gains, IQ phase correction
     @return 0-success, other-failure
 */
-int LMS7002M::CalibrateRx(float_type bandwidth_Hz, bool useExtLoopback)
+int LMS7002M::CalibrateRx(float_type bandwidth_Hz, bool useExtLoopback, bool useStoredResult)
 {
     if (TrxCalib_RF_LimitLow > bandwidth_Hz)
     {
@@ -308,6 +456,14 @@ int LMS7002M::CalibrateRx(float_type bandwidth_Hz, bool useExtLoopback)
     uint8_t ch = (uint8_t)Get_SPI_Reg_bits(LMS7_MAC);
     if(ch == 0 || ch == 3)
         return ReportError(EINVAL, "Rx Calibration: Incorrect channel selection MAC %i", ch);
+
+    //results of calibration in the same conditions are reused
+    const float_type temperature = useStoredResult ? MeasureTemperature(this) : 0;
+    if (useStoredResult && ApplyStoredCalibration(false, bandwidth_Hz, useExtLoopback, temperature))
+    {
+        Log("Rx calibration restored from stored result", LOG_INFO);
+        return 0;
+    }
     uint8_t channel = ch == 1 ? 0 : 1;
     uint8_t lna = (uint8_t)Get_SPI_Reg_bits(LMS7_SEL_PATH_RFE);
     double rxFreq = GetFrequencySX(LMS7002M::Rx);
@@ -379,6 +535,8 @@ int LMS7002M::CalibrateRx(float_type bandwidth_Hz, bool useExtLoopback)
     gcorrq = Get_SPI_Reg_bits(LMS7_GCORRQ_RXTSP, true);
     phaseOffset = signextIqCorr(Get_SPI_Reg_bits(LMS7_IQCORR_RXTSP, true));
 
+    if (useStoredResult)
+        StoreCalibration(false, bandwidth_Hz, useExtLoopback, temperature);
     Log("Rx calibration finished", LOG_INFO);
 #ifdef LMS_VERBOSE_OUTPUT
     verbose_printf("RX | DC  | GAIN | PHASE\n");
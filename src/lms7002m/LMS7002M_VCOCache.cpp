@@ -0,0 +1,175 @@
+/**
+@file LMS7002M_VCOCache.cpp
+@author Lime Microsystems
+@brief Persistent storage of LMS7002M VCO tuning results
+*/
+
+#include "LMS7002M_VCOCache.h"
+#include "SystemResources.h"
+#include "Logger.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cinttypes>
+#include <iterator>
+
+using namespace lime;
+
+//results closer than this are considered to be for the same frequency
+static const double cSameFrequency = 1e3;
+//furthest result used to estimate CSW when frequency is not between two results
+static const double cMaxExtrapolation = 50e6;
+//rewrite file when it holds more superseded lines than results
+static const int cCompactThreshold = 256;
+
+LMS7002M_VCOCache &LMS7002M_VCOCache::Instance()
+{
+    static LMS7002M_VCOCache cache;
+    return cache;
+}
+
+LMS7002M_VCOCache::LMS7002M_VCOCache() :
+    mLoaded(false)
+{
+    const char* path = std::getenv("LIME_VCO_CACHE");
+    mPath = path ? path : getAppDataDirectory() + "/vco_cache.txt";
+}
+
+void LMS7002M_VCOCache::Load()
+{
+    mLoaded = true;
+    if (mPath.empty())
+        return;
+    FILE* file = fopen(mPath.c_str(), "r");
+    if (!file)
+        return;
+    //later lines supersede earlier results
+    int lines = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        uint64_t serial;
+        unsigned chip;
+        int vco, sel, csw;
+        double vcoFreq;
+        if (sscanf(line, "%" SCNx64 " %u %d %d %lf %d", &serial, &chip, &vco, &sel, &vcoFreq, &csw) != 6)
+            continue;
+        Insert(Key(serial, chip, vco, sel), vcoFreq, csw);
+        ++lines;
+    }
+    fclose(file);
+
+    size_t count = 0;
+    for (const auto &results : mResults)
+        count += results.second.size();
+    if (lines - int(count) < cCompactThreshold)
+        return;
+    file = fopen(mPath.c_str(), "w");
+    if (!file)
+        return;
+    for (const auto &results : mResults)
+        for (const auto &result : results.second)
+            fprintf(file, "%" PRIx64 " %u %d %d %.0f %d\n", std::get<0>(results.first), std::get<1>(results.first),
+                std::get<2>(results.first), std::get<3>(results.first), result.first, result.second);
+    fclose(file);
+}
+
+void LMS7002M_VCOCache::Insert(const Key &key, double vcoFreq, int csw)
+{
+    //one VCO core holds result for given frequency
+    for (int sel = 0; sel < 3; ++sel)
+    {
+        auto iter = mResults.find(Key(std::get<0>(key), std::get<1>(key), std::get<2>(key), sel));
+        if (iter == mResults.end())
+            continue;
+        auto result = iter->second.lower_bound(vcoFreq - cSameFrequency);
+        if (result != iter->second.end() && result->first <= vcoFreq + cSameFrequency)
+            iter->second.erase(result);
+    }
+    mResults[key][vcoFreq] = csw;
+}
+
+bool LMS7002M_VCOCache::Find(uint64_t serial, unsigned chip, int vco, double vcoFreq, int &sel, int &csw)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mLoaded)
+        Load();
+    for (int i = 0; i < 3; ++i)
+    {
+        auto iter = mResults.find(Key(serial, chip, vco, i));
+        if (iter == mResults.end())
+            continue;
+        auto result = iter->second.lower_bound(vcoFreq - cSameFrequency);
+        if (result != iter->second.end() && result->first <= vcoFreq + cSameFrequency)
+        {
+            sel = i;
+            csw = result->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LMS7002M_VCOCache::Estimate(uint64_t serial, unsigned chip, int vco, int sel, double vcoFreq, int &csw)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mLoaded)
+        Load();
+    auto iter = mResults.find(Key(serial, chip, vco, sel));
+    if (iter == mResults.end() || iter->second.empty())
+        return false;
+    const Results &results = iter->second;
+    auto high = results.lower_bound(vcoFreq);
+    Results::const_iterator low;
+    if (high == results.begin())
+    {
+        //below all results, extrapolate from two lowest
+        low = high++;
+        if (low->first - vcoFreq > cMaxExtrapolation)
+            return false;
+    }
+    else if (high == results.end())
+    {
+        //above all results, extrapolate from two highest
+        high = std::prev(results.end());
+        if (vcoFreq - high->first > cMaxExtrapolation)
+            return false;
+        low = high == results.begin() ? high : std::prev(high);
+    }
+    else
+        low = std::prev(high);
+
+    if (high == results.end() || low == high)
+    {
+        csw = low->second;
+        return true;
+    }
+    const double slope = (high->second - low->second) / (high->first - low->first);
+    const double estimate = low->second + slope * (vcoFreq - low->first);
+    csw = estimate < 0 ? 0 : (estimate > 255 ? 255 : int(std::lround(estimate)));
+    return true;
+}
+
+void LMS7002M_VCOCache::Store(uint64_t serial, unsigned chip, int vco, double vcoFreq, int sel, int csw)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mLoaded)
+        Load();
+    Insert(Key(serial, chip, vco, sel), vcoFreq, csw);
+    if (mPath.empty() || serial == 0)
+        return;
+    FILE* file = fopen(mPath.c_str(), "a");
+    if (!file)
+    {
+        makeDirectories(mPath.substr(0, mPath.find_last_of("/\\")));
+        file = fopen(mPath.c_str(), "a");
+    }
+    if (!file)
+    {
+        lime::warning("VCO cache: cannot write %s", mPath.c_str());
+        mPath.clear();
+        return;
+    }
+    fprintf(file, "%" PRIx64 " %u %d %d %.0f %d\n", serial, chip, vco, sel, vcoFreq, csw);
+    fclose(file);
+}
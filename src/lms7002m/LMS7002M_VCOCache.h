@@ -0,0 +1,62 @@
+/**
+@file LMS7002M_VCOCache.h
+@author Lime Microsystems
+@brief Persistent storage of LMS7002M VCO tuning results
+*/
+
+#ifndef LMS7002M_VCO_CACHE_H
+#define LMS7002M_VCO_CACHE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+namespace lime{
+
+/** @brief VCO capacitor bank (CSW) values found by tuning.
+
+    Results are kept per board serial number, chip index, VCO (CGEN, SXR, SXT)
+    and VCO core (SEL_VCO), ordered by VCO frequency, so values for untuned
+    frequencies can be interpolated from neighbouring results.
+    Every stored result is appended to a file in application data directory,
+    which is loaded on first use. Path can be overridden by LIME_VCO_CACHE
+    environment variable, empty value keeps results in memory only.
+    Results of boards without serial number are not saved.
+*/
+class LMS7002M_VCOCache
+{
+public:
+    static LMS7002M_VCOCache &Instance();
+
+    /** @brief Finds result stored for given VCO frequency
+        @param sel VCO core of stored result
+        @param csw stored CSW value
+        @return true if result was found
+    */
+    bool Find(uint64_t serial, unsigned chip, int vco, double vcoFreq, int &sel, int &csw);
+
+    /** @brief Estimates CSW value of given VCO core from neighbouring results
+        @return true if there are results close enough for estimation
+    */
+    bool Estimate(uint64_t serial, unsigned chip, int vco, int sel, double vcoFreq, int &csw);
+
+    void Store(uint64_t serial, unsigned chip, int vco, double vcoFreq, int sel, int csw);
+
+private:
+    typedef std::tuple<uint64_t, unsigned, int, int> Key; //serial, chip, vco, sel
+    typedef std::map<double, int> Results; //VCO frequency, CSW
+
+    LMS7002M_VCOCache();
+    void Load();
+    void Insert(const Key &key, double vcoFreq, int csw);
+
+    std::mutex mLock;
+    bool mLoaded;
+    std::string mPath;
+    std::map<Key, Results> mResults;
+};
+
+}
+#endif
@@ -37,6 +37,8 @@ LMS7002M_RegistersMap *LMS7002M::BackupRegisterMap(void)
     Channel chBck = this->GetActiveChannel();
     this->SetActiveChannel(ChA);
     *backup = *mRegistersMap;
+    //track registers changed from now on, backup keeps earlier changes
+    mRegistersMap->ClearDirty();
     this->SetActiveChannel(chBck);
     return backup;
 }
@@ -51,7 +53,7 @@ void LMS7002M::RestoreRegisterMap(LMS7002M_RegistersMap *backup)
         //determine addresses that have been changed
         //and restore backup to the main register map
         std::vector<uint16_t> restoreAddrs, restoreData;
-        for (const uint16_t addr : mRegistersMap->GetUsedAddresses(ch))
+        for (const uint16_t addr : mRegistersMap->GetDirtyAddresses(ch))
         {
             uint16_t original = backup->GetValue(ch, addr);
             uint16_t current = mRegistersMap->GetValue(ch, addr);
@@ -67,6 +69,8 @@ void LMS7002M::RestoreRegisterMap(LMS7002M_RegistersMap *backup)
         this->SetActiveChannel((ch==0)?ChA:ChB);
         SPI_write_batch(restoreAddrs.data(), restoreData.data(), restoreData.size(), true);
     }
+    //changes before backup are still pending for enclosing backups
+    mRegistersMap->AddDirty(*backup);
 
     //cleanup
     delete backup;
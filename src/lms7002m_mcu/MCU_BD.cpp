@@ -59,6 +59,11 @@ void MCU_BD::Initialize(IConnection* pSerPort, unsigned chipID, unsigned size)
         byte_array_size = size;
 }
 
+void MCU_BD::SetPendingWritesFlush(std::function<int()> flush)
+{
+    mFlushPendingWrites = flush;
+}
+
 /** @brief Read program code from file into memory
     @param inFileName source file path
     @param bin binary or hex file
@@ -120,6 +125,8 @@ void MCU_BD:: mSPI_write(
 {
     if(m_serPort == nullptr)
         return;
+    if (mFlushPendingWrites)
+        mFlushPendingWrites();
     uint32_t wrdata = (1 << 31) | addr_reg << 16 | data_reg;
     m_serPort->WriteLMS7002MSPI(&wrdata, 1, mChipID);
 }
@@ -130,6 +137,8 @@ unsigned short MCU_BD:: mSPI_read(
 {// returns 16 bit value
     if(m_serPort == nullptr)
         return 0;
+    if (mFlushPendingWrites)
+        mFlushPendingWrites();
     uint32_t wrdata = addr_reg << 16;
     uint32_t rddata = 0;
     if(m_serPort->ReadLMS7002MSPI(&wrdata, &rddata, 1, mChipID)!=0)
@@ -582,6 +591,8 @@ int MCU_BD::Program_MCU(const uint8_t* buffer, const IConnection::MCU_PROG_MODE
 {
     if(!m_serPort)
         return ReportError(ENOLINK, "Device not connected");
+    if (mFlushPendingWrites && mFlushPendingWrites() != 0)
+        return -1;
 
     if (byte_array_size <= 8192)
         return m_serPort->ProgramMCU(buffer, byte_array_size, mode, callback);
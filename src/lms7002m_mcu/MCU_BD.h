@@ -8,6 +8,7 @@
 #define MCU_BD_H
 
 #include <atomic>
+#include <functional>
 #include <string>
 #include "IConnection.h"
 
@@ -87,6 +88,7 @@ class MCU_BD
         int m_bLoadedProd;
         int byte_array_size;
         unsigned mChipID;
+        std::function<int()> mFlushPendingWrites;
 
     public:
         uint8_t ReadMCUProgramID();
@@ -123,6 +125,10 @@ class MCU_BD
         int ResetPC_MCU();
         int RunInstr_MCU(unsigned short * pPCVAL);
         void Initialize(IConnection* pSerPort, unsigned chipID = 0, unsigned rom_size = 0);
+        /** @brief Sets function sending chip register writes still held by a transaction,
+            it is called before MCU accesses chip, so procedures see the configuration made for them
+        */
+        void SetPendingWritesFlush(std::function<int()> flush);
         lime::IConnection::ProgrammingCallback callback;
 };
 }
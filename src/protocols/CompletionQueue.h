@@ -0,0 +1,96 @@
+/**
+    @file CompletionQueue.h
+    @author Lime Microsystems
+    @brief Lock-free signalling of completed asynchronous transfers
+*/
+
+#ifndef LMS_COMPLETION_QUEUE_H
+#define LMS_COMPLETION_QUEUE_H
+
+#include "fifo.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace lime{
+
+/** @brief Passes indices of completed transfer contexts from completion
+    callbacks to the stream thread without locking.
+
+    Callbacks must not run concurrently with each other, which holds for
+    libusb callbacks as they are serialized by libusb event handling.
+    Only one thread may wait for completions. Context is pushed once per
+    submitted transfer, so queue never holds more entries than contexts.
+*/
+class CompletionQueue
+{
+public:
+    explicit CompletionQueue(unsigned contexts = 1) : mHead(0), mTail(0)
+    {
+        Resize(contexts);
+    }
+
+    //! @brief Sets number of contexts, only while no transfers are in flight
+    void Resize(unsigned contexts)
+    {
+        unsigned capacity = 1;
+        while (capacity < contexts)
+            capacity <<= 1;
+        mSlots.assign(capacity, 0);
+        mMask = capacity - 1;
+        mCompleted.assign(contexts, 0);
+        mHead = 0;
+        mTail.store(0, std::memory_order_relaxed);
+    }
+
+    //! @brief Called from completion callback
+    void Push(unsigned context)
+    {
+        const uint32_t tail = mTail.load(std::memory_order_relaxed);
+        mSlots[tail & mMask] = context;
+        mTail.store(tail + 1, std::memory_order_release);
+        mHasItems.notify();
+    }
+
+    //! @brief Marks context as not completed before its transfer is submitted
+    void Clear(unsigned context)
+    {
+        Collect();
+        mCompleted[context] = 0;
+    }
+
+    /** @brief Waits for completion of given context
+        @return true if transfer of context was completed
+    */
+    bool Wait(unsigned context, unsigned timeout_ms)
+    {
+        if (IsCompleted(context))
+            return true;
+        return mHasItems.wait_for([&]{ return IsCompleted(context); }, timeout_ms);
+    }
+
+    bool IsCompleted(unsigned context)
+    {
+        Collect();
+        return mCompleted[context] != 0;
+    }
+
+private:
+    //moves queued completions to consumer owned flags
+    void Collect()
+    {
+        const uint32_t tail = mTail.load(std::memory_order_acquire);
+        for (; mHead != tail; ++mHead)
+            mCompleted[mSlots[mHead & mMask]] = 1;
+    }
+
+    std::vector<unsigned> mSlots;
+    uint32_t mMask;
+    std::vector<uint8_t> mCompleted;
+    uint32_t mHead;
+    std::atomic<uint32_t> mTail;
+    AdaptiveWait mHasItems;
+};
+
+}
+#endif
@@ -39,7 +39,10 @@ static int convertStatus(const int &status, const LMS64CProtocol::GenericPacket
     return ReportError(EPROTO, status2string(pkt.status));
 }
 
-LMS64CProtocol::LMS64CProtocol(void)
+LMS64CProtocol::LMS64CProtocol(void) :
+    mPendingWindow(1),
+    mReplyReading(false),
+    mControlWindow(1)
 {
     //set a sane-default for the rate
     _cachedRefClockRate = 61.44e6/2;
@@ -57,6 +60,22 @@ LMS64CProtocol::~LMS64CProtocol(void)
     return;
 }
 
+void LMS64CProtocol::SetControlWindow(int packets)
+{
+    std::lock_guard<std::mutex> lock(mControlPortLock);
+    mControlWindow = packets < 1 ? 1 : packets;
+}
+
+int LMS64CProtocol::GetControlWindow() const
+{
+    return mControlWindow;
+}
+
+bool LMS64CProtocol::CanPipeline(const int) const
+{
+    return false;
+}
+
 int LMS64CProtocol::DeviceReset(int ind)
 {
     if (not this->IsOpen())
@@ -356,65 +375,142 @@ LMS64CProtocol::FPGAinfo LMS64CProtocol::GetFPGAInfo()
 }
 
 
+LMS64CProtocol::ControlSlot &LMS64CProtocol::GetControlSlot(unsigned periphID)
+{
+    std::lock_guard<std::mutex> lock(mSlotsLock);
+    std::unique_ptr<ControlSlot> &slot = mSlots[periphID];
+    if (!slot)
+        slot.reset(new ControlSlot);
+    return *slot;
+}
+
+/** @brief Reads oldest pending reply into buffer of its request
+    @param lock held control port lock, released while reading
+    @return 0: success, other: failure, all pending replies are failed
+*/
+int LMS64CProtocol::ReadReply(std::unique_lock<std::mutex> &lock)
+{
+    const int packetLen = ProtocolLMS64C::pktLength;
+    const PendingReply reply = mPendingReplies.front();
+    mReplyReading = true;
+    lock.unlock();
+    int bread = Read(reply.buffer, packetLen);
+    lock.lock();
+    mReplyReading = false;
+    if (bread != packetLen)
+    {
+        //replies can no longer be matched to requests
+        const size_t outstanding = mPendingReplies.size();
+        for (auto &pending : mPendingReplies)
+            *pending.status = -1;
+        mPendingReplies.clear();
+        //late replies of requests already sent would be taken as replies to next requests,
+        //read them out while port lock keeps other threads from sending
+        unsigned char stale[ProtocolLMS64C::pktLength];
+        size_t drained = 0;
+        while (drained < outstanding && Read(stale, packetLen) == packetLen)
+            ++drained;
+        mReplyCond.notify_all();
+        return lime::error("TransferPacket: Read failed (ret=%d), %i late replies discarded", bread, int(drained));
+    }
+    *reply.status = 0;
+    mPendingReplies.pop_front();
+    mReplyCond.notify_all();
+    return 0;
+}
+
 /** @brief Transfers data between packet and connected device
     @param pkt packet containing output data and to receive incomming data
     @return 0: success, other: failure
+
+    Replies arrive in order of requests, so while one thread waits for the
+    device, others may send their requests, and the thread reading replies
+    stores them in buffers of the requesting threads.
 */
 int LMS64CProtocol::TransferPacket(GenericPacket& pkt)
 {
-    std::lock_guard<std::mutex> lock(mControlPortLock);
+    ControlSlot &slot = GetControlSlot(pkt.periphID);
+    std::lock_guard<std::mutex> slotLock(slot.lock);
     int status = 0;
     if(IsOpen() == false) ReportError(ENOTCONN, "connection is not open");
 
     const int packetLen = ProtocolLMS64C::pktLength;
-    int outLen = 0;
-    unsigned char* outBuffer = PreparePacket(pkt, outLen);
-    unsigned char* inBuffer = new unsigned char[outLen];
-    memset(inBuffer, 0, outLen);
-
-    int outBufPos = 0;
-    int inDataPos = 0;
-    if(outLen == 0)
-        outLen = 1;
-
-    for(int i=0; i<outLen; i+=packetLen)
-    {
-        if (callback_logData)
-            callback_logData(true, &outBuffer[outBufPos], packetLen);
-        int written = Write(&outBuffer[outBufPos], packetLen);
-        if(written != packetLen)
+    const int outLen = PreparePacket(pkt, slot.outBuffer);
+    if (slot.inBuffer.size() < size_t(outLen))
+        slot.inBuffer.resize(outLen);
+    const int packetsCount = outLen / packetLen;
+    if (slot.replyStatus.size() < size_t(packetsCount))
+        slot.replyStatus.resize(packetsCount);
+
+    //requests are sent ahead of replies, up to window size, replies arrive in order.
+    //requests of different window may not be in flight together, as transport
+    //can use different endpoints for them
+    const int window = CanPipeline(pkt.cmd) ? mControlWindow : 1;
+    int sent = 0;
+    int received = 0;
+    std::unique_lock<std::mutex> lock(mControlPortLock);
+    while(received < packetsCount)
+    {
+        while(status == 0 && sent < packetsCount && (mPendingReplies.empty()
+            || (window == mPendingWindow && int(mPendingReplies.size()) < window)))
         {
-            status = lime::error("TransferPacket: Write failed (ret=%d)", written);
-            break;
+            unsigned char* outPacket = &slot.outBuffer[sent*packetLen];
+            if (callback_logData)
+                callback_logData(true, outPacket, packetLen);
+            int written = Write(outPacket, packetLen);
+            if(written != packetLen)
+            {
+                status = lime::error("TransferPacket: Write failed (ret=%d)", written);
+                break;
+            }
+            slot.replyStatus[sent] = 1;
+            mPendingReplies.push_back({&slot.inBuffer[sent*packetLen], &slot.replyStatus[sent]});
+            mPendingWindow = window;
+            ++sent;
         }
-        outBufPos += packetLen;
-        int bread = Read(&inBuffer[inDataPos], packetLen);
-        if(bread != packetLen)
+        if (sent == received)
         {
-            status = lime::error("TransferPacket: Read failed (ret=%d)", bread);
+            if (status != 0) //write failed, no replies pending
+                break;
+            mReplyCond.wait(lock); //port is busy with requests of other threads
+            continue;
+        }
+        while (slot.replyStatus[received] > 0)
+        {
+            if (mReplyReading)
+                mReplyCond.wait(lock);
+            else
+                ReadReply(lock);
+        }
+        if (slot.replyStatus[received] != 0)
+        {
+            status = -1;
             break;
         }
         if (callback_logData)
-            callback_logData(false, &inBuffer[inDataPos], bread);
-        inDataPos += bread;
+            callback_logData(false, &slot.inBuffer[received*packetLen], packetLen);
+        ++received;
     }
-    ParsePacket(pkt, inBuffer, inDataPos);
-
-    delete[] outBuffer;
-    delete[] inBuffer;
+    //replies of sent requests must be read before buffers are reused
+    while (received < sent && slot.replyStatus[sent-1] > 0)
+    {
+        if (mReplyReading)
+            mReplyCond.wait(lock);
+        else
+            ReadReply(lock);
+    }
+    lock.unlock();
+    ParsePacket(pkt, slot.inBuffer.data(), received*packetLen);
     return convertStatus(status, pkt);
 }
 
 /** @brief Takes generic packet and converts to specific protocol buffer
     @param pkt generic data packet to convert
-    @param length returns length of returned buffer
-    @param protocol which protocol to use for data
-    @return pointer to data buffer, must be manually deleted after use
+    @param buffer destination, grown when needed and reused between calls
+    @return length of prepared data, multiple of packet length
 */
-unsigned char* LMS64CProtocol::PreparePacket(const GenericPacket& pkt, int& length)
+int LMS64CProtocol::PreparePacket(const GenericPacket& pkt, std::vector<unsigned char> &buffer)
 {
-    unsigned char* buffer = NULL;
-
     ProtocolLMS64C packet;
     int maxDataLength = packet.maxDataLength;
     packet.cmd = pkt.cmd;
@@ -459,8 +555,9 @@ unsigned char* LMS64CProtocol::PreparePacket(const GenericPacket& pkt, int& leng
     bufLen *= packet.pktLength;
     if(bufLen == 0)
         bufLen = packet.pktLength;
-    buffer = new unsigned char[bufLen];
-    memset(buffer, 0, bufLen);
+    if (buffer.size() < size_t(bufLen))
+        buffer.resize(bufLen);
+    memset(buffer.data(), 0, bufLen);
     unsigned int srcPos = 0;
     for(int j=0; j*packet.pktLength<bufLen; ++j)
     {
@@ -480,8 +577,7 @@ unsigned char* LMS64CProtocol::PreparePacket(const GenericPacket& pkt, int& leng
         for (int k = 0; k<bytesToPack && srcPos < pkt.outBuffer.size(); ++srcPos, ++k)
             buffer[pktPos + 8 + k] = pkt.outBuffer[srcPos];
     }
-    length = bufLen;
-    return buffer;
+    return bufLen;
 }
 
 /** @brief Parses given data buffer into generic packet
@@ -499,7 +595,9 @@ int LMS64CProtocol::ParsePacket(GenericPacket& pkt, const unsigned char* buffer,
     for(int i=0; i<length; i+=packet.pktLength)
     {
         pkt.cmd = (eCMD_LMS)buffer[i];
-        pkt.status = (eCMD_STATUS)buffer[i+1];
+        //keep the first failure of multi-packet transfer
+        if (i == 0 || pkt.status == STATUS_COMPLETED_CMD)
+            pkt.status = (eCMD_STATUS)buffer[i+1];
         memcpy(&pkt.inBuffer[inBufPos], &buffer[i+8], packet.maxDataLength);
         inBufPos += packet.maxDataLength;
     }
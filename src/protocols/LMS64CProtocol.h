@@ -7,6 +7,10 @@
 #pragma once
 #include <IConnection.h>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
 #include <LMS64CCommands.h>
 #include <LMSBoards.h>
 #include <thread>
@@ -96,9 +100,20 @@ public:
      * using the GenericPacket data structure.
      * Some implementations will cast to LMS64CProtocol
      * and directly use the TransferPacket() API call.
+     * Transfers of the same peripheral (chip) are serialized,
+     * transfers of different peripherals may be called from
+     * several threads and share the control port.
      */
     virtual int TransferPacket(GenericPacket &pkt);
 
+    /*!
+     * Set the number of control packets that may be sent
+     * before their replies are read. Applies only to commands
+     * the connection can pipeline, 1 means request/response.
+     */
+    void SetControlWindow(int packets);
+    int GetControlWindow() const;
+
     struct LMSinfo
     {
         eLMS_DEV device;
@@ -132,6 +147,9 @@ public:
     //! virtual read function to be implemented by the base class
     virtual int Read(unsigned char *buffer, int length, int timeout_ms = 100) = 0;
 
+    //! true if transport can queue requests of given command before replies are read
+    virtual bool CanPipeline(const int cmd) const;
+
     enum ProgramWriteTarget
     {
         HPM,
@@ -170,9 +188,35 @@ private:
     int WriteADF4002SPI(const uint32_t *writeData, const size_t size);
     int ReadADF4002SPI(const uint32_t *writeData, uint32_t *readData, const size_t size);
 
-    unsigned char* PreparePacket(const GenericPacket &pkt, int &length);
+    int PreparePacket(const GenericPacket &pkt, std::vector<unsigned char> &buffer);
     int ParsePacket(GenericPacket &pkt, const unsigned char* buffer, const int length);
-    std::mutex mControlPortLock;
+
+    //! transfer state of one peripheral, buffers are reused by TransferPacket
+    struct ControlSlot
+    {
+        std::mutex lock;
+        std::vector<unsigned char> outBuffer;
+        std::vector<unsigned char> inBuffer;
+        std::vector<int> replyStatus;
+    };
+    ControlSlot &GetControlSlot(unsigned periphID);
+
+    //! request sent to port, reply is stored by whichever thread reads it
+    struct PendingReply
+    {
+        unsigned char* buffer;
+        int* status;
+    };
+    int ReadReply(std::unique_lock<std::mutex> &lock);
+
+    std::mutex mSlotsLock;
+    std::map<unsigned, std::unique_ptr<ControlSlot> > mSlots;
+    std::mutex mControlPortLock; //guards request order and pending replies
+    std::condition_variable mReplyCond;
+    std::deque<PendingReply> mPendingReplies;
+    int mPendingWindow; //window of requests in flight
+    bool mReplyReading;
+    int mControlWindow;
     double _cachedRefClockRate;
 };
 }
@@ -0,0 +1,166 @@
+/**
+@file LinkTrace.cpp
+@author Lime Microsystems
+@brief Capture of raw Rx link transfers for offline replay
+*/
+
+#include "LinkTrace.h"
+#include "Logger.h"
+#include <cstring>
+#include <errno.h>
+
+using namespace lime;
+
+static const size_t cChunkSize = 8 << 20;
+static const unsigned cChunksCount = 8;
+
+static_assert(sizeof(LinkTraceHeader) == 64, "trace header layout");
+static_assert(sizeof(LinkTraceRecord) == 16, "trace record layout");
+
+LinkTraceWriter::LinkTraceWriter() :
+    mFile(nullptr),
+    mCurrent(-1),
+    mCurrentUsed(0),
+    mClosing(false),
+    mFailed(false),
+    mFirstTime(0),
+    mPendingDrops(0),
+    mDropped(0),
+    mRecords(0)
+{
+}
+
+LinkTraceWriter::~LinkTraceWriter()
+{
+    Close();
+}
+
+int LinkTraceWriter::Open(const std::string &path, const LinkTraceHeader &header)
+{
+    if (mFile)
+        return ReportError(EBUSY, "Link trace is already open");
+    mFile = fopen(path.c_str(), "wb");
+    if (mFile == nullptr)
+        return ReportError(errno, "Failed to create link trace %s", path.c_str());
+    if (fwrite(&header, sizeof(header), 1, mFile) != 1)
+    {
+        fclose(mFile);
+        mFile = nullptr;
+        return ReportError(EIO, "Failed to write link trace %s", path.c_str());
+    }
+
+    mPath = path;
+    //zero filled, so pages are already faulted in when stream thread copies to them
+    mChunks.assign(cChunksCount, std::vector<char>(cChunkSize));
+    mFreeChunks.clear();
+    mFullChunks.clear();
+    for (unsigned i = 0; i < cChunksCount; ++i)
+        mFreeChunks.push_back(i);
+    mCurrent = -1;
+    mCurrentUsed = 0;
+    mClosing = false;
+    mFailed.store(false);
+    mFirstTime = 0;
+    mPendingDrops = 0;
+    mDropped = 0;
+    mRecords = 0;
+    mWriterThread = std::thread(&LinkTraceWriter::WriterLoop, this);
+    lime::info("Link trace: recording Rx transfers to %s", path.c_str());
+    return 0;
+}
+
+void LinkTraceWriter::Append(const char* data, uint32_t length, uint64_t time)
+{
+    const size_t recordSize = sizeof(LinkTraceRecord) + length;
+    if (recordSize > cChunkSize)
+    {
+        ++mPendingDrops;
+        return;
+    }
+    if (mCurrent >= 0 && mCurrentUsed + recordSize > cChunkSize)
+        Submit();
+    if (mCurrent < 0)
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mFreeChunks.empty())
+        {
+            ++mPendingDrops;
+            return;
+        }
+        mCurrent = mFreeChunks.front();
+        mFreeChunks.pop_front();
+        mCurrentUsed = 0;
+    }
+
+    if (mRecords == 0)
+        mFirstTime = time;
+    LinkTraceRecord record;
+    record.time = time - mFirstTime;
+    record.length = length;
+    record.dropped = mPendingDrops;
+    mDropped += mPendingDrops;
+    mPendingDrops = 0;
+    char* dest = mChunks[mCurrent].data() + mCurrentUsed;
+    memcpy(dest, &record, sizeof(record));
+    memcpy(dest + sizeof(record), data, length);
+    mCurrentUsed += recordSize;
+    ++mRecords;
+}
+
+void LinkTraceWriter::Submit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mFullChunks.push_back(std::make_pair(unsigned(mCurrent), mCurrentUsed));
+        mCurrent = -1;
+    }
+    mChunkFilled.notify_one();
+}
+
+int LinkTraceWriter::Close()
+{
+    if (mFile == nullptr)
+        return 0;
+    if (mCurrent >= 0)
+        Submit();
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mClosing = true;
+    }
+    mChunkFilled.notify_one();
+    mWriterThread.join();
+
+    int status = 0;
+    if (fclose(mFile) != 0 || mFailed.load())
+        status = ReportError(EIO, "Failed to write link trace %s", mPath.c_str());
+    mFile = nullptr;
+    mChunks.clear();
+    mDropped += mPendingDrops;
+    if (mDropped)
+        lime::warning("Link trace: %llu transfers were not recorded, disk could not keep up", (unsigned long long)mDropped);
+    lime::info("Link trace: %llu transfers recorded to %s", (unsigned long long)mRecords, mPath.c_str());
+    return status;
+}
+
+void LinkTraceWriter::WriterLoop()
+{
+    while (true)
+    {
+        std::pair<unsigned, size_t> item;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mChunkFilled.wait(lock, [this]{ return !mFullChunks.empty() || mClosing; });
+            if (mFullChunks.empty())
+                break;
+            item = mFullChunks.front();
+            mFullChunks.pop_front();
+        }
+        if (!mFailed.load() && fwrite(mChunks[item.first].data(), 1, item.second, mFile) != item.second)
+        {
+            lime::error("Link trace: failed to write %s", mPath.c_str());
+            mFailed.store(true);
+        }
+        std::lock_guard<std::mutex> lock(mLock);
+        mFreeChunks.push_back(item.first);
+    }
+}
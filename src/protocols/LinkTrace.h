@@ -0,0 +1,108 @@
+/**
+@file LinkTrace.h
+@author Lime Microsystems
+@brief Capture of raw Rx link transfers for offline replay
+*/
+
+#ifndef LIME_LINK_TRACE_H
+#define LIME_LINK_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lime
+{
+
+/** @brief Trace file header.
+
+    Trace file is the header followed by one record per completed Rx
+    transfer: LinkTraceRecord and the bytes returned by FinishDataReading(),
+    i.e. whole FPGA_DataPacket structures with header bytes, counters and
+    flags exactly as received. All fields are little endian.
+*/
+struct LinkTraceHeader
+{
+    enum
+    {
+        PACKED = 1 << 0, ///<12 bit link format
+        MIMO = 1 << 1, ///<two channels per packet
+    };
+    char magic[8]; ///<"LMSTRACE"
+    uint32_t version;
+    uint32_t flags;
+    uint32_t transferSize; ///<bytes requested per transfer
+    uint32_t buffersCount; ///<transfers kept in flight
+    double sampleRate; ///<Rx sample rate in Hz, 0 if unknown
+    uint64_t startTime; ///<capture start, nanoseconds since Unix epoch
+    uint32_t chipId;
+    uint8_t reserved[20];
+};
+
+struct LinkTraceRecord
+{
+    uint64_t time; ///<completion time, nanoseconds since first record
+    uint32_t length; ///<number of data bytes following record header
+    uint32_t dropped; ///<transfers missing before this one, writer could not keep up
+};
+
+static const char cLinkTraceMagic[8] = {'L', 'M', 'S', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t cLinkTraceVersion = 1;
+
+/** @brief Writes Rx transfers to trace file without blocking stream thread.
+
+    Records are gathered in large preallocated chunks and written by a
+    separate thread. If all chunks are waiting for disk, transfers are
+    skipped and counted in the next record, so capture never stalls link.
+*/
+class LinkTraceWriter
+{
+public:
+    LinkTraceWriter();
+    ~LinkTraceWriter();
+
+    /** @brief Creates trace file and starts writer thread
+        @return 0 on success, (-1) on failure
+    */
+    int Open(const std::string &path, const LinkTraceHeader &header);
+
+    /** @brief Stream thread: adds completed transfer to trace
+        @param time completion time in nanoseconds, any monotonic clock
+    */
+    void Append(const char* data, uint32_t length, uint64_t time);
+
+    /** @brief Writes remaining records and closes file
+        @return 0 on success, (-1) if any write failed
+    */
+    int Close();
+
+private:
+    void WriterLoop();
+    void Submit();
+
+    FILE* mFile;
+    std::string mPath;
+    std::vector<std::vector<char> > mChunks;
+    std::deque<unsigned> mFreeChunks;
+    std::deque<std::pair<unsigned, size_t> > mFullChunks; //index, bytes
+    std::mutex mLock;
+    std::condition_variable mChunkFilled;
+    int mCurrent; //chunk being filled by stream thread, -1 if none
+    size_t mCurrentUsed;
+    bool mClosing;
+    std::thread mWriterThread;
+    std::atomic<bool> mFailed;
+    uint64_t mFirstTime;
+    uint32_t mPendingDrops;
+    uint64_t mDropped;
+    uint64_t mRecords;
+};
+
+}
+#endif // LIME_LINK_TRACE_H
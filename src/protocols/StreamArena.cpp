@@ -0,0 +1,211 @@
+/**
+@file StreamArena.cpp
+@author Lime Microsystems
+@brief Pre-faulted memory for stream transfer buffers and FIFO packets
+*/
+
+#include "StreamArena.h"
+#include "Logger.h"
+#include <string.h>
+#include <atomic>
+#include <iterator>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace lime;
+
+static const size_t cHugePageSize = 2*1024*1024;
+//memory locked in RAM by all arenas of the process, chunks above it are left unlocked
+static const size_t cMaxLockedSize = 256*1024*1024;
+static std::atomic<size_t> lockedSize(0);
+
+StreamArena::StreamArena()
+{
+}
+
+StreamArena::~StreamArena()
+{
+    Reset();
+}
+
+size_t StreamArena::AlignedOffset(const Chunk &chunk, size_t offset, size_t alignment)
+{
+    const size_t address = (size_t)chunk.base + offset;
+    return offset + (((address + alignment - 1) & ~(alignment - 1)) - address);
+}
+
+int StreamArena::Reserve(size_t bytes, size_t alignment)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto &chunk : mChunks)
+        for (auto &range : chunk.freeRanges)
+            if (AlignedOffset(chunk, range.first, alignment) + bytes <= range.first + range.second)
+                return 0;
+
+    //chunks without allocations would only add to mapped and locked memory
+    for (size_t i = 0; i < mChunks.size();)
+    {
+        if (mChunks[i].used == 0)
+        {
+            UnmapChunk(mChunks[i]);
+            mChunks.erase(mChunks.begin() + i);
+        }
+        else
+            ++i;
+    }
+
+    Chunk chunk;
+    if (!MapChunk(bytes + alignment, chunk))
+        return -1;
+    mChunks.push_back(chunk);
+    return 0;
+}
+
+void* StreamArena::Allocate(size_t bytes, size_t alignment)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto &chunk : mChunks)
+    {
+        //first fit, allocations are few and made only during stream setup
+        for (auto range = chunk.freeRanges.begin(); range != chunk.freeRanges.end(); ++range)
+        {
+            const size_t begin = range->first;
+            const size_t end = range->first + range->second;
+            const size_t offset = AlignedOffset(chunk, begin, alignment);
+            if (offset + bytes > end)
+                continue;
+            chunk.freeRanges.erase(range);
+            if (offset > begin)
+                chunk.freeRanges[begin] = offset - begin;
+            if (offset + bytes < end)
+                chunk.freeRanges[offset + bytes] = end - offset - bytes;
+            chunk.used += offset + bytes - begin;
+            char* ptr = chunk.base + offset;
+            mAllocations[ptr] = std::make_pair(begin, offset + bytes - begin);
+            memset(ptr, 0, bytes); //memory can be reused, pages stay resident
+            return ptr;
+        }
+    }
+    return nullptr;
+}
+
+void StreamArena::Free(void* ptr)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    auto allocation = mAllocations.find((char*)ptr);
+    if (allocation == mAllocations.end())
+        return;
+    size_t begin = allocation->second.first;
+    size_t size = allocation->second.second;
+    mAllocations.erase(allocation);
+    for (auto &chunk : mChunks)
+    {
+        if ((char*)ptr < chunk.base || (char*)ptr >= chunk.base + chunk.size)
+            continue;
+        chunk.used -= size;
+        //merge with adjacent free ranges
+        auto next = chunk.freeRanges.lower_bound(begin);
+        if (next != chunk.freeRanges.end() && next->first == begin + size)
+        {
+            size += next->second;
+            next = chunk.freeRanges.erase(next);
+        }
+        if (next != chunk.freeRanges.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == begin)
+            {
+                begin = prev->first;
+                size += prev->second;
+                chunk.freeRanges.erase(prev);
+            }
+        }
+        chunk.freeRanges[begin] = size;
+        return;
+    }
+}
+
+void StreamArena::Reset()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto &chunk : mChunks)
+        UnmapChunk(chunk);
+    mChunks.clear();
+    mAllocations.clear();
+}
+
+bool StreamArena::MapChunk(size_t bytes, Chunk &chunk)
+{
+    //whole huge pages, so that the chunk can be backed by them
+    const size_t size = (bytes + cHugePageSize - 1) / cHugePageSize * cHugePageSize;
+    chunk.size = size;
+    chunk.used = 0;
+    chunk.hugePages = false;
+    chunk.locked = false;
+    chunk.freeRanges[0] = size;
+    //locking is skipped once limit is reached, pages are still pre-faulted
+    const bool lockAllowed = lockedSize.fetch_add(size) + size <= cMaxLockedSize;
+    if (!lockAllowed)
+        lockedSize.fetch_sub(size);
+#ifdef _WIN32
+    chunk.base = (char*)VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (chunk.base == nullptr)
+    {
+        lime::error("StreamArena: failed to allocate %lu bytes", (unsigned long)size);
+        if (lockAllowed)
+            lockedSize.fetch_sub(size);
+        return false;
+    }
+    chunk.locked = lockAllowed && VirtualLock(chunk.base, size) != 0;
+    const size_t pageSize = 4096;
+#else
+    void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    //succeeds only if huge pages are reserved in the system
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    chunk.hugePages = ptr != MAP_FAILED;
+#endif
+    if (ptr == MAP_FAILED)
+    {
+        ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (ptr == MAP_FAILED)
+        {
+            lime::error("StreamArena: failed to map %lu bytes", (unsigned long)size);
+            if (lockAllowed)
+                lockedSize.fetch_sub(size);
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, size, MADV_HUGEPAGE); //transparent huge pages, if enabled
+#endif
+    }
+    chunk.base = (char*)ptr;
+    chunk.locked = lockAllowed && mlock(chunk.base, size) == 0; //usually limited by RLIMIT_MEMLOCK
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+#endif
+    if (lockAllowed && !chunk.locked)
+        lockedSize.fetch_sub(size);
+    //pre-fault every page from the calling thread
+    for (size_t i = 0; i < size; i += pageSize)
+        ((volatile char*)chunk.base)[i] = 0;
+
+    lime::debug("StreamArena: %lu KB, %s, %s", (unsigned long)(size/1024),
+        chunk.hugePages ? "huge pages" : "normal pages", chunk.locked ? "locked" : "not locked");
+    return true;
+}
+
+void StreamArena::UnmapChunk(const Chunk &chunk)
+{
+    if (chunk.locked)
+        lockedSize.fetch_sub(chunk.size);
+#ifdef _WIN32
+    VirtualFree(chunk.base, 0, MEM_RELEASE);
+#else
+    munmap(chunk.base, chunk.size);
+#endif
+}
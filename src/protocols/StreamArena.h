@@ -0,0 +1,75 @@
+/**
+@file StreamArena.h
+@author Lime Microsystems
+@brief Pre-faulted memory for stream transfer buffers and FIFO packets
+*/
+
+#ifndef LIME_STREAM_ARENA_H
+#define LIME_STREAM_ARENA_H
+
+#include <stddef.h>
+#include <vector>
+#include <map>
+#include <mutex>
+
+namespace lime
+{
+
+/** @brief Memory arena for stream transfer buffers and FIFO packets.
+
+    Memory is mapped in large contiguous chunks, backed by huge pages when
+    the system has them reserved, otherwise locked in RAM when permitted.
+    Chunks are pre-faulted when reserved, so streaming threads do not take
+    page faults or allocate from heap. Freed allocations are reused by later
+    ones, chunks left without allocations are unmapped before new chunks are
+    mapped, and only limited amount of memory is locked in RAM.
+*/
+class StreamArena
+{
+public:
+    StreamArena();
+    ~StreamArena();
+
+    /** @brief Makes sure given amount of pre-faulted memory is available for Allocate()
+        @param bytes required free space
+        @param alignment power of two alignment of the allocation
+        @return 0 on success, (-1) if memory could not be mapped
+    */
+    int Reserve(size_t bytes, size_t alignment = 64);
+
+    /** @brief Takes memory from reserved space
+        @param bytes allocation size
+        @param alignment power of two alignment
+        @return pointer to zeroed memory, nullptr if reserved space is insufficient
+    */
+    void* Allocate(size_t bytes, size_t alignment = 64);
+
+    /** @brief Returns allocation to free space, it can be handed out again right away
+        @param ptr pointer returned by Allocate(), nullptr and unknown pointers are ignored
+    */
+    void Free(void* ptr);
+
+    //! @brief Unmaps all memory, all pointers returned by Allocate() become invalid
+    void Reset();
+
+private:
+    struct Chunk
+    {
+        char* base;
+        size_t size;
+        size_t used; //bytes taken by allocations, including alignment padding
+        bool hugePages;
+        bool locked;
+        std::map<size_t, size_t> freeRanges; //offset and size of free space
+    };
+    bool MapChunk(size_t bytes, Chunk &chunk);
+    void UnmapChunk(const Chunk &chunk);
+    static size_t AlignedOffset(const Chunk &chunk, size_t offset, size_t alignment);
+
+    std::vector<Chunk> mChunks;
+    std::map<char*, std::pair<size_t, size_t> > mAllocations; //pointer to range offset and size
+    std::mutex mLock;
+};
+
+}
+#endif // LIME_STREAM_ARENA_H
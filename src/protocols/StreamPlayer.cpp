@@ -0,0 +1,341 @@
+/**
+@file StreamPlayer.cpp
+@author Lime Microsystems
+@brief Playback of memory mapped sample files through Tx stream
+*/
+
+#include "StreamPlayer.h"
+#include "Streamer.h"
+#include "SampleConversion.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <errno.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace lime;
+
+//readahead window, large enough that one request covers many packets even at full link rate
+static const size_t cReadahead = 16 << 20;
+
+static int64_t NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StreamPlayer::Config::Config() :
+    format(FMT_CS16),
+    loop(false),
+    useTimestamp(false),
+    startTimestamp(0),
+    sampleRate(0)
+{
+}
+
+StreamPlayer::StreamPlayer(StreamChannel* channel) :
+    mChannel(channel),
+    mData(nullptr),
+    mFileSize(0),
+    mSampleSize(0),
+    mPosition(0),
+    mPrefetched(0),
+    mPageSize(4096),
+#ifdef _WIN32
+    mFile(INVALID_HANDLE_VALUE),
+    mMapping(nullptr),
+#else
+    mFd(-1),
+#endif
+    mAttached(false),
+    mActive(false),
+    mSamples(0),
+    mLoops(0),
+    mStartNanoseconds(0),
+    mStopNanoseconds(0)
+{
+}
+
+StreamPlayer::~StreamPlayer()
+{
+    Stop();
+}
+
+int StreamPlayer::Start(const Config &config)
+{
+    if (mAttached)
+        return ReportError(EBUSY, "Playback is already running");
+    if (mChannel == nullptr || !mChannel->config.isTx)
+        return ReportError(EINVAL, "Files can be played only through Tx streams");
+    if (mChannel->IsActive() || mChannel->GetPlayer())
+        return ReportError(EBUSY, "Playback must be started before the Tx stream");
+
+    mConfig = config;
+    switch (config.format)
+    {
+    case FMT_CS16: mSampleSize = 2*sizeof(int16_t); break;
+    case FMT_CF32: mSampleSize = 2*sizeof(float); break;
+    case FMT_PACKED12: mSampleSize = 3; break;
+    default: return ReportError(EINVAL, "Unsupported playback file format");
+    }
+
+#ifdef _WIN32
+    mFile = CreateFileA(config.path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)
+        return ReportError(ENOENT, "Failed to open %s", config.path.c_str());
+    LARGE_INTEGER size;
+    GetFileSizeEx(mFile, &size);
+    mFileSize = size.QuadPart;
+#else
+    mFd = open(config.path.c_str(), O_RDONLY);
+    if (mFd < 0)
+        return ReportError(errno, "Failed to open %s", config.path.c_str());
+    struct stat st;
+    fstat(mFd, &st);
+    mFileSize = st.st_size;
+    mPageSize = sysconf(_SC_PAGESIZE);
+#endif
+    if (mFileSize % mSampleSize)
+        lime::warning("%s: ignoring %i trailing bytes of incomplete sample", config.path.c_str(), int(mFileSize % mSampleSize));
+    mFileSize -= mFileSize % mSampleSize;
+    if (mFileSize == 0)
+    {
+        Unmap();
+        return ReportError(EINVAL, "%s does not contain any samples", config.path.c_str());
+    }
+
+#ifdef _WIN32
+    mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMapping)
+        mData = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    if (mData == nullptr)
+    {
+        Unmap();
+        return ReportError(ENOMEM, "Failed to map %s", config.path.c_str());
+    }
+#else
+    void* ptr = mmap(nullptr, mFileSize, PROT_READ, MAP_SHARED, mFd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        const int err = errno;
+        Unmap();
+        return ReportError(err, "Failed to map %s", config.path.c_str());
+    }
+    mData = (const char*)ptr;
+    //looped files are read again, pages behind playback position must stay cached
+    if (!config.loop)
+        madvise(ptr, mFileSize, MADV_SEQUENTIAL);
+#endif
+
+    mPosition = 0;
+    mPrefetched = 0;
+    Prefetch(0);
+    mSamples.store(0);
+    mLoops.store(0);
+    mStartNanoseconds.store(0);
+    mStopNanoseconds.store(0);
+    mActive.store(true);
+    mChannel->SetPlayer(this);
+    mAttached = true;
+    return 0;
+}
+
+int StreamPlayer::Stop()
+{
+    if (!mAttached)
+        return 0;
+    int status = 0;
+    if (mChannel->IsActive())
+        status = mChannel->Stop();
+    //Tx thread can still be running for the other channel, mapping is released
+    //only after it no longer reads from this player
+    mChannel->SetPlayer(nullptr);
+    mAttached = false;
+    if (mActive.exchange(false) && mStartNanoseconds.load())
+        mStopNanoseconds.store(NowNanoseconds());
+    Unmap();
+    return status;
+}
+
+StreamPlayer::Status StreamPlayer::GetStatus() const
+{
+    Status status;
+    status.samples = mSamples.load(std::memory_order_relaxed);
+    status.fileSamples = mSampleSize ? mFileSize / mSampleSize : 0;
+    status.loops = mLoops.load(std::memory_order_relaxed);
+    const int64_t start = mStartNanoseconds.load(std::memory_order_relaxed);
+    const int64_t stop = mStopNanoseconds.load(std::memory_order_relaxed);
+    status.seconds = start ? ((stop ? stop : NowNanoseconds()) - start) * 1e-9 : 0;
+    status.active = mActive.load(std::memory_order_relaxed);
+    return status;
+}
+
+bool StreamPlayer::IsStarted() const
+{
+    return mStartNanoseconds.load(std::memory_order_relaxed) != 0;
+}
+
+bool StreamPlayer::CopiesPayload(bool packedLink) const
+{
+    return mConfig.format == (packedLink ? FMT_PACKED12 : FMT_CS16);
+}
+
+void StreamPlayer::Read(SamplesPacket &packet, int count)
+{
+    const bool packedLink = mChannel->config.linkFormat == StreamConfig::FMT_INT12;
+    const SampleConverters& conv = GetSampleConverters();
+    Pace(mSamples.load(std::memory_order_relaxed));
+    int filled = 0;
+    bool endOfFile = false;
+    while (filled < count && !endOfFile)
+    {
+        const char* src = mData + mPosition;
+        const size_t n = Take(count - filled, endOfFile);
+        complex16_t* dest = packet.samples + filled;
+        int16_t* destShort = (int16_t*)dest;
+        switch (mConfig.format)
+        {
+        case FMT_CS16:
+            if (packedLink)
+            {
+                const int16_t* srcShort = (const int16_t*)src;
+                for (size_t i = 0; i < 2*n; ++i)
+                    destShort[i] = srcShort[i] >> 4;
+            }
+            else
+                memcpy(dest, src, n*sizeof(complex16_t));
+            break;
+        case FMT_CF32:
+            conv.FloatToInt16((const float*)src, n, packedLink ? 2047.0f : 32767.0f, dest);
+            break;
+        case FMT_PACKED12:
+            conv.Unpack12((const uint8_t*)src, n, dest);
+            if (!packedLink)
+                for (size_t i = 0; i < 2*n; ++i)
+                    destShort[i] <<= 4;
+            break;
+        }
+        filled += n;
+    }
+    if (filled < count)
+        memset(packet.samples + filled, 0, (count - filled)*sizeof(complex16_t));
+    SetHeader(packet, filled, endOfFile);
+}
+
+void StreamPlayer::ReadPayload(uint8_t* payload, SamplesPacket &packet, int count)
+{
+    Pace(mSamples.load(std::memory_order_relaxed));
+    int filled = 0;
+    bool endOfFile = false;
+    while (filled < count && !endOfFile)
+    {
+        const char* src = mData + mPosition;
+        const size_t n = Take(count - filled, endOfFile);
+        memcpy(payload + filled*mSampleSize, src, n*mSampleSize);
+        filled += n;
+    }
+    if (filled < count)
+        memset(payload + filled*mSampleSize, 0, (count - filled)*mSampleSize);
+    SetHeader(packet, filled, endOfFile);
+}
+
+//takes up to count contiguous samples at current position
+size_t StreamPlayer::Take(int count, bool &endOfFile)
+{
+    if (mPosition == mFileSize)
+    {
+        endOfFile = true;
+        return 0;
+    }
+    const size_t n = std::min<size_t>(count, (mFileSize - mPosition) / mSampleSize);
+    mPosition += n*mSampleSize;
+    if (mPosition == mFileSize && mConfig.loop)
+    {
+        mPosition = 0;
+        mPrefetched = 0;
+        mLoops.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (mPosition == mFileSize)
+        endOfFile = true;
+    Prefetch(mPosition);
+    return n;
+}
+
+//holds Tx thread back when playback is ahead of requested sample rate
+void StreamPlayer::Pace(uint64_t played)
+{
+    if (mStartNanoseconds.load(std::memory_order_relaxed) == 0)
+        mStartNanoseconds.store(NowNanoseconds(), std::memory_order_relaxed);
+    if (mConfig.sampleRate <= 0 || !mActive.load(std::memory_order_relaxed))
+        return;
+    const int64_t due = mStartNanoseconds.load(std::memory_order_relaxed) + int64_t(played * 1e9 / mConfig.sampleRate);
+    const int64_t wait = due - NowNanoseconds();
+    if (wait > 0)
+        std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+}
+
+void StreamPlayer::Prefetch(size_t offset)
+{
+#ifndef _WIN32
+    //keep at least half of readahead window requested ahead of playback position
+    if (mPrefetched >= mFileSize || mPrefetched > offset + cReadahead/2)
+        return;
+    const size_t begin = std::max(mPrefetched, offset) & ~(mPageSize - 1);
+    const size_t end = std::min(begin + cReadahead, mFileSize);
+    madvise((void*)(mData + begin), end - begin, MADV_WILLNEED);
+    mPrefetched = end;
+#endif
+}
+
+void StreamPlayer::SetHeader(SamplesPacket &packet, int count, bool endOfFile)
+{
+    const uint64_t played = mSamples.load(std::memory_order_relaxed);
+    packet.timestamp = mConfig.startTimestamp + played;
+    packet.last = count;
+    packet.flags = 0;
+    if (mConfig.useTimestamp)
+        packet.flags |= RingFIFO::SYNC_TIMESTAMP;
+    if (count == 0)
+    {
+        //file has ended, behave like empty FIFO
+        packet.flags = 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return;
+    }
+    mSamples.store(played + count, std::memory_order_relaxed);
+    if (endOfFile)
+    {
+        packet.flags |= RingFIFO::END_BURST;
+        if (mActive.exchange(false))
+            mStopNanoseconds.store(NowNanoseconds(), std::memory_order_relaxed);
+    }
+}
+
+void StreamPlayer::Unmap()
+{
+#ifdef _WIN32
+    if (mData)
+        UnmapViewOfFile(mData);
+    if (mMapping)
+        CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mFile);
+    mMapping = nullptr;
+    mFile = INVALID_HANDLE_VALUE;
+#else
+    if (mData)
+        munmap((void*)mData, mFileSize);
+    if (mFd >= 0)
+        close(mFd);
+    mFd = -1;
+#endif
+    mData = nullptr;
+}
@@ -0,0 +1,131 @@
+/**
+@file StreamPlayer.h
+@author Lime Microsystems
+@brief Playback of memory mapped sample files through Tx stream
+*/
+
+#ifndef LIME_STREAM_PLAYER_H
+#define LIME_STREAM_PLAYER_H
+
+#include "LimeSuiteConfig.h"
+#include "dataTypes.h"
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace lime
+{
+
+class StreamChannel;
+
+/** @brief Feeds samples of memory mapped file to Tx stream channel.
+
+    Tx thread takes samples straight from the mapping instead of the channel
+    FIFO, so file is neither read into application buffers nor copied through
+    StreamChannel::Write(). When file format matches link format and single
+    channel is streamed, file data is copied directly into packet payload.
+    Pages ahead of playback position are requested from the kernel in large
+    windows, so page faults are rare even on first pass over the file.
+    Player replaces the channel FIFO: it must be started before the stream
+    channel is started, and Stop() stops the channel if it is still running.
+    Players of both channels of a MIMO stream begin playing only when both
+    channels are started.
+*/
+class LIME_API StreamPlayer
+{
+public:
+    enum Format
+    {
+        FMT_CS16, ///<interleaved little endian int16 I/Q, full scale 32767
+        FMT_CF32, ///<interleaved float I/Q, full scale 1.0
+        FMT_PACKED12, ///<12 bit I/Q packed to 3 bytes, as stored by packed StreamRecorder
+    };
+
+    struct Config
+    {
+        Config();
+        std::string path;
+        Format format;
+        //! Start over from beginning of file when end is reached
+        bool loop;
+        //! Transmit first sample at startTimestamp, otherwise as soon as possible
+        bool useTimestamp;
+        uint64_t startTimestamp;
+        //! Limit feeding to this many samples per second, 0 to let link pace playback
+        double sampleRate;
+    };
+
+    struct Status
+    {
+        uint64_t samples; ///<samples handed to Tx thread
+        uint64_t fileSamples; ///<samples in file
+        uint32_t loops; ///<number of completed passes over file
+        double seconds; ///<time since first sample was taken
+        bool active; ///<false after end of file without loop or Stop()
+    };
+
+    StreamPlayer(StreamChannel* channel);
+    ~StreamPlayer();
+
+    /** @brief Maps file and attaches player to stopped Tx channel
+        @return 0 on success, (-1) on failure
+    */
+    int Start(const Config &config);
+
+    /** @brief Stops channel if needed, detaches player and unmaps file
+        @return 0 on success, (-1) on failure
+    */
+    int Stop();
+
+    Status GetStatus() const;
+
+    //! @brief Tx thread has taken first samples
+    bool IsStarted() const;
+
+    /** @brief Tx thread: fills packet with next samples in link format scale
+        @param packet destination, last is set to number of samples, 0 after end of file
+        @param count packet capacity in samples
+    */
+    void Read(SamplesPacket &packet, int count);
+
+    /** @brief Tx thread: copies next samples straight into packet payload,
+        only if CopiesPayload() is true. Remainder of payload is zeroed.
+        @param payload packet payload for count samples
+        @param packet receives timestamp, flags and number of samples
+    */
+    void ReadPayload(uint8_t* payload, SamplesPacket &packet, int count);
+
+    //! @brief File format equals single channel payload format of given link
+    bool CopiesPayload(bool packedLink) const;
+
+private:
+    size_t Take(int count, bool &endOfFile);
+    void Pace(uint64_t played);
+    void Prefetch(size_t offset);
+    void SetHeader(SamplesPacket &packet, int count, bool endOfFile);
+    void Unmap();
+
+    StreamChannel* mChannel;
+    Config mConfig;
+    const char* mData;
+    size_t mFileSize; //bytes of whole samples
+    size_t mSampleSize;
+    size_t mPosition; //byte offset of next sample
+    size_t mPrefetched; //readahead requested up to this offset
+    size_t mPageSize;
+#ifdef _WIN32
+    void* mFile;
+    void* mMapping;
+#else
+    int mFd;
+#endif
+    bool mAttached;
+    std::atomic<bool> mActive;
+    std::atomic<uint64_t> mSamples;
+    std::atomic<uint32_t> mLoops;
+    std::atomic<int64_t> mStartNanoseconds;
+    std::atomic<int64_t> mStopNanoseconds;
+};
+
+}
+#endif // LIME_STREAM_PLAYER_H
@@ -0,0 +1,475 @@
+/**
+@file StreamRecorder.cpp
+@author Lime Microsystems
+@brief Recording of received stream samples to disk in SigMF format
+*/
+
+#include "StreamRecorder.h"
+#include "Streamer.h"
+#include "FPGA_common.h"
+#include "Logger.h"
+#include "VersionInfo.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <errno.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace lime;
+
+//O_DIRECT transfers must be multiples of logical block size, 4 KiB covers all common disks
+static const size_t cBlockSize = 4096;
+static const size_t cBufferGranularity = 1 << 20;
+
+static int64_t NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int OpenForWriting(const std::string &path, bool &directIO)
+{
+#ifdef _WIN32
+    directIO = false;
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    int fd = open(path.c_str(), flags | O_DIRECT, 0644);
+    if (fd >= 0)
+    {
+        directIO = true;
+        return fd;
+    }
+    if (errno != EINVAL) //file system does not support O_DIRECT
+        return -1;
+#endif
+    directIO = false;
+    return open(path.c_str(), flags, 0644);
+#endif
+}
+
+static int WriteAll(int fd, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+#ifdef _WIN32
+        const int cnt = _write(fd, data, unsigned(length));
+#else
+        const ssize_t cnt = write(fd, data, length);
+#endif
+        if (cnt < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += cnt;
+        length -= cnt;
+    }
+    return 0;
+}
+
+static int CloseTruncated(int fd, uint64_t size)
+{
+#ifdef _WIN32
+    int status = _chsize_s(fd, size) == 0 ? 0 : -1;
+    if (_close(fd) != 0)
+        status = -1;
+#else
+    int status = ftruncate(fd, size);
+    if (close(fd) != 0)
+        status = -1;
+#endif
+    return status;
+}
+
+static std::string JsonString(const std::string &value)
+{
+    std::string escaped("\"");
+    for (const char c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else
+            escaped += c;
+    }
+    return escaped + "\"";
+}
+
+StreamRecorder::Config::Config() :
+    packed(false),
+    frequency(0),
+    sampleRate(0),
+    maxSamples(0),
+    bufferSize(4 << 20),
+    bufferCount(16)
+{
+}
+
+StreamRecorder::StreamRecorder(StreamChannel* channel) :
+    mChannel(channel),
+    mCurrent(-1),
+    mCurrentUsed(0),
+    mStopCapture(false),
+    mCaptureDone(false),
+    mActive(false),
+    mFailed(false),
+    mFd(-1),
+    mDirectIO(false),
+    mStartTimestamp(0),
+    mSamples(0),
+    mBytesWritten(0),
+    mDroppedSamples(0),
+    mWriteNanoseconds(0),
+    mGapCount(0),
+    mBuffersHighWater(0),
+    mStartNanoseconds(0),
+    mStopNanoseconds(0)
+{
+}
+
+StreamRecorder::~StreamRecorder()
+{
+    Stop();
+}
+
+int StreamRecorder::Start(const Config &config)
+{
+    if (mCaptureThread.joinable())
+        return ReportError(EBUSY, "Recording is already running");
+    if (mChannel == nullptr || mChannel->config.isTx)
+        return ReportError(EINVAL, "Only Rx streams can be recorded");
+    if (config.path.empty())
+        return ReportError(EINVAL, "Recording path is not set");
+    if (config.packed && mChannel->config.linkFormat != StreamConfig::FMT_INT12)
+        return ReportError(EINVAL, "Packed recording requires 12 bit link format");
+
+    mConfig = config;
+    mConfig.bufferSize = (std::max(config.bufferSize, cBufferGranularity) + cBufferGranularity - 1) / cBufferGranularity * cBufferGranularity;
+    mConfig.bufferCount = std::max(config.bufferCount, 2u);
+
+    mArena.Reset();
+    if (mArena.Reserve(mConfig.bufferSize * mConfig.bufferCount) != 0)
+        return ReportError(ENOMEM, "Failed to allocate recording buffers");
+    mBuffers.clear();
+    mFreeBuffers.clear();
+    mFullBuffers.clear();
+    for (unsigned i = 0; i < mConfig.bufferCount; ++i)
+    {
+        mBuffers.push_back(static_cast<char*>(mArena.Allocate(mConfig.bufferSize, cBlockSize)));
+        mFreeBuffers.push_back(i);
+    }
+
+    mGaps.clear();
+    mStartTimestamp = 0;
+    mSamples.store(0);
+    mBytesWritten.store(0);
+    mDroppedSamples.store(0);
+    mWriteNanoseconds.store(0);
+    mGapCount.store(0);
+    mBuffersHighWater.store(0);
+
+    const std::string dataPath = mConfig.path + ".sigmf-data";
+    mFd = OpenForWriting(dataPath, mDirectIO);
+    if (mFd < 0)
+    {
+        ReportError(errno, "Failed to create %s", dataPath.c_str());
+        mArena.Reset();
+        return -1;
+    }
+
+    char timeString[32];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(timeString, sizeof(timeString), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    mStartTime = timeString;
+    if (WriteMetadata() != 0)
+    {
+        CloseTruncated(mFd, 0);
+        mFd = -1;
+        mArena.Reset();
+        return -1;
+    }
+
+    mCurrent = -1;
+    mCurrentUsed = 0;
+    mCaptureDone = false;
+    mStopCapture.store(false);
+    mFailed.store(false);
+    mActive.store(true);
+    mStartNanoseconds.store(NowNanoseconds());
+    mStopNanoseconds.store(0);
+    mWriterThread = std::thread(&StreamRecorder::WriterLoop, this);
+    mCaptureThread = std::thread(&StreamRecorder::CaptureLoop, this);
+    return 0;
+}
+
+int StreamRecorder::Stop()
+{
+    if (!mCaptureThread.joinable())
+        return 0;
+    mStopCapture.store(true);
+    mCaptureThread.join();
+    mWriterThread.join();
+    if (mStopNanoseconds.load() == 0)
+        mStopNanoseconds.store(NowNanoseconds());
+
+    //O_DIRECT writes whole blocks, padding of the last buffer is cut off
+    int status = 0;
+    if (CloseTruncated(mFd, mBytesWritten.load()) != 0)
+        status = ReportError(errno, "Failed to close %s.sigmf-data", mConfig.path.c_str());
+    mFd = -1;
+    if (WriteMetadata() != 0)
+        status = -1;
+    mArena.Reset();
+    mBuffers.clear();
+    if (mFailed.load())
+        status = -1;
+    return status;
+}
+
+StreamRecorder::Status StreamRecorder::GetStatus() const
+{
+    Status status;
+    status.samples = mSamples.load(std::memory_order_relaxed);
+    status.bytesWritten = mBytesWritten.load(std::memory_order_relaxed);
+    status.droppedSamples = mDroppedSamples.load(std::memory_order_relaxed);
+    status.gaps = mGapCount.load(std::memory_order_relaxed);
+    const int64_t start = mStartNanoseconds.load(std::memory_order_relaxed);
+    const int64_t stop = mStopNanoseconds.load(std::memory_order_relaxed);
+    status.seconds = start ? ((stop ? stop : NowNanoseconds()) - start) * 1e-9 : 0;
+    status.writeSeconds = mWriteNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+    status.buffersHighWater = mBuffersHighWater.load(std::memory_order_relaxed);
+    status.bufferCount = mConfig.bufferCount;
+    status.active = mActive.load(std::memory_order_relaxed);
+    status.directIO = mDirectIO;
+    return status;
+}
+
+void StreamRecorder::CaptureLoop()
+{
+    std::vector<uint8_t> packed;
+    uint64_t nextTimestamp = 0;
+    bool first = true;
+    while (!mStopCapture.load(std::memory_order_relaxed) && !mFailed.load(std::memory_order_relaxed))
+    {
+        size_t handle;
+        const complex16_t* samples = nullptr;
+        StreamChannel::Metadata meta;
+        int count = mChannel->AcquireRead(handle, &samples, &meta, 100);
+        if (count <= 0)
+            continue;
+
+        if (first)
+        {
+            mStartTimestamp = meta.timestamp;
+            first = false;
+        }
+        else if (meta.timestamp != nextTimestamp)
+        {
+            Gap gap;
+            gap.sampleStart = mSamples.load(std::memory_order_relaxed);
+            gap.timestamp = meta.timestamp;
+            gap.dropped = meta.timestamp > nextTimestamp ? meta.timestamp - nextTimestamp : 0;
+            mGaps.push_back(gap);
+            mGapCount.fetch_add(1, std::memory_order_relaxed);
+            mDroppedSamples.fetch_add(gap.dropped, std::memory_order_relaxed);
+        }
+        nextTimestamp = meta.timestamp + count;
+
+        const uint64_t stored = mSamples.load(std::memory_order_relaxed);
+        if (mConfig.maxSamples && stored + count > mConfig.maxSamples)
+            count = mConfig.maxSamples - stored;
+        if (mConfig.packed)
+        {
+            packed.resize(count * 3);
+            const int bytes = FPGA::Samples2FPGAPacketPayload(&samples, count, false, true, packed.data());
+            Append(reinterpret_cast<const char*>(packed.data()), bytes);
+        }
+        else
+            Append(reinterpret_cast<const char*>(samples), count * sizeof(complex16_t));
+        mChannel->ReleaseRead(handle);
+        mSamples.store(stored + count, std::memory_order_relaxed);
+        if (mConfig.maxSamples && stored + count >= mConfig.maxSamples)
+            break;
+    }
+
+    //hand over partially filled buffer and let writer finish
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mCurrent >= 0 && mCurrentUsed > 0)
+            mFullBuffers.push_back(std::make_pair(unsigned(mCurrent), mCurrentUsed));
+        else if (mCurrent >= 0)
+            mFreeBuffers.push_back(mCurrent);
+        mCurrent = -1;
+        mCaptureDone = true;
+    }
+    mBufferFilled.notify_one();
+    mActive.store(false);
+}
+
+void StreamRecorder::Append(const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        if (mCurrent < 0)
+        {
+            //while writer is behind, FIFO keeps filling and eventually drops
+            //packets, which is recorded as timestamp gap
+            std::unique_lock<std::mutex> lock(mLock);
+            mBufferFreed.wait(lock, [this]{ return !mFreeBuffers.empty() || mFailed.load(); });
+            if (mFailed.load())
+                return;
+            mCurrent = mFreeBuffers.front();
+            mFreeBuffers.pop_front();
+            mCurrentUsed = 0;
+        }
+        const size_t chunk = std::min(length, mConfig.bufferSize - mCurrentUsed);
+        memcpy(mBuffers[mCurrent] + mCurrentUsed, data, chunk);
+        mCurrentUsed += chunk;
+        data += chunk;
+        length -= chunk;
+        if (mCurrentUsed == mConfig.bufferSize)
+            SubmitBuffer();
+    }
+}
+
+void StreamRecorder::SubmitBuffer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mFullBuffers.push_back(std::make_pair(unsigned(mCurrent), mCurrentUsed));
+        if (mFullBuffers.size() > mBuffersHighWater.load(std::memory_order_relaxed))
+            mBuffersHighWater.store(mFullBuffers.size(), std::memory_order_relaxed);
+        mCurrent = -1;
+    }
+    mBufferFilled.notify_one();
+}
+
+void StreamRecorder::WriterLoop()
+{
+    while (true)
+    {
+        std::pair<unsigned, size_t> item;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mBufferFilled.wait(lock, [this]{ return !mFullBuffers.empty() || mCaptureDone; });
+            if (mFullBuffers.empty())
+                break;
+            item = mFullBuffers.front();
+            mFullBuffers.pop_front();
+        }
+
+        //only the last buffer can be partially filled, its padding is cut off by Stop()
+        size_t length = item.second;
+        if (mDirectIO)
+            length = (length + cBlockSize - 1) / cBlockSize * cBlockSize;
+        if (!mFailed.load())
+        {
+            const int64_t t0 = NowNanoseconds();
+            if (WriteAll(mFd, mBuffers[item.first], length) == 0)
+                mBytesWritten.fetch_add(item.second, std::memory_order_relaxed);
+            else
+            {
+                lime::error("Recording stopped, failed to write %s.sigmf-data: %s", mConfig.path.c_str(), strerror(errno));
+                mFailed.store(true);
+                mActive.store(false);
+                mStopNanoseconds.store(NowNanoseconds());
+            }
+            mWriteNanoseconds.fetch_add(NowNanoseconds() - t0, std::memory_order_relaxed);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mFreeBuffers.push_back(item.first);
+        }
+        mBufferFreed.notify_one();
+    }
+}
+
+int StreamRecorder::WriteMetadata()
+{
+    const std::string path = mConfig.path + ".sigmf-meta";
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+    if (!file.good())
+        return ReportError(errno, "Failed to create %s", path.c_str());
+
+    const bool packed = mConfig.packed;
+    const uint64_t samples = mSamples.load();
+    file.precision(15);
+    file << "{\n";
+    file << "    \"global\": {\n";
+    file << "        \"core:datatype\": \"ci16_le\",\n";
+    file << "        \"core:version\": \"1.0.0\",\n";
+    if (mConfig.sampleRate > 0)
+        file << "        \"core:sample_rate\": " << mConfig.sampleRate << ",\n";
+    file << "        \"core:num_channels\": 1,\n";
+    if (!mConfig.hardware.empty())
+        file << "        \"core:hw\": " << JsonString(mConfig.hardware) << ",\n";
+    if (!mConfig.description.empty())
+        file << "        \"core:description\": " << JsonString(mConfig.description) << ",\n";
+    file << "        \"core:recorder\": " << JsonString("LimeSuite " + GetLibraryVersion()) << ",\n";
+    //packed samples can not be read as ci16_le, readers must know the extension
+    file << "        \"core:extensions\": [{\"name\": \"limesuite\", \"version\": \"1.0.0\", \"optional\": "
+        << (packed ? "false" : "true") << "}],\n";
+    if (packed)
+        file << "        \"limesuite:sample_packing\": \"int12\",\n";
+    file << "        \"limesuite:full_scale\": "
+        << (mChannel->config.linkFormat == StreamConfig::FMT_INT12 ? 2048 : 32768) << ",\n";
+    file << "        \"limesuite:dropped_samples\": " << mDroppedSamples.load() << "\n";
+    file << "    },\n";
+
+    file << "    \"captures\": [\n";
+    file << "        {\"core:sample_start\": 0";
+    if (samples > 0)
+        file << ", \"core:global_index\": " << mStartTimestamp;
+    if (mConfig.frequency > 0)
+        file << ", \"core:frequency\": " << mConfig.frequency;
+    file << ", \"core:datetime\": " << JsonString(mStartTime) << "}";
+    for (const Gap &gap : mGaps)
+    {
+        file << ",\n        {\"core:sample_start\": " << gap.sampleStart << ", \"core:global_index\": " << gap.timestamp;
+        if (mConfig.frequency > 0)
+            file << ", \"core:frequency\": " << mConfig.frequency;
+        file << "}";
+    }
+    file << "\n    ],\n";
+
+    file << "    \"annotations\": [";
+    for (size_t i = 0; i < mGaps.size(); ++i)
+    {
+        const Gap &gap = mGaps[i];
+        std::ostringstream comment;
+        if (gap.dropped)
+            comment << gap.dropped << " samples dropped before this sample";
+        else
+            comment << "timestamp jumped back to " << gap.timestamp;
+        file << (i ? ",\n" : "\n") << "        {\"core:sample_start\": " << gap.sampleStart
+            << ", \"core:sample_count\": 1"
+            << ", \"core:comment\": " << JsonString(comment.str())
+            << ", \"limesuite:dropped_samples\": " << gap.dropped << "}";
+    }
+    file << (mGaps.empty() ? "]\n" : "\n    ]\n");
+    file << "}\n";
+    file.close();
+    if (file.fail())
+        return ReportError(EIO, "Failed to write %s", path.c_str());
+    return 0;
+}
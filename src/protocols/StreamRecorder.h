@@ -0,0 +1,141 @@
+/**
+@file StreamRecorder.h
+@author Lime Microsystems
+@brief Recording of received stream samples to disk in SigMF format
+*/
+
+#ifndef LIME_STREAM_RECORDER_H
+#define LIME_STREAM_RECORDER_H
+
+#include "LimeSuiteConfig.h"
+#include "StreamArena.h"
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lime
+{
+
+class StreamChannel;
+
+/** @brief Writes samples of Rx stream channel to SigMF recording.
+
+    Capture thread takes packets directly from channel FIFO and fills large
+    page aligned buffers, a dedicated writer thread stores full buffers to
+    disk with O_DIRECT writes where the file system supports them. Samples
+    are stored as interleaved little endian int16 I/Q in link format scale,
+    or packed into 12 bits per value (3 bytes per sample, same as 12 bit link
+    format) when channel uses 12 bit link.
+    Gaps in packet timestamps start a new SigMF capture segment and are
+    annotated with number of missing samples.
+    Recorder takes all packets of the channel, so the channel must not be read
+    by other means, and recording must be stopped before the stream is stopped.
+*/
+class LIME_API StreamRecorder
+{
+public:
+    struct Config
+    {
+        Config();
+        //! Path without extension, .sigmf-data and .sigmf-meta are appended
+        std::string path;
+        //! Store 12 bit link samples packed, 3 bytes per sample
+        bool packed;
+        //! Metadata only, center frequency in Hz, 0 to omit
+        double frequency;
+        //! Metadata only, sample rate in Hz
+        double sampleRate;
+        //! Stop after this many samples, 0 for no limit
+        uint64_t maxSamples;
+        //! Size of one write buffer in bytes, rounded up to 1 MiB
+        size_t bufferSize;
+        //! Number of write buffers
+        unsigned bufferCount;
+        //! Metadata only, hardware name and free text description
+        std::string hardware;
+        std::string description;
+    };
+
+    struct Status
+    {
+        uint64_t samples; ///<samples stored
+        uint64_t bytesWritten;
+        uint64_t droppedSamples; ///<samples missing according to timestamps
+        uint32_t gaps; ///<number of timestamp discontinuities
+        double seconds; ///<time since recording started
+        double writeSeconds; ///<time writer thread spent in write calls
+        unsigned buffersHighWater; ///<largest number of full buffers waiting for writer
+        unsigned bufferCount;
+        bool active; ///<false after error, reaching maxSamples or Stop()
+        bool directIO; ///<data file is written with O_DIRECT
+    };
+
+    StreamRecorder(StreamChannel* channel);
+    ~StreamRecorder();
+
+    /** @brief Creates recording files and starts capture and writer threads
+        @return 0 on success, (-1) on failure
+    */
+    int Start(const Config &config);
+
+    /** @brief Stores remaining samples and completes metadata
+        @return 0 on success, (-1) if any write failed
+    */
+    int Stop();
+
+    Status GetStatus() const;
+
+private:
+    struct Gap
+    {
+        uint64_t sampleStart;
+        uint64_t timestamp;
+        uint64_t dropped; ///<0 if timestamp went backwards
+    };
+
+    void CaptureLoop();
+    void WriterLoop();
+    void Append(const char* data, size_t length);
+    void SubmitBuffer();
+    int WriteMetadata();
+
+    StreamChannel* mChannel;
+    Config mConfig;
+    StreamArena mArena;
+    std::vector<char*> mBuffers;
+    std::deque<unsigned> mFreeBuffers;
+    std::deque<std::pair<unsigned, size_t> > mFullBuffers; //index, bytes
+    std::mutex mLock;
+    std::condition_variable mBufferFreed;
+    std::condition_variable mBufferFilled;
+    int mCurrent; //buffer being filled by capture thread, -1 if none
+    size_t mCurrentUsed;
+    std::thread mCaptureThread;
+    std::thread mWriterThread;
+    std::atomic<bool> mStopCapture;
+    bool mCaptureDone;
+    std::atomic<bool> mActive;
+    std::atomic<bool> mFailed;
+    int mFd;
+    bool mDirectIO;
+    uint64_t mStartTimestamp;
+    std::string mStartTime;
+    std::vector<Gap> mGaps;
+    std::atomic<uint64_t> mSamples;
+    std::atomic<uint64_t> mBytesWritten;
+    std::atomic<uint64_t> mDroppedSamples;
+    std::atomic<uint64_t> mWriteNanoseconds;
+    std::atomic<uint32_t> mGapCount;
+    std::atomic<unsigned> mBuffersHighWater;
+    std::atomic<int64_t> mStartNanoseconds;
+    std::atomic<int64_t> mStopNanoseconds;
+};
+
+}
+#endif // LIME_STREAM_RECORDER_H
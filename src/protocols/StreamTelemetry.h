@@ -0,0 +1,157 @@
+/**
+@file StreamTelemetry.h
+@author Lime Microsystems
+@brief Lock-free histograms of stream stage timings
+*/
+
+#ifndef LIME_STREAM_TELEMETRY_H
+#define LIME_STREAM_TELEMETRY_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace lime
+{
+
+/** @brief Histogram with power of two buckets, safe to record from several threads.
+
+    Bucket 0 counts zero values, bucket i counts values in [2^(i-1), 2^i),
+    the last bucket also takes everything above its range. Recording is a few
+    relaxed atomic additions, so it can be done on every transfer.
+*/
+class StreamHistogram
+{
+public:
+    static const int cBucketsCount = 32;
+
+    struct Snapshot
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t buckets[cBucketsCount];
+    };
+
+    StreamHistogram()
+    {
+        Reset();
+    }
+
+    void Record(uint64_t value)
+    {
+        int bucket = value ? HighestBit(value) + 1 : 0;
+        if (bucket >= cBucketsCount)
+            bucket = cBucketsCount - 1;
+        mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t prev = mMax.load(std::memory_order_relaxed);
+        while (value > prev && !mMax.compare_exchange_weak(prev, value, std::memory_order_relaxed))
+            ;
+    }
+
+    /** @brief Copies current counters
+        @param reset clear counters after reading, values recorded concurrently may land in either period
+    */
+    Snapshot Get(bool reset = false)
+    {
+        Snapshot s;
+        for (int i = 0; i < cBucketsCount; ++i)
+            s.buckets[i] = reset ? mBuckets[i].exchange(0, std::memory_order_relaxed) : mBuckets[i].load(std::memory_order_relaxed);
+        s.count = reset ? mCount.exchange(0, std::memory_order_relaxed) : mCount.load(std::memory_order_relaxed);
+        s.sum = reset ? mSum.exchange(0, std::memory_order_relaxed) : mSum.load(std::memory_order_relaxed);
+        s.max = reset ? mMax.exchange(0, std::memory_order_relaxed) : mMax.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    void Reset()
+    {
+        Get(true);
+    }
+
+private:
+    static int HighestBit(uint64_t value)
+    {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return index;
+#else
+        int bit = 0;
+        while (value >>= 1)
+            ++bit;
+        return bit;
+#endif
+    }
+
+    std::atomic<uint64_t> mBuckets[cBucketsCount];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+    std::atomic<uint64_t> mMax;
+};
+
+/** @brief Timings of one stream channel.
+    Times are in nanoseconds of steady clock, TX lead time is in samples.
+*/
+class StreamTelemetry
+{
+public:
+    struct Snapshot
+    {
+        StreamHistogram::Snapshot transferInterval;
+        StreamHistogram::Snapshot processingTime;
+        StreamHistogram::Snapshot producerWait;
+        StreamHistogram::Snapshot consumerWait;
+        StreamHistogram::Snapshot txLeadTime;
+        uint32_t fifoHighWater;
+    };
+
+    StreamTelemetry() : fifoHighWater(0) {}
+
+    //! @brief Monotonic time for telemetry intervals
+    static uint64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Snapshot Get(bool reset = false)
+    {
+        Snapshot s;
+        s.transferInterval = transferInterval.Get(reset);
+        s.processingTime = processingTime.Get(reset);
+        s.producerWait = producerWait.Get(reset);
+        s.consumerWait = consumerWait.Get(reset);
+        s.txLeadTime = txLeadTime.Get(reset);
+        s.fifoHighWater = reset ? fifoHighWater.exchange(0, std::memory_order_relaxed) : fifoHighWater.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    void Reset()
+    {
+        Get(true);
+    }
+
+    //! Time between completions of consecutive link transfers
+    StreamHistogram transferInterval;
+    //! Time spent decoding (RX) or encoding (TX) packets of one transfer
+    StreamHistogram processingTime;
+    //! Time FIFO writer was blocked waiting for free space
+    StreamHistogram producerWait;
+    //! Time FIFO reader was blocked waiting for data
+    StreamHistogram consumerWait;
+    //! Samples between TX packet timestamp and last received timestamp when packet was sent, 0 if late
+    StreamHistogram txLeadTime;
+    //! Maximum number of packets held in FIFO
+    std::atomic<uint32_t> fifoHighWater;
+};
+
+}
+#endif // LIME_STREAM_TELEMETRY_H
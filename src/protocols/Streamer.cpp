@@ -1,9 +1,12 @@
 #include <assert.h>
 #include "FPGA_common.h"
+#include "SampleConversion.h"
 #include "LMS7002M.h"
 #include <ciso646>
 #include "Logger.h"
 #include "Streamer.h"
+#include "StreamPlayer.h"
+#include "LinkTrace.h"
 #include "IConnection.h"
 #include <complex>
 #include "LMSBoards.h"
@@ -12,12 +15,57 @@
 namespace lime
 {
 
+//runs function on a thread restricted to given CPUs, so memory it touches first is placed on their NUMA node
+template<class Func>
+static void RunOnCPUs(const std::vector<int> &cpus, Func func)
+{
+    if (cpus.empty())
+        return func();
+    std::thread pinnedThread([&]{
+        SetOSCurrentThreadAffinity(cpus);
+        func();
+    });
+    pinnedThread.join();
+}
+
+//FIFO packets are taken from pre-faulted stream arena
+void Streamer::ResizeFIFO(StreamChannel &channel, int pktSize, int bufSize)
+{
+    RingFIFO* &fifo = channel.fifo;
+    if (!fifo)
+        fifo = new RingFIFO(&arena);
+    if (bufSize < 0)
+        bufSize = fifo->GetPacketSize()*fifo->GetBufferCount()/pktSize;
+    if (pktSize == fifo->GetPacketSize() && bufSize == (int)fifo->GetBufferCount())
+        return fifo->Clear();
+    //running thread can still hold packets of this FIFO and pass them to the next one,
+    //so its memory is kept until all streams are released
+    if ((channel.config.isTx ? txThread : rxThread).joinable() && fifo->GetBufferCount())
+    {
+        mRetiredFIFOs.push_back(fifo);
+        fifo = new RingFIFO(&arena);
+        fifo->SetTelemetry(channel.telemetry);
+    }
+    RunOnCPUs(channel.config.threadCPUs, [&]{
+        fifo->Resize(pktSize, bufSize);
+    });
+}
+
+//adds value to given histogram of every active channel
+static void RecordTelemetry(std::vector<StreamChannel> &streams, StreamHistogram StreamTelemetry::*histogram, uint64_t value)
+{
+    for (auto &s : streams)
+        if (s.used && s.mActive && s.telemetry)
+            (s.telemetry->*histogram).Record(value);
+}
+
 StreamChannel::StreamChannel(Streamer* streamer) :
     mStreamer(streamer),
     pktLost(0),
     mActive(false),
     used(false),
-    fifo(nullptr)
+    fifo(nullptr),
+    telemetry(nullptr)
 {
 }
 
@@ -25,6 +73,8 @@ StreamChannel::~StreamChannel()
 {
     if (fifo)
         delete fifo;
+    if (telemetry)
+        delete telemetry;
 }
 
 void StreamChannel::Setup(StreamConfig conf)
@@ -36,53 +86,56 @@ void StreamChannel::Setup(StreamConfig conf)
     int pktSize = config.linkFormat != StreamConfig::FMT_INT12 ? samples16InPkt : samples12InPkt;
     if (bufferLength < 4*pktSize)  //set FIFO to at least 4 packets
         bufferLength = 4*pktSize;
-    if (!fifo)
-        fifo = new RingFIFO();
-    fifo->Resize(pktSize, bufferLength/pktSize);
+    mStreamer->ResizeFIFO(*this, pktSize, bufferLength/pktSize);
+    if (!telemetry)
+        telemetry = new StreamTelemetry();
+    telemetry->Reset();
+    fifo->SetTelemetry(telemetry);
 }
 
 void StreamChannel::Close()
 {
     if (mActive)
         Stop();
-    if (fifo)
-        delete fifo;
-    fifo = nullptr;
     used = false;
+    //FIFO is kept for next setup of channel, unless stream thread can no longer use it
+    mStreamer->ReleaseArena();
 }
 
 int StreamChannel::Write(const void* samples, const uint32_t count, const Metadata *meta, const int32_t timeout_ms)
 {
     int pushed = 0;
+    const uint64_t timestamp = meta ? meta->timestamp : 0;
+    const uint32_t flags = meta ? meta->flags : 0;
+    //conversions are done directly into FIFO packets, no intermediate buffers
     if(config.format == StreamConfig::FMT_FLOAT32 && config.isTx)
     {
         const float* samplesFloat = (const float*)samples;
-        int16_t* samplesShort = new int16_t[2*count];
         const float maxValue = config.linkFormat == StreamConfig::FMT_INT12 ? 2047.0f : 32767.0f;
-        for(size_t i=0; i<2*count; ++i)
-            samplesShort[i] = samplesFloat[i]*maxValue;
-        const complex16_t* ptr = (const complex16_t*)samplesShort ;
-        pushed = fifo->push_samples(ptr, count, meta ? meta->timestamp : 0, timeout_ms, meta ? meta->flags : 0);
-        delete[] samplesShort;
+        const SampleConverters& conv = GetSampleConverters();
+        pushed = fifo->push_converted([&](complex16_t* dest, uint32_t offset, int cnt){
+            conv.FloatToInt16(samplesFloat + 2*offset, cnt, maxValue, dest);
+        }, count, timestamp, timeout_ms, flags);
     }
     else if(config.format != config.linkFormat)
     {
-        int16_t* samplesShort = (int16_t*)samples;
-        int16_t* samplesConverted = new int16_t[2*count];
-        if(config.format == StreamConfig::FMT_INT16)
-            for(size_t i=0; i<2*count; ++i)
-                samplesConverted[i] = samplesShort[i] >> 4;
-        else
-            for(size_t i=0; i<2*count; ++i)
-                samplesConverted[i] = samplesShort[i] << 4;
-        const complex16_t* ptr = (const complex16_t*)samplesConverted;
-        pushed = fifo->push_samples(ptr, count, meta ? meta->timestamp : 0, timeout_ms, meta ? meta->flags : 0);
-        delete[] samplesConverted;
+        const int16_t* samplesShort = (const int16_t*)samples;
+        const bool toInt12 = config.format == StreamConfig::FMT_INT16;
+        pushed = fifo->push_converted([&](complex16_t* dest, uint32_t offset, int cnt){
+            int16_t* samplesConverted = (int16_t*)dest;
+            const int16_t* src = samplesShort + 2*offset;
+            if(toInt12)
+                for(int i=0; i<2*cnt; ++i)
+                    samplesConverted[i] = src[i] >> 4;
+            else
+                for(int i=0; i<2*cnt; ++i)
+                    samplesConverted[i] = src[i] << 4;
+        }, count, timestamp, timeout_ms, flags);
     }
     else
     {
         const complex16_t* ptr = (const complex16_t*)samples;
-        pushed = fifo->push_samples(ptr, count, meta ? meta->timestamp : 0, timeout_ms, meta ? meta->flags : 0);
+        pushed = fifo->push_samples(ptr, count, timestamp, timeout_ms, flags);
     }
     return pushed;
 }
@@ -90,34 +143,36 @@ int StreamChannel::Write(const void* samples, const uint32_t count, const Metada
 int StreamChannel::Read(void* samples, const uint32_t count, Metadata* meta, const int32_t timeout_ms)
 {
     int popped = 0;
+    uint64_t* timestamp = meta ? &meta->timestamp : nullptr;
+    //conversions are done directly from FIFO packets into user buffer
     if(config.format == StreamConfig::FMT_FLOAT32 && !config.isTx)
     {
-        //in place conversion
-        complex16_t* ptr = (complex16_t*)samples;
-        int16_t* samplesShort = (int16_t*)samples;
         float* samplesFloat = (float*)samples;
         const float maxValue = config.linkFormat == StreamConfig::FMT_INT12 ? 2047.0f : 32767.0f;
-        popped = fifo->pop_samples(ptr, count, meta ? &meta->timestamp : nullptr, timeout_ms);
-        for(int i=2*popped-1; i>=0; --i)
-            samplesFloat[i] = (float)samplesShort[i]/maxValue;
+        const SampleConverters& conv = GetSampleConverters();
+        popped = fifo->pop_converted([&](const complex16_t* src, uint32_t offset, int cnt){
+            conv.Int16ToFloat(src, cnt, maxValue, samplesFloat + 2*offset);
+        }, count, timestamp, timeout_ms);
     }
     else if(config.format != config.linkFormat)
     {
-        complex16_t* ptr = (complex16_t*)samples;
         int16_t* samplesShort = (int16_t*)samples;
-        int16_t* samplesConverted = (int16_t*)samples;
-        popped = fifo->pop_samples(ptr, count, meta ? &meta->timestamp : nullptr, timeout_ms);
-        if(config.format == StreamConfig::FMT_INT16)
-            for(int i=2*popped-1; i>=0; --i)
-                samplesConverted[i] = samplesShort[i] << 4;
-        else
-            for(int i=2*popped-1; i>=0; --i)
-                samplesConverted[i] = samplesShort[i] >> 4;
+        const bool toInt16 = config.format == StreamConfig::FMT_INT16;
+        popped = fifo->pop_converted([&](const complex16_t* src, uint32_t offset, int cnt){
+            const int16_t* srcShort = (const int16_t*)src;
+            int16_t* dest = samplesShort + 2*offset;
+            if(toInt16)
+                for(int i=0; i<2*cnt; ++i)
+                    dest[i] = srcShort[i] << 4;
+            else
+                for(int i=0; i<2*cnt; ++i)
+                    dest[i] = srcShort[i] >> 4;
+        }, count, timestamp, timeout_ms);
     }
     else
     {
         complex16_t* ptr = (complex16_t*)samples;
-        popped = fifo->pop_samples(ptr, count, meta ? &meta->timestamp : nullptr, timeout_ms);
+        popped = fifo->pop_samples(ptr, count, timestamp, timeout_ms);
     }
     if(meta)
         meta->flags |= RingFIFO::SYNC_TIMESTAMP;
@@ -125,6 +180,53 @@ int StreamChannel::Read(void* samples, const uint32_t count, Metadata* meta, con
     return popped;
 }
 
+int StreamChannel::AcquireRead(size_t& handle, const complex16_t** samples, Metadata* meta, const int32_t timeout_ms)
+{
+    if (config.isTx)
+        return ReportError(EINVAL, "Zero-copy read is not supported on Tx stream");
+    const SamplesPacket* pkt = nullptr;
+    int64_t slot = fifo->acquire_packet(&pkt, timeout_ms);
+    if(slot < 0)
+        return 0;
+    handle = (size_t)slot;
+    *samples = pkt->samples;
+    if(meta)
+    {
+        meta->timestamp = pkt->timestamp;
+        meta->flags = pkt->flags | RingFIFO::SYNC_TIMESTAMP;
+    }
+    return pkt->last;
+}
+
+void StreamChannel::ReleaseRead(size_t handle)
+{
+    fifo->release_packet((int64_t)handle);
+}
+
+int StreamChannel::AcquireWrite(size_t& handle, complex16_t** samples, const int32_t timeout_ms)
+{
+    if (!config.isTx)
+        return ReportError(EINVAL, "Zero-copy write is not supported on Rx stream");
+    uint32_t capacity = 0;
+    int64_t slot = fifo->acquire_free_packet(samples, &capacity, timeout_ms);
+    if(slot < 0)
+        return 0;
+    handle = (size_t)slot;
+    return capacity;
+}
+
+int StreamChannel::CommitWrite(size_t handle, const uint32_t count, const Metadata* meta)
+{
+    const uint64_t timestamp = meta ? meta->timestamp : 0;
+    const uint32_t flags = meta ? meta->flags : 0;
+    return fifo->commit_packet((int64_t)handle, count, timestamp, flags);
+}
+
+int StreamChannel::GetBufferCount()
+{
+    return fifo->GetBufferCount();
+}
+
 StreamChannel::Info StreamChannel::GetInfo()
 {
     Info stats;
@@ -150,6 +252,13 @@ StreamChannel::Info StreamChannel::GetInfo()
     return stats;
 }
 
+StreamTelemetry::Snapshot StreamChannel::GetTelemetry(bool reset)
+{
+    if (!telemetry)
+        return StreamTelemetry().Get();
+    return telemetry->Get(reset);
+}
+
 int StreamChannel::GetStreamSize()
 {
     return mStreamer->GetStreamSize(config.isTx);
@@ -162,9 +271,9 @@ bool StreamChannel::IsActive() const
 
 int StreamChannel::Start()
 {
-    mActive = true;
     fifo->Clear();
     pktLost = 0;
+    mActive = true;
     return mStreamer->UpdateThreads();
 }
 
@@ -174,6 +283,21 @@ int StreamChannel::Stop()
     return mStreamer->UpdateThreads();
 }
 
+StreamPlayer* StreamChannel::GetPlayer() const
+{
+    return mStreamer->txPlayers[config.channelID&1].load();
+}
+
+void StreamChannel::SetPlayer(StreamPlayer* player)
+{
+    const int ch = config.channelID&1;
+    mStreamer->txPlayers[ch].store(player);
+    //Tx thread raises busy flag before loading player, so once flag is seen clear
+    //it either has finished with previous player or will load the new one
+    while (player == nullptr && mStreamer->txPlayerBusy[ch].load())
+        std::this_thread::yield();
+}
+
 Streamer::Streamer(FPGA* f, LMS7002M* chip, int id) : mRxStreams(2, this), mTxStreams(2, this)
 {
     lms = chip,
@@ -189,6 +313,17 @@ Streamer::Streamer(FPGA* f, LMS7002M* chip, int id) : mRxStreams(2, this), mTxSt
     txBatchSize = 1;
     rxBatchSize = 1;
     streamSize = 1;
+    rxDecodeThreads = 0;
+    rxTransferBuffers = nullptr;
+    txTransferBuffers = nullptr;
+    rxTransferSize = 0;
+    txTransferSize = 0;
+    rxTrace = nullptr;
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        txPlayers[ch].store(nullptr);
+        txPlayerBusy[ch].store(false);
+    }
 }
 
 Streamer::~Streamer()
@@ -199,6 +334,21 @@ Streamer::~Streamer()
         txThread.join();
     if (rxThread.joinable())
         rxThread.join();
+    StopRxTrace();
+    FreeDeviceBuffers();
+    //FIFO packets are returned to arena, which is destroyed before channels
+    for (auto &i : mRxStreams)
+    {
+        delete i.fifo;
+        i.fifo = nullptr;
+    }
+    for (auto &i : mTxStreams)
+    {
+        delete i.fifo;
+        i.fifo = nullptr;
+    }
+    for (auto fifo : mRetiredFIFOs)
+        delete fifo;
 }
 
 
@@ -228,9 +378,17 @@ StreamChannel* Streamer::SetupStream(const StreamConfig& config)
     }
 
     if(config.isTx)
+    {
         mTxStreams[ch].Setup(config);
+        txCPUs = config.threadCPUs;
+    }
     else
+    {
         mRxStreams[ch].Setup(config);
+        rxDecodeThreads = config.decodeThreads;
+        rxDecodeCPUs = config.decodeCPUs;
+        rxCPUs = config.threadCPUs;
+    }
 
     double rate = lms->GetSampleRate(config.isTx,LMS7002M::ChA)/1e6;
     streamSize = (mTxStreams[0].used||mRxStreams[0].used) + (mTxStreams[1].used||mRxStreams[1].used);
@@ -242,6 +400,40 @@ StreamChannel* Streamer::SetupStream(const StreamConfig& config)
         else
             rxBatchSize = batch;
 
+    //pre-fault transfer buffers now, so first packets do not take page faults
+    const unsigned batchSize = config.isTx ? txBatchSize : rxBatchSize;
+    size_t buffersCount = dataPort->GetBuffersCount();
+    if (!config.isTx)
+        buffersCount += 2*config.decodeThreads; //decode pipeline batches
+    const size_t transferSize = buffersCount*dataPort->CheckStreamSize(batchSize)*sizeof(FPGA_DataPacket);
+    char* &transferBuffers = config.isTx ? txTransferBuffers : rxTransferBuffers;
+    size_t &reservedSize = config.isTx ? txTransferSize : rxTransferSize;
+    //memory that connection transfers without copying is preferred,
+    //it is kept until stream memory is released as running thread may use previous buffers
+    char* deviceBuffers = transferSize > reservedSize ? (char*)dataPort->AllocateStreamBuffers(transferSize) : nullptr;
+    if (deviceBuffers)
+    {
+        mDeviceBuffers.push_back(std::make_pair(deviceBuffers, transferSize));
+        transferBuffers = deviceBuffers;
+        reservedSize = transferSize;
+    }
+    else if (transferSize > reservedSize)
+    {
+        //previous buffers are kept while stream thread may still be using them
+        if (!(config.isTx ? txThread : rxThread).joinable())
+        {
+            arena.Free(transferBuffers);
+            transferBuffers = nullptr;
+            reservedSize = 0;
+        }
+        RunOnCPUs(config.threadCPUs, [&]{
+            if (arena.Reserve(transferSize, 4096) != 0)
+                return;
+            transferBuffers = (char*)arena.Allocate(transferSize, 4096);
+            reservedSize = transferBuffers ? transferSize : 0;
+        });
+    }
+
     return config.isTx ? &mTxStreams[ch] : &mRxStreams[ch]; //success
 }
 
@@ -257,10 +449,99 @@ void Streamer::ResizeChannelBuffers()
 
     for(auto& i : mRxStreams)
         if(i.used && i.fifo)
-            i.fifo->Resize(pktSize);
+            ResizeFIFO(i, pktSize, -1);
     for(auto& i : mTxStreams)
         if(i.used && i.fifo)
-            i.fifo->Resize(pktSize);
+            ResizeFIFO(i, pktSize, -1);
+}
+
+//LIME_LINK_TRACE=path records raw Rx transfers, which emulated board can replay
+void Streamer::StartRxTrace()
+{
+    const char* path = getenv("LIME_LINK_TRACE");
+    if (path == nullptr || *path == 0)
+        return;
+    std::string tracePath(path);
+    if (chipId > 0)
+        tracePath += "." + std::to_string(chipId);
+
+    LinkTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cLinkTraceMagic, sizeof(header.magic));
+    header.version = cLinkTraceVersion;
+    if (dataLinkFormat == StreamConfig::FMT_INT12)
+        header.flags |= LinkTraceHeader::PACKED;
+    if (streamSize == 2)
+        header.flags |= LinkTraceHeader::MIMO;
+    header.transferSize = dataPort->CheckStreamSize(rxBatchSize)*sizeof(FPGA_DataPacket);
+    header.buffersCount = dataPort->GetBuffersCount();
+    header.sampleRate = lms->GetSampleRate(false, LMS7002M::ChA);
+    header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    header.chipId = chipId;
+    rxTrace = new LinkTraceWriter();
+    if (rxTrace->Open(tracePath, header) != 0)
+        StopRxTrace();
+}
+
+void Streamer::StopRxTrace()
+{
+    if (rxTrace == nullptr)
+        return;
+    rxTrace->Close();
+    delete rxTrace;
+    rxTrace = nullptr;
+}
+
+void Streamer::ReleaseArena()
+{
+    //FIFOs of closed channels go back to arena when their stream thread is not running
+    for(auto& i : mRxStreams)
+        if(!i.used && i.fifo && !rxThread.joinable())
+        {
+            delete i.fifo;
+            i.fifo = nullptr;
+        }
+    for(auto& i : mTxStreams)
+        if(!i.used && i.fifo && !txThread.joinable())
+        {
+            delete i.fifo;
+            i.fifo = nullptr;
+        }
+
+    //rest of stream memory is released only when no streams are left
+    for(auto& i : mRxStreams)
+        if(i.used)
+            return;
+    for(auto& i : mTxStreams)
+        if(i.used)
+            return;
+    if (rxThread.joinable() || txThread.joinable())
+        return;
+    for (auto fifo : mRetiredFIFOs)
+        delete fifo;
+    mRetiredFIFOs.clear();
+    rxTransferBuffers = nullptr;
+    txTransferBuffers = nullptr;
+    rxTransferSize = 0;
+    txTransferSize = 0;
+    FreeDeviceBuffers();
+    arena.Reset();
+}
+
+void Streamer::FreeDeviceBuffers()
+{
+    for (auto &buffers : mDeviceBuffers)
+        dataPort->FreeStreamBuffers(buffers.first, buffers.second);
+    mDeviceBuffers.clear();
+}
+
+char* Streamer::GetTransferBuffers(bool tx, size_t size, std::vector<char> &heapBuffers)
+{
+    if (size <= (tx ? txTransferSize : rxTransferSize))
+        return tx ? txTransferBuffers : rxTransferBuffers;
+    heapBuffers.resize(size, 0); //not reserved at setup
+    return heapBuffers.data();
 }
 
 int Streamer::GetStreamSize(bool tx)
@@ -592,6 +873,7 @@ int Streamer::UpdateThreads(bool stopAll)
     {
         terminateRx.store(true, std::memory_order_relaxed);
         rxThread.join();
+        StopRxTrace();
     }
 
     //configure FPGA on first start, or disable FPGA when not streaming
@@ -659,7 +941,8 @@ int Streamer::UpdateThreads(bool stopAll)
     if(needRx && (!rxThread.joinable()))
     {
         terminateRx.store(false, std::memory_order_relaxed);
-        auto RxLoopFunction = std::bind(&Streamer::ReceivePacketsLoop, this);
+        StartRxTrace();
+        auto RxLoopFunction = std::bind(rxDecodeThreads ? &Streamer::ReceivePacketsPipelined : &Streamer::ReceivePacketsLoop, this);
         rxThread = std::thread(RxLoopFunction);
         SetOSThreadPriority(ThreadPriority::NORMAL, ThreadPolicy::REALTIME, &rxThread);
     }
@@ -686,12 +969,16 @@ void Streamer::TransmitPacketsLoop()
     const uint8_t packetsToBatch = dataPort->CheckStreamSize(txBatchSize);
     const uint32_t bufferSize = packetsToBatch*sizeof(FPGA_DataPacket);
 
+    //pin before allocating buffers not reserved at setup, so they are placed on the thread's NUMA node
+    if (!txCPUs.empty())
+        SetOSCurrentThreadAffinity(txCPUs);
+
     const int maxSamplesBatch = (packed ? samples12InPkt:samples16InPkt)/chCount;
     std::vector<int> handles(buffersCount, 0);
     std::vector<bool> bufferUsed(buffersCount, 0);
     std::vector<uint32_t> bytesToSend(buffersCount, 0);
-    std::vector<char> buffers;
-    buffers.resize(buffersCount*bufferSize, 0);
+    std::vector<char> heapBuffers;
+    char* buffers = GetTransferBuffers(true, buffersCount*bufferSize, heapBuffers);
     std::vector<SamplesPacket> packets;
     for (int i = 0; i<maxChannelCount; ++i)
         packets.emplace_back(maxSamplesBatch);
@@ -699,6 +986,7 @@ void Streamer::TransmitPacketsLoop()
     long totalBytesSent = 0;
     auto t1 = std::chrono::high_resolution_clock::now();
     auto t2 = t1;
+    uint64_t lastCompletion = 0;
     bool end_burst = false;
     uint8_t bi = 0; //buffer index
     while (terminateTx.load(std::memory_order_relaxed) != true)
@@ -710,6 +998,10 @@ void Streamer::TransmitPacketsLoop()
                 unsigned bytesSent = dataPort->FinishDataSending(&buffers[bi*bufferSize], bytesToSend[bi], handles[bi]);
                 totalBytesSent += bytesSent;
                 bufferUsed[bi] = false;
+                const uint64_t completed = StreamTelemetry::Now();
+                if (lastCompletion)
+                    RecordTelemetry(mTxStreams, &StreamTelemetry::transferInterval, completed - lastCompletion);
+                lastCompletion = completed;
             }
             else
             {
@@ -720,10 +1012,18 @@ void Streamer::TransmitPacketsLoop()
         }
         bytesToSend[bi] = 0;
         FPGA_DataPacket* pkt = reinterpret_cast<FPGA_DataPacket*>(&buffers[bi*bufferSize]);
+        uint64_t encodeTime = 0;
         int i=0;
         do
         {
             bool has_samples = false;
+            bool payloadCopied = false;
+            //players begin together once all channels they are attached to are started,
+            //so channels started one after another still play aligned files in sync
+            bool playersWaiting = false;
+            for(int ch=0; ch<maxChannelCount; ++ch)
+                if (mTxStreams[ch].used && !mTxStreams[ch].mActive && txPlayers[ch].load())
+                    playersWaiting = true;
             int payloadSize = sizeof(FPGA_DataPacket::data);
             for(int ch=0; ch<maxChannelCount; ++ch)
             {
@@ -735,7 +1035,25 @@ void Streamer::TransmitPacketsLoop()
                     memset(packets[ind].samples,0,maxSamplesBatch*sizeof(complex16_t));
                     continue;
                 }
-                mTxStreams[ch].fifo->pop_packet(packets[ind]);
+                txPlayerBusy[ch].store(true);
+                StreamPlayer* player = txPlayers[ch].load();
+                if (player && playersWaiting && !player->IsStarted())
+                {
+                    txPlayerBusy[ch].store(false);
+                    memset(packets[ind].samples,0,maxSamplesBatch*sizeof(complex16_t));
+                    continue;
+                }
+                if (player && chCount == 1 && player->CopiesPayload(packed))
+                {
+                    //file already holds link format samples, no conversion needed
+                    player->ReadPayload((uint8_t*)pkt[i].data, packets[ind], maxSamplesBatch);
+                    payloadCopied = true;
+                }
+                else if (player)
+                    player->Read(packets[ind], maxSamplesBatch);
+                else
+                    mTxStreams[ch].fifo->pop_packet(packets[ind]);
+                txPlayerBusy[ch].store(false);
                 int samplesPopped = packets[ind].last;
                 if (samplesPopped != maxSamplesBatch)
                 {
@@ -760,11 +1078,21 @@ void Streamer::TransmitPacketsLoop()
             pkt[i].reserved[0] |= ((int)ignoreTimestamp << 4); //ignore timestamp
             pkt[i].reserved[1] = payloadSize & 0xFF;
             pkt[i].reserved[2] = (payloadSize >> 8) & 0xFF;
-            std::vector<complex16_t*> src(chCount);
-            for(uint8_t c=0; c<chCount; ++c)
-                src[c] = (packets[c].samples);
-            uint8_t* const dataStart = (uint8_t*)pkt[i].data;
-            FPGA::Samples2FPGAPacketPayload(src.data(), maxSamplesBatch, chCount==2, packed, dataStart);
+            if (!ignoreTimestamp) //lead over the most recent received timestamp
+            {
+                const uint64_t rxTs = rxLastTimestamp.load(std::memory_order_relaxed);
+                RecordTelemetry(mTxStreams, &StreamTelemetry::txLeadTime, pkt[i].counter > rxTs ? pkt[i].counter - rxTs : 0);
+            }
+            const uint64_t encodeStart = StreamTelemetry::Now();
+            if (!payloadCopied)
+            {
+                std::vector<complex16_t*> src(chCount);
+                for(uint8_t c=0; c<chCount; ++c)
+                    src[c] = (packets[c].samples);
+                uint8_t* const dataStart = (uint8_t*)pkt[i].data;
+                FPGA::Samples2FPGAPacketPayload(src.data(), maxSamplesBatch, chCount==2, packed, dataStart);
+            }
+            encodeTime += StreamTelemetry::Now() - encodeStart;
             bytesToSend[bi] += 16+payloadSize;
         }while(++i<packetsToBatch && end_burst == false);
 
@@ -773,6 +1101,7 @@ void Streamer::TransmitPacketsLoop()
 
         if (i)
         {
+            RecordTelemetry(mTxStreams, &StreamTelemetry::processingTime, encodeTime);
             handles[bi] = dataPort->BeginDataSending(&buffers[bi*bufferSize], bytesToSend[bi], epIndex);
             txLastTimestamp.store(pkt[i-1].counter+maxSamplesBatch-1, std::memory_order_relaxed); //timestamp of the last sample that was sent to HW
             bufferUsed[bi] = true;
@@ -814,8 +1143,13 @@ void Streamer::ReceivePacketsLoop()
     const uint8_t buffersCount = dataPort->GetBuffersCount();
     const uint8_t packetsToBatch = dataPort->CheckStreamSize(rxBatchSize);
     const uint32_t bufferSize = packetsToBatch*sizeof(FPGA_DataPacket);
+
+    //pin before allocating buffers not reserved at setup, so they are placed on the thread's NUMA node
+    if (!rxCPUs.empty())
+        SetOSCurrentThreadAffinity(rxCPUs);
     std::vector<int> handles(buffersCount, 0);
-    std::vector<char>buffers(buffersCount*bufferSize, 0);
+    std::vector<char> heapBuffers;
+    char* buffers = GetTransferBuffers(false, buffersCount*bufferSize, heapBuffers);
     std::vector<SamplesPacket> chFrames;
 
     for (int i = 0; i<maxChannelCount; ++i)
@@ -832,6 +1166,7 @@ void Streamer::ReceivePacketsLoop()
 
     int resetFlagsDelay = 0;
     uint64_t prevTs = 0;
+    uint64_t lastCompletion = 0;
     while (terminateRx.load(std::memory_order_relaxed) == false)
     {
         int32_t bytesReceived = 0;
@@ -849,49 +1184,28 @@ void Streamer::ReceivePacketsLoop()
                 continue;
             }
         }
+        const uint64_t completed = StreamTelemetry::Now();
+        if (bytesReceived > 0)
+        {
+            if (rxTrace)
+                rxTrace->Append(&buffers[bi*bufferSize], bytesReceived, completed);
+            if (lastCompletion)
+                RecordTelemetry(mRxStreams, &StreamTelemetry::transferInterval, completed - lastCompletion);
+            lastCompletion = completed;
+        }
+        const FPGA_DataPacket* pkt = (FPGA_DataPacket*)&buffers[bi*bufferSize];
         for (uint8_t pktIndex = 0; pktIndex < bytesReceived / sizeof(FPGA_DataPacket); ++pktIndex)
         {
-            const FPGA_DataPacket* pkt = (FPGA_DataPacket*)&buffers[bi*bufferSize];
-            const uint8_t byte0 = pkt[pktIndex].reserved[0];
-            if ((byte0 & (1 << 3)) != 0)
-            {
-                if(resetFlagsDelay > 0)
-                    --resetFlagsDelay;
-                else
-                {
-                    lime::debug("L");
-                    resetFlagsDelay = buffersCount*2;
-                }
-                for(auto &value: mTxStreams)
-                    if (value.used && value.mActive)
-                        value.pktLost++;
-            }
-            uint8_t* pktStart = (uint8_t*)pkt[pktIndex].data;
-            if(pkt[pktIndex].counter - prevTs != samplesInPacket && pkt[pktIndex].counter != prevTs)
-            {
-                int packetLoss = ((pkt[pktIndex].counter - prevTs)/samplesInPacket)-1;
-                for(auto &value: mRxStreams)
-                    if (value.used && value.mActive)
-                        value.pktLost += packetLoss;
-            }
-            prevTs = pkt[pktIndex].counter;
-            rxLastTimestamp.store(prevTs, std::memory_order_relaxed);
+            ParseRxPacketHeader(pkt[pktIndex], samplesInPacket, prevTs, resetFlagsDelay, buffersCount);
             //parse samples
             std::vector<complex16_t*> dest(chCount);
             for(uint8_t c=0; c<chCount; ++c)
                 dest[c] = (chFrames[c].samples);
-            int samplesCount = FPGA::FPGAPacketPayload2Samples(pktStart, 4080, chCount==2, packed, dest.data());
-
-            for(int ch=0; ch<maxChannelCount; ++ch)
-            {
-                if (mRxStreams[ch].used==false || mRxStreams[ch].mActive==false)
-                    continue;
-                const int ind = chCount == maxChannelCount ? ch : 0;
-                chFrames[ind].timestamp = pkt[pktIndex].counter;
-                chFrames[ind].last = samplesCount;
-                mRxStreams[ch].fifo->push_packet(chFrames[ind]);
-            }
+            int samplesCount = FPGA::FPGAPacketPayload2Samples(pkt[pktIndex].data, 4080, chCount==2, packed, dest.data());
+            PushRxFrames(chFrames.data(), pkt[pktIndex].counter, samplesCount);
         }
+        if (bytesReceived > 0)
+            RecordTelemetry(mRxStreams, &StreamTelemetry::processingTime, StreamTelemetry::Now() - completed);
         // Re-submit this request to keep the queue full
         handles[bi] = dataPort->BeginDataReading(&buffers[bi*bufferSize], bufferSize, epIndex);
         bi = (bi + 1) & (buffersCount-1);
@@ -914,4 +1228,231 @@ void Streamer::ReceivePacketsLoop()
     rxDataRate_Bps.store(0, std::memory_order_relaxed);
 }
 
+
+void Streamer::ParseRxPacketHeader(const FPGA_DataPacket &pkt, uint32_t samplesInPacket, uint64_t &prevTs, int &resetFlagsDelay, int buffersCount)
+{
+    const uint8_t byte0 = pkt.reserved[0];
+    if ((byte0 & (1 << 3)) != 0)
+    {
+        if(resetFlagsDelay > 0)
+            --resetFlagsDelay;
+        else
+        {
+            lime::debug("L");
+            resetFlagsDelay = buffersCount*2;
+        }
+        for(auto &value: mTxStreams)
+            if (value.used && value.mActive)
+                value.pktLost++;
+    }
+    if(pkt.counter - prevTs != samplesInPacket && pkt.counter != prevTs)
+    {
+        int packetLoss = ((pkt.counter - prevTs)/samplesInPacket)-1;
+        for(auto &value: mRxStreams)
+            if (value.used && value.mActive)
+                value.pktLost += packetLoss;
+    }
+    prevTs = pkt.counter;
+    rxLastTimestamp.store(prevTs, std::memory_order_relaxed);
+}
+
+void Streamer::PushRxFrames(SamplesPacket* frames, uint64_t timestamp, int samplesCount)
+{
+    const uint8_t maxChannelCount = 2;
+    for(int ch=0; ch<maxChannelCount; ++ch)
+    {
+        if (mRxStreams[ch].used==false || mRxStreams[ch].mActive==false)
+            continue;
+        const int ind = streamSize == maxChannelCount ? ch : 0;
+        frames[ind].timestamp = timestamp;
+        frames[ind].last = samplesCount;
+        mRxStreams[ch].fifo->push_packet(frames[ind]);
+    }
+}
+
+/** @brief Receives data samples using separate threads for link transfers and packet decoding.
+    Transfer thread fills batches in sequence; decode workers claim batches in any order
+    but hand decoded packets to FIFOs strictly in sequence, so FIFOs keep a single producer.
+*/
+void Streamer::ReceivePacketsPipelined()
+{
+    const uint8_t chCount = streamSize;
+    const bool packed = dataLinkFormat == StreamConfig::FMT_INT12;
+    const uint32_t samplesInPacket = (packed  ? samples12InPkt : samples16InPkt)/chCount;
+
+    const int epIndex = chipId;
+    const uint8_t buffersCount = dataPort->GetBuffersCount();
+    const uint8_t packetsToBatch = dataPort->CheckStreamSize(rxBatchSize);
+    const uint32_t bufferSize = packetsToBatch*sizeof(FPGA_DataPacket);
+
+    //pin before allocating buffers not reserved at setup, so they are placed on the thread's NUMA node
+    if (!rxCPUs.empty())
+        SetOSCurrentThreadAffinity(rxCPUs);
+    const unsigned workersCount = rxDecodeThreads;
+    const unsigned poolSize = buffersCount + 2*workersCount;
+
+    //batch slot is free for sequence s when seq == s, holds received data when seq == s+1
+    struct Batch
+    {
+        std::atomic<uint64_t> seq;
+        int32_t bytesReceived;
+        std::vector<SamplesPacket> frames;
+    };
+    std::vector<Batch> pool(poolSize);
+    std::vector<char> heapBuffers;
+    char* buffers = GetTransferBuffers(false, poolSize*bufferSize, heapBuffers);
+    for (unsigned i = 0; i < poolSize; ++i)
+    {
+        pool[i].seq.store(i, std::memory_order_relaxed);
+        pool[i].bytesReceived = 0;
+        for (int j = 0; j < packetsToBatch*chCount; ++j)
+            pool[i].frames.emplace_back(samplesInPacket);
+    }
+
+    std::atomic<uint64_t> nextDecode(0);
+    std::atomic<uint64_t> nextCommit(0);
+    std::atomic<bool> stopWorkers(false);
+    AdaptiveWait hasBatch, hasFreeBatch, committed;
+    uint64_t prevTs = 0; //owned by the worker which is committing
+    int resetFlagsDelay = 0;
+
+    auto DecodeLoop = [&]()
+    {
+        if (!rxDecodeCPUs.empty()) //otherwise inherited from Rx thread
+            SetOSCurrentThreadAffinity(rxDecodeCPUs);
+        std::vector<int> samplesCount(packetsToBatch); //per packet of batch, reused by every batch
+        while (stopWorkers.load(std::memory_order_relaxed) == false)
+        {
+            uint64_t s = nextDecode.load(std::memory_order_acquire);
+            Batch &batch = pool[s % poolSize];
+            if (batch.seq.load(std::memory_order_acquire) != s + 1)
+            {
+                hasBatch.wait_for([&]{
+                    const uint64_t n = nextDecode.load(std::memory_order_acquire);
+                    return stopWorkers.load(std::memory_order_relaxed) || pool[n % poolSize].seq.load(std::memory_order_acquire) == n + 1;
+                }, 100);
+                continue;
+            }
+            if (!nextDecode.compare_exchange_weak(s, s + 1, std::memory_order_acq_rel))
+                continue;
+
+            const uint64_t decodeStart = StreamTelemetry::Now();
+            const FPGA_DataPacket* pkt = (FPGA_DataPacket*)&buffers[(s % poolSize)*bufferSize];
+            const int packetsCount = batch.bytesReceived / sizeof(FPGA_DataPacket);
+            for (int p = 0; p < packetsCount; ++p)
+            {
+                complex16_t* dest[2];
+                for(uint8_t c=0; c<chCount; ++c)
+                    dest[c] = batch.frames[p*chCount + c].samples;
+                samplesCount[p] = FPGA::FPGAPacketPayload2Samples(pkt[p].data, 4080, chCount==2, packed, dest);
+            }
+
+            uint64_t decodeTime = StreamTelemetry::Now() - decodeStart;
+
+            //wait for preceding batches to be committed
+            while (nextCommit.load(std::memory_order_acquire) != s)
+            {
+                committed.wait_for([&]{ return stopWorkers.load(std::memory_order_relaxed) || nextCommit.load(std::memory_order_acquire) == s; }, 100);
+                if (stopWorkers.load(std::memory_order_relaxed))
+                    return;
+            }
+            const uint64_t commitStart = StreamTelemetry::Now();
+            for (int p = 0; p < packetsCount; ++p)
+            {
+                ParseRxPacketHeader(pkt[p], samplesInPacket, prevTs, resetFlagsDelay, buffersCount);
+                PushRxFrames(&batch.frames[p*chCount], pkt[p].counter, samplesCount[p]);
+            }
+            if (packetsCount > 0)
+            {
+                decodeTime += StreamTelemetry::Now() - commitStart;
+                RecordTelemetry(mRxStreams, &StreamTelemetry::processingTime, decodeTime);
+            }
+            batch.seq.store(s + poolSize, std::memory_order_release);
+            hasFreeBatch.notify();
+            nextCommit.store(s + 1, std::memory_order_release);
+            committed.notify();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < workersCount; ++i)
+    {
+        workers.push_back(std::thread(DecodeLoop));
+        SetOSThreadPriority(ThreadPriority::NORMAL, ThreadPolicy::REALTIME, &workers.back());
+    }
+
+    //link requests are completed in the order they were submitted
+    std::vector<int> handles(buffersCount, 0);
+    for (int i = 0; i<buffersCount; ++i)
+        handles[i] = dataPort->BeginDataReading(&buffers[i*bufferSize], bufferSize, epIndex);
+    uint64_t completeSeq = 0;
+    uint64_t submitSeq = buffersCount;
+
+    unsigned long totalBytesReceived = 0; //for data rate calculation
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto t2 = t1;
+    uint64_t lastCompletion = 0;
+
+    while (terminateRx.load(std::memory_order_relaxed) == false)
+    {
+        int32_t bytesReceived = 0;
+        const int hi = completeSeq % buffersCount;
+        const unsigned bi = completeSeq % poolSize;
+        if(handles[hi] >= 0)
+        {
+            if (dataPort->WaitForReading(handles[hi], 1000) == true)
+            {
+                bytesReceived = dataPort->FinishDataReading(&buffers[bi*bufferSize], bufferSize, handles[hi]);
+                totalBytesReceived += bytesReceived;
+                const uint64_t completed = StreamTelemetry::Now();
+                if (rxTrace && bytesReceived > 0)
+                    rxTrace->Append(&buffers[bi*bufferSize], bytesReceived, completed);
+                if (lastCompletion)
+                    RecordTelemetry(mRxStreams, &StreamTelemetry::transferInterval, completed - lastCompletion);
+                lastCompletion = completed;
+            }
+            else
+            {
+                rxDataRate_Bps.store(totalBytesReceived, std::memory_order_relaxed);
+                totalBytesReceived = 0;
+                continue;
+            }
+        }
+        pool[bi].bytesReceived = bytesReceived;
+        pool[bi].seq.store(completeSeq + 1, std::memory_order_release);
+        hasBatch.notify();
+        ++completeSeq;
+
+        // Re-submit a free buffer to keep the queue full
+        Batch &next = pool[submitSeq % poolSize];
+        while (next.seq.load(std::memory_order_acquire) != submitSeq && terminateRx.load(std::memory_order_relaxed) == false)
+            hasFreeBatch.wait_for([&]{ return next.seq.load(std::memory_order_acquire) == submitSeq; }, 100);
+        if (terminateRx.load(std::memory_order_relaxed))
+            break;
+        handles[submitSeq % buffersCount] = dataPort->BeginDataReading(&buffers[(submitSeq % poolSize)*bufferSize], bufferSize, epIndex);
+        ++submitSeq;
+
+        t2 = std::chrono::high_resolution_clock::now();
+        auto timePeriod = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+        if (timePeriod >= 1000)
+        {
+            t1 = t2;
+            //total number of bytes sent per second
+            double dataRate = 1000.0*totalBytesReceived / timePeriod;
+#ifndef NDEBUG
+            lime::log(LOG_LEVEL_DEBUG, "Rx: %.3f MB/s\n", dataRate / 1000000.0);
+#endif
+            totalBytesReceived = 0;
+            rxDataRate_Bps.store((uint32_t)dataRate, std::memory_order_relaxed);
+        }
+    }
+    stopWorkers.store(true, std::memory_order_relaxed);
+    hasBatch.notify();
+    committed.notify();
+    for (auto &w : workers)
+        w.join();
+    dataPort->AbortReading(epIndex);
+    rxDataRate_Bps.store(0, std::memory_order_relaxed);
+}
+
 }
@@ -14,9 +14,12 @@
 #ifndef STREAMER_H
 #define STREAMER_H
 
+#include "LimeSuiteConfig.h"
 #include "dataTypes.h"
 #include "fifo.h"
+#include "StreamTelemetry.h"
 #include <vector>
+#include <utility>
 
 namespace lime
 {
@@ -25,13 +28,15 @@ class IConnection;
 class FPGA;
 class Streamer;
 class LMS7002M;
+class StreamPlayer;
+class LinkTraceWriter;
 
 /*!
  * The stream config structure is used with the SetupStream() API.
  */
 struct LIME_API StreamConfig
 {
-    StreamConfig(void){};
+    StreamConfig(void) : decodeThreads(0) {};
 
     //! True for transmit stream, false for receive
     bool isTx;
@@ -66,6 +71,23 @@ struct LIME_API StreamConfig
      * Default: STREAM_12_BIT_IN_16
      */
     StreamDataFormat linkFormat;
+
+    /*!
+     * Number of worker threads decoding received packets.
+     * Transfer thread then only recycles link buffers.
+     * Default: 0, packets are decoded by the transfer thread
+     */
+    uint8_t decodeThreads;
+
+    //! CPUs decode threads are allowed to run on, empty to use threadCPUs
+    std::vector<int> decodeCPUs;
+
+    /*!
+     * CPUs the RX or TX streaming thread is allowed to run on.
+     * Stream buffers are allocated from these CPUs, placing
+     * them on their NUMA node. Empty for no restriction
+     */
+    std::vector<int> threadCPUs;
 };
 
 class LIME_API StreamChannel
@@ -96,7 +118,25 @@ public:
     void Close();
     int Read(void* samples, const uint32_t count, Metadata* meta, const int32_t timeout_ms = 100);
     int Write(const void* samples, const uint32_t count, const Metadata* meta, const int32_t timeout_ms = 100);
+    /** @brief Zero-copy read, gives access to one packet inside RX FIFO.
+        Samples are in link format scale. Packet must be returned with ReleaseRead().
+        @return number of samples in packet, 0 on timeout, (-1) on Tx stream
+    */
+    int AcquireRead(size_t& handle, const complex16_t** samples, Metadata* meta, const int32_t timeout_ms = 100);
+    void ReleaseRead(size_t handle);
+    /** @brief Zero-copy write, gives access to free space of one packet inside TX FIFO.
+        Samples must be written in link format scale and committed with CommitWrite().
+        Short commits keep filling the same packet, it is sent once full or on END_BURST.
+        @return number of samples that fit, 0 on timeout, (-1) on Rx stream
+    */
+    int AcquireWrite(size_t& handle, complex16_t** samples, const int32_t timeout_ms = 100);
+    int CommitWrite(size_t handle, const uint32_t count, const Metadata* meta);
+    int GetBufferCount();
     StreamChannel::Info GetInfo();
+    /** @brief Returns stage timing histograms of this channel
+        @param reset clear histograms after reading
+    */
+    StreamTelemetry::Snapshot GetTelemetry(bool reset = false);
     int GetStreamSize();
 
     bool IsActive() const;
@@ -108,11 +148,18 @@ public:
     bool mActive;
     bool used;
     RingFIFO* fifo;
+    StreamTelemetry* telemetry;
+    //! Tx samples are taken from player instead of FIFO while it is set
+    StreamPlayer* GetPlayer() const;
+    /** @brief Attaches player to Tx channel, nullptr detaches it.
+        Detaching returns only after Tx thread has stopped reading from previous player.
+    */
+    void SetPlayer(StreamPlayer* player);
 protected:
 
 };
 
-class Streamer
+class LIME_API Streamer
 {
 public:
     Streamer(FPGA* f, LMS7002M* chip, int id);
@@ -135,6 +182,8 @@ public:
 
     std::vector<StreamChannel> mRxStreams;
     std::vector<StreamChannel> mTxStreams;
+    std::atomic<StreamPlayer*> txPlayers[2];
+    std::atomic<bool> txPlayerBusy[2]; //set while Tx thread reads from player of channel
     std::atomic<uint64_t> rxLastTimestamp;
     std::atomic<uint64_t> txLastTimestamp;
     uint64_t mTimestampOffset;
@@ -143,8 +192,29 @@ public:
     unsigned rxBatchSize;
     StreamConfig::StreamDataFormat dataLinkFormat;
     void ReceivePacketsLoop();
+    void ReceivePacketsPipelined();
     void TransmitPacketsLoop();
+    unsigned rxDecodeThreads;
+    std::vector<int> rxDecodeCPUs;
+    std::vector<int> rxCPUs;
+    std::vector<int> txCPUs;
+    StreamArena arena;
+    void ResizeFIFO(StreamChannel &channel, int pktSize, int bufSize);
+    void ReleaseArena();
 private:
+    char* GetTransferBuffers(bool tx, size_t size, std::vector<char> &heapBuffers);
+    char* rxTransferBuffers;
+    char* txTransferBuffers;
+    size_t rxTransferSize;
+    size_t txTransferSize;
+    std::vector<std::pair<char*, size_t> > mDeviceBuffers; //allocated by connection
+    std::vector<RingFIFO*> mRetiredFIFOs; //replaced while stream thread was running
+    void FreeDeviceBuffers();
+    LinkTraceWriter* rxTrace; //set while Rx transfers are recorded
+    void StartRxTrace();
+    void StopRxTrace();
+    void ParseRxPacketHeader(const FPGA_DataPacket &pkt, uint32_t samplesInPacket, uint64_t &prevTs, int &resetFlagsDelay, int buffersCount);
+    void PushRxFrames(SamplesPacket* frames, uint64_t timestamp, int samplesCount);
     void ResizeChannelBuffers();
     void AlignRxTSP();
     void AlignRxRF(bool restoreValues);
@@ -35,7 +35,16 @@ public:
         timestamp(0),
         last(0),
         flags(0),
-        samples(size ? new complex16_t[size]: nullptr)  {};
+        samples(size ? new complex16_t[size](): nullptr),
+        owned(true) {};
+
+    //! Uses external buffer, which is not freed by packet
+    SamplesPacket(complex16_t* buffer):
+        timestamp(0),
+        last(0),
+        flags(0),
+        samples(buffer),
+        owned(false) {};
 
     SamplesPacket (SamplesPacket&& pkt)
     {
@@ -43,6 +52,7 @@ public:
         last = pkt.last;
         flags = pkt.flags;
         samples = pkt.samples;
+        owned = pkt.owned;
         pkt.samples = nullptr;
     };
 
@@ -52,16 +62,19 @@ public:
         last = pkt.last;
         flags = pkt.flags;
         std::swap(samples, pkt.samples);
+        std::swap(owned, pkt.owned);
         return *this;
     }
     ~SamplesPacket()
     {
-        if (samples)
+        if (samples && owned)
             delete [] samples;
     };
 
     SamplesPacket (const SamplesPacket&) = delete;
     SamplesPacket& operator=(const SamplesPacket&) = delete;
+private:
+    bool owned; //buffer ownership travels with buffer when packets are swapped
 };
 
 }// namespace lime
@@ -7,12 +7,150 @@
 #include <vector>
 #include <thread>
 #include <queue>
+#include <chrono>
 #include "dataTypes.h"
+#include "StreamArena.h"
+#include "StreamTelemetry.h"
 #include <cmath>
 #include <assert.h>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace lime{
 
+//! @brief CPU hint used inside busy-wait loops
+static inline void CpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(_M_IX86) || defined(_M_X64)
+    _mm_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && (__ARM_ARCH >= 7 || defined(__ARM_ARCH_6K__)))
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/** @brief Wake-up signal for lock-free queues.
+
+    Waiters spin for an adaptively tuned number of iterations before going to
+    sleep on a futex (condition variable on non-Linux systems). Notify() only
+    enters the kernel when some thread is actually sleeping, so the producer
+    hot path is a fence and a relaxed load.
+*/
+class AdaptiveWait
+{
+public:
+    AdaptiveWait() : mEpoch(0), mSleepers(0), mSpinLimit(cMaxSpin/4) {}
+
+    /** @brief Waits until ready() returns true or timeout expires
+        @param ready predicate checked after every wake-up
+        @param timeout_ms maximum time to wait
+        @return true if predicate was satisfied
+    */
+    template<typename Predicate>
+    bool wait_for(Predicate ready, const uint32_t timeout_ms)
+    {
+        const int spinLimit = mSpinLimit.load(std::memory_order_relaxed);
+        for (int i = 0; i < spinLimit; ++i)
+        {
+            if (ready())
+            {
+                if (spinLimit < cMaxSpin)
+                    mSpinLimit.store(spinLimit + 1 + spinLimit/8, std::memory_order_relaxed);
+                return true;
+            }
+            CpuRelax();
+        }
+        if (spinLimit > cMinSpin)
+            mSpinLimit.store(spinLimit - 1 - spinLimit/16, std::memory_order_relaxed);
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true)
+        {
+            mSleepers.fetch_add(1, std::memory_order_seq_cst);
+            const uint32_t epoch = mEpoch.load(std::memory_order_seq_cst);
+            if (ready())
+            {
+                mSleepers.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+            {
+                mSleepers.fetch_sub(1, std::memory_order_relaxed);
+                return false;
+            }
+            Sleep(epoch, std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count());
+            mSleepers.fetch_sub(1, std::memory_order_relaxed);
+            if (ready())
+                return true;
+        }
+    }
+
+    //! @brief Wakes all sleeping waiters, cheap when nobody sleeps
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mSleepers.load(std::memory_order_relaxed) == 0)
+            return;
+#ifdef __linux__
+        mEpoch.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mEpoch), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+        {
+            std::lock_guard<std::mutex> lck(mLock);
+            mEpoch.fetch_add(1, std::memory_order_seq_cst);
+        }
+        mCond.notify_all();
+#endif
+    }
+
+private:
+    void Sleep(uint32_t epoch, long long timeout_us)
+    {
+#ifdef __linux__
+        static_assert(sizeof(mEpoch) == sizeof(uint32_t), "futex word must be 32 bits");
+        timespec ts;
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = (timeout_us % 1000000) * 1000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mEpoch), FUTEX_WAIT_PRIVATE, epoch, &ts, nullptr, 0);
+#else
+        std::unique_lock<std::mutex> lck(mLock);
+        if (mEpoch.load(std::memory_order_relaxed) == epoch)
+            mCond.wait_for(lck, std::chrono::microseconds(timeout_us));
+#endif
+    }
+
+    static const int cMinSpin = 16;
+    static const int cMaxSpin = 4096;
+    std::atomic<uint32_t> mEpoch;
+    std::atomic<uint32_t> mSleepers;
+    std::atomic<int> mSpinLimit;
+#ifndef __linux__
+    std::mutex mLock;
+    std::condition_variable mCond;
+#endif
+};
+
+/** @brief Single producer, single consumer packet ring.
+
+    Every slot carries a sequence number: slot is free for the producer when
+    seq == position, and holds data for the consumer when seq == position+1.
+    When the ring is full push_packet() drops the oldest packet by advancing
+    the read index itself, so the consumer and the dropping producer both
+    claim packets with a CAS on mHead. No locks are taken on either side.
+*/
 class RingFIFO
 {
 public:
@@ -35,18 +173,20 @@ public:
     BufferInfo GetInfo()
     {
         BufferInfo stats;
-        std::unique_lock<std::mutex> lck(lock);
+        const uint64_t tail = mTail.load(std::memory_order_relaxed);
+        const uint64_t head = mHead.load(std::memory_order_relaxed);
         stats.size = mBufferSize*mPktSize;
-        stats.itemsFilled = mElementsFilled*mPktSize;
-        stats.overflow = mOverflow;
-        stats.underflow = mUnderflow;
-        mOverflow = 0;
-        mUnderflow = 0;
+        stats.itemsFilled = tail > head ? (tail-head)*mPktSize : 0;
+        stats.overflow = mOverflow.exchange(0, std::memory_order_relaxed);
+        stats.underflow = mUnderflow.exchange(0, std::memory_order_relaxed);
         return stats;
     }
 
-    //!    @brief Initializes FIFO memory
-    RingFIFO() :  mBuffer(nullptr), mPktSize(0), mBufferSize(0)
+    /** @brief Initializes FIFO memory
+        @param arena optional memory for packet buffers, must outlive FIFO. Packet buffers
+        go back to arena when FIFO is resized or destroyed, packets taken out of FIFO must not be used after that.
+    */
+    RingFIFO(StreamArena* arena = nullptr) :  mBuffer(nullptr), mPktSize(0), mBufferSize(0), mArena(arena), mArenaBlock(nullptr), mTelemetry(nullptr)
     {
         Clear();
     }
@@ -55,29 +195,54 @@ public:
     {
         if (mBuffer)
             delete [] mBuffer;
+        if (mArena)
+            mArena->Free(mArenaBlock);
     };
 
+    /** @brief inserts packet to FIFO, drops the oldest packet if FIFO is full
+        @param packet packet to insert, receives a free buffer in exchange
+    */
     void push_packet(SamplesPacket &packet)
     {
-        std::unique_lock<std::mutex> lck(lock);
+        const uint64_t pos = mTail.load(std::memory_order_relaxed);
+        Slot &slot = mBuffer[pos % mBufferSize];
 
-        if (mElementsFilled >= mBufferSize) //buffer might be full, wait for free slots
+        if (slot.seq.load(std::memory_order_acquire) != pos) //buffer full, drop oldest packet
         {
-                mHead = (mHead + 1) % mBufferSize;//advance to next one
-                mElementsFilled--;
-                mFirst = 0;
-                mOverflow++;
+            uint64_t oldest = pos - mBufferSize;
+            if (mHead.compare_exchange_strong(oldest, oldest + 1, std::memory_order_acq_rel))
+            {
+                mOverflow.fetch_add(1, std::memory_order_relaxed);
+                slot.seq.store(pos, std::memory_order_relaxed);
+            }
+            else if (slot.held.load(std::memory_order_acquire)) //zero-copy reader holds it, drop incoming packet
+            {
+                mOverflow.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else //consumer is moving it out, wait briefly
+            {
+                int spins = 0;
+                while (slot.seq.load(std::memory_order_acquire) != pos)
+                {
+                    if (++spins > cReleaseSpin) //drop incoming packet instead
+                    {
+                        mOverflow.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+                    CpuRelax();
+                }
+            }
         }
 
-        mBuffer[mTail] = std::move(packet);
-        mTail  = (mTail + 1) % mBufferSize;//advance to next one
-        ++mElementsFilled;
-
-        lck.unlock();
-        hasItems.notify_one();
+        slot.packet = std::move(packet);
+        slot.seq.store(pos + 1, std::memory_order_release);
+        mTail.store(pos + 1, std::memory_order_relaxed);
+        hasItems.notify();
+        update_high_water(pos + 1);
     }
 
-    /** @brief inserts samples to FIFO, operation is thread-safe
+    /** @brief inserts samples to FIFO, only one thread may push at a time
     @param buffer pointer to array containing samples data
     @param samplesCount number of samples to insert from each buffer channel
     @param timeout_ms timeout duration for operation
@@ -87,47 +252,60 @@ public:
     uint32_t push_samples(const complex16_t *buffer, const uint32_t samplesCount, uint64_t timestamp, const uint32_t timeout_ms, const uint32_t flags)
     {
         assert(buffer != nullptr);
+        return push_converted([buffer](complex16_t* dest, uint32_t offset, int cnt){
+            memcpy(dest, &buffer[offset], cnt*sizeof(complex16_t));
+        }, samplesCount, timestamp, timeout_ms, flags);
+    }
+
+    /** @brief inserts samples to FIFO, writing them straight into packet buffers
+    @param convert functor (complex16_t* dest, uint32_t offset, int count) that
+           stores count samples starting at source sample offset into dest
+    @param samplesCount number of samples to insert
+    @param timeout_ms timeout duration for operation
+    @param flags optional flags associated with the samples
+    @return number of items inserted
+    */
+    template<typename Convert>
+    uint32_t push_converted(Convert convert, const uint32_t samplesCount, uint64_t timestamp, const uint32_t timeout_ms, const uint32_t flags)
+    {
         uint32_t samplesTaken = 0;
-        std::unique_lock<std::mutex> lck(lock);
-        auto t1 = std::chrono::high_resolution_clock::now();
         while (samplesTaken < samplesCount)
         {
-            if (mElementsFilled >= mBufferSize) //buffer might be full, wait for free slots
+            const uint64_t pos = mTail.load(std::memory_order_relaxed);
+            Slot &slot = mBuffer[pos % mBufferSize];
+            if (slot.seq.load(std::memory_order_acquire) != pos) //buffer full, wait for free slots
             {
-                auto elapsed = std::chrono::high_resolution_clock::now()-t1;
-                if(elapsed >= std::chrono::milliseconds(timeout_ms))
+                if (!wait_space([&slot, pos]{ return slot.seq.load(std::memory_order_acquire) == pos; }, timeout_ms))
                     return samplesTaken;
-                hasItems.wait_for(lck, std::chrono::milliseconds(timeout_ms)-elapsed);
+                continue;
+            }
+            SamplesPacket &pkt = slot.packet;
+            pkt.timestamp = timestamp + samplesTaken - mLast;
+            int cnt = samplesCount-samplesTaken;
+            if (cnt > mPktSize - mLast)
+            {
+                cnt = mPktSize - mLast;
+                pkt.flags = flags & SYNC_TIMESTAMP;
             }
             else
+                pkt.flags = flags;
+            convert(pkt.samples + mLast, samplesTaken, cnt);
+            samplesTaken+=cnt;
+            mLast += cnt;
+            pkt.last = mLast;
+            if ((mLast == mPktSize) || (pkt.flags&END_BURST))
             {
-                mBuffer[mTail].timestamp = timestamp + samplesTaken - mLast;
-                int cnt = samplesCount-samplesTaken;
-                if (cnt > mPktSize - mLast)
-                {
-                    cnt = mPktSize - mLast;
-                    mBuffer[mTail].flags = flags & SYNC_TIMESTAMP;
-                }
-                else
-                    mBuffer[mTail].flags = flags;
-                memcpy(mBuffer[mTail].samples + mLast,&buffer[samplesTaken],cnt*sizeof(complex16_t));
-                samplesTaken+=cnt;
-                mLast += cnt;
-                mBuffer[mTail].last = mLast;
-                if ((mLast == mPktSize) || (mBuffer[mTail].flags&END_BURST))
-                {
-                    mTail = (mTail+1) % mBufferSize;//advance to next one
-                    ++mElementsFilled;
-                    mLast = 0;
-                }
+                slot.seq.store(pos + 1, std::memory_order_release);
+                mTail.store(pos + 1, std::memory_order_relaxed);
+                mLast = 0;
+                hasItems.notify();
+                update_high_water(pos + 1);
             }
         }
-        lck.unlock();
-        hasItems.notify_one();
         return samplesTaken;
     }
 
-    /** @brief Takes samples out of FIFO, operation is thread-safe
+    /** @brief Takes samples out of FIFO, only one thread may pop at a time
         @param buffer pointer to destination arrays for each channel samples data, each array must be big enough to contain \samplesCount number of samples.
         @param samplesCount number of samples to pop
         @param timestamp returns timestamp of the first sample in buffer
@@ -137,109 +315,357 @@ public:
     uint32_t pop_samples(complex16_t* buffer, const uint32_t samplesCount, uint64_t *timestamp, const uint32_t timeout_ms)
     {
         assert(buffer != nullptr);
+        return pop_converted([buffer](const complex16_t* src, uint32_t offset, int cnt){
+            memcpy(&buffer[offset], src, cnt*sizeof(complex16_t));
+        }, samplesCount, timestamp, timeout_ms);
+    }
+
+    /** @brief Takes samples out of FIFO, reading them straight from packet buffers
+        @param convert functor (const complex16_t* src, uint32_t offset, int count)
+               that stores count samples to destination starting at sample offset
+        @param samplesCount number of samples to pop
+        @param timestamp returns timestamp of the first sample in buffer
+        @param timeout_ms timeout duration for operation
+        @return number of samples popped
+    */
+    template<typename Convert>
+    uint32_t pop_converted(Convert convert, const uint32_t samplesCount, uint64_t *timestamp, const uint32_t timeout_ms)
+    {
         uint32_t samplesFilled = 0;
-        std::unique_lock<std::mutex> lck(lock);
         while (samplesFilled < samplesCount)
         {
-            while (mElementsFilled == 0) //buffer might be empty, wait for packets
+            if (mFirst >= (int32_t)mReadPkt.last) //current packet depleted, take next one
             {
-                if ((timeout_ms==0) || (hasItems.wait_for(lck, std::chrono::milliseconds(timeout_ms)) == std::cv_status::timeout))
+                if (!try_claim(mReadPkt))
                 {
-                    mUnderflow++;
-                    return samplesFilled;
+                    //buffer might be empty, wait for packets
+                    if ((timeout_ms==0) || !wait_items(timeout_ms))
+                    {
+                        mUnderflow.fetch_add(1, std::memory_order_relaxed);
+                        return samplesFilled;
+                    }
+                    continue;
                 }
+                mFirst = 0;
+                hasSpace.notify();
             }
             if(samplesFilled == 0 && timestamp != nullptr)
-                *timestamp = mBuffer[mHead].timestamp + mFirst;
+                *timestamp = mReadPkt.timestamp + mFirst;
 
-            while(mElementsFilled > 0 && samplesFilled < samplesCount)
-            {
-                int cnt = samplesCount - samplesFilled;
-                const int cntbuf = mBuffer[mHead].last - mFirst;
-                cnt = cnt > cntbuf ? cntbuf : cnt;
+            int cnt = samplesCount - samplesFilled;
+            const int cntbuf = mReadPkt.last - mFirst;
+            cnt = cnt > cntbuf ? cntbuf : cnt;
 
-                memcpy(&buffer[samplesFilled],&mBuffer[mHead].samples[mFirst],cnt*sizeof(complex16_t));
-                samplesFilled += cnt;
+            convert(&mReadPkt.samples[mFirst], samplesFilled, cnt);
+            samplesFilled += cnt;
+            mFirst += cnt;
+        }
+        return samplesFilled;
+    }
 
-                if (cntbuf == cnt) //packet depleated
+    /** @brief Zero-copy read, claims the oldest packet and leaves it inside FIFO.
+        The slot is not reused until release_packet() is called; while it is held,
+        overflowing packets are dropped instead of the held one.
+        Remaining samples of a packet partially read by pop_samples() are discarded.
+        @param packet returns pointer to packet, valid until release_packet()
+        @param timeout_ms timeout duration for operation
+        @return handle for release_packet(), -1 on timeout
+    */
+    int64_t acquire_packet(const SamplesPacket** packet, const uint32_t timeout_ms)
+    {
+        mFirst = mReadPkt.last;
+        while (true)
+        {
+            uint64_t head = mHead.load(std::memory_order_acquire);
+            while (mBufferSize && mBuffer[head % mBufferSize].seq.load(std::memory_order_acquire) == head + 1)
+            {
+                if (mHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
                 {
-                    mHead = (mHead + 1) % mBufferSize;//advance to next one
-                    mFirst = 0;
-                    --mElementsFilled;
+                    Slot &slot = mBuffer[head % mBufferSize];
+                    slot.held.store(true, std::memory_order_release);
+                    *packet = &slot.packet;
+                    return head;
                 }
-                else
-                    mFirst += cnt;
+            }
+            if ((timeout_ms==0) || !wait_items(timeout_ms))
+            {
+                mUnderflow.fetch_add(1, std::memory_order_relaxed);
+                return -1;
             }
         }
-        lck.unlock();
-        hasItems.notify_one();
-        return samplesFilled;
     }
 
-    void pop_packet(SamplesPacket &packet)
+    /** @brief Returns packet obtained by acquire_packet() back to FIFO
+        @param handle value returned by acquire_packet()
+    */
+    void release_packet(int64_t handle)
     {
-        std::unique_lock<std::mutex> lck(lock);
+        if (handle < 0 || mBufferSize == 0)
+            return;
+        Slot &slot = mBuffer[handle % mBufferSize];
+        if (slot.seq.load(std::memory_order_relaxed) != uint64_t(handle) + 1)
+            return; //stale handle, FIFO was cleared
+        slot.held.store(false, std::memory_order_relaxed);
+        slot.seq.store(handle + mBufferSize, std::memory_order_release);
+        hasSpace.notify();
+    }
+
+    /** @brief Zero-copy write, gives access to free space of the packet being filled.
+        Packet is not visible to consumer until it is full or committed with END_BURST,
+        calling again before commit_packet() returns the same space.
+        @param samples returns pointer to first free sample of packet
+        @param capacity returns number of samples that fit in packet
+        @param timeout_ms timeout duration for operation
+        @return handle for commit_packet(), -1 on timeout
+    */
+    int64_t acquire_free_packet(complex16_t** samples, uint32_t* capacity, const uint32_t timeout_ms)
+    {
+        if (mBufferSize == 0)
+            return -1;
+        const uint64_t pos = mTail.load(std::memory_order_relaxed);
+        Slot &slot = mBuffer[pos % mBufferSize];
+        if (slot.seq.load(std::memory_order_acquire) != pos &&
+            !wait_space([&slot, pos]{ return slot.seq.load(std::memory_order_acquire) == pos; }, timeout_ms))
+            return -1;
+        *samples = slot.packet.samples + mLast;
+        *capacity = mPktSize - mLast;
+        return pos;
+    }
 
-        while (mElementsFilled == 0) //buffer might be empty, wait for packets
-            if (hasItems.wait_for(lck, std::chrono::milliseconds(100)) == std::cv_status::timeout)
+    /** @brief Adds samples written to space obtained by acquire_free_packet().
+        Short commits keep filling the same packet like push_samples(), it is
+        published once full or when END_BURST is set.
+        @param handle value returned by acquire_free_packet()
+        @param samplesCount number of samples written
+        @param timestamp timestamp of the first sample, used if packet was empty
+        @param flags optional flags associated with the samples
+        @return number of samples committed
+    */
+    uint32_t commit_packet(int64_t handle, uint32_t samplesCount, uint64_t timestamp, const uint32_t flags)
+    {
+        if (handle < 0 || mBufferSize == 0 || uint64_t(handle) != mTail.load(std::memory_order_relaxed))
+            return 0;
+        if (samplesCount > uint32_t(mPktSize - mLast))
+            samplesCount = mPktSize - mLast;
+        Slot &slot = mBuffer[handle % mBufferSize];
+        SamplesPacket &pkt = slot.packet;
+        if (mLast == 0)
+        {
+            if (samplesCount == 0) //nothing written, slot stays free
+                return 0;
+            pkt.timestamp = timestamp;
+            pkt.flags = flags;
+        }
+        else
+            pkt.flags |= flags & END_BURST;
+        mLast += samplesCount;
+        pkt.last = mLast;
+        if (mLast == mPktSize || (pkt.flags & END_BURST))
+        {
+            slot.seq.store(handle + 1, std::memory_order_release);
+            mTail.store(handle + 1, std::memory_order_relaxed);
+            mLast = 0;
+            hasItems.notify();
+            update_high_water(handle + 1);
+        }
+        return samplesCount;
+    }
+
+    //! @brief Returns number of packets FIFO can hold
+    uint32_t GetBufferCount() const
+    {
+        return mBufferSize;
+    }
+
+    //! @brief Returns number of samples in one packet
+    int GetPacketSize() const
+    {
+        return mPktSize;
+    }
+
+    /** @brief Takes whole packet out of FIFO
+        @param packet destination packet, its buffer is given to FIFO in exchange
+    */
+    void pop_packet(SamplesPacket &packet)
+    {
+        while (!try_claim(packet)) //buffer might be empty, wait for packets
+            if (!wait_items(100))
             {
-                mUnderflow++;
+                mUnderflow.fetch_add(1, std::memory_order_relaxed);
                 packet.last = 0;
                 packet.flags = 0;
                 return;
             }
-
-        packet = std::move(mBuffer[mHead]);
-        mHead = (mHead + 1) % mBufferSize;//advance to next one
-        --mElementsFilled;
-        lck.unlock();
-        hasItems.notify_one();
+        hasSpace.notify();
     }
 
     void Resize(int pktSize, int bufSize = -1)
     {
-        Clear();
-        std::unique_lock<std::mutex> lck(lock);
         if (bufSize < 0)
            bufSize =  mPktSize*mBufferSize/pktSize;
 
         if ((unsigned)bufSize == mBufferSize && pktSize == mPktSize)
+        {
+            Clear();
             return;
+        }
         mBufferSize = bufSize;
         mPktSize = pktSize;
         if (mBuffer)
             delete [] mBuffer;
 
-        mBuffer = bufSize == 0 ? nullptr : new SamplesPacket[mBufferSize];
+        //all packet buffers, including reader's one, are taken from single arena block
+        if (mArena)
+        {
+            mArena->Free(mArenaBlock);
+            const size_t blockSize = (mBufferSize + 1)*PacketStride();
+            mArenaBlock = mArena->Reserve(blockSize) == 0 ? (char*)mArena->Allocate(blockSize) : nullptr;
+        }
+        mBuffer = bufSize == 0 ? nullptr : new Slot[mBufferSize];
         for (unsigned i = 0; i < mBufferSize; i++)
-            mBuffer[i] = SamplesPacket(mPktSize);
+            mBuffer[i].packet = NewPacket(i);
+        mReadPkt = NewPacket(mBufferSize);
+        Clear();
     }
 
+    /** @brief Sets where blocking waits and fill level are recorded
+        @param telemetry destination, nullptr to disable, must outlive FIFO
+    */
+    void SetTelemetry(StreamTelemetry* telemetry)
+    {
+        mTelemetry = telemetry;
+    }
+
+    //! @brief Resets FIFO to empty state, must not race with push/pop calls
     void Clear()
     {
-        std::unique_lock<std::mutex> lck(lock);
-        mHead = 0;
-        mTail = 0;
+        for (unsigned i = 0; i < mBufferSize; i++)
+        {
+            mBuffer[i].seq.store(i, std::memory_order_relaxed);
+            mBuffer[i].held.store(false, std::memory_order_relaxed);
+        }
+        mHead.store(0, std::memory_order_relaxed);
+        mTail.store(0, std::memory_order_relaxed);
         mFirst = 0;
         mLast = 0;
-        mElementsFilled = 0;
-        mOverflow = 0;
-        mUnderflow = 0;
+        mReadPkt.last = 0;
+        mOverflow.store(0, std::memory_order_relaxed);
+        mUnderflow.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
     }
 
 protected:
-    SamplesPacket* mBuffer;
+    struct Slot
+    {
+        Slot() : seq(0), held(false) {}
+        std::atomic<uint64_t> seq;
+        std::atomic<bool> held; //claimed by acquire_packet(), not released yet
+        SamplesPacket packet;
+    };
+
+    //! @brief Packet buffer size rounded up to cache line
+    size_t PacketStride() const
+    {
+        return (mPktSize*sizeof(complex16_t) + cCacheLine - 1) / cCacheLine * cCacheLine;
+    }
+
+    //! @brief Creates packet with buffer from arena block, or from heap if arena had no space
+    SamplesPacket NewPacket(unsigned index)
+    {
+        if (mArenaBlock)
+            return SamplesPacket((complex16_t*)(mArenaBlock + index*PacketStride()));
+        return SamplesPacket(mPktSize);
+    }
+
+    //! @brief Producer side: waits for free slot, blocked time goes to telemetry
+    template<typename Predicate>
+    bool wait_space(Predicate ready, const uint32_t timeout_ms)
+    {
+        if (!mTelemetry)
+            return hasSpace.wait_for(ready, timeout_ms);
+        const uint64_t t0 = StreamTelemetry::Now();
+        const bool ok = hasSpace.wait_for(ready, timeout_ms);
+        mTelemetry->producerWait.Record(StreamTelemetry::Now() - t0);
+        return ok;
+    }
+
+    //! @brief Consumer side: waits for packets, blocked time goes to telemetry
+    bool wait_items(const uint32_t timeout_ms)
+    {
+        if (!mTelemetry)
+            return hasItems.wait_for([this]{ return has_packet(); }, timeout_ms);
+        const uint64_t t0 = StreamTelemetry::Now();
+        const bool ok = hasItems.wait_for([this]{ return has_packet(); }, timeout_ms);
+        mTelemetry->consumerWait.Record(StreamTelemetry::Now() - t0);
+        return ok;
+    }
+
+    //! @brief Producer side: tracks the highest number of packets held
+    void update_high_water(uint64_t tail)
+    {
+        if (!mTelemetry)
+            return;
+        const uint64_t head = mHead.load(std::memory_order_relaxed);
+        const uint32_t filled = tail > head ? tail - head : 0;
+        if (filled > mTelemetry->fifoHighWater.load(std::memory_order_relaxed))
+            mTelemetry->fifoHighWater.store(filled, std::memory_order_relaxed);
+    }
+
+    //! @brief true if oldest packet is available for consumer
+    bool has_packet() const
+    {
+        if (mBufferSize == 0)
+            return false;
+        const uint64_t head = mHead.load(std::memory_order_acquire);
+        return mBuffer[head % mBufferSize].seq.load(std::memory_order_acquire) == head + 1;
+    }
+
+    //! @brief Consumer side: moves the oldest packet out of FIFO
+    bool try_claim(SamplesPacket &dest)
+    {
+        if (mBufferSize == 0)
+            return false;
+        uint64_t head = mHead.load(std::memory_order_acquire);
+        while (true)
+        {
+            Slot &slot = mBuffer[head % mBufferSize];
+            if (slot.seq.load(std::memory_order_acquire) != head + 1)
+                return false;
+            if (mHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                dest = std::move(slot.packet);
+                slot.seq.store(head + mBufferSize, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    static const int cCacheLine = 64;
+    static const int cReleaseSpin = 1024;
+
+    Slot* mBuffer;
     int32_t mPktSize;
     uint32_t mBufferSize;
-    uint32_t mHead;
-    uint32_t mTail;
+    StreamArena* mArena;
+    char* mArenaBlock;
+    StreamTelemetry* mTelemetry;
+
+    //consumer owned
+    char mPad0[cCacheLine];
+    std::atomic<uint64_t> mHead;
     int32_t mFirst;
+    SamplesPacket mReadPkt;
+    std::atomic<uint32_t> mUnderflow;
+
+    //producer owned
+    char mPad1[cCacheLine];
+    std::atomic<uint64_t> mTail;
     int32_t mLast;
-    uint32_t mElementsFilled;
-    uint32_t mOverflow;
-    uint32_t mUnderflow;
-    std::mutex lock;
-    std::condition_variable hasItems;
+    std::atomic<uint32_t> mOverflow;
+
+    char mPad2[cCacheLine];
+    AdaptiveWait hasItems;
+    AdaptiveWait hasSpace;
 };
 
 }
@@ -6,9 +6,47 @@
 #include <windows.h>
 #endif
 #include "Logger.h"
+#include <fstream>
+#include <sstream>
 
 using namespace lime;
 
+std::vector<int> lime::ParseCPUList(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        if (range.find_first_not_of(" \t\n") == std::string::npos)
+            continue;
+        int first, last;
+        char dash;
+        std::stringstream rs(range);
+        if (!(rs >> first))
+            return std::vector<int>();
+        last = first;
+        if (rs >> dash && (dash != '-' || !(rs >> last)))
+            return std::vector<int>();
+        if (first < 0 || last < first)
+            return std::vector<int>();
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> lime::GetNumaNodeCPUs(int node)
+{
+#ifdef __linux__
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if (file.good() && std::getline(file, list))
+        return ParseCPUList(list);
+#endif
+    return std::vector<int>();
+}
+
 #ifdef __unix__
 int lime::SetOSThreadPriority(ThreadPriority priority, ThreadPolicy policy, std::thread *thread)
 {
@@ -96,6 +134,33 @@ int lime::SetOSCurrentThreadPriority(ThreadPriority priority, ThreadPolicy polic
     return 0;
 }
 
+int lime::SetOSCurrentThreadAffinity(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (cpus.empty())
+    {
+        const int count = std::thread::hardware_concurrency();
+        for (int i = 0; i < count && i < CPU_SETSIZE; ++i)
+            CPU_SET(i, &cpuset);
+    }
+    for (int cpu : cpus)
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &cpuset);
+
+    if (int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+    {
+        lime::debug("SetOSCurrentThreadAffinity: Failed to set affinity, ret(%d)", ret);
+        return -1;
+    }
+    return 0;
+#else
+    lime::debug("SetOSCurrentThreadAffinity: not supported on this platform");
+    return cpus.empty() ? 0 : -1;
+#endif
+}
+
 #elif _WIN32
 
 int lime::SetOSThreadPriority(ThreadPriority priority, ThreadPolicy /*policy*/, std::thread *thread)
@@ -177,6 +242,23 @@ int lime::SetOSCurrentThreadPriority(ThreadPriority priority, ThreadPolicy /*pol
     }
     return 0;
 }
+int lime::SetOSCurrentThreadAffinity(const std::vector<int> &cpus)
+{
+    DWORD_PTR processMask, systemMask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        return -1;
+    DWORD_PTR mask = cpus.empty() ? processMask : 0;
+    for (int cpu : cpus)
+        if (cpu >= 0 && cpu < int(8*sizeof(DWORD_PTR)))
+            mask |= DWORD_PTR(1) << cpu;
+
+    if (!SetThreadAffinityMask(GetCurrentThread(), mask))
+    {
+        lime::debug("SetThreadAffinityMask: Failed to set mask(%llx)", (unsigned long long)mask);
+        return -1;
+    }
+    return 0;
+}
 #else
 
 int lime::SetOSThreadPriority(ThreadPriority priority, ThreadPolicy policy, std::thread *thread)
@@ -188,4 +270,9 @@ int lime::SetOSCurrentThreadPriority(ThreadPriority priority, ThreadPolicy polic
 {
     return 0;
 }
+
+int lime::SetOSCurrentThreadAffinity(const std::vector<int> &cpus)
+{
+    return cpus.empty() ? 0 : -1;
+}
 #endif
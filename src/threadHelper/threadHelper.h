@@ -1,7 +1,10 @@
 #ifndef LIMESUITE_THREAD_H
 #define LIMESUITE_THREAD_H
 
+#include "LimeSuiteConfig.h"
 #include <thread>
+#include <vector>
+#include <string>
 
 namespace lime{
 
@@ -41,6 +44,33 @@ int SetOSThreadPriority(ThreadPriority priority, ThreadPolicy policy, std::threa
  * @return          0 on success, (-1) on failure
  */
 int SetOSCurrentThreadPriority(ThreadPriority priority, ThreadPolicy policy);
+
+/**
+ * Restrict current thread to run only on specified CPUs
+ *
+ * @param cpus      CPU indexes, empty list removes restriction
+ *
+ * @return          0 on success, (-1) on failure
+ */
+int SetOSCurrentThreadAffinity(const std::vector<int> &cpus);
+
+/**
+ * Parse CPU list in Linux cpulist format, e.g. "0-3,8,10-11"
+ *
+ * @param list      CPU list string
+ *
+ * @return          CPU indexes, empty on parse error
+ */
+LIME_API std::vector<int> ParseCPUList(const std::string &list);
+
+/**
+ * Get CPUs belonging to NUMA node
+ *
+ * @param node      NUMA node index
+ *
+ * @return          CPU indexes, empty if node does not exist or NUMA information is unavailable
+ */
+LIME_API std::vector<int> GetNumaNodeCPUs(int node);
 }
 
 #endif
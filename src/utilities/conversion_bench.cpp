@@ -0,0 +1,153 @@
+/**
+@file conversion_bench.cpp
+@brief Measures throughput of packet payload conversion kernels
+*/
+#include "SampleConversion.h"
+#include "dataTypes.h"
+#include <iostream>
+#include <iomanip>
+#include <getopt.h>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <functional>
+#include <string.h>
+
+using namespace std;
+using namespace lime;
+
+static const int payloadSize = sizeof(FPGA_DataPacket::data);
+
+//runs kernel over all packets repeatedly, returns link format bytes per second
+static double Measure(const function<void(int)> &kernel, int packets, double minSeconds)
+{
+    auto t1 = chrono::high_resolution_clock::now();
+    long long processed = 0;
+    double elapsed = 0;
+    do
+    {
+        for (int p = 0; p < packets; ++p)
+            kernel(p);
+        processed += (long long)packets*payloadSize;
+        elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - t1).count();
+    } while (elapsed < minSeconds);
+    return processed / elapsed;
+}
+
+int printHelp(void)
+{
+    cout << "conversion_bench [options]" << endl;
+    cout << "    -h, --help\t\t This help" << endl;
+    cout << "    -p, --packets <n>\t Number of packets in test buffer (default 256)" << endl;
+    cout << "    -t, --time <s>\t Minimum measurement time per kernel (default 0.5)" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int packets = 256;
+    double minSeconds = 0.5;
+    int c;
+    while (1)
+    {
+        static struct option long_options[] =
+        {
+            {"packets", required_argument, 0, 'p'},
+            {"time",    required_argument, 0, 't'},
+            {"help",    no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long (argc, argv, "p:t:h", long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c)
+        {
+        case 'p': packets = stoi(optarg); break;
+        case 't': minSeconds = stod(optarg); break;
+        case 'h': return printHelp();
+        default: return printHelp();
+        }
+    }
+
+    const int siso12 = samples12InPkt;
+    const int mimo12 = samples12InPkt/2;
+    const int mimo16 = samples16InPkt/2;
+    vector<uint8_t> payload((size_t)packets*payloadSize);
+    mt19937 rng(0);
+    for (auto &b : payload)
+        b = rng() & 0xFF;
+    vector<complex16_t> chA((size_t)packets*siso12);
+    vector<complex16_t> chB((size_t)packets*siso12);
+    vector<uint8_t> out(payload.size());
+    vector<float> floats((size_t)packets*samples16InPkt*2);
+    vector<float> floatsOut(floats.size());
+    for (auto &f : floats)
+        f = (int(rng() % 2401) - 1200) / 1000.0f; //includes values beyond full scale
+
+    auto convList = GetAvailableSampleConverters();
+    const SampleConverters &ref = *convList.front();
+
+    //reference results for verification
+    vector<complex16_t> refA(siso12), refB(siso12);
+    vector<uint8_t> refOut(payloadSize);
+
+    cout << "Link format bytes processed, GB/s" << endl;
+    cout << left << setw(10) << "kernel";
+    const char* names[] = {"unpack12", "unpack12m", "pack12", "pack12m", "deintl16", "intl16", "f32toi16", "i16tof32"};
+    for (auto n : names)
+        cout << right << setw(11) << n;
+    cout << endl;
+
+    for (auto conv : convList)
+    {
+        bool ok = true;
+        //verify against scalar implementation on first packet
+        ref.Unpack12(payload.data(), siso12, refA.data());
+        conv->Unpack12(payload.data(), siso12, chA.data());
+        ok &= memcmp(refA.data(), chA.data(), siso12*sizeof(complex16_t)) == 0;
+        ref.Unpack12MIMO(payload.data(), mimo12, refA.data(), refB.data());
+        conv->Unpack12MIMO(payload.data(), mimo12, chA.data(), chB.data());
+        ok &= memcmp(refA.data(), chA.data(), mimo12*sizeof(complex16_t)) == 0;
+        ok &= memcmp(refB.data(), chB.data(), mimo12*sizeof(complex16_t)) == 0;
+        ref.Pack12(chA.data(), siso12, refOut.data());
+        conv->Pack12(chA.data(), siso12, out.data());
+        ok &= memcmp(refOut.data(), out.data(), payloadSize) == 0;
+        ref.Pack12MIMO(chA.data(), chB.data(), mimo12, refOut.data());
+        conv->Pack12MIMO(chA.data(), chB.data(), mimo12, out.data());
+        ok &= memcmp(refOut.data(), out.data(), payloadSize) == 0;
+        ref.Deinterleave16((const complex16_t*)payload.data(), mimo16, refA.data(), refB.data());
+        conv->Deinterleave16((const complex16_t*)payload.data(), mimo16, chA.data(), chB.data());
+        ok &= memcmp(refA.data(), chA.data(), mimo16*sizeof(complex16_t)) == 0;
+        ok &= memcmp(refB.data(), chB.data(), mimo16*sizeof(complex16_t)) == 0;
+        ref.FloatToInt16(floats.data(), samples16InPkt, 2047.0f, refA.data());
+        conv->FloatToInt16(floats.data(), samples16InPkt, 2047.0f, chA.data());
+        ok &= memcmp(refA.data(), chA.data(), samples16InPkt*sizeof(complex16_t)) == 0;
+        vector<float> refF(2*samples16InPkt), outF(2*samples16InPkt);
+        ref.Int16ToFloat(refA.data(), samples16InPkt, 2047.0f, refF.data());
+        conv->Int16ToFloat(refA.data(), samples16InPkt, 2047.0f, outF.data());
+        ok &= memcmp(refF.data(), outF.data(), refF.size()*sizeof(float)) == 0;
+
+        const uint8_t* in = payload.data();
+        complex16_t* a = chA.data();
+        complex16_t* b = chB.data();
+        uint8_t* o = out.data();
+        const float* f = floats.data();
+        float* fo = floatsOut.data();
+        double rates[8];
+        rates[0] = Measure([&](int p){ conv->Unpack12(in + p*payloadSize, siso12, a + p*siso12); }, packets, minSeconds);
+        rates[1] = Measure([&](int p){ conv->Unpack12MIMO(in + p*payloadSize, mimo12, a + p*mimo12, b + p*mimo12); }, packets, minSeconds);
+        rates[2] = Measure([&](int p){ conv->Pack12(a + p*siso12, siso12, o + p*payloadSize); }, packets, minSeconds);
+        rates[3] = Measure([&](int p){ conv->Pack12MIMO(a + p*mimo12, b + p*mimo12, mimo12, o + p*payloadSize); }, packets, minSeconds);
+        rates[4] = Measure([&](int p){ conv->Deinterleave16((const complex16_t*)(in + p*payloadSize), mimo16, a + p*mimo16, b + p*mimo16); }, packets, minSeconds);
+        rates[5] = Measure([&](int p){ conv->Interleave16(a + p*mimo16, b + p*mimo16, mimo16, (complex16_t*)(o + p*payloadSize)); }, packets, minSeconds);
+        rates[6] = Measure([&](int p){ conv->FloatToInt16(f + 2*p*samples16InPkt, samples16InPkt, 32767.0f, (complex16_t*)(o + p*payloadSize)); }, packets, minSeconds);
+        rates[7] = Measure([&](int p){ conv->Int16ToFloat((const complex16_t*)(in + p*payloadSize), samples16InPkt, 32767.0f, fo + 2*p*samples16InPkt); }, packets, minSeconds);
+
+        cout << left << setw(10) << conv->name << fixed << setprecision(2);
+        for (auto r : rates)
+            cout << right << setw(11) << r/1e9;
+        cout << (ok ? "" : "  MISMATCH") << endl;
+    }
+    return 0;
+}
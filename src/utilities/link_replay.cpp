@@ -0,0 +1,438 @@
+/**
+@file link_replay.cpp
+@brief Replays recorded Rx link trace through Streamer to reproduce and benchmark decoding
+*/
+#include "Streamer.h"
+#include "IConnection.h"
+#include "FPGA_common.h"
+#include "LMS7002M.h"
+#include "LinkTrace.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <getopt.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <ctime>
+#include <string.h>
+
+using namespace std;
+using namespace lime;
+
+typedef chrono::steady_clock Clock;
+
+struct TraceRecord
+{
+    size_t offset;
+    uint32_t length;
+    uint64_t time;
+};
+
+/** @brief In-process connection returning transfers of a link trace.
+    Recorded transfers are returned in order, split when Streamer requests
+    smaller transfers. With pacing each transfer completes at its recorded
+    time after start, otherwise as soon as it is requested.
+*/
+class ReplayConnection : public IConnection
+{
+public:
+    ReplayConnection(const vector<char> &data, const vector<TraceRecord> &records, int buffersCount, bool pace) :
+        data(data),
+        records(records),
+        buffersCount(buffersCount),
+        pace(pace),
+        next(0),
+        consumed(0),
+        submitted(0)
+    {
+        lmsRegisters.resize(0x10000, 0);
+    }
+
+    bool Finished() const
+    {
+        return next >= records.size();
+    }
+
+    int WriteLMS7002MSPI(const uint32_t *writeData, size_t size, unsigned) override
+    {
+        for (size_t i = 0; i < size; ++i)
+            lmsRegisters[(writeData[i] >> 16) & 0x7FFF] = writeData[i] & 0xFFFF;
+        return 0;
+    }
+
+    int ReadLMS7002MSPI(const uint32_t *writeData, uint32_t *readData, size_t size, unsigned) override
+    {
+        for (size_t i = 0; i < size; ++i)
+            readData[i] = lmsRegisters[(writeData[i] >> 16) & 0x7FFF];
+        return 0;
+    }
+
+    int WriteRegisters(const uint32_t *addrs, const uint32_t *data, const size_t size) override
+    {
+        for (size_t i = 0; i < size; ++i)
+            fpgaRegisters[addrs[i]] = data[i];
+        return 0;
+    }
+
+    int ReadRegisters(const uint32_t *addrs, uint32_t *data, const size_t size) override
+    {
+        for (size_t i = 0; i < size; ++i)
+            data[i] = fpgaRegisters[addrs[i]];
+        return 0;
+    }
+
+    int GetBuffersCount() const override
+    {
+        return buffersCount;
+    }
+
+    int CheckStreamSize(int size) const override
+    {
+        return size;
+    }
+
+    int BeginDataReading(char*, uint32_t length, int) override
+    {
+        if (submitted == 0)
+            startTime = Clock::now();
+        Transfer &t = transfers[submitted % cMaxTransfers];
+        const uint32_t requested = length/sizeof(FPGA_DataPacket)*sizeof(FPGA_DataPacket);
+        if (Finished() || requested == 0)
+        {
+            t.length = 0;
+            t.ready = Clock::time_point::max();
+        }
+        else
+        {
+            const TraceRecord &r = records[next];
+            t.offset = r.offset + consumed;
+            t.length = min(r.length - consumed, requested);
+            t.ready = pace ? startTime + chrono::duration_cast<Clock::duration>(chrono::nanoseconds(r.time)) : Clock::time_point::min();
+            consumed += t.length;
+            if (consumed == r.length)
+            {
+                consumed = 0;
+                ++next;
+            }
+        }
+        return submitted++ % cMaxTransfers;
+    }
+
+    bool WaitForReading(int handle, unsigned int timeout_ms) override
+    {
+        const Clock::time_point ready = transfers[handle].ready;
+        if (ready == Clock::time_point::min())
+            return true;
+        const Clock::time_point deadline = Clock::now() + chrono::milliseconds(timeout_ms);
+        this_thread::sleep_until(min(ready, deadline));
+        return Clock::now() >= ready;
+    }
+
+    int FinishDataReading(char* buffer, uint32_t, int handle) override
+    {
+        const Transfer &t = transfers[handle];
+        memcpy(buffer, &data[t.offset], t.length);
+        return t.length;
+    }
+
+    void AbortReading(int) override
+    {
+    }
+
+private:
+    struct Transfer
+    {
+        size_t offset;
+        uint32_t length;
+        Clock::time_point ready;
+    };
+    static const int cMaxTransfers = 256;
+
+    const vector<char> &data;
+    const vector<TraceRecord> &records;
+    int buffersCount;
+    bool pace;
+    size_t next;
+    uint32_t consumed;
+    uint64_t submitted;
+    Clock::time_point startTime;
+    Transfer transfers[cMaxTransfers];
+    vector<uint16_t> lmsRegisters;
+    map<uint32_t, uint32_t> fpgaRegisters;
+};
+
+struct Trace
+{
+    LinkTraceHeader header;
+    vector<char> data;
+    vector<TraceRecord> records;
+    uint64_t packets;
+    uint64_t gaps; //timestamp discontinuities between packets
+    uint64_t lost; //packets Streamer counts as lost, including those before first one
+    uint64_t lossFlags; //packets with Tx packet loss flag
+    uint64_t dropped; //transfers trace writer could not store
+};
+
+static bool LoadTrace(const string &path, Trace &trace)
+{
+    ifstream file(path.c_str(), ios::binary | ios::ate);
+    if (!file.good())
+    {
+        cerr << "Failed to open " << path << endl;
+        return false;
+    }
+    const size_t size = file.tellg();
+    file.seekg(0);
+    trace.data.resize(size);
+    file.read(trace.data.data(), size);
+    if (!file.good() || size < sizeof(trace.header))
+    {
+        cerr << "Failed to read " << path << endl;
+        return false;
+    }
+    memcpy(&trace.header, trace.data.data(), sizeof(trace.header));
+    if (memcmp(trace.header.magic, cLinkTraceMagic, sizeof(cLinkTraceMagic)) != 0 || trace.header.version != cLinkTraceVersion)
+    {
+        cerr << path << " is not a supported link trace" << endl;
+        return false;
+    }
+
+    const bool mimo = trace.header.flags & LinkTraceHeader::MIMO;
+    const bool packed = trace.header.flags & LinkTraceHeader::PACKED;
+    const uint32_t samplesInPacket = (packed ? samples12InPkt : samples16InPkt)/(mimo ? 2 : 1);
+    trace.packets = trace.gaps = trace.lost = trace.lossFlags = trace.dropped = 0;
+    uint64_t expected = 0;
+    uint64_t prevTs = 0;
+    size_t offset = sizeof(trace.header);
+    while (offset + sizeof(LinkTraceRecord) <= size)
+    {
+        LinkTraceRecord record;
+        memcpy(&record, &trace.data[offset], sizeof(record));
+        offset += sizeof(record);
+        if (offset + record.length > size)
+        {
+            cerr << "Trace is truncated" << endl;
+            break;
+        }
+        TraceRecord r;
+        r.offset = offset;
+        r.length = record.length;
+        r.time = record.time;
+        trace.records.push_back(r);
+        trace.dropped += record.dropped;
+        for (uint32_t i = 0; i < record.length/sizeof(FPGA_DataPacket); ++i)
+        {
+            const FPGA_DataPacket* pkt = (const FPGA_DataPacket*)&trace.data[offset + i*sizeof(FPGA_DataPacket)];
+            if (trace.packets && pkt->counter != expected)
+                ++trace.gaps;
+            //same rule as Streamer::ParseRxPacketHeader()
+            if (pkt->counter - prevTs != samplesInPacket && pkt->counter != prevTs)
+                trace.lost += (pkt->counter - prevTs)/samplesInPacket - 1;
+            prevTs = pkt->counter;
+            if (pkt->reserved[0] & (1 << 3))
+                ++trace.lossFlags;
+            expected = pkt->counter + samplesInPacket;
+            ++trace.packets;
+        }
+        offset += record.length;
+    }
+    return !trace.records.empty();
+}
+
+struct ReplayOptions
+{
+    bool pace;
+    int decodeThreads;
+    float latency;
+    bool zeroCopy;
+    bool floats;
+};
+
+struct ReplayResult
+{
+    double seconds;
+    double cpuPerPacket_us;
+    uint64_t samples;
+    uint64_t gaps;
+    uint64_t lost;
+    uint64_t overrun;
+};
+
+static ReplayResult Replay(const Trace &trace, const ReplayOptions &opt)
+{
+    ReplayResult result = {};
+    const bool mimo = trace.header.flags & LinkTraceHeader::MIMO;
+    const bool packed = trace.header.flags & LinkTraceHeader::PACKED;
+    int buffersCount = 1;
+    while (buffersCount < (int)trace.header.buffersCount && buffersCount < 128)
+        buffersCount <<= 1;
+    ReplayConnection port(trace.data, trace.records, buffersCount, opt.pace);
+    FPGA fpga;
+    fpga.SetConnection(&port);
+    LMS7002M lms;
+    lms.SetConnection(&port);
+    lms.EnableValuesCache(true);
+    Streamer streamer(&fpga, &lms, 0);
+
+    const int chCount = mimo ? 2 : 1;
+    const uint32_t samplesInPacket = (packed ? samples12InPkt : samples16InPkt)/chCount;
+    StreamChannel* channels[2] = {nullptr, nullptr};
+    for (int c = 0; c < chCount; ++c)
+    {
+        StreamConfig config;
+        config.isTx = false;
+        config.channelID = c;
+        config.align = false;
+        config.performanceLatency = opt.latency;
+        //without pacing decoding outruns reader, FIFO holds whole trace so nothing is overwritten
+        config.bufferLength = opt.pace ? 0 : min<uint64_t>(trace.packets*samplesInPacket, 64 << 20);
+        config.format = opt.floats ? StreamConfig::FMT_FLOAT32 : StreamConfig::FMT_INT16;
+        config.linkFormat = packed ? StreamConfig::FMT_INT12 : StreamConfig::FMT_INT16;
+        config.decodeThreads = opt.decodeThreads;
+        channels[c] = streamer.SetupStream(config);
+        if (channels[c] == nullptr)
+            return result;
+    }
+
+    const uint64_t expectedSamples = trace.packets*samplesInPacket*chCount;
+    vector<float> buffer(2*samplesInPacket);
+    uint64_t expected[2] = {0, 0};
+    bool first[2] = {true, true};
+
+    const auto t1 = Clock::now();
+    auto t2 = t1;
+    const clock_t cpu1 = clock();
+    for (int c = 0; c < chCount; ++c)
+        channels[c]->Start();
+    while (result.samples < expectedSamples)
+    {
+        int count = 0;
+        for (int c = 0; c < chCount; ++c)
+        {
+            StreamChannel::Metadata meta;
+            if (opt.zeroCopy)
+            {
+                size_t handle;
+                const complex16_t* data;
+                count = channels[c]->AcquireRead(handle, &data, &meta, 200);
+                if (count > 0)
+                    channels[c]->ReleaseRead(handle);
+            }
+            else
+                count = channels[c]->Read(buffer.data(), samplesInPacket, &meta, 200);
+            if (count <= 0)
+                break;
+            if (!first[c] && meta.timestamp != expected[c])
+                ++result.gaps;
+            first[c] = false;
+            expected[c] = meta.timestamp + count;
+            result.samples += count;
+            t2 = Clock::now();
+        }
+        //packets lost in FIFO never arrive, stop once trace is exhausted
+        if (count <= 0 && port.Finished())
+            break;
+    }
+    const clock_t cpu2 = clock();
+    //time to last sample, excludes final read timeout when some packets were lost
+    result.seconds = chrono::duration<double>(t2 - t1).count();
+
+    for (int c = 0; c < chCount; ++c)
+    {
+        StreamChannel::Info info = channels[c]->GetInfo();
+        result.lost += info.droppedPackets;
+        result.overrun += info.overrun;
+        channels[c]->Stop();
+    }
+    for (int c = 0; c < chCount; ++c)
+        channels[c]->Close();
+    if (trace.packets)
+        result.cpuPerPacket_us = 1e6*(cpu2 - cpu1)/CLOCKS_PER_SEC/trace.packets;
+    return result;
+}
+
+int printHelp(void)
+{
+    cout << "link_replay [options] <trace file>" << endl;
+    cout << "    -h, --help\t\t This help" << endl;
+    cout << "    -p, --pace\t\t Complete transfers at recorded times (default as fast as possible)" << endl;
+    cout << "    -n, --repeat <n>\t Number of replays (default 1)" << endl;
+    cout << "    -l, --latency <0-1>\t Stream performance latency (default 0.5)" << endl;
+    cout << "    -d, --decode <n>\t Number of RX decode threads (default 0)" << endl;
+    cout << "    -z, --zerocopy\t Read packets in place instead of copying" << endl;
+    cout << "    -f, --float\t\t Read samples as float32" << endl;
+    cout << "Traces are recorded by running any application with LIME_LINK_TRACE=<trace file>." << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    ReplayOptions opt;
+    opt.pace = false;
+    opt.decodeThreads = 0;
+    opt.latency = 0.5;
+    opt.zeroCopy = false;
+    opt.floats = false;
+    int repeat = 1;
+    int c;
+    while (1)
+    {
+        static struct option long_options[] =
+        {
+            {"pace",     no_argument, 0, 'p'},
+            {"repeat",   required_argument, 0, 'n'},
+            {"latency",  required_argument, 0, 'l'},
+            {"decode",   required_argument, 0, 'd'},
+            {"zerocopy", no_argument, 0, 'z'},
+            {"float",    no_argument, 0, 'f'},
+            {"help",     no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long (argc, argv, "pn:l:d:zfh", long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c)
+        {
+        case 'p': opt.pace = true; break;
+        case 'n': repeat = stoi(optarg); break;
+        case 'l': opt.latency = stof(optarg); break;
+        case 'd': opt.decodeThreads = stoi(optarg); break;
+        case 'z': opt.zeroCopy = true; break;
+        case 'f': opt.floats = true; break;
+        case 'h': return printHelp();
+        default: return printHelp();
+        }
+    }
+    if (optind >= argc)
+        return printHelp();
+
+    Trace trace;
+    if (!LoadTrace(argv[optind], trace))
+        return -1;
+    const double duration = trace.records.back().time*1e-9;
+    cout << "Trace: " << trace.records.size() << " transfers, " << trace.packets << " packets, "
+         << ((trace.header.flags & LinkTraceHeader::MIMO) ? "MIMO" : "SISO") << " "
+         << ((trace.header.flags & LinkTraceHeader::PACKED) ? "12" : "16") << " bit, "
+         << fixed << setprecision(3) << duration << " s";
+    if (trace.header.sampleRate > 0)
+        cout << " at " << trace.header.sampleRate/1e6 << " MS/s";
+    cout << endl;
+    cout << "  timestamp gaps: " << trace.gaps << ", expected lost: " << trace.lost << ", Tx loss flags: " << trace.lossFlags
+         << ", transfers missing from trace: " << trace.dropped << endl;
+    cout << "Replay: " << (opt.pace ? "recorded pace" : "as fast as possible") << ", decode threads: " << opt.decodeThreads
+         << ", " << (opt.zeroCopy ? "zero-copy" : (opt.floats ? "float32" : "int16")) << " reads" << endl;
+    cout << setw(6) << "run" << setw(10) << "time s" << setw(10) << "MS/s" << setw(12) << "CPU us/pkt"
+         << setw(8) << "gaps" << setw(8) << "lost" << setw(9) << "overrun" << endl;
+    for (int i = 0; i < repeat; ++i)
+    {
+        const ReplayResult r = Replay(trace, opt);
+        cout << setw(6) << i + 1 << setprecision(3) << setw(10) << r.seconds
+             << setprecision(2) << setw(10) << (r.seconds > 0 ? r.samples/r.seconds/1e6 : 0) << setw(12) << r.cpuPerPacket_us
+             << setw(8) << r.gaps << setw(8) << r.lost << setw(9) << r.overrun << endl;
+    }
+    return 0;
+}
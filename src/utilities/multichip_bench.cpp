@@ -0,0 +1,191 @@
+/**
+@file multichip_bench.cpp
+@brief Measures bring-up and calibration time of boards with several LMS7002M chips
+*/
+#include "lms7_device.h"
+#include "ConnectionHandle.h"
+#include "Logger.h"
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <getopt.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace lime;
+
+//runs operation once, returns duration in milliseconds or -1 on failure
+static double Measure(const function<int()> &operation)
+{
+    auto t1 = chrono::high_resolution_clock::now();
+    if (operation() != 0)
+    {
+        cout << "failed: " << GetLastErrorMessage() << endl;
+        return -1;
+    }
+    return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - t1).count();
+}
+
+static void Print(const string &name, double ms)
+{
+    cout << left << setw(36) << name << right << setw(10) << fixed << setprecision(1) << ms << " ms" << endl;
+}
+
+struct Results
+{
+    double init;
+    double download;
+    double upload;
+    double calSequential;
+    double calConcurrent;
+};
+
+static int Run(const ConnectionHandle &handle, double bw, Results &results)
+{
+    LMS7_Device* device = LMS7_Device::CreateDevice(handle);
+    if (!device)
+    {
+        cout << "failed to open " << handle.serialize() << endl;
+        return -1;
+    }
+    //each chip has two channels, channel 4 of LimeSDR-QPCIe is ADC/DAC without LMS7002M
+    const unsigned chips = max(1u, device->GetNumChannels() / 2);
+    vector<unsigned> channels;
+    for (unsigned i = 0; i < min(device->GetNumChannels(), 2 * chips); ++i)
+        channels.push_back(i);
+    cout << device->GetInfo()->deviceName << ", " << chips << " chip(s)" << endl;
+
+    int status = -1;
+    do
+    {
+        if ((results.init = Measure([&]{ return device->Init(); })) < 0)
+            break;
+        if ((results.download = Measure([&]{ return device->Synchronize(false); })) < 0)
+            break;
+        if ((results.upload = Measure([&]{ return device->Synchronize(true); })) < 0)
+            break;
+        for (auto ch : channels)
+        {
+            device->EnableChannel(false, ch, true);
+            device->EnableChannel(true, ch, true);
+        }
+        //stored results are ignored, so every calibration runs on the chip
+        results.calSequential = Measure([&]{
+            for (auto ch : channels)
+                if (device->Calibrate(false, ch, bw, LMS_CALIBRATE_FORCE) != 0
+                    || device->Calibrate(true, ch, bw, LMS_CALIBRATE_FORCE) != 0)
+                    return -1;
+            return 0;
+        });
+        if (results.calSequential < 0)
+            break;
+        results.calConcurrent = Measure([&]{
+            if (device->CalibrateChannels(false, channels, bw, LMS_CALIBRATE_FORCE) != 0)
+                return -1;
+            return device->CalibrateChannels(true, channels, bw, LMS_CALIBRATE_FORCE);
+        });
+        if (results.calConcurrent < 0)
+            break;
+        status = 0;
+    } while (false);
+    delete device;
+    return status;
+}
+
+int printHelp(void)
+{
+    cout << "multichip_bench [options]" << endl;
+    cout << "    -h, --help\t\t\t This help" << endl;
+    cout << "    -d, --device <index>\t Device index (default 0)" << endl;
+    cout << "    -e, --emulator <options>\t Use emulated board, e.g. \"chips=2;latency=250\"," << endl;
+    cout << "    \t\t\t\t one chip board with same options is measured for reference" << endl;
+    cout << "    -b, --bw <Hz>\t\t Calibration bandwidth (default 10e6)" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int deviceIndex = 0;
+    string emulatorOptions;
+    bool emulator = false;
+    double bw = 10e6;
+    int c;
+    while (1)
+    {
+        static struct option long_options[] =
+        {
+            {"device",   required_argument, 0, 'd'},
+            {"emulator", required_argument, 0, 'e'},
+            {"bw",       required_argument, 0, 'b'},
+            {"help",     no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long (argc, argv, "d:e:b:h", long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c)
+        {
+        case 'd': deviceIndex = stoi(optarg); break;
+        case 'e': emulator = true; emulatorOptions = optarg; break;
+        case 'b': bw = stod(optarg); break;
+        case 'h': return printHelp();
+        default: return printHelp();
+        }
+    }
+    registerLogHandler([](const LogLevel level, const char *message){
+        if (level <= LOG_LEVEL_ERROR)
+            cout << message << endl;
+    });
+
+    ConnectionHandle handle;
+    if (emulator)
+    {
+        handle.media = "emulator";
+        handle.addr = emulatorOptions;
+    }
+    else
+    {
+        auto handles = LMS7_Device::GetDeviceList();
+        if (deviceIndex < 0 || size_t(deviceIndex) >= handles.size())
+        {
+            cout << "device " << deviceIndex << " not found" << endl;
+            return -1;
+        }
+        handle = handles[deviceIndex];
+    }
+
+    //chips of emulated board are brought up in parallel, one chip board
+    //shows how long it would take to do it for each chip in sequence
+    Results single;
+    bool haveSingle = false;
+    if (emulator)
+    {
+        ConnectionHandle singleHandle = handle;
+        singleHandle.addr = emulatorOptions + ";chips=1";
+        if (Run(singleHandle, bw, single) != 0)
+            return -1;
+        haveSingle = true;
+    }
+
+    Results results;
+    if (Run(handle, bw, results) != 0)
+        return -1;
+
+    if (haveSingle)
+    {
+        Print("one chip Init", single.init);
+        Print("one chip Rx/Tx calibration", single.calSequential);
+    }
+    Print("Init", results.init);
+    Print("Synchronize from chip", results.download);
+    Print("Synchronize to chip", results.upload);
+    Print("Rx/Tx calibration, sequential", results.calSequential);
+    Print("Rx/Tx calibration, concurrent", results.calConcurrent);
+    cout << left << setw(36) << "calibration speedup" << right << setw(10) << setprecision(2)
+        << results.calSequential / results.calConcurrent << " x" << endl;
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**
+@file register_bench.cpp
+@brief Measures LMS7002M register cache access throughput without hardware
+*/
+#include "LMS7002M.h"
+#include "LMS7002M_parameters.h"
+#include "LMS7002M_RegistersMap.h"
+#include <iostream>
+#include <iomanip>
+#include <getopt.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace lime;
+
+//parameters spread over register pages of both channels
+static const LMS7Parameter* params[] = {
+    &LMS7_SEL_PATH_RFE, &LMS7_PD_LNA_RFE, &LMS7_CG_IAMP_TBB, &LMS7_SEL_BAND1_TRF,
+    &LMS7_INT_SDM, &LMS7_SEL_VCO, &LMS7_CSW_VCO, &LMS7_ICT_VCO, &LMS7_EN_INTONLY_SDM,
+    &LMS7_DIV_OUTCH_CGEN, &LMS7_CSW_VCO_CGEN, &LMS7_RSSI_PD, &LMS7_MUX_BIAS_OUT,
+};
+static const int paramsCount = sizeof(params)/sizeof(params[0]);
+
+//runs operation repeatedly, returns operations per second
+static double Measure(const function<void(int)> &operation, int batch, double minSeconds)
+{
+    auto t1 = chrono::high_resolution_clock::now();
+    long long done = 0;
+    double elapsed = 0;
+    do
+    {
+        for (int i = 0; i < batch; ++i)
+            operation(i);
+        done += batch;
+        elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - t1).count();
+    } while (elapsed < minSeconds);
+    return done / elapsed;
+}
+
+int printHelp(void)
+{
+    cout << "register_bench [options]" << endl;
+    cout << "    -h, --help\t\t This help" << endl;
+    cout << "    -t, --time <s>\t Minimum measurement time per test (default 0.5)" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    double minSeconds = 0.5;
+    int c;
+    while (1)
+    {
+        static struct option long_options[] =
+        {
+            {"time",    required_argument, 0, 't'},
+            {"help",    no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long (argc, argv, "t:h", long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c)
+        {
+        case 't': minSeconds = stod(optarg); break;
+        case 'h': return printHelp();
+        default: return printHelp();
+        }
+    }
+
+    //not connected chip with cache enabled, all accesses are served from register map
+    LMS7002M lms;
+    lms.EnableValuesCache(true);
+    lms.SetActiveChannel(LMS7002M::ChA);
+
+    volatile unsigned sink = 0;
+    vector<string> names;
+    for (auto p : params)
+        names.push_back(p->name);
+    const double lookupRate = Measure([&](int i){
+        sink += LMS7002M::GetParam(names[i % paramsCount])->address;
+    }, 1024, minSeconds);
+
+    const double getRate = Measure([&](int i){
+        sink += lms.Get_SPI_Reg_bits(*params[i % paramsCount]);
+    }, 1024, minSeconds);
+
+    const double modifyRate = Measure([&](int i){
+        const LMS7Parameter &p = *params[i % paramsCount];
+        lms.Modify_SPI_Reg_bits(p, (i / paramsCount) & ((1 << (p.msb - p.lsb + 1)) - 1));
+    }, 1024, minSeconds);
+
+    const double backupRate = Measure([&](int i){
+        LMS7002M_RegistersMap* backup = lms.BackupRegisterMap();
+        lms.Modify_SPI_Reg_bits(*params[i % paramsCount], i & 1);
+        lms.RestoreRegisterMap(backup);
+    }, 64, minSeconds);
+
+    cout << left << setw(32) << "parameter lookup by name" << right << setw(10) << fixed << setprecision(2) << lookupRate/1e6 << " M/s" << endl;
+    cout << left << setw(32) << "cached parameter get" << right << setw(10) << getRate/1e6 << " M/s" << endl;
+    cout << left << setw(32) << "cached parameter modify" << right << setw(10) << modifyRate/1e6 << " M/s" << endl;
+    cout << left << setw(32) << "register map backup/restore" << right << setw(10) << backupRate/1e3 << " k/s" << endl;
+    return sink == 0xFFFFFFFF;
+}
@@ -0,0 +1,611 @@
+/**
+@file stream_bench.cpp
+@brief Measures streaming performance of Streamer using a synthetic device
+*/
+#include "Streamer.h"
+#include "IConnection.h"
+#include "FPGA_common.h"
+#include "LMS7002M.h"
+#include <iostream>
+#include <iomanip>
+#include <getopt.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <ctime>
+#include <string.h>
+
+using namespace std;
+using namespace lime;
+
+typedef chrono::steady_clock Clock;
+
+/** @brief In-process connection generating timestamped FPGA packets.
+    Models a device producing packets at a fixed sample rate, with limited
+    on-board buffering. Transfers complete when the device would have
+    produced all of their packets, packets that did not fit into device
+    buffer while the host was late are dropped, as hardware does.
+    In Tx direction the device consumes packets at the same rate, sending
+    transfers complete when their packets fit into device buffer, and time
+    the device buffer stayed empty is counted as dropped packets.
+*/
+class MockConnection : public IConnection
+{
+public:
+    MockConnection(int buffersCount, int deviceBufferPackets) :
+        deviceDropped(0),
+        txGaps(0),
+        txPackets(0),
+        buffersCount(buffersCount),
+        deviceBufferPackets(deviceBufferPackets),
+        packetPeriod(0),
+        samplesInPacket(0),
+        nextPacket(0),
+        submitted(0),
+        completed(0),
+        startTime(0),
+        readyTimes(cLatencySlots)
+    {
+        lmsRegisters.resize(0x10000, 0);
+    }
+
+    //! Prepares packet payload and pacing, rate 0 produces packets as fast as they are consumed
+    void Configure(bool mimo, bool packed, double sampleRate)
+    {
+        const int chCount = mimo ? 2 : 1;
+        samplesInPacket = (packed ? samples12InPkt : samples16InPkt)/chCount;
+        packetPeriod = sampleRate > 0 ? samplesInPacket/sampleRate : 0;
+
+        //one tone per channel, payload is constant, only headers change
+        vector<complex16_t> ch[2];
+        const int amplitude = packed ? 1800 : 29000;
+        for (int c = 0; c < chCount; ++c)
+        {
+            ch[c].resize(samplesInPacket);
+            for (uint32_t i = 0; i < samplesInPacket; ++i)
+            {
+                const double phase = 2*M_PI*i*(c+1)/64.0;
+                ch[c][i].i = amplitude*cos(phase);
+                ch[c][i].q = amplitude*sin(phase);
+            }
+        }
+        const complex16_t* src[2] = {ch[0].data(), ch[chCount-1].data()};
+        memset(payload, 0, sizeof(payload));
+        FPGA::Samples2FPGAPacketPayload(src, samplesInPacket, mimo, packed, payload);
+        filledBuffers.clear();
+        transfers.clear();
+        nextPacket = 0;
+        deviceDropped = 0;
+        submitted = 0;
+        completed = 0;
+        txGaps = 0;
+        txPackets = 0;
+        txLatencies.clear();
+    }
+
+    //! Records time when Tx packet with given timestamp was written to Streamer
+    void SetPacketWriteTime(uint64_t timestamp, double time)
+    {
+        readyTimes[(timestamp/samplesInPacket) % cLatencySlots].store(time, memory_order_release);
+    }
+
+    //! Time in seconds when packet with given timestamp was handed to Streamer
+    double PacketReadyTime(uint64_t timestamp) const
+    {
+        const uint64_t index = timestamp/samplesInPacket;
+        return readyTimes[index % cLatencySlots].load(memory_order_acquire);
+    }
+
+    static double Now()
+    {
+        return chrono::duration<double>(Clock::now().time_since_epoch()).count();
+    }
+
+    int WriteLMS7002MSPI(const uint32_t *writeData, size_t size, unsigned) override
+    {
+        for (size_t i = 0; i < size; ++i)
+            lmsRegisters[(writeData[i] >> 16) & 0x7FFF] = writeData[i] & 0xFFFF;
+        return 0;
+    }
+
+    int ReadLMS7002MSPI(const uint32_t *writeData, uint32_t *readData, size_t size, unsigned) override
+    {
+        for (size_t i = 0; i < size; ++i)
+            readData[i] = lmsRegisters[(writeData[i] >> 16) & 0x7FFF];
+        return 0;
+    }
+
+    int WriteRegisters(const uint32_t *addrs, const uint32_t *data, const size_t size) override
+    {
+        for (size_t i = 0; i < size; ++i)
+            fpgaRegisters[addrs[i]] = data[i];
+        return 0;
+    }
+
+    int ReadRegisters(const uint32_t *addrs, uint32_t *data, const size_t size) override
+    {
+        for (size_t i = 0; i < size; ++i)
+            data[i] = fpgaRegisters[addrs[i]];
+        return 0;
+    }
+
+    int GetBuffersCount() const override
+    {
+        return buffersCount;
+    }
+
+    int CheckStreamSize(int size) const override
+    {
+        return size;
+    }
+
+    int BeginDataReading(char* buffer, uint32_t length, int) override
+    {
+        const uint32_t packets = length/sizeof(FPGA_DataPacket);
+        Transfer t;
+        t.buffer = buffer;
+        t.packets = packets;
+        if (packetPeriod > 0)
+        {
+            if (submitted == 0)
+                startTime = Now();
+            //device keeps producing while no transfer is queued, excess is lost
+            const double now = Now();
+            const int64_t produced = (now - startTime)/packetPeriod;
+            if (produced - (int64_t)nextPacket > deviceBufferPackets)
+            {
+                const uint64_t skip = produced - deviceBufferPackets - nextPacket;
+                deviceDropped += skip;
+                nextPacket += skip;
+            }
+            t.readyTime = startTime + (nextPacket + packets)*packetPeriod;
+        }
+        else
+            t.readyTime = 0;
+        t.firstPacket = nextPacket;
+        nextPacket += packets;
+        transfers[submitted % cMaxTransfers] = t;
+        return submitted++ % cMaxTransfers;
+    }
+
+    bool WaitForReading(int handle, unsigned int timeout_ms) override
+    {
+        const Transfer &t = transfers[handle];
+        if (t.readyTime == 0)
+            return true;
+        const double wait = t.readyTime - Now();
+        if (wait > timeout_ms/1000.0)
+        {
+            this_thread::sleep_for(chrono::milliseconds(timeout_ms));
+            return false;
+        }
+        if (wait > 0)
+            this_thread::sleep_for(chrono::duration<double>(wait));
+        return true;
+    }
+
+    int FinishDataReading(char* buffer, uint32_t, int handle) override
+    {
+        const Transfer &t = transfers[handle];
+        FPGA_DataPacket* pkt = (FPGA_DataPacket*)buffer;
+        //payload stays in transfer buffer, Streamer only reads it
+        const bool fill = filledBuffers.insert(buffer).second;
+        const double now = Now();
+        for (uint32_t i = 0; i < t.packets; ++i)
+        {
+            if (fill)
+                memcpy(pkt[i].data, payload, sizeof(payload));
+            memset(pkt[i].reserved, 0, sizeof(pkt[i].reserved));
+            pkt[i].counter = (t.firstPacket + i)*samplesInPacket;
+            readyTimes[(t.firstPacket + i) % cLatencySlots].store(now, memory_order_release);
+        }
+        ++completed;
+        return t.packets*sizeof(FPGA_DataPacket);
+    }
+
+    void AbortReading(int) override
+    {
+    }
+
+    int BeginDataSending(const char* buffer, uint32_t length, int) override
+    {
+        const FPGA_DataPacket* pkt = (const FPGA_DataPacket*)buffer;
+        const uint32_t packets = length/sizeof(FPGA_DataPacket);
+        const double now = Now();
+        for (uint32_t i = 0; i < packets; ++i)
+        {
+            if (pkt[i].counter != nextPacket*samplesInPacket)
+                ++txGaps;
+            nextPacket = pkt[i].counter/samplesInPacket + 1;
+            txLatencies.push_back((now - PacketReadyTime(pkt[i].counter))*1e6);
+        }
+        txPackets += packets;
+        Transfer t;
+        t.buffer = (char*)buffer;
+        t.packets = packets;
+        if (packetPeriod > 0)
+        {
+            if (submitted == 0)
+                startTime = now;
+            //device buffer ran empty before this transfer arrived, playback resumes now
+            const int64_t consumed = (now - startTime)/packetPeriod;
+            if (consumed > (int64_t)completed)
+            {
+                deviceDropped += consumed - completed;
+                startTime = now - completed*packetPeriod;
+            }
+            t.readyTime = startTime + ((int64_t)(completed + packets) - deviceBufferPackets)*packetPeriod;
+        }
+        else
+            t.readyTime = 0;
+        completed += packets; //packets handed to device
+        transfers[submitted % cMaxTransfers] = t;
+        return submitted++ % cMaxTransfers;
+    }
+
+    bool WaitForSending(int handle, uint32_t timeout_ms) override
+    {
+        return WaitForReading(handle, timeout_ms);
+    }
+
+    int FinishDataSending(const char*, uint32_t length, int) override
+    {
+        return length;
+    }
+
+    void AbortSending(int) override
+    {
+    }
+
+    uint64_t deviceDropped;
+    uint64_t txGaps; //Tx packets not following previous one
+    uint64_t txPackets; //Tx packets handed to device
+    vector<float> txLatencies; //from write to link, filled by Tx thread
+
+private:
+    struct Transfer
+    {
+        char* buffer;
+        uint32_t packets;
+        uint64_t firstPacket;
+        double readyTime;
+    };
+    static const int cMaxTransfers = 256;
+    static const int cLatencySlots = 1 << 16;
+
+    int buffersCount;
+    int deviceBufferPackets;
+    double packetPeriod;
+    uint32_t samplesInPacket;
+    uint64_t nextPacket;
+    uint64_t submitted;
+    uint64_t completed;
+    double startTime;
+    uint8_t payload[sizeof(FPGA_DataPacket::data)];
+    map<int, Transfer> transfers;
+    set<char*> filledBuffers;
+    vector<atomic<double>> readyTimes;
+    vector<uint16_t> lmsRegisters;
+    map<uint32_t, uint32_t> fpgaRegisters;
+};
+
+struct BenchOptions
+{
+    double sampleRate;
+    double seconds;
+    float latency;
+    int decodeThreads;
+    int buffersCount;
+    bool zeroCopy;
+    bool floats;
+    bool tx;
+};
+
+struct BenchResult
+{
+    double msps;
+    double cpuPerPacket_us;
+    vector<float> latencies;
+    uint64_t packets;
+    uint64_t gaps;
+    uint64_t lost;
+    uint64_t overrun;
+    uint64_t deviceDropped;
+};
+
+//writes tone packets to Tx streams, Streamer transmit thread sends them to mock device
+static void RunTx(const BenchOptions &opt, MockConnection &port, StreamChannel** channels, int chCount, bool packed, BenchResult &result)
+{
+    const uint32_t samplesInPacket = (packed ? samples12InPkt : samples16InPkt)/chCount;
+    const int amplitude = packed ? 1800 : 29000;
+    vector<complex16_t> tone(samplesInPacket);
+    vector<float> toneFloat(2*samplesInPacket);
+    for (uint32_t i = 0; i < samplesInPacket; ++i)
+    {
+        const double phase = 2*M_PI*i/64.0;
+        tone[i].i = amplitude*cos(phase);
+        tone[i].q = amplitude*sin(phase);
+        toneFloat[2*i] = cos(phase);
+        toneFloat[2*i+1] = sin(phase);
+    }
+    port.txLatencies.reserve(opt.sampleRate > 0 ? opt.sampleRate*opt.seconds/samplesInPacket + 1024 : 1 << 20);
+    uint64_t timestamp = 0;
+
+    for (int c = 0; c < chCount; ++c)
+        channels[c]->Start();
+    const auto t1 = Clock::now();
+    const clock_t cpu1 = clock();
+    double elapsed = 0;
+    while (elapsed < opt.seconds)
+    {
+        for (int c = 0; c < chCount; ++c)
+        {
+            StreamChannel::Metadata meta;
+            meta.timestamp = timestamp;
+            meta.flags = 0;
+            //link packet holds samples of all channels, it can be sent once the last one is written
+            if (c == chCount-1)
+                port.SetPacketWriteTime(timestamp, MockConnection::Now());
+            int count;
+            if (opt.zeroCopy)
+            {
+                size_t handle;
+                complex16_t* data;
+                count = channels[c]->AcquireWrite(handle, &data, 1000);
+                if (count > 0)
+                {
+                    count = min<int>(count, samplesInPacket);
+                    memcpy(data, tone.data(), count*sizeof(complex16_t));
+                    count = channels[c]->CommitWrite(handle, count, &meta);
+                }
+            }
+            else if (opt.floats)
+                count = channels[c]->Write(toneFloat.data(), samplesInPacket, &meta, 1000);
+            else
+                count = channels[c]->Write(tone.data(), samplesInPacket, &meta, 1000);
+            if (count <= 0)
+            {
+                cerr << "Write timeout" << endl;
+                elapsed = opt.seconds;
+                break;
+            }
+            ++result.packets;
+        }
+        timestamp += samplesInPacket;
+        elapsed = chrono::duration<double>(Clock::now() - t1).count();
+    }
+    const clock_t cpu2 = clock();
+
+    for (int c = 0; c < chCount; ++c)
+    {
+        StreamChannel::Info info = channels[c]->GetInfo();
+        result.lost += info.underrun;
+        result.overrun += info.overrun;
+    }
+    for (int c = 0; c < chCount; ++c)
+        channels[c]->Stop();
+    for (int c = 0; c < chCount; ++c)
+        channels[c]->Close();
+
+    //rate of samples taken by device, writes run ahead of it by FIFO size
+    result.msps = port.txPackets*samplesInPacket*chCount/elapsed/1e6;
+    if (result.packets)
+        result.cpuPerPacket_us = 1e6*(cpu2 - cpu1)/CLOCKS_PER_SEC/result.packets;
+    result.latencies.swap(port.txLatencies);
+    result.gaps = port.txGaps;
+    result.deviceDropped = port.deviceDropped;
+}
+
+static BenchResult RunBenchmark(const BenchOptions &opt, bool mimo, bool packed)
+{
+    BenchResult result = {};
+    MockConnection port(opt.buffersCount, 256);
+    port.Configure(mimo, packed, opt.sampleRate);
+    FPGA fpga;
+    fpga.SetConnection(&port);
+    LMS7002M lms;
+    lms.SetConnection(&port);
+    lms.EnableValuesCache(true);
+    Streamer streamer(&fpga, &lms, 0);
+
+    const int chCount = mimo ? 2 : 1;
+    StreamChannel* channels[2] = {nullptr, nullptr};
+    for (int c = 0; c < chCount; ++c)
+    {
+        StreamConfig config;
+        config.isTx = opt.tx;
+        config.channelID = c;
+        config.align = false;
+        config.performanceLatency = opt.latency;
+        config.bufferLength = 0;
+        config.format = opt.floats ? StreamConfig::FMT_FLOAT32 : StreamConfig::FMT_INT16;
+        config.linkFormat = packed ? StreamConfig::FMT_INT12 : StreamConfig::FMT_INT16;
+        config.decodeThreads = opt.decodeThreads;
+        channels[c] = streamer.SetupStream(config);
+        if (channels[c] == nullptr)
+            return result;
+    }
+    if (opt.tx)
+    {
+        RunTx(opt, port, channels, chCount, packed, result);
+        return result;
+    }
+
+    const uint32_t samplesInPacket = (packed ? samples12InPkt : samples16InPkt)/chCount;
+    vector<float> buffer(2*samplesInPacket);
+    uint64_t expected[2] = {0, 0};
+    uint64_t samples = 0;
+    result.latencies.reserve(opt.sampleRate > 0 ? opt.sampleRate*opt.seconds*chCount/samplesInPacket + 1024 : 1 << 20);
+
+    for (int c = 0; c < chCount; ++c)
+        channels[c]->Start();
+    const auto t1 = Clock::now();
+    const clock_t cpu1 = clock();
+    double elapsed = 0;
+    while (elapsed < opt.seconds)
+    {
+        for (int c = 0; c < chCount; ++c)
+        {
+            StreamChannel::Metadata meta;
+            int count;
+            if (opt.zeroCopy)
+            {
+                size_t handle;
+                const complex16_t* data;
+                count = channels[c]->AcquireRead(handle, &data, &meta, 1000);
+                if (count > 0)
+                    channels[c]->ReleaseRead(handle);
+            }
+            else
+                count = channels[c]->Read(buffer.data(), samplesInPacket, &meta, 1000);
+            if (count <= 0)
+            {
+                cerr << "Read timeout" << endl;
+                elapsed = opt.seconds;
+                break;
+            }
+            const double now = MockConnection::Now();
+            result.latencies.push_back((now - port.PacketReadyTime(meta.timestamp))*1e6);
+            if (meta.timestamp != expected[c])
+                ++result.gaps;
+            expected[c] = meta.timestamp + count;
+            samples += count;
+            ++result.packets;
+        }
+        elapsed = chrono::duration<double>(Clock::now() - t1).count();
+    }
+    const clock_t cpu2 = clock();
+
+    for (int c = 0; c < chCount; ++c)
+    {
+        StreamChannel::Info info = channels[c]->GetInfo();
+        result.lost += info.droppedPackets;
+        result.overrun += info.overrun;
+        channels[c]->Stop();
+    }
+    for (int c = 0; c < chCount; ++c)
+        channels[c]->Close();
+
+    result.msps = samples/elapsed/1e6;
+    if (result.packets)
+        result.cpuPerPacket_us = 1e6*(cpu2 - cpu1)/CLOCKS_PER_SEC/result.packets;
+    result.deviceDropped = port.deviceDropped;
+    return result;
+}
+
+static float Percentile(const vector<float> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    return sorted[min(sorted.size() - 1, (size_t)(p*sorted.size()))];
+}
+
+int printHelp(void)
+{
+    cout << "stream_bench [options]" << endl;
+    cout << "    -h, --help\t\t This help" << endl;
+    cout << "    -r, --rate <MS/s>\t Sample rate per channel, 0 for unpaced (default 30.72)" << endl;
+    cout << "    -t, --time <s>\t Measurement time per configuration (default 3)" << endl;
+    cout << "    -l, --latency <0-1>\t Stream performance latency (default 0.5)" << endl;
+    cout << "    -d, --decode <n>\t Number of RX decode threads (default 0)" << endl;
+    cout << "    -b, --buffers <n>\t Number of transfers in flight, power of 2 (default 16)" << endl;
+    cout << "    -z, --zerocopy\t Read packets in place instead of copying" << endl;
+    cout << "    -f, --float\t\t Read samples as float32" << endl;
+    cout << "    -x, --tx\t\t Write Tx streams instead of reading Rx streams" << endl;
+    cout << "Packets are generated in-process, CPU cost includes generation and reading." << endl;
+    cout << "Tx latency is from write to link, lost counts FIFO underruns and dev drop" << endl;
+    cout << "counts packets the device had no data for." << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions opt;
+    opt.sampleRate = 30.72e6;
+    opt.seconds = 3;
+    opt.latency = 0.5;
+    opt.decodeThreads = 0;
+    opt.buffersCount = 16;
+    opt.zeroCopy = false;
+    opt.floats = false;
+    opt.tx = false;
+    int c;
+    while (1)
+    {
+        static struct option long_options[] =
+        {
+            {"rate",     required_argument, 0, 'r'},
+            {"time",     required_argument, 0, 't'},
+            {"latency",  required_argument, 0, 'l'},
+            {"decode",   required_argument, 0, 'd'},
+            {"buffers",  required_argument, 0, 'b'},
+            {"zerocopy", no_argument, 0, 'z'},
+            {"float",    no_argument, 0, 'f'},
+            {"tx",       no_argument, 0, 'x'},
+            {"help",     no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long (argc, argv, "r:t:l:d:b:zfxh", long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c)
+        {
+        case 'r': opt.sampleRate = stod(optarg)*1e6; break;
+        case 't': opt.seconds = stod(optarg); break;
+        case 'l': opt.latency = stof(optarg); break;
+        case 'd': opt.decodeThreads = stoi(optarg); break;
+        case 'b': opt.buffersCount = stoi(optarg); break;
+        case 'z': opt.zeroCopy = true; break;
+        case 'f': opt.floats = true; break;
+        case 'x': opt.tx = true; break;
+        case 'h': return printHelp();
+        default: return printHelp();
+        }
+    }
+    if (opt.buffersCount < 1 || (opt.buffersCount & (opt.buffersCount - 1)) || opt.buffersCount > 128)
+    {
+        cerr << "Buffers count must be a power of 2, up to 128" << endl;
+        return -1;
+    }
+    if (opt.zeroCopy && opt.floats)
+        cerr << "Zero-copy access is in link format, --float ignored" << endl;
+
+    cout << "Rate: ";
+    if (opt.sampleRate > 0)
+        cout << opt.sampleRate/1e6 << " MS/s per channel";
+    else
+        cout << "unpaced";
+    if (!opt.tx)
+        cout << ", decode threads: " << opt.decodeThreads;
+    cout << ", " << (opt.zeroCopy ? "zero-copy" : (opt.floats ? "float32" : "int16")) << (opt.tx ? " writes" : " reads") << endl;
+    cout << left << setw(10) << "config" << right
+         << setw(10) << "MS/s" << setw(12) << "CPU us/pkt"
+         << setw(10) << "p50 us" << setw(10) << "p90 us" << setw(10) << "p99 us" << setw(10) << "max us"
+         << setw(8) << "gaps" << setw(8) << "lost" << setw(9) << "overrun" << setw(9) << "dev drop" << endl;
+
+    const struct { const char* name; bool mimo; bool packed; } configs[] =
+    {
+        {"SISO 12", false, true},
+        {"SISO 16", false, false},
+        {"MIMO 12", true, true},
+        {"MIMO 16", true, false},
+    };
+    for (auto &cfg : configs)
+    {
+        BenchResult r = RunBenchmark(opt, cfg.mimo, cfg.packed);
+        sort(r.latencies.begin(), r.latencies.end());
+        cout << left << setw(10) << cfg.name << right << fixed
+             << setprecision(2) << setw(10) << r.msps << setw(12) << r.cpuPerPacket_us
+             << setprecision(0)
+             << setw(10) << Percentile(r.latencies, 0.5) << setw(10) << Percentile(r.latencies, 0.9)
+             << setw(10) << Percentile(r.latencies, 0.99) << setw(10) << (r.latencies.empty() ? 0 : r.latencies.back())
+             << setw(8) << r.gaps << setw(8) << r.lost << setw(9) << r.overrun << setw(9) << r.deviceDropped << endl;
+    }
+    return 0;
+}
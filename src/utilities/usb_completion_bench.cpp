@@ -0,0 +1,210 @@
+/**
+@file usb_completion_bench.cpp
+@brief Measures CPU cost of submitting and completing USB transfer contexts
+*/
+#include "CompletionQueue.h"
+#include <iostream>
+#include <iomanip>
+#include <getopt.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <sys/resource.h>
+
+using namespace std;
+using namespace lime;
+
+typedef chrono::steady_clock Clock;
+
+static double ThreadCPUTime()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+//completion signalling used by connections before, one mutex and condition variable per context
+class ConditionCompletions
+{
+public:
+    explicit ConditionCompletions(unsigned contexts) : mContexts(contexts) {}
+    void Clear(unsigned i)
+    {
+        std::lock_guard<std::mutex> lock(mContexts[i].mutex);
+        mContexts[i].done = false;
+    }
+    void Push(unsigned i)
+    {
+        std::unique_lock<std::mutex> lock(mContexts[i].mutex);
+        mContexts[i].done = true;
+        lock.unlock();
+        mContexts[i].cv.notify_one();
+    }
+    bool Wait(unsigned i, unsigned timeout_ms)
+    {
+        std::unique_lock<std::mutex> lock(mContexts[i].mutex);
+        return mContexts[i].cv.wait_for(lock, chrono::milliseconds(timeout_ms), [&]{ return mContexts[i].done; });
+    }
+private:
+    struct Context
+    {
+        bool done = false;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    vector<Context> mContexts;
+};
+
+struct Options
+{
+    unsigned contexts;
+    uint64_t transfers;
+    double rate; //completions per second, 0 for unlimited
+};
+
+struct Result
+{
+    double seconds;
+    double streamCPU;
+    double eventCPU;
+    uint64_t timeouts;
+};
+
+/* Stream thread submits contexts in order and waits for the oldest one like
+   Streamer does, event thread stands in for libusb event handling and
+   completes submitted transfers at the requested rate. */
+template<class Completions>
+static Result Run(const Options &opt)
+{
+    Completions completions(opt.contexts);
+    //submission side is shared by both methods, so only completion path differs
+    vector<atomic<bool> > submitted(opt.contexts);
+    for (auto &s : submitted)
+        s.store(false);
+    AdaptiveWait hasSubmitted;
+    atomic<bool> running(true);
+    double eventCPU = 0;
+
+    thread eventThread([&]{
+        const double cpu0 = ThreadCPUTime();
+        auto next = Clock::now();
+        const auto period = chrono::duration_cast<Clock::duration>(chrono::duration<double>(opt.rate > 0 ? 1.0 / opt.rate : 0));
+        for (uint64_t n = 0; n < opt.transfers; ++n)
+        {
+            const unsigned i = n % opt.contexts;
+            if (!hasSubmitted.wait_for([&]{ return submitted[i].load(memory_order_acquire) || !running.load(); }, 1000) || !running.load())
+                break;
+            if (opt.rate > 0)
+            {
+                next += period;
+                this_thread::sleep_until(next);
+            }
+            submitted[i].store(false, memory_order_relaxed);
+            completions.Push(i);
+        }
+        eventCPU = ThreadCPUTime() - cpu0;
+    });
+
+    Result result;
+    result.timeouts = 0;
+    const double cpu0 = ThreadCPUTime();
+    const auto t0 = Clock::now();
+    uint64_t begun = 0;
+    for (uint64_t n = 0; n < opt.transfers; ++n)
+    {
+        while (begun < opt.transfers && begun < n + opt.contexts)
+        {
+            const unsigned i = begun++ % opt.contexts;
+            completions.Clear(i);
+            submitted[i].store(true, memory_order_release);
+            hasSubmitted.notify();
+        }
+        if (!completions.Wait(n % opt.contexts, 1000))
+        {
+            ++result.timeouts;
+            break;
+        }
+    }
+    result.seconds = chrono::duration<double>(Clock::now() - t0).count();
+    result.streamCPU = ThreadCPUTime() - cpu0;
+    running.store(false);
+    hasSubmitted.notify();
+    eventThread.join();
+    result.eventCPU = eventCPU;
+    return result;
+}
+
+static void Print(const string &name, const Options &opt, const Result &r)
+{
+    const double perTransfer = 1e6 / opt.transfers;
+    cout << left << setw(22) << name << right << fixed << setprecision(3)
+        << setw(10) << r.seconds << " s"
+        << setw(12) << setprecision(0) << opt.transfers / r.seconds << " /s"
+        << setw(10) << setprecision(2) << r.streamCPU * perTransfer << " us"
+        << setw(10) << r.eventCPU * perTransfer << " us";
+    if (r.timeouts)
+        cout << "  " << r.timeouts << " timeout(s)";
+    cout << endl;
+}
+
+int printHelp(void)
+{
+    cout << "usb_completion_bench [options]" << endl;
+    cout << "    -h, --help\t\t\t This help" << endl;
+    cout << "    -c, --contexts <count>\t Transfers in flight (default 16)" << endl;
+    cout << "    -n, --transfers <count>\t Number of transfers (default 1000000)" << endl;
+    cout << "    -r, --rate <count>\t\t Completions per second, 0 for unlimited (default 0)," << endl;
+    cout << "    \t\t\t\t e.g. 8000 for 16 KB transfers at 125 MB/s" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    opt.contexts = 16;
+    opt.transfers = 1000000;
+    opt.rate = 0;
+    int c;
+    while (1)
+    {
+        static struct option long_options[] =
+        {
+            {"contexts",  required_argument, 0, 'c'},
+            {"transfers", required_argument, 0, 'n'},
+            {"rate",      required_argument, 0, 'r'},
+            {"help",      no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long (argc, argv, "c:n:r:h", long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c)
+        {
+        case 'c': opt.contexts = stoul(optarg); break;
+        case 'n': opt.transfers = stoull(optarg); break;
+        case 'r': opt.rate = stod(optarg); break;
+        case 'h': return printHelp();
+        default: return printHelp();
+        }
+    }
+    if (opt.contexts == 0 || opt.transfers == 0)
+        return printHelp();
+
+    cout << opt.contexts << " contexts, " << opt.transfers << " transfers";
+    if (opt.rate > 0)
+        cout << ", " << int(opt.rate) << " completions/s";
+    cout << endl;
+    cout << left << setw(22) << "method" << right << setw(12) << "time" << setw(15) << "rate"
+        << setw(13) << "stream CPU" << setw(13) << "event CPU" << endl;
+    Print("mutex+cond. variable", opt, Run<ConditionCompletions>(opt));
+    Print("completion queue", opt, Run<CompletionQueue>(opt));
+    cout << "CPU time is per transfer, event thread stands in for libusb callbacks" << endl;
+    return 0;
+}
@@ -0,0 +1,352 @@
+/**
+@file xillybus_io_bench.cpp
+@brief Compares Xillybus stream transfer methods on a pipe or FIFO standing in for device file
+*/
+#include "ConnectionXillybus/AsyncStreamIO.h"
+#include <iostream>
+#include <iomanip>
+#include <getopt.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+using namespace std;
+using namespace lime;
+
+typedef chrono::steady_clock Clock;
+
+enum Method
+{
+    SPIN, ///<non-blocking read()/write() retried until it succeeds, as synchronous transfers did
+    POLL,
+    IO_URING,
+};
+
+static const char* methodNames[] = {"spin", "poll", "io_uring"};
+
+struct Options
+{
+    bool tx;
+    uint64_t totalBytes;
+    size_t bufferSize;
+    int contexts;
+    double rate; //bytes per second of device, 0 for unlimited
+};
+
+struct Result
+{
+    double seconds;
+    double transferCPU; //seconds of CPU time not used by device thread
+    uint64_t errors;
+};
+
+static double CPUTime(int who)
+{
+    rusage usage;
+    getrusage(who, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+//sleeps until given number of bytes is due at device rate
+static void Pace(const Options &options, Clock::time_point start, uint64_t bytes)
+{
+    if (options.rate > 0)
+        this_thread::sleep_until(start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(bytes / options.rate)));
+}
+
+//transfers whole block with blocking calls
+static bool TransferAll(int fd, bool write, char* data, size_t length)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+        const ssize_t count = write ? ::write(fd, data + done, length - done) : read(fd, data + done, length - done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        done += count;
+    }
+    return true;
+}
+
+/** @brief Stands in for FPGA, produces counter words for receiving or checks them when sending
+*/
+static void DeviceLoop(int fd, const Options &options, atomic<uint64_t> &errors, double &cpu)
+{
+    vector<uint32_t> block(65536 / sizeof(uint32_t));
+    char* data = reinterpret_cast<char*>(block.data());
+    uint32_t counter = 0;
+    const auto start = Clock::now();
+    for (uint64_t bytes = 0; bytes < options.totalBytes; bytes += block.size() * sizeof(uint32_t))
+    {
+        Pace(options, start, bytes);
+        const size_t length = min<uint64_t>(block.size() * sizeof(uint32_t), options.totalBytes - bytes);
+        if (!options.tx)
+        {
+            for (size_t i = 0; i < length / sizeof(uint32_t); ++i)
+                block[i] = counter++;
+            if (!TransferAll(fd, true, data, length))
+                break;
+            continue;
+        }
+        if (!TransferAll(fd, false, data, length))
+            break;
+        for (size_t i = 0; i < length / sizeof(uint32_t); ++i)
+            if (block[i] != counter++)
+            {
+                ++errors;
+                counter = block[i] + 1;
+            }
+    }
+    cpu = CPUTime(RUSAGE_THREAD);
+}
+
+//fills buffer for sending, returns number of mismatched words of received buffer
+static uint64_t Process(bool tx, char* buffer, size_t length, uint32_t &counter)
+{
+    uint32_t* words = reinterpret_cast<uint32_t*>(buffer);
+    uint64_t errors = 0;
+    for (size_t i = 0; i < length / sizeof(uint32_t); ++i)
+    {
+        if (tx)
+            words[i] = counter++;
+        else if (words[i] != counter++)
+        {
+            ++errors;
+            counter = words[i] + 1;
+        }
+    }
+    return errors;
+}
+
+static uint64_t TransferSpin(int fd, const Options &options, vector<char> &buffers)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    uint32_t counter = 0;
+    uint64_t errors = 0;
+    for (uint64_t bytes = 0; bytes < options.totalBytes; bytes += options.bufferSize)
+    {
+        char* buffer = buffers.data();
+        if (options.tx)
+            Process(true, buffer, options.bufferSize, counter);
+        size_t done = 0;
+        while (done < options.bufferSize)
+        {
+            const ssize_t count = options.tx ? write(fd, buffer + done, options.bufferSize - done)
+                : read(fd, buffer + done, options.bufferSize - done);
+            if (count < 0 && (errno == EINTR || errno == EAGAIN))
+                continue;
+            if (count <= 0)
+                return errors + 1;
+            done += count;
+        }
+        if (!options.tx)
+            errors += Process(false, buffer, options.bufferSize, counter);
+    }
+    return errors;
+}
+
+static uint64_t TransferAsync(int fd, const Options &options, vector<char> &buffers, AsyncStreamIO::Backend backend)
+{
+    AsyncStreamIO io(fd, options.tx, options.contexts, backend);
+    uint32_t counter = 0;
+    uint64_t errors = 0;
+    const uint64_t buffersCount = options.totalBytes / options.bufferSize;
+    vector<int> handles(options.contexts);
+    uint64_t begun = 0;
+    //same pattern as Streamer: keep all buffers queued, resubmit each one after processing
+    for (int i = 0; i < options.contexts && begun < buffersCount; ++i, ++begun)
+    {
+        char* buffer = &buffers[i * options.bufferSize];
+        if (options.tx)
+            Process(true, buffer, options.bufferSize, counter);
+        handles[i] = io.Begin(buffer, options.bufferSize);
+    }
+    for (uint64_t completed = 0; completed < buffersCount; ++completed)
+    {
+        const int bi = completed % options.contexts;
+        char* buffer = &buffers[bi * options.bufferSize];
+        if (!io.Wait(handles[bi], 1000) || io.Finish(handles[bi]) != int(options.bufferSize))
+            return errors + 1;
+        if (!options.tx)
+            errors += Process(false, buffer, options.bufferSize, counter);
+        if (begun < buffersCount)
+        {
+            if (options.tx)
+                Process(true, buffer, options.bufferSize, counter);
+            handles[bi] = io.Begin(buffer, options.bufferSize);
+            ++begun;
+        }
+    }
+    return errors;
+}
+
+static bool IsIOUringAvailable()
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    bool available;
+    {
+        AsyncStreamIO io(fds[0], false, 1, AsyncStreamIO::IO_URING);
+        available = io.GetBackend() == AsyncStreamIO::IO_URING;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return available;
+}
+
+static int Run(Method method, const string &fifoPath, const Options &options, Result &result)
+{
+    int fds[2]; //read end, write end
+    if (fifoPath.empty())
+    {
+        if (pipe(fds) != 0)
+            return -1;
+    }
+    else
+    {
+        unlink(fifoPath.c_str());
+        if (mkfifo(fifoPath.c_str(), 0600) != 0)
+            return -1;
+        fds[0] = open(fifoPath.c_str(), O_RDONLY | O_NONBLOCK);
+        fds[1] = open(fifoPath.c_str(), O_WRONLY);
+        fcntl(fds[0], F_SETFL, 0);
+    }
+    //device files have buffers of a few megabytes
+    fcntl(fds[1], F_SETPIPE_SZ, 1 << 20);
+
+    const int hostFd = options.tx ? fds[1] : fds[0];
+    const int deviceFd = options.tx ? fds[0] : fds[1];
+    vector<char> buffers(options.contexts * options.bufferSize);
+    atomic<uint64_t> deviceErrors(0);
+    double deviceCPU = 0;
+
+    const double cpuStart = CPUTime(RUSAGE_SELF);
+    const auto start = Clock::now();
+    thread device(DeviceLoop, deviceFd, cref(options), ref(deviceErrors), ref(deviceCPU));
+    uint64_t errors = 0;
+    switch (method)
+    {
+    case SPIN: errors = TransferSpin(hostFd, options, buffers); break;
+    case POLL: errors = TransferAsync(hostFd, options, buffers, AsyncStreamIO::POLL); break;
+    case IO_URING: errors = TransferAsync(hostFd, options, buffers, AsyncStreamIO::IO_URING); break;
+    }
+    result.seconds = chrono::duration<double>(Clock::now() - start).count();
+    //unblocks device thread if transfer stopped early
+    close(hostFd);
+    device.join();
+    result.transferCPU = CPUTime(RUSAGE_SELF) - cpuStart - deviceCPU;
+    result.errors = errors + deviceErrors;
+    close(deviceFd);
+    if (!fifoPath.empty())
+        unlink(fifoPath.c_str());
+    return 0;
+}
+
+int printHelp(void)
+{
+    cout << "xillybus_io_bench [options]" << endl;
+    cout << "    -h, --help\t\t\t This help" << endl;
+    cout << "    -t, --tx\t\t\t Measure sending instead of receiving" << endl;
+    cout << "    -s, --size <MB>\t\t Amount of data to transfer (default 1024)" << endl;
+    cout << "    -b, --buffer <bytes>\t Transfer buffer size (default 65536)" << endl;
+    cout << "    -c, --contexts <count>\t Transfers in flight (default 8)" << endl;
+    cout << "    -r, --rate <MB/s>\t\t Device data rate, 0 for unlimited (default 0)" << endl;
+    cout << "    -m, --method <name>\t\t spin, poll or io_uring (default all)" << endl;
+    cout << "    -f, --fifo <path>\t\t Use named FIFO instead of pipe" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.tx = false;
+    options.totalBytes = 1024ull << 20;
+    options.bufferSize = 65536;
+    options.contexts = 8;
+    options.rate = 0;
+    vector<Method> methods = {SPIN, POLL, IO_URING};
+    string fifoPath;
+    int c;
+    while (1)
+    {
+        static struct option long_options[] =
+        {
+            {"tx",       no_argument, 0, 't'},
+            {"size",     required_argument, 0, 's'},
+            {"buffer",   required_argument, 0, 'b'},
+            {"contexts", required_argument, 0, 'c'},
+            {"rate",     required_argument, 0, 'r'},
+            {"method",   required_argument, 0, 'm'},
+            {"fifo",     required_argument, 0, 'f'},
+            {"help",     no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long (argc, argv, "ts:b:c:r:m:f:h", long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c)
+        {
+        case 't': options.tx = true; break;
+        case 's': options.totalBytes = uint64_t(stod(optarg) * (1 << 20)); break;
+        case 'b': options.bufferSize = stoul(optarg); break;
+        case 'c': options.contexts = stoi(optarg); break;
+        case 'r': options.rate = stod(optarg) * 1e6; break;
+        case 'm':
+            methods.clear();
+            for (int i = SPIN; i <= IO_URING; ++i)
+                if (strcmp(optarg, methodNames[i]) == 0)
+                    methods.push_back(Method(i));
+            if (methods.empty())
+                return printHelp();
+            break;
+        case 'f': fifoPath = optarg; break;
+        case 'h': return printHelp();
+        default: return printHelp();
+        }
+    }
+    options.bufferSize &= ~size_t(3);
+    if (options.bufferSize == 0 || options.contexts < 1)
+        return printHelp();
+    options.totalBytes -= options.totalBytes % options.bufferSize;
+    //device thread stops writing when transfer fails early
+    signal(SIGPIPE, SIG_IGN);
+
+    cout << (options.tx ? "Tx " : "Rx ") << (options.totalBytes >> 20) << " MB, "
+         << options.bufferSize << " byte buffers, " << options.contexts << " in flight, "
+         << (options.rate > 0 ? to_string(int(options.rate / 1e6)) + " MB/s device rate" : string("unlimited rate")) << endl;
+    cout << left << setw(10) << "method" << right << setw(12) << "MB/s" << setw(12) << "CPU %" << setw(10) << "errors" << endl;
+    for (auto method : methods)
+    {
+        if (method == IO_URING && !IsIOUringAvailable())
+        {
+            cout << left << setw(10) << methodNames[method] << " not available" << endl;
+            continue;
+        }
+        Result result;
+        if (Run(method, fifoPath, options, result) != 0)
+        {
+            cout << methodNames[method] << ": failed to create pipe: " << strerror(errno) << endl;
+            return -1;
+        }
+        cout << left << setw(10) << methodNames[method] << right << fixed << setprecision(1)
+             << setw(12) << options.totalBytes / result.seconds / 1e6
+             << setw(12) << 100 * result.transferCPU / result.seconds
+             << setw(10) << result.errors << endl;
+    }
+    return 0;
+}